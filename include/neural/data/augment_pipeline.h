@@ -0,0 +1,102 @@
+/*
+ * Augment Pipeline
+ *
+ * Stage between MNISTDataloader and the trainer that reads batches and
+ * runs the Augmenter over them on its own worker threads, so the
+ * training thread only ever waits on a batch when the workers fall
+ * behind. Workers claim batches in order and may run up to the queue
+ * depth ahead of the trainer; finished batches are handed out in order
+ * whichever worker made them. Example i of epoch e is augmented with
+ * sample id e * DataLength() + i, so a run reproduces with any number of
+ * workers.
+ *
+ * Batches are written straight into tensors from a pool. A tensor goes
+ * back to the pool once the trainer drops every reference to it, so in
+ * steady state no batch allocates its output.
+ */
+
+#pragma once
+
+#include "neural/data/augmenter.h"
+#include "neural/data/mnist_dataloader.h"
+#include "neural/math/tensor.h"
+
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neural
+{
+
+class AugmentPipeline
+{
+public:
+    // a_dataloader has to outlive us. a_queueDepth of 0 lets each worker
+    // be two batches ahead.
+    AugmentPipeline(
+        const MNISTDataloader& a_dataloader, const Augmenter& a_augmenter,
+        size_t a_batchSize, size_t a_numWorkers, size_t a_queueDepth = 0);
+    ~AugmentPipeline();
+
+    AugmentPipeline(const AugmentPipeline&) = delete;
+    AugmentPipeline& operator=(const AugmentPipeline&) = delete;
+
+    // Starts a pass over the dataset from batch a_firstBatch (ie. resuming
+    // from a checkpoint), dropping what is left of the last one
+    void StartEpoch(size_t a_epoch, size_t a_firstBatch = 0);
+
+    // Next batch of this pass in the dataloader's layout, one target per
+    // example, false once the pass is done. Rethrows anything a worker threw.
+    bool Next(TTensorPtr& a_outInputs, std::vector<float>& a_outTargets);
+
+    // Batches in one pass
+    size_t NumBatches() const;
+
+    // Tensors the pool has made so far
+    size_t PoolSize() const;
+
+private:
+    struct Batch
+    {
+        TMutableTensorPtr inputs;
+        std::vector<float> targets;
+    };
+
+    const MNISTDataloader& m_dataloader;
+    Augmenter m_augmenter;
+    size_t m_batchSize;
+    size_t m_queueDepth;
+    float m_background;
+
+    // The current pass. Workers claim m_nextClaim, finished batches wait in
+    // m_done until Next gets to them. A new pass bumps m_generation so
+    // batches of the old one are thrown away.
+    std::mutex m_mutex;
+    std::condition_variable m_workCond;
+    std::condition_variable m_doneCond;
+    size_t m_epoch;
+    size_t m_generation;
+    size_t m_numBatches;
+    size_t m_nextClaim;
+    size_t m_nextOut;
+    std::map<size_t, Batch> m_done;
+    std::exception_ptr m_error;
+    bool m_stop;
+    std::vector<std::thread> m_threads;
+
+    mutable std::mutex m_poolMutex;
+    std::vector<TMutableTensorPtr> m_pool;
+
+    void p_WorkerLoop();
+
+    // Reads and augments batch a_batch of epoch a_epoch
+    void p_MakeBatch(size_t a_epoch, size_t a_batch, Batch& a_outBatch);
+
+    // A pooled tensor of a_shape nobody else holds, or a new one
+    TMutableTensorPtr p_Acquire(const std::vector<size_t>& a_shape);
+};
+
+} // namespace neural
@@ -0,0 +1,67 @@
+/*
+ * Augmenter
+ *
+ * Random distortions of training images: a shift, a small rotation, an
+ * elastic distortion (Simard et al. 2003, a random displacement field
+ * smoothed with a Gaussian) and additive noise. The shift, rotation and
+ * elastic field are folded into one map from output to input pixels,
+ * so every image is resampled once, bilinearly. The coordinates, the
+ * blur, the resampling (from a copy with a border, so it has no
+ * branches) and the noise all run a row at a time in omp simd loops.
+ *
+ * Every random number an image gets comes from Philox streams of our
+ * seed and the sample id passed in, so the same sample id gives the same
+ * image whichever thread augments it and in whatever order.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace neural
+{
+
+// 0 turns a distortion off
+struct AugmentParams
+{
+    // Largest shift in pixels, along each axis
+    float maxShift;
+    // Largest rotation in degrees, either way
+    float maxRotation;
+    // Scale of the elastic displacements in pixels, and the stddev in pixels
+    // of the Gaussian that smooths them
+    float elasticAlpha;
+    float elasticSigma;
+    // Stddev of the Gaussian noise added to every pixel
+    float noiseStddev;
+};
+
+class Augmenter
+{
+public:
+    Augmenter(const AugmentParams& a_params, uint64_t a_seed);
+
+    // 2 pixel shifts, 10 degrees, Simard's alpha 34 and sigma 4, noise 0.05
+    static AugmentParams DefaultParams();
+
+    // Distorts one image of a_numChannels planes of a_height x a_width from
+    // a_in into a_out, both channels first. Pixels from outside the image
+    // and noise are clamped to [a_background, 1].
+    void Apply(
+        const float* a_in, float* a_out,
+        size_t a_numChannels, size_t a_height, size_t a_width,
+        float a_background, uint64_t a_sampleId) const;
+
+    const AugmentParams& Params() const;
+    uint64_t Seed() const;
+
+private:
+    AugmentParams m_params;
+    uint64_t m_seed;
+
+    // Smoothed random displacements along one axis, scaled by elasticAlpha
+    void p_ElasticField(uint64_t a_stream, size_t a_height, size_t a_width, float* a_out) const;
+};
+
+} // namespace neural
@@ -0,0 +1,113 @@
+/*
+ * Gzip Stream
+ *
+ * Random access reads of the decompressed bytes of a gzip file without
+ * unpacking it to disk. A background thread inflates ahead of the reader
+ * into a ring buffer, so sequential reads only wait on it when it falls
+ * behind. On its first pass it also keeps an index of access points, one
+ * every 256KB of output, holding where the deflate block starts in the
+ * file and the 32KB of output before it (what the next block may refer
+ * back to). A read anywhere else restarts inflate from the nearest point
+ * before it, so it never costs more than one span, and two in a row
+ * moves the background thread there.
+ *
+ * The thread starts on the first read, don't fork after that.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace neural
+{
+
+class GzipStream
+{
+public:
+    // Reads from a_fd, which has to stay open while we are alive
+    GzipStream(int a_fd, const std::string& a_path, size_t a_ringBytes = 4 << 20);
+    ~GzipStream();
+
+    GzipStream(const GzipStream&) = delete;
+    GzipStream& operator=(const GzipStream&) = delete;
+
+    // Decompressed bytes [a_offset, a_offset + a_size), throws if the file ends
+    // before them or is corrupt. Safe to call from many threads at once.
+    void Read(size_t a_offset, size_t a_size, uint8_t* a_out);
+
+    // Same, inflating on the calling thread and without starting the
+    // background one, for a few bytes read once (ie. a header)
+    void ReadDirect(size_t a_offset, size_t a_size, uint8_t* a_out);
+
+    // Inflates the whole file once now so every access point is known up
+    // front, returns the decompressed size
+    size_t BuildIndex();
+
+    size_t NumAccessPoints() const;
+
+    // Spacing of the access points in decompressed bytes
+    static const size_t kSpan = 256 << 10;
+
+    // What a deflate block may refer back to
+    static const size_t kWindowBytes = 32 << 10;
+
+private:
+    struct AccessPoint
+    {
+        // Decompressed offset, and the compressed offset of the block there
+        uint64_t out;
+        uint64_t in;
+        // Bits of the byte before a_in that belong to the block
+        int bits;
+        std::vector<uint8_t> window;
+    };
+    typedef std::shared_ptr<const AccessPoint> TAccessPointPtr;
+
+    class Inflater;
+
+    int m_fd;
+    std::string m_path;
+
+    // Sorted by offset, only ever appended to
+    mutable std::mutex m_indexMutex;
+    std::vector<TAccessPointPtr> m_index;
+
+    // Ring holds decompressed bytes [m_ringBegin, m_ringEnd) at offset % size
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<uint8_t> m_ring;
+    size_t m_ringBegin;
+    size_t m_ringEnd;
+    bool m_atEnd;
+    std::string m_error;
+
+    // Moving the background thread, and where the last read that missed the ring ended
+    size_t m_restartAt;
+    size_t m_generation;
+    size_t m_lastMissEnd;
+
+    std::thread m_thread;
+    bool m_started;
+    bool m_stop;
+
+    // Background thread loop
+    void p_Produce();
+
+    // Nearest access point at or before a_offset, nullptr for the start of the file
+    TAccessPointPtr p_NearestPoint(size_t a_offset) const;
+
+    // Adds a point if a_out is a span past the last one
+    bool p_WantsPoint(size_t a_out) const;
+    void p_AddPoint(const TAccessPointPtr& a_point);
+
+    // Throws a_what for our file
+    void p_Throw(const std::string& a_what) const;
+};
+
+} // namespace neural
@@ -0,0 +1,130 @@
+/*
+ * IDX File
+ *
+ * Reader for the IDX format MNIST and friends come in: a magic number
+ * of two zero bytes, a type code and a rank, then one big endian 32 bit
+ * size per dimension, then the values, big endian, row major. The first
+ * dimension counts items (images, labels), the rest is one item.
+ *
+ * The file is never read whole. Items are read a range at a time, from
+ * a read only mapping of the file or with pread, and while they are read
+ * sequentially the next window of the file is hinted to the kernel
+ * (madvise / posix_fadvise WILLNEED) so the disk stays busy while we
+ * convert. Files bigger than half the RAM also drop the window behind
+ * us from the page cache, so a pass over them doesn't push out
+ * everything else.
+ *
+ * Gzip compressed files (ie. train-images-idx3-ubyte.gz as downloaded)
+ * are read directly, see GzipStream. The read ahead hints don't apply to
+ * them, the background inflate is the read ahead.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace neural
+{
+
+class GzipStream;
+
+class IdxFile
+{
+public:
+    // Type codes from the magic number
+    enum EType
+    {
+        UINT8 = 0x08,
+        INT8 = 0x09,
+        INT16 = 0x0B,
+        INT32 = 0x0C,
+        FLOAT32 = 0x0D,
+        FLOAT64 = 0x0E
+    };
+
+    // MMAP maps the whole file, PREAD reads every range into a buffer. GZIP
+    // is what Access() says for a compressed file, whatever was asked for.
+    enum EAccess
+    {
+        MMAP = 0,
+        PREAD,
+        GZIP
+    };
+
+    // Throws if the file can't be opened, the magic number is wrong or the
+    // file is shorter than its header says. MMAP falls back to PREAD if the
+    // file can't be mapped.
+    IdxFile(const std::string& a_path, EAccess a_access = MMAP);
+    ~IdxFile();
+
+    IdxFile(const IdxFile&) = delete;
+    IdxFile& operator=(const IdxFile&) = delete;
+
+    const std::string& Path() const;
+    EType Type() const;
+    EAccess Access() const;
+
+    // Every dimension, ie. {60000, 28, 28}
+    const std::vector<size_t>& Shape() const;
+
+    // First dimension, and values per item (the product of the rest)
+    size_t NumItems() const;
+    size_t ItemSize() const;
+
+    // Bytes of one value of a_type
+    static size_t TypeSize(EType a_type);
+
+    // Items [a_begin, a_end) as floats, a_out needs (a_end - a_begin) * ItemSize()
+    // values. Safe to call from many threads at once.
+    void ReadItems(size_t a_begin, size_t a_end, float* a_out) const;
+
+    // How far past a sequential read to hint the kernel, 8MB by default, 0 turns it off
+    void SetReadAhead(size_t a_bytes);
+    size_t ReadAhead() const;
+
+    // For a compressed file, inflates it once now so random reads never
+    // have to wait for the first pass to get to them. Nothing otherwise.
+    void BuildIndex();
+
+private:
+    std::string m_path;
+    EType m_type;
+    EAccess m_access;
+    std::vector<size_t> m_shape;
+    size_t m_itemSize;
+    size_t m_headerBytes;
+    size_t m_fileBytes;
+    int m_fd;
+    const uint8_t* m_map;
+    bool m_dropBehind;
+    std::unique_ptr<GzipStream> m_gzip;
+
+    std::atomic<size_t> m_readAhead;
+    // End of the last read, to spot sequential reads, and how far we have hinted
+    mutable std::atomic<size_t> m_lastEnd;
+    mutable std::atomic<size_t> m_hintedUpTo;
+
+    // Throws with errno if a_ok is false
+    void p_Check(bool a_ok, const std::string& a_what) const;
+
+    // Reads a_size bytes at a_offset with pread, retrying short reads
+    void p_Pread(size_t a_offset, size_t a_size, uint8_t* a_out) const;
+
+    // Reads a_size bytes of the (decompressed) file at a_offset
+    void p_ReadBytes(size_t a_offset, size_t a_size, uint8_t* a_out) const;
+
+    // Parses and validates the magic number and the dimensions
+    void p_ReadHeader();
+
+    // Read ahead and drop behind hints for a read of [a_offset, a_offset + a_size)
+    void p_Hint(size_t a_offset, size_t a_size) const;
+
+    // a_count big endian values of our type to floats
+    void p_Convert(const uint8_t* a_in, size_t a_count, float* a_out) const;
+};
+
+} // namespace neural
@@ -1,12 +1,22 @@
 /*
  * MNISTDataloader
+ *
+ * Images and labels from a pair of IDX files, read a range of examples at
+ * a time. Images can be any IDX type and [N, W], [N, H, W] or
+ * [N, C, H, W], uint8 pixels are scaled from [0, 255] and everything else
+ * is taken as is.
  */
 
 #pragma once
 
+#include "neural/data/idx_file.h"
 #include "neural/math/tensor.h"
+#include "neural/math/sparse_tensor.h"
 
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace neural
 {
@@ -14,38 +24,104 @@ namespace neural
 class MNISTDataloader
 {
 public:
+    // How images come out, FLAT as [N, H*W] rows for linear layers, NCHW as
+    // [N, 1, H, W] for convolutions
+    enum ELayout
+    {
+        FLAT = 0,
+        NCHW
+    };
+
+    // The MNIST files in a_path, train-* or t10k-*, or the *.gz ones as downloaded
     MNISTDataloader(
         const std::string& a_path,
-        bool a_isTrain = true);
+        bool a_isTrain = true,
+        IdxFile::EAccess a_access = IdxFile::MMAP);
+
+    // Any other pair of IDX files with one label per image
+    static MNISTDataloader FromFiles(
+        const std::string& a_imageFile,
+        const std::string& a_labelFile,
+        IdxFile::EAccess a_access = IdxFile::MMAP);
 
     // Total number of examples
     size_t DataLength() const;
 
+    // {C, H, W} of one image, whatever the layout
+    std::vector<size_t> ImageShape() const;
+
     // Get specific example
     bool DataAt(
         size_t i,
         TMutableTensorPtr& a_outInput,
         TMutableTensorPtr& a_outOutput) const;
 
+    // Loads example i on the ThreadPool, or with the OpenMP backend on one
+    // loading thread of its own so no pool workers compete with the OpenMP
+    // threads. The out params must stay alive until the future is ready.
+    std::future<bool> DataAtAsync(
+        size_t i,
+        TMutableTensorPtr& a_outInput,
+        TMutableTensorPtr& a_outOutput) const;
+
+    // Scale pixels to [0, 1] instead of [-1, 1], so the background is exactly
+    // zero and TensorMath can skip it
+    void SetZeroBackground(bool a_zeroBackground);
+    bool ZeroBackground() const;
+
+    // Image layout of DataAt and BatchAt, FLAT by default
+    void SetLayout(ELayout a_layout);
+    ELayout Layout() const;
+
+    // Read ahead window of both files, see IdxFile::SetReadAhead
+    void SetReadAhead(size_t a_bytes);
+
+    // Index of both files if they are compressed, see IdxFile::BuildIndex
+    void BuildIndex();
+
+    // Examples [a_begin, a_end) as one dense batch in our layout, one target per example
+    bool BatchAt(
+        size_t a_begin, size_t a_end,
+        TMutableTensorPtr& a_outInputs,
+        std::vector<float>& a_outTargets) const;
+
+    // Examples [a_begin, a_end) as one CSR matrix with a row per image, pixels
+    // in [0, 1] with only the foreground stored
+    bool SparseBatchAt(
+        size_t a_begin, size_t a_end,
+        TSparseTensorPtr& a_outInputs,
+        std::vector<float>& a_outTargets) const;
+
 private:
     // Total number of examples
     size_t m_numData;
 
+    bool m_zeroBackground;
+    ELayout m_layout;
+
     // Image sizes
+    size_t m_numChannels;
     size_t m_imageWidth;
     size_t m_imageHeight;
 
-    // Files for images and labels
-    std::string m_imageFile;
-    std::string m_labelFile;
+    // Files for images and labels, shared so the loader stays copyable
+    std::shared_ptr<IdxFile> m_images;
+    std::shared_ptr<IdxFile> m_labels;
+
+    MNISTDataloader();
 
     // Helpers functions
+    // Opens both files, logs and leaves us empty if one is missing
+    void p_Open(const std::string& a_imageFile, const std::string& a_labelFile, IdxFile::EAccess a_access);
+    // Shape of a batch of a_numExamples images in our layout
+    std::vector<size_t> p_BatchShape(size_t a_numExamples) const;
+    // Raw pixels and labels of examples [a_begin, a_end), read in one go
+    void p_ReadExamples(
+        size_t a_begin, size_t a_end,
+        std::vector<float>& a_outPixels, std::vector<float>& a_outLabels) const;
+    // Raw pixel value to our range, a_min to 1 for uint8 pixels
+    float p_Scale(float a_pixel, float a_min) const;
     bool p_FileExists(const std::string& a_file) const;
-    int32_t p_ReverseInt(int32_t a_int) const;
-    size_t p_ReadNumImages(const std::string& a_file) const;
-    size_t p_ReadImageWidth(const std::string& a_file) const;
-    size_t p_ReadImageHeight(const std::string& a_file) const;
-    size_t p_ReadIntAt(const std::string& a_file, size_t a_idx) const;
     float p_TransformToInterval(
         float a_input, float a_oldMin, float a_oldMax,
         float a_newMin, float a_newMax) const;
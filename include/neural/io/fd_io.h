@@ -0,0 +1,46 @@
+/*
+ * File Descriptor I/O
+ *
+ * The few loops every user of a raw file descriptor or socket needs:
+ * reading and writing all of a buffer through short counts and EINTR,
+ * and accepting connections on a listening socket while checking a stop
+ * flag now and then. Used by the checkpointer, the inference server and
+ * the metrics reporter.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace neural
+{
+
+class FdIo
+{
+public:
+    // How often blocked loops call their stop function
+    static const int kPollMs = 100;
+
+    // LOG(ERROR)s a_what and throws it as a runtime_error
+    static void Throw(const std::string& a_what);
+
+    // Reads exactly a_size bytes, false on end of file, an error, or a_stop
+    // (if given) returning true while we wait
+    static bool ReadFully(
+        int a_fd, void* a_data, size_t a_size,
+        const std::function<bool()>& a_stop = std::function<bool()>());
+
+    // Writes all a_size bytes, false on an error with errno set. A socket
+    // whose peer has gone is an error too, not a SIGPIPE.
+    static bool WriteFully(int a_fd, const void* a_data, size_t a_size);
+
+    // Accepts connections on a_listenFd and hands each one to a_serve, which
+    // owns it from then on, until a_stop returns true
+    static void AcceptLoop(
+        int a_listenFd, const std::function<bool()>& a_stop,
+        const std::function<void(int)>& a_serve);
+};
+
+} // namespace neural
@@ -0,0 +1,71 @@
+/*
+ * Conv2D Layer Definition
+ *
+ * 2D convolution over NCHW batches, [B, C in, H, W] -> [B, C out, H', W'].
+ * Every output pixel is the dot product of one filter with the patch of
+ * input under it, so the patches are unrolled into the rows of a matrix
+ * (im2col) and the whole layer becomes one GEMM with the weights. The
+ * unrolled matrix is built a few images at a time so it stays in cache
+ * between being written and being multiplied.
+ *
+ * Weights are stored like LinearLayer's, fan in x fan out:
+ * (C in * kernel * kernel) x C out, rows ordered by channel, kernel row,
+ * kernel column, with the bias as one extra row at the end.
+ */
+
+#pragma once
+
+#include "neural/layers/weighted_layer.h"
+
+#include <vector>
+
+namespace neural
+{
+
+class Conv2DLayer : public WeightedLayer
+{
+public:
+    Conv2DLayer(
+        const TTensorPtr& a_weights, size_t a_inChannels, size_t a_kernelSize,
+        size_t a_stride = 1, size_t a_padding = 0, bool a_hasBias = true);
+
+    virtual TTensorPtr Forward(const TTensorPtr& a_input) const override;
+    virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override;
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override;
+    virtual TLayerPtr Clone() const override;
+
+    size_t InChannels() const;
+    size_t OutChannels() const;
+
+    // Output height (or width) for an input of height (or width) a_inSize
+    size_t OutSize(size_t a_inSize) const;
+
+private:
+    size_t m_inChannels;
+    size_t m_outChannels;
+    size_t m_kernelSize;
+    size_t m_stride;
+    size_t m_padding;
+    bool m_hasBias;
+
+    // Columns of the unrolled matrix, one per weight row
+    size_t p_PatchSize() const;
+
+    // Throws unless a_input is [B, m_inChannels, H, W] with room for the kernel
+    void p_CheckInput(const TTensorPtr& a_input) const;
+
+    // Images per block of the unrolled matrix
+    size_t p_ImagesPerBlock(size_t a_rowsPerImage) const;
+
+    // Unrolls images [a_first, a_first + a_count) of a_input into a_cols,
+    // one row per output pixel
+    void p_Im2Col(const TTensorPtr& a_input, size_t a_first, size_t a_count, float* a_cols) const;
+
+    // Adds the rows of a_cols (without the bias column) back onto the input
+    // pixels they came from, the reverse of p_Im2Col
+    void p_Col2Im(const float* a_cols, size_t a_first, size_t a_count, const TMutableTensorPtr& a_input) const;
+};
+
+} // namespace neural
@@ -0,0 +1,28 @@
+/*
+ * Flatten Layer Definition
+ *
+ * [B, ...] -> [B, everything else], so a LinearLayer can follow
+ * convolution and pooling layers.
+ */
+
+#pragma once
+
+#include "neural/layers/layer.h"
+
+namespace neural
+{
+
+class FlattenLayer : public Layer
+{
+public:
+    FlattenLayer();
+
+    virtual TTensorPtr Forward(const TTensorPtr& a_input) const override;
+    virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override;
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override;
+    virtual TLayerPtr Clone() const override;
+};
+
+} // namespace neural
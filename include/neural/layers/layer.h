@@ -10,12 +10,51 @@
 namespace neural
 {
 
+class Layer;
+typedef std::shared_ptr<Layer> TLayerPtr;
+
 class Layer
 {
 public:
+    virtual ~Layer() {}
+
     virtual TTensorPtr Forward(const TTensorPtr& a_input) const = 0;
     virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) = 0;
 
+    // Forward on an input Backward is going to be called with. Layers that
+    // keep something for Backward (ie. LinearReLULayer) only do it here, so
+    // plain Forward (inference) leaves nothing behind.
+    virtual TTensorPtr ForwardForBackward(const TTensorPtr& a_input) const { return Forward(a_input); }
+
+    // Backward without accumulating, the weight gradient (nullptr if there are no weights)
+    // is handed back instead, so many threads can run it on the same layer at once
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const = 0;
+
+    // Deep copy, including any weights
+    virtual TLayerPtr Clone() const = 0;
+
+    // Layers with weights override the rest, layers without have nothing to learn
+    virtual bool HasWeights() const { return false; }
+
+    // Current weights, nullptr if there are none
+    virtual TTensorPtr Weights() const { return nullptr; }
+
+    // Replaces the weights with a_weights of the same shape, ie. from a checkpoint
+    virtual void SetWeights(const TTensorPtr& a_weights) {}
+
+    // Average of the weight gradients accumulated by Backward
+    virtual TTensorPtr CalcAvgWeightGrad() const { return nullptr; }
+
+    // weights -= a_learningRate * a_gradient
+    virtual void ApplyGradient(const TTensorPtr& a_gradient, float a_learningRate) {}
+
+    // Forget the gradients accumulated by Backward
+    virtual void ZeroGrad() {}
+
+    // ApplyGradient with our own average gradient, then ZeroGrad
+    virtual void UpdateWeights(float a_learningRate) {}
 };
 
 } // namespace neural
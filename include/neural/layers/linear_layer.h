@@ -5,25 +5,32 @@
 
 #pragma once
 
-#include "neural/layers/layer.h"
+#include "neural/layers/weighted_layer.h"
+#include "neural/math/sparse_tensor.h"
 
 namespace neural
 {
 
-class LinearLayer : public Layer
+class LinearLayer : public WeightedLayer
 {
 public:
     LinearLayer(const TTensorPtr& a_weights, bool a_hasBias = true);
     virtual TTensorPtr Forward(const TTensorPtr& a_input) const override;
     virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override;
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override;
+    virtual TLayerPtr Clone() const override;
 
-    TTensorPtr CalcAvgWeightGrad() const;
-    void UpdateWeights(float a_learningRate);
+    // Same as above for a sparse input batch, ie. straight from the dataloader
+    TTensorPtr Forward(const TSparseTensorPtr& a_input) const;
+    TTensorPtr Backward(const TSparseTensorPtr& a_origInput, const TTensorPtr& a_gradInput);
 
-private:
+protected:
     bool m_hasBias;
-    TMutableTensorPtr m_weights;
-    std::vector<TTensorPtr> m_weightGrads;
+
+    // Gradient wrt our input, the same for sparse and dense inputs
+    TTensorPtr p_GradWrtInput(const TTensorPtr& a_gradInput) const;
 };
 
 } // namespace
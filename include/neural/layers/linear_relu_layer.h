@@ -0,0 +1,83 @@
+/*
+ * Linear ReLU Layer Definition
+ *
+ * LinearLayer followed by ReLULayer in one pass. The GEMM runs a block
+ * of rows at a time and the bias and the clamp are applied to each
+ * block of the output right after it is computed, while it is still in
+ * cache, instead of writing the pre-activations out and reading them
+ * back twice. ForwardForBackward keeps one bit per output (was it
+ * positive) for Backward instead of the whole pre-activation tensor.
+ *
+ * Only ForwardForBackward keeps the bits, plain Forward (inference)
+ * doesn't. They are kept per input tensor and only as long as that
+ * tensor is alive, so both stay const and safe to call from many
+ * threads. Backward on an input we have no bits for works them out
+ * again with another forward pass.
+ */
+
+#pragma once
+
+#include "neural/layers/linear_layer.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace neural
+{
+
+class LinearReLULayer : public LinearLayer
+{
+public:
+    LinearReLULayer(const TTensorPtr& a_weights, bool a_hasBias = true);
+
+    virtual TTensorPtr Forward(const TTensorPtr& a_input) const override;
+    virtual TTensorPtr ForwardForBackward(const TTensorPtr& a_input) const override;
+    virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override;
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override;
+    virtual TLayerPtr Clone() const override;
+
+    // Number of inputs we are holding bits for, ie. waiting on Backward
+    size_t NumPendingMasks() const;
+
+private:
+    // Bit j % 64 of word (i * wordsPerRow + j / 64) is set if output (i, j) was
+    // positive. Rows start on a new word so blocks of rows never share one.
+    struct ReLUMask
+    {
+        size_t rows;
+        size_t cols;
+        size_t wordsPerRow;
+        std::vector<uint64_t> bits;
+    };
+    typedef std::shared_ptr<const ReLUMask> TReLUMaskPtr;
+
+    struct MaskCache
+    {
+        std::mutex mutex;
+        // Keyed by the input, the weak pointer tells us if it is still the same tensor
+        std::map<const Tensor*, std::pair<std::weak_ptr<const Tensor>, TReLUMaskPtr>> masks;
+    };
+
+    // Shared pointer so the layer stays copyable, Clone() gives the copy its own
+    std::shared_ptr<MaskCache> m_maskCache;
+
+    // Throws unless a_input is a matrix with one column per input weight row
+    void p_CheckInput(const TTensorPtr& a_input) const;
+
+    // Fused forward pass, fills in a_outMask unless it is null
+    TMutableTensorPtr p_Forward(const TTensorPtr& a_input, ReLUMask* a_outMask) const;
+
+    // Output a_first to a_first + a_rows of a_output gets the bias, the clamp
+    // and, if a_mask isn't null, its bits
+    void p_Epilogue(float* a_output, size_t a_first, size_t a_rows, size_t a_cols, ReLUMask* a_mask) const;
+
+    // Removes and returns the bits ForwardForBackward kept for a_input, nullptr if there are none
+    TReLUMaskPtr p_TakeMask(const TTensorPtr& a_input) const;
+};
+
+} // namespace neural
@@ -0,0 +1,45 @@
+/*
+ * Max Pool 2D Layer Definition
+ *
+ * Keeps the largest value of every kernel x kernel window of each
+ * channel of an NCHW batch. Windows that would run past the edge are
+ * dropped. Backward sends each gradient to the input that won its
+ * window, found again from the original input so there is no state
+ * between the passes.
+ */
+
+#pragma once
+
+#include "neural/layers/layer.h"
+
+namespace neural
+{
+
+class MaxPool2DLayer : public Layer
+{
+public:
+    // A stride of 0 is the kernel size, windows next to each other
+    MaxPool2DLayer(size_t a_kernelSize = 2, size_t a_stride = 0);
+
+    virtual TTensorPtr Forward(const TTensorPtr& a_input) const override;
+    virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override;
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override;
+    virtual TLayerPtr Clone() const override;
+
+    // Output height (or width) for an input of height (or width) a_inSize
+    size_t OutSize(size_t a_inSize) const;
+
+private:
+    size_t m_kernelSize;
+    size_t m_stride;
+
+    // Throws unless a_input is NCHW with room for one window
+    void p_CheckInput(const TTensorPtr& a_input) const;
+
+    // Offset in its plane of the largest input of window (a_oh, a_ow), the first one on ties
+    size_t p_ArgMax(const float* a_plane, size_t a_width, size_t a_oh, size_t a_ow) const;
+};
+
+} // namespace neural
@@ -16,6 +16,10 @@ public:
     ReLULayer();
     virtual TTensorPtr Forward(const TTensorPtr& a_input) const override;
     virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override;
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override;
+    virtual TLayerPtr Clone() const override;
 
 private:
 
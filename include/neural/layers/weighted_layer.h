@@ -0,0 +1,46 @@
+/*
+ * Weighted Layer Definition
+ *
+ * Base for layers with one weight tensor (LinearLayer, Conv2DLayer). It
+ * keeps the weights and the gradients Backward accumulates, and does the
+ * bookkeeping on them, averaging, stepping and replacing the weights, so
+ * every such layer does it the same way. Subclasses only compute.
+ */
+
+#pragma once
+
+#include "neural/layers/layer.h"
+
+#include <string>
+#include <vector>
+
+namespace neural
+{
+
+class WeightedLayer : public Layer
+{
+public:
+    virtual bool HasWeights() const override;
+    virtual TTensorPtr Weights() const override;
+    virtual void SetWeights(const TTensorPtr& a_weights) override;
+    virtual TTensorPtr CalcAvgWeightGrad() const override;
+    virtual void ApplyGradient(const TTensorPtr& a_gradient, float a_learningRate) override;
+    virtual void ZeroGrad() override;
+    virtual void UpdateWeights(float a_learningRate) override;
+
+protected:
+    // a_name is the subclass's, for error messages
+    WeightedLayer(const std::string& a_name, const TTensorPtr& a_weights);
+
+    std::string m_name;
+    TMutableTensorPtr m_weights;
+    std::vector<TTensorPtr> m_weightGrads;
+
+    // Sum of m_weightGrads
+    TMutableTensorPtr p_SumWeightGrads() const;
+
+    // Throws unless a_gradient has the shape of our weights
+    void p_CheckGradientShape(const TTensorPtr& a_gradient) const;
+};
+
+} // namespace neural
@@ -0,0 +1,73 @@
+/*
+ * GEMM Autotuner
+ *
+ * Picks a GemmKernel for each (M,N,K,threads), threads being what the
+ * multiply actually gets from Threading::ThreadsFor. When tuning is enabled
+ * the first multiply of a new shape times every kernel that supports it.
+ * New winners are written to a cache file on Save(), or when the tuner is
+ * destroyed, and later runs load them on Enable(). When tuning is disabled
+ * a simple shape heuristic is used instead.
+ */
+
+#pragma once
+
+#include "neural/math/gemm_kernels.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace neural
+{
+
+class GemmAutotuner
+{
+public:
+    GemmAutotuner();
+    ~GemmAutotuner();
+
+    // Tuner used by TensorMath::Multiply
+    static GemmAutotuner& Instance();
+
+    // Turn on tuning, loads previous winners from a_cacheFile if it exists
+    void Enable(const std::string& a_cacheFile);
+    void Disable();
+    bool IsEnabled() const;
+
+    // Kernel to use for MxK * KxN with the threads the calling thread would
+    // give it
+    const GemmKernel& Select(size_t a_m, size_t a_n, size_t a_k);
+
+    // Number of shapes we have a tuned kernel for
+    size_t NumCached() const;
+
+    // Read/Write winners from/to the cache file, Save() only writes when
+    // something was tuned since the last save
+    bool Load();
+    bool Save();
+
+    // Kernel picked from the shape alone, without timing anything
+    static const GemmKernel& Heuristic(size_t a_m, size_t a_n, size_t a_k);
+
+private:
+    struct Key
+    {
+        size_t m;
+        size_t n;
+        size_t k;
+        size_t threads;
+
+        bool operator<(const Key& a_other) const;
+    };
+
+    bool m_enabled;
+    bool m_dirty;
+    std::string m_cacheFile;
+    std::map<Key, std::string> m_winners;
+    mutable std::mutex m_mutex;
+
+    // Times every supported kernel and returns the name of the fastest
+    std::string p_Tune(const Key& a_key) const;
+};
+
+} // namespace neural
@@ -0,0 +1,77 @@
+/*
+ * GEMM Kernel Registry
+ *
+ * Every kernel computes C = A * B for row major matrices where
+ * A is MxK, B is KxN and C is MxN. TensorMath::Multiply picks one
+ * of these per shape, see GemmAutotuner.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace neural
+{
+
+typedef void (*TGemmFn)(
+    size_t a_m, size_t a_n, size_t a_k,
+    const float* a_A, const float* a_B, float* a_C);
+
+typedef bool (*TGemmSupportsFn)(size_t a_m, size_t a_n, size_t a_k);
+
+struct GemmKernel
+{
+    // Name used in logs and in the autotuner cache file
+    std::string name;
+    // Computes C = A * B
+    TGemmFn fn;
+    // Returns true if the kernel can handle this shape
+    TGemmSupportsFn supports;
+};
+
+class GemmKernels
+{
+public:
+    // All registered kernels, BLAS first
+    static const std::vector<GemmKernel>& All();
+
+    // Returns nullptr if there is no kernel with this name
+    static const GemmKernel* Find(const std::string& a_name);
+
+    // cblas_sgemm
+    static void Blas(
+        size_t a_m, size_t a_n, size_t a_k,
+        const float* a_A, const float* a_B, float* a_C);
+
+    // Built in cache blocked GEMM, parallel over blocks of rows
+    static void Blocked(
+        size_t a_m, size_t a_n, size_t a_k,
+        const float* a_A, const float* a_B, float* a_C);
+
+    // cblas_sgemv for row vector * matrix and matrix * column vector
+    static void Gemv(
+        size_t a_m, size_t a_n, size_t a_k,
+        const float* a_A, const float* a_B, float* a_C);
+
+    // Unrolled loops for matrices that fit in registers/L1
+    static void Small(
+        size_t a_m, size_t a_n, size_t a_k,
+        const float* a_A, const float* a_B, float* a_C);
+
+    // C_b = A_b * B_b for every b < a_batch, where A_b starts at a_A + b * a_strideA
+    // and so on. A stride of 0 shares one matrix over the whole batch.
+    // Uses cblas_sgemm_batch_strided when built with NEURAL_BLAS_BATCHED, otherwise
+    // runs the products in parallel over the batch, or one after the other with
+    // the autotuned kernel when there are fewer products than threads.
+    static void Batched(
+        size_t a_batch, size_t a_m, size_t a_n, size_t a_k,
+        const float* a_A, size_t a_strideA,
+        const float* a_B, size_t a_strideB,
+        float* a_C);
+
+    // Largest dimension Small() supports
+    static const size_t kSmallMaxDim = 32;
+};
+
+} // namespace neural
@@ -0,0 +1,62 @@
+/*
+ * Philox
+ *
+ * Counter based random numbers (Philox4x32-10, Salmon et al. 2011).
+ * Value i of a generator is a pure function of (seed, stream, i), so any
+ * thread can fill any slice of a tensor on its own and the result is
+ * the same no matter how many threads did the work. Each call to Next()
+ * hands out a new stream of the process wide seed, so a run is
+ * reproducible from its seed as long as tensors are created in the
+ * same order.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace neural
+{
+
+class Philox
+{
+public:
+    Philox(uint64_t a_seed, uint64_t a_stream = 0);
+
+    // Generator on the next stream of the process wide seed
+    static Philox Next();
+
+    // Process wide seed, also restarts the streams. Defaults to the time at startup.
+    static void SetGlobalSeed(uint64_t a_seed);
+    static uint64_t GlobalSeed();
+
+    // Four random words for one counter value
+    static void Block(uint64_t a_seed, uint64_t a_stream, uint64_t a_counter, uint32_t a_out[4]);
+
+    // Value i of this generator, as raw bits and in [0, 1)
+    uint32_t At(size_t a_idx) const;
+    float UniformAt(size_t a_idx) const;
+
+    // a_data[i] from value i, filled in parallel
+    void FillUniform(float* a_data, size_t a_size, float a_min, float a_max) const;
+    void FillNormal(float* a_data, size_t a_size, float a_mean, float a_stddev) const;
+
+    // Inverted dropout, a_mask[i] is 1 / a_keepProb with probability a_keepProb and 0 otherwise
+    void FillDropoutMask(float* a_mask, size_t a_size, float a_keepProb) const;
+
+    // Fisher-Yates shuffle, the same permutation for the same seed and stream
+    void Shuffle(std::vector<size_t>& a_values) const;
+
+    uint64_t Seed() const;
+    uint64_t Stream() const;
+
+private:
+    uint64_t m_seed;
+    uint64_t m_stream;
+
+    // Fills a_out with the four words of blocks [a_firstBlock, a_firstBlock + a_numBlocks)
+    void p_Blocks(size_t a_firstBlock, size_t a_numBlocks, uint32_t* a_out) const;
+};
+
+} // namespace neural
@@ -0,0 +1,88 @@
+/*
+ * Sparse Tensor
+ *
+ * Matrix that only stores its non zero values. CSR keeps the non zeros
+ * of each row together, CSC those of each column. The two share one
+ * layout (offsets per outer index, then the inner index and value of
+ * every non zero), so the CSR form of a matrix is the CSC form of its
+ * transpose and Transpose() never moves any data.
+ */
+
+#pragma once
+
+#include "neural/math/tensor.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace neural
+{
+
+class SparseTensor;
+
+typedef std::shared_ptr<const SparseTensor> TSparseTensorPtr;
+
+class SparseTensor
+{
+public:
+    enum EFormat
+    {
+        CSR = 0,
+        CSC
+    };
+
+    // Empty rows x cols matrix
+    SparseTensor(size_t a_rows, size_t a_cols, EFormat a_format = CSR);
+
+    // Keeps every value that is not exactly zero
+    static TSparseTensorPtr FromDense(const TTensorPtr& a_dense, EFormat a_format = CSR);
+
+    // Same as FromDense, but gives up and returns nullptr as soon as more
+    // than a_maxDensity of the values turn out to be non zero
+    static TSparseTensorPtr FromDenseIfSparse(const TTensorPtr& a_dense, float a_maxDensity);
+
+    TTensorPtr ToDense() const;
+
+    // Same matrix stored the other way
+    TSparseTensorPtr ToFormat(EFormat a_format) const;
+
+    // The transpose, shares our storage
+    TSparseTensorPtr Transpose() const;
+
+    // Copy with an extra column of a_val at the end, like TensorMath::AddCol
+    TSparseTensorPtr AddCol(float a_val) const;
+
+    // Appends the next row (CSR) or column (CSC), a_values[i] goes at a_indices[i]
+    void AppendOuter(const std::vector<uint32_t>& a_indices, const std::vector<float>& a_values);
+
+    EFormat Format() const;
+
+    // {rows, cols}
+    const std::vector<size_t>& Shape() const;
+    std::string ShapeStr() const;
+
+    size_t NumNonZeros() const;
+
+    // Fraction of the values that are non zero
+    float Density() const;
+
+    // Rows for CSR, columns for CSC
+    size_t NumOuter() const;
+
+    // Non zeros of outer index i are [Offsets()[i], Offsets()[i + 1])
+    const std::vector<size_t>& Offsets() const;
+    const std::vector<uint32_t>& Indices() const;
+    const std::vector<float>& Values() const;
+
+private:
+    EFormat m_format;
+    std::vector<size_t> m_shape;
+
+    // Shared so a transpose can reuse them
+    std::shared_ptr<std::vector<size_t>> m_offsets;
+    std::shared_ptr<std::vector<uint32_t>> m_indices;
+    std::shared_ptr<std::vector<float>> m_values;
+};
+
+} // namespace neural
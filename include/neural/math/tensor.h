@@ -1,10 +1,21 @@
 /*
  * Tensor is our basic building block for our models, inputs,
  * internal representation and outputs
+ *
+ * The values live in a reference counted buffer that copies of a tensor
+ * (ToMutable, Reshape, the copy constructor) share. A tensor only copies
+ * the buffer when it is written to while someone else still shares it,
+ * so a mutable copy nobody else holds on to costs nothing.
+ *
+ * Tensors sharing a buffer can each be written by their own thread, but a
+ * tensor that several threads write at once (ie. hogwild weights) must not
+ * be shared when they start, since they would race to replace its buffer.
  */
 
 #pragma once
 
+#include "neural/math/tensor_view.h"
+
 #include <vector>
 #include <memory>
 
@@ -42,9 +53,19 @@ public:
       const std::vector<size_t>& a_shape,
       const std::vector<float>& a_data);
 
-    // Tensor filled with random floats
+    // Tensor filled with uniform random floats in [a_min, a_max). Every random
+    // tensor takes the next Philox stream, see Philox::SetGlobalSeed.
     static TMutableTensorPtr Random(const std::vector<size_t>& a_shape, float a_min=0.0, float a_max=1.0);
 
+    // Tensor filled with normally distributed floats
+    static TMutableTensorPtr RandomNormal(const std::vector<size_t>& a_shape, float a_mean=0.0, float a_stddev=1.0);
+
+    // Weight initializers for a fan in x fan out matrix.
+    // Xavier/Glorot: uniform in +-sqrt(6 / (fan in + fan out)), for linear or tanh layers
+    static TMutableTensorPtr XavierUniform(const std::vector<size_t>& a_shape);
+    // He/Kaiming: normal with stddev sqrt(2 / fan in), for layers followed by ReLU
+    static TMutableTensorPtr HeNormal(const std::vector<size_t>& a_shape);
+
     // Tensor filled with all the same value
     static TMutableTensorPtr Constant(const std::vector<size_t>& a_shape, float a_val);
 
@@ -54,9 +75,15 @@ public:
     // Tensor filled with zeros
     static TMutableTensorPtr Ones(const std::vector<size_t>& a_shape);
 
-    // Copies data into mutable tensor
+    // Mutable copy, shares our buffer until one of us writes to it
     TMutableTensorPtr ToMutable() const;
 
+    // Same values with another shape of the same size, shares our buffer too
+    TMutableTensorPtr Reshape(const std::vector<size_t>& a_shape) const;
+
+    // True if we share our buffer with another tensor, ie. the next write copies it
+    bool IsShared() const;
+
     // Sets all the values in the tensor to this value
     void SetAll(float a_val);
   
@@ -70,23 +97,42 @@ public:
     // Get size of raw data
     size_t Size() const;
   
-    // Get raw data
+    // Get raw data. MutableData copies the buffer first if it is shared. Keep
+    // the reference or a pointer from it rather than calling it per value.
     const std::vector<float>& Data() const;
     std::vector<float>& MutableData();
 
-    // Returns value at offset at a_idx ie. {1, 2, 0}
+    // Returns value at offset at a_idx ie. {1, 2, 0}, builds a_idx on every
+    // call so hot loops should use View<N>() instead
     float At(const std::vector<size_t>& a_idx) const;
 
     // Set value at idx
     void SetAt(const std::vector<size_t>& a_idx, float a_val);
+
+    // Fast access for hot loops, ie. View<2>()(i, j), N has to match our rank
+    template <size_t N>
+    TensorView<N, const float> View() const
+    {
+        return TensorView<N, const float>(m_data->data(), m_shape);
+    }
+
+    template <size_t N>
+    TensorView<N, float> MutableView()
+    {
+        return TensorView<N, float>(MutableData().data(), m_shape);
+    }
   
 private:
     std::vector<size_t> m_shape;
-    std::vector<float> m_data;
+    std::shared_ptr<std::vector<float>> m_data;
     // Precomputed stride sizes
     std::vector<size_t> m_strideSizes;
   
     size_t p_CalcSize(const std::vector<size_t>& a_shape) const;
+
+    // Gives us our own copy of the buffer if anyone else shares it
+    void p_Detach();
+
     // Add to precompute stride sizes
     std::vector<size_t> p_ComputeStrideSizes(const std::vector<size_t>& a_tensorShape) const;
 
@@ -0,0 +1,428 @@
+/*
+ * Tensor Expressions
+ *
+ * Lazily evaluated elementwise math on tensors. Lazy(t) wraps a tensor,
+ * and +, -, *, /, Max, Min, comparisons and Where on it only build a
+ * small expression type, nothing is computed yet. Assigning the
+ * expression to a tensor runs the whole chain in one parallel pass, each
+ * element is read once and the result written once, with no temporary
+ * tensors for the intermediate steps:
+ *
+ *     Lazy(w) -= a_learningRate * (Lazy(g) / numGrads);
+ *
+ * The leaves keep their tensors alive, but the destination may be read
+ * by the expression only at the index being written (w -= ...), not at
+ * any other one.
+ */
+
+#pragma once
+
+#include "neural/math/tensor.h"
+#include "neural/parallel/threading.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace neural
+{
+
+// Throws when two shapes in an expression don't match, a_where is the op
+void ThrowExprShapeMismatch(
+    const std::string& a_where,
+    const std::vector<size_t>& a_expected,
+    const std::vector<size_t>& a_got);
+
+// Every expression node derives from Expr<itself>, so the operators only
+// pick up our types and Self() gets back to the node without virtual calls
+template <typename E>
+class Expr
+{
+public:
+    inline const E& Self() const
+    {
+        return static_cast<const E&>(*this);
+    }
+};
+
+// Elementwise ops, At() is what one element of the node evaluates to
+struct AddOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs + a_rhs; }
+};
+
+struct SubOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs - a_rhs; }
+};
+
+struct MulOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs * a_rhs; }
+};
+
+struct DivOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs / a_rhs; }
+};
+
+struct MaxOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs > a_rhs ? a_lhs : a_rhs; }
+};
+
+struct MinOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs < a_rhs ? a_lhs : a_rhs; }
+};
+
+// Comparisons give 1.0 or 0.0 so they can be used as masks or in Where
+struct GreaterOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs > a_rhs ? 1.0f : 0.0f; }
+};
+
+struct LessOp
+{
+    static inline float At(float a_lhs, float a_rhs) { return a_lhs < a_rhs ? 1.0f : 0.0f; }
+};
+
+// Plain assignment, the old value is ignored
+struct AssignOp
+{
+    static inline float At(float, float a_rhs) { return a_rhs; }
+};
+
+// Leaf that reads a tensor
+class TensorExpr : public Expr<TensorExpr>
+{
+public:
+    explicit TensorExpr(const TTensorPtr& a_tensor)
+        : m_tensor(a_tensor)
+        , m_data(a_tensor->Data().data())
+    {
+
+    }
+
+    inline float At(size_t a_idx) const
+    {
+        return m_data[a_idx];
+    }
+
+    // Shape of the result, nullptr if any shape goes (a scalar)
+    inline const std::vector<size_t>* Shape() const
+    {
+        return &m_tensor->Shape();
+    }
+
+    inline void CheckShape(const std::vector<size_t>& a_shape) const
+    {
+        if (m_tensor->Shape() != a_shape)
+        {
+            ThrowExprShapeMismatch("TensorExpr", a_shape, m_tensor->Shape());
+        }
+    }
+
+private:
+    TTensorPtr m_tensor;
+    const float* m_data;
+};
+
+// Leaf that is the same value everywhere
+class ScalarExpr : public Expr<ScalarExpr>
+{
+public:
+    explicit ScalarExpr(float a_val)
+        : m_val(a_val)
+    {
+
+    }
+
+    inline float At(size_t) const
+    {
+        return m_val;
+    }
+
+    inline const std::vector<size_t>* Shape() const
+    {
+        return nullptr;
+    }
+
+    inline void CheckShape(const std::vector<size_t>&) const
+    {
+
+    }
+
+private:
+    float m_val;
+};
+
+// a_op(lhs[i], rhs[i]), children are held by value so temporaries in a chain are safe
+template <typename TOp, typename TLhs, typename TRhs>
+class BinaryExpr : public Expr<BinaryExpr<TOp, TLhs, TRhs>>
+{
+public:
+    BinaryExpr(const TLhs& a_lhs, const TRhs& a_rhs)
+        : m_lhs(a_lhs)
+        , m_rhs(a_rhs)
+    {
+
+    }
+
+    inline float At(size_t a_idx) const
+    {
+        return TOp::At(m_lhs.At(a_idx), m_rhs.At(a_idx));
+    }
+
+    inline const std::vector<size_t>* Shape() const
+    {
+        const std::vector<size_t>* l_shape = m_lhs.Shape();
+        return l_shape != nullptr ? l_shape : m_rhs.Shape();
+    }
+
+    inline void CheckShape(const std::vector<size_t>& a_shape) const
+    {
+        m_lhs.CheckShape(a_shape);
+        m_rhs.CheckShape(a_shape);
+    }
+
+private:
+    TLhs m_lhs;
+    TRhs m_rhs;
+};
+
+// cond[i] != 0 ? true[i] : false[i]
+template <typename TCond, typename TTrue, typename TFalse>
+class WhereExpr : public Expr<WhereExpr<TCond, TTrue, TFalse>>
+{
+public:
+    WhereExpr(const TCond& a_cond, const TTrue& a_true, const TFalse& a_false)
+        : m_cond(a_cond)
+        , m_true(a_true)
+        , m_false(a_false)
+    {
+
+    }
+
+    inline float At(size_t a_idx) const
+    {
+        // Both sides are evaluated so the loop stays branch free
+        float l_true = m_true.At(a_idx);
+        float l_false = m_false.At(a_idx);
+        return m_cond.At(a_idx) != 0.0f ? l_true : l_false;
+    }
+
+    inline const std::vector<size_t>* Shape() const
+    {
+        const std::vector<size_t>* l_shape = m_cond.Shape();
+        if (l_shape == nullptr)
+        {
+            l_shape = m_true.Shape();
+        }
+        return l_shape != nullptr ? l_shape : m_false.Shape();
+    }
+
+    inline void CheckShape(const std::vector<size_t>& a_shape) const
+    {
+        m_cond.CheckShape(a_shape);
+        m_true.CheckShape(a_shape);
+        m_false.CheckShape(a_shape);
+    }
+
+private:
+    TCond m_cond;
+    TTrue m_true;
+    TFalse m_false;
+};
+
+// Writes a_expr into a_dst with a_op(dst[i], expr[i]) in one parallel pass
+template <typename TOp, typename E>
+void EvalInto(Tensor& a_dst, const Expr<E>& a_expr)
+{
+    const E& l_expr = a_expr.Self();
+    l_expr.CheckShape(a_dst.Shape());
+
+    float* l_dst = a_dst.MutableData().data();
+    Threading::ParallelFor(Threading::ELEMENTWISE, a_dst.Size(), [&](size_t a_begin, size_t a_end) {
+        for (size_t i = a_begin; i < a_end; ++i)
+        {
+            l_dst[i] = TOp::At(l_dst[i], l_expr.At(i));
+        }
+    });
+}
+
+// Leaf over a tensor we can also write to, Lazy(w) -= ...
+class MutableTensorExpr : public Expr<MutableTensorExpr>
+{
+public:
+    explicit MutableTensorExpr(const TMutableTensorPtr& a_tensor)
+        : m_tensor(a_tensor)
+        , m_read(a_tensor)
+    {
+
+    }
+
+    inline float At(size_t a_idx) const
+    {
+        return m_read.At(a_idx);
+    }
+
+    inline const std::vector<size_t>* Shape() const
+    {
+        return m_read.Shape();
+    }
+
+    inline void CheckShape(const std::vector<size_t>& a_shape) const
+    {
+        m_read.CheckShape(a_shape);
+    }
+
+    template <typename E>
+    const MutableTensorExpr& operator=(const Expr<E>& a_expr) const
+    {
+        EvalInto<AssignOp>(*m_tensor, a_expr);
+        return *this;
+    }
+
+    // Needed so Lazy(a) = Lazy(b) evaluates instead of copying the leaf
+    const MutableTensorExpr& operator=(const MutableTensorExpr& a_expr) const
+    {
+        EvalInto<AssignOp>(*m_tensor, a_expr);
+        return *this;
+    }
+
+    template <typename E>
+    const MutableTensorExpr& operator+=(const Expr<E>& a_expr) const
+    {
+        EvalInto<AddOp>(*m_tensor, a_expr);
+        return *this;
+    }
+
+    template <typename E>
+    const MutableTensorExpr& operator-=(const Expr<E>& a_expr) const
+    {
+        EvalInto<SubOp>(*m_tensor, a_expr);
+        return *this;
+    }
+
+    template <typename E>
+    const MutableTensorExpr& operator*=(const Expr<E>& a_expr) const
+    {
+        EvalInto<MulOp>(*m_tensor, a_expr);
+        return *this;
+    }
+
+    template <typename E>
+    const MutableTensorExpr& operator/=(const Expr<E>& a_expr) const
+    {
+        EvalInto<DivOp>(*m_tensor, a_expr);
+        return *this;
+    }
+
+    const MutableTensorExpr& operator+=(float a_val) const
+    {
+        return *this += ScalarExpr(a_val);
+    }
+
+    const MutableTensorExpr& operator-=(float a_val) const
+    {
+        return *this -= ScalarExpr(a_val);
+    }
+
+    const MutableTensorExpr& operator*=(float a_val) const
+    {
+        return *this *= ScalarExpr(a_val);
+    }
+
+    const MutableTensorExpr& operator/=(float a_val) const
+    {
+        return *this /= ScalarExpr(a_val);
+    }
+
+private:
+    TMutableTensorPtr m_tensor;
+    TensorExpr m_read;
+};
+
+inline TensorExpr Lazy(const TTensorPtr& a_tensor)
+{
+    return TensorExpr(a_tensor);
+}
+
+inline MutableTensorExpr Lazy(const TMutableTensorPtr& a_tensor)
+{
+    return MutableTensorExpr(a_tensor);
+}
+
+// New tensor holding the value of a_expr, which needs at least one tensor in it
+template <typename E>
+TMutableTensorPtr Evaluate(const Expr<E>& a_expr)
+{
+    const std::vector<size_t>* l_shape = a_expr.Self().Shape();
+    if (l_shape == nullptr)
+    {
+        ThrowExprShapeMismatch("Evaluate of a scalar expression", {}, {});
+    }
+    TMutableTensorPtr l_ret = Tensor::New(*l_shape);
+    EvalInto<AssignOp>(*l_ret, a_expr);
+    return l_ret;
+}
+
+// Operators between two expressions, and between an expression and a float
+#define NEURAL_TENSOR_EXPR_BINARY(a_name, a_op)                                                      \
+    template <typename TLhs, typename TRhs>                                                          \
+    inline BinaryExpr<a_op, TLhs, TRhs> a_name(const Expr<TLhs>& a_lhs, const Expr<TRhs>& a_rhs)   \
+    {                                                                                                \
+        return BinaryExpr<a_op, TLhs, TRhs>(a_lhs.Self(), a_rhs.Self());                             \
+    }                                                                                                \
+    template <typename TLhs>                                                                         \
+    inline BinaryExpr<a_op, TLhs, ScalarExpr> a_name(const Expr<TLhs>& a_lhs, float a_rhs)         \
+    {                                                                                                \
+        return BinaryExpr<a_op, TLhs, ScalarExpr>(a_lhs.Self(), ScalarExpr(a_rhs));                  \
+    }                                                                                                \
+    template <typename TRhs>                                                                         \
+    inline BinaryExpr<a_op, ScalarExpr, TRhs> a_name(float a_lhs, const Expr<TRhs>& a_rhs)         \
+    {                                                                                                \
+        return BinaryExpr<a_op, ScalarExpr, TRhs>(ScalarExpr(a_lhs), a_rhs.Self());                  \
+    }
+
+NEURAL_TENSOR_EXPR_BINARY(operator+, AddOp)
+NEURAL_TENSOR_EXPR_BINARY(operator-, SubOp)
+NEURAL_TENSOR_EXPR_BINARY(operator*, MulOp)
+NEURAL_TENSOR_EXPR_BINARY(operator/, DivOp)
+NEURAL_TENSOR_EXPR_BINARY(operator>, GreaterOp)
+NEURAL_TENSOR_EXPR_BINARY(operator<, LessOp)
+NEURAL_TENSOR_EXPR_BINARY(Max, MaxOp)
+NEURAL_TENSOR_EXPR_BINARY(Min, MinOp)
+
+#undef NEURAL_TENSOR_EXPR_BINARY
+
+template <typename E>
+inline BinaryExpr<SubOp, ScalarExpr, E> operator-(const Expr<E>& a_expr)
+{
+    return BinaryExpr<SubOp, ScalarExpr, E>(ScalarExpr(0.0f), a_expr.Self());
+}
+
+template <typename TCond, typename TTrue, typename TFalse>
+inline WhereExpr<TCond, TTrue, TFalse> Where(
+    const Expr<TCond>& a_cond, const Expr<TTrue>& a_true, const Expr<TFalse>& a_false)
+{
+    return WhereExpr<TCond, TTrue, TFalse>(a_cond.Self(), a_true.Self(), a_false.Self());
+}
+
+template <typename TCond, typename TTrue>
+inline WhereExpr<TCond, TTrue, ScalarExpr> Where(
+    const Expr<TCond>& a_cond, const Expr<TTrue>& a_true, float a_false)
+{
+    return WhereExpr<TCond, TTrue, ScalarExpr>(a_cond.Self(), a_true.Self(), ScalarExpr(a_false));
+}
+
+template <typename TCond, typename TFalse>
+inline WhereExpr<TCond, ScalarExpr, TFalse> Where(
+    const Expr<TCond>& a_cond, float a_true, const Expr<TFalse>& a_false)
+{
+    return WhereExpr<TCond, ScalarExpr, TFalse>(a_cond.Self(), ScalarExpr(a_true), a_false.Self());
+}
+
+} // namespace neural
@@ -6,6 +6,9 @@
 #pragma once
 
 #include "neural/math/tensor.h"
+#include "neural/math/sparse_tensor.h"
+
+#include <vector>
 
 namespace neural
 {
@@ -13,7 +16,13 @@ namespace neural
 class TensorMath
 {
 public:
+    // Switches to the sparse kernel by itself when a_lhs is sparse enough
     static TTensorPtr Multiply(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs);
+    // Sparse * dense (SpMM), a_lhs can be CSR or CSC
+    static TTensorPtr Multiply(const TSparseTensorPtr& a_lhs, const TTensorPtr& a_rhs);
+    // [B,M,K] * [B,K,N] = [B,M,N], one product per batch entry. Either side can
+    // be a plain matrix (or have a batch of 1) to share it with every entry.
+    static TTensorPtr BatchedMultiply(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs);
     static TTensorPtr Transpose(const TTensorPtr& a_tensor);
     // Assumes matrix, adds column at the end
     static TTensorPtr AddCol(const TTensorPtr& a_tensor, float a_val);
@@ -23,6 +32,40 @@ public:
     static TTensorPtr AddRow(const TTensorPtr& a_tensor, float a_val);
     // Assumes matrix, removes row at the end
     static TTensorPtr RemoveRow(const TTensorPtr& a_tensor);
+
+    // Elementwise, a_lhs and a_rhs need the same shape
+    static TTensorPtr Add(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs);
+    static TTensorPtr Subtract(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs);
+    static TTensorPtr Hadamard(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs);
+    static TTensorPtr Scale(const TTensorPtr& a_tensor, float a_alpha);
+    // a_y += a_alpha * a_x in place
+    static void Axpy(float a_alpha, const TTensorPtr& a_x, const TMutableTensorPtr& a_y);
+
+    // Reductions over every value. Sums are pairwise over fixed size blocks, so
+    // the rounding error grows with log(size) and the result is the same
+    // however many threads run it.
+    static float Sum(const TTensorPtr& a_tensor);
+    static float Mean(const TTensorPtr& a_tensor);
+    static float Max(const TTensorPtr& a_tensor);
+    // Flat index of the largest value, the first one on ties
+    static size_t ArgMax(const TTensorPtr& a_tensor);
+
+    // Same over raw data, ie. a vector of losses
+    static float Sum(const float* a_data, size_t a_size);
+    static float Mean(const float* a_data, size_t a_size);
+
+    // Reductions along one axis, the result has that axis removed,
+    // ie. Sum of a BxN matrix over axis 0 is N, over axis 1 is B
+    static TTensorPtr Sum(const TTensorPtr& a_tensor, size_t a_axis);
+    static TTensorPtr Mean(const TTensorPtr& a_tensor, size_t a_axis);
+    static TTensorPtr Max(const TTensorPtr& a_tensor, size_t a_axis);
+    // Index along a_axis of the largest value for every output, ie. the predicted class of every row
+    static std::vector<size_t> ArgMax(const TTensorPtr& a_tensor, size_t a_axis);
+
+    // Dense Multiply uses SpMM when at most this fraction of a_lhs is non zero,
+    // 0 (the default) turns it off
+    static void SetSparseThreshold(float a_maxDensity);
+    static float SparseThreshold();
 };
 
 } // namespace neural
@@ -0,0 +1,98 @@
+/*
+ * Tensor View
+ *
+ * Indexes into a tensor's data with the rank fixed at compile time, so
+ * view(i, j) is a couple of multiply-adds on strides kept in the view
+ * instead of building a std::vector and walking the shape like
+ * Tensor::At does. Indices are only bounds checked when built with
+ * NEURAL_CHECK_BOUNDS, otherwise they index as fast as a raw pointer and
+ * callers check the shapes they index with before their loops.
+ *
+ * The view doesn't own the data, it has to stay alive and must not be
+ * resized while the view is used.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace neural
+{
+
+template <size_t N, typename T = float>
+class TensorView
+{
+public:
+    TensorView(T* a_data, const std::vector<size_t>& a_shape)
+        : m_data(a_data)
+    {
+        // Once per view, so always checked
+        if (a_shape.size() != N)
+        {
+            std::stringstream l_ss;
+            l_ss << "TensorView<" << N << "> on a tensor of rank " << a_shape.size();
+            throw(std::runtime_error(l_ss.str()));
+        }
+
+        size_t l_stride = 1;
+        for (size_t i = N; i > 0; --i)
+        {
+            m_shape[i - 1] = a_shape[i - 1];
+            m_strides[i - 1] = l_stride;
+            l_stride *= a_shape[i - 1];
+        }
+    }
+
+    template <typename... TIdx>
+    inline T& operator()(TIdx... a_idx) const
+    {
+        static_assert(sizeof...(TIdx) == N, "TensorView needs one index per dimension");
+        const size_t l_idx[N] = {static_cast<size_t>(a_idx)...};
+
+        size_t l_offset = 0;
+        for (size_t i = 0; i < N; ++i)
+        {
+#ifdef NEURAL_CHECK_BOUNDS
+            p_CheckBounds(i, l_idx[i]);
+#endif
+            l_offset += l_idx[i] * m_strides[i];
+        }
+        return m_data[l_offset];
+    }
+
+    inline size_t Dim(size_t a_dim) const
+    {
+        return m_shape[a_dim];
+    }
+
+    inline size_t Stride(size_t a_dim) const
+    {
+        return m_strides[a_dim];
+    }
+
+    inline T* Data() const
+    {
+        return m_data;
+    }
+
+private:
+    T* m_data;
+    size_t m_shape[N];
+    size_t m_strides[N];
+
+    void p_CheckBounds(size_t a_dim, size_t a_idx) const
+    {
+        if (a_idx >= m_shape[a_dim])
+        {
+            std::stringstream l_ss;
+            l_ss << "TensorView index " << a_idx << " >= " << m_shape[a_dim]
+                 << " in dimension " << a_dim;
+            throw(std::out_of_range(l_ss.str()));
+        }
+    }
+};
+
+} // namespace neural
@@ -0,0 +1,161 @@
+/*
+ * Metrics
+ *
+ * Counters and histograms cheap enough to update on every training step
+ * from any number of threads. Each metric is split into shards, one
+ * cache line each, and every thread always updates the same shard with
+ * relaxed atomics, so updates never lock and threads don't fight over
+ * cache lines. Reading sums the shards, which is left to the
+ * MetricsReporter thread.
+ *
+ * Metrics live in a registry for the life of the process and are found
+ * by name and labels (Prometheus style, ie. layer="0"), so hot code
+ * looks them up once and keeps the reference.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace neural
+{
+
+// Every thread updates shard ThreadShard() of every metric
+static const size_t kMetricShards = 16;
+
+class Counter
+{
+public:
+    Counter();
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    // Plain new doesn't honour the shards' alignment before C++17
+    static void* operator new(size_t a_size);
+    static void operator delete(void* a_ptr);
+
+    void Add(uint64_t a_value = 1);
+
+    // Sum over the shards, may miss adds racing with it
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> value;
+    };
+
+    Shard m_shards[kMetricShards];
+};
+
+class Histogram
+{
+public:
+    // Counts of values <= each bound, and one more bucket for the rest
+    explicit Histogram(const std::vector<double>& a_bounds);
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    static void* operator new(size_t a_size);
+    static void operator delete(void* a_ptr);
+
+    // a_first, a_first * a_factor, ... a_count bounds
+    static std::vector<double> ExponentialBounds(double a_first, double a_factor, size_t a_count);
+
+    // 1e-6 up to about 1e6 doubling, fine for seconds and losses alike
+    static const std::vector<double>& DefaultBounds();
+
+    void Record(double a_value);
+
+    // Counts summed over the shards, or the difference of two of them
+    struct Snapshot
+    {
+        uint64_t count;
+        double sum;
+        std::vector<uint64_t> buckets;
+
+        double Mean() const;
+
+        // Estimated from the buckets, linear inside the one a_quantile falls into
+        double Quantile(const std::vector<double>& a_bounds, double a_quantile) const;
+
+        Snapshot operator-(const Snapshot& a_earlier) const;
+    };
+    Snapshot Read() const;
+
+    const std::vector<double>& Bounds() const;
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> count;
+        std::atomic<double> sum;
+    };
+
+    std::vector<double> m_bounds;
+    Shard m_shards[kMetricShards];
+
+    // Bucket b of shard s at s * m_stride + b, m_stride padded to whole cache lines
+    size_t m_stride;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+};
+
+// Records how long it lived into a histogram of seconds
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Histogram& a_histogram);
+    ~ScopedTimer();
+
+private:
+    Histogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+class Metrics
+{
+public:
+    // Registry used by the library and the tools
+    static Metrics& Instance();
+
+    // The metric with this name and labels, made the first time it is asked for
+    Counter& GetCounter(const std::string& a_name, const std::string& a_labels = "");
+    Histogram& GetHistogram(
+        const std::string& a_name, const std::string& a_labels = "",
+        const std::vector<double>& a_bounds = Histogram::DefaultBounds());
+
+    // One per metric in the order they were made, exactly one of counter
+    // and histogram is set
+    struct Entry
+    {
+        std::string name;
+        std::string labels;
+        Counter* counter;
+        Histogram* histogram;
+    };
+    std::vector<Entry> Entries() const;
+
+    // Index of the calling thread's shard
+    static size_t ThreadShard();
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+    std::map<std::string, size_t> m_index;
+    std::vector<std::unique_ptr<Counter>> m_counters;
+    std::vector<std::unique_ptr<Histogram>> m_histograms;
+
+    // Entry of a_name{a_labels}, nullptr if there is none
+    const Entry* p_Find(const std::string& a_name, const std::string& a_labels) const;
+};
+
+} // namespace neural
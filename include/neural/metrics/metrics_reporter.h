@@ -0,0 +1,81 @@
+/*
+ * Metrics Reporter
+ *
+ * Reads every metric of a Metrics registry on its own thread once an
+ * interval and writes them out, so the training loop only ever bumps
+ * counters. Reports go to stdout and CSV as the change over the last
+ * interval (rates, and the mean and quantiles of what was recorded in
+ * it), and can also be scraped as Prometheus text over HTTP on
+ * 127.0.0.1, which gives the running totals as Prometheus expects.
+ */
+
+#pragma once
+
+#include "neural/metrics/metrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace neural
+{
+
+class MetricsReporter
+{
+public:
+    explicit MetricsReporter(double a_intervalSeconds = 10.0, Metrics& a_metrics = Metrics::Instance());
+
+    // Stops the threads and reports what happened since the last report
+    ~MetricsReporter();
+
+    MetricsReporter(const MetricsReporter&) = delete;
+    MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+    // Sinks, to be added before Start
+    void ToStdout();
+    void ToCsv(const std::string& a_path);
+
+    // Serves GET of any path with PrometheusText, a_port 0 takes any free
+    // port. Returns the port.
+    uint16_t ServePrometheus(uint16_t a_port);
+
+    // Reports every interval from now on
+    void Start();
+
+    // Reports right away on the calling thread
+    void Report();
+
+    // Text exposition format of all of a_metrics
+    static std::string PrometheusText(const Metrics& a_metrics);
+
+private:
+    double m_interval;
+    Metrics& m_metrics;
+    bool m_stdout;
+    std::ofstream m_csv;
+
+    // What the last report saw, by name{labels}
+    std::mutex m_reportMutex;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_last;
+    std::map<std::string, uint64_t> m_lastCounters;
+    std::map<std::string, Histogram::Snapshot> m_lastHistograms;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop;
+    std::thread m_thread;
+
+    int m_listenFd;
+    std::thread m_serverThread;
+
+    void p_ReportLoop();
+    void p_ServeLoop();
+};
+
+} // namespace neural
@@ -0,0 +1,114 @@
+/*
+ * Sequential Model
+ *
+ * Stack of layers where the output of each layer is the input
+ * to the next one.
+ *
+ * Backward needs the input of every layer, so by default Forward keeps
+ * them all. With a checkpoint budget Forward only keeps some of them
+ * (the checkpoints) and Backward recomputes the ones in between, one
+ * segment at a time, trading extra forward passes for activation memory.
+ */
+
+#pragma once
+
+#include "neural/layers/layer.h"
+#include "neural/metrics/metrics.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace neural
+{
+
+// What the last Backward held and redid, all sizes are activation bytes
+struct CheckpointStats
+{
+    // Kept by Forward
+    size_t keptBytes;
+    // Every layer input, what Forward keeps without a budget
+    size_t allBytes;
+    // Most held at once during Backward, kept plus one recomputed segment
+    size_t peakBytes;
+    // Layer forwards run again and the time they took
+    size_t recomputedLayers;
+    double recomputeSeconds;
+    double backwardSeconds;
+};
+
+// Called with a layer index while Forward or Backward walks the layers
+typedef std::function<void(size_t)> TLayerHook;
+
+class Sequential
+{
+public:
+    Sequential();
+
+    // Appends a layer to the end of the stack
+    void Add(const TLayerPtr& a_layer);
+
+    const std::vector<TLayerPtr>& Layers() const;
+
+    // Output of the last layer
+    TTensorPtr Forward(const TTensorPtr& a_input) const;
+
+    // Same as above but keeps the activations for Backward (and has the layers
+    // keep what they need, see Layer::ForwardForBackward), a_outActivations[i]
+    // is the input to layer i. With a checkpoint budget the ones Backward will
+    // recompute are left null, so callers that walk the layers themselves
+    // (ie. HogwildTrainer) need the budget off. a_beforeLayer, if set, is
+    // called with each layer's index right before it runs.
+    TTensorPtr Forward(
+        const TTensorPtr& a_input,
+        std::vector<TTensorPtr>& a_outActivations,
+        const TLayerHook& a_beforeLayer = TLayerHook()) const;
+
+    // Backward through every layer given the activations from Forward,
+    // returns the gradient wrt the input of the model. a_afterLayer, if set,
+    // is called with each layer's index once its Backward has returned, when
+    // its weight gradient is final.
+    TTensorPtr Backward(
+        const std::vector<TTensorPtr>& a_activations,
+        const TTensorPtr& a_gradOutput,
+        const TLayerHook& a_afterLayer = TLayerHook());
+
+    // Bytes of activations Forward and Backward should stay around, 0 keeps
+    // every activation (the default). Half goes to the segment being
+    // recomputed and the checkpoints fill in the gaps, so the peak is only
+    // within budget if the checkpoints fit in the other half.
+    void SetCheckpointBudget(size_t a_bytes);
+    size_t CheckpointBudget() const;
+
+    // Memory and recompute numbers of the last Backward
+    const CheckpointStats& LastCheckpointStats() const;
+
+    // Records the time each layer's Forward and Backward take into the
+    // layer_forward_seconds and layer_backward_seconds histograms of
+    // Metrics::Instance(), labelled with the layer index. Off by default.
+    void SetLayerTiming(bool a_enabled);
+    bool LayerTiming() const;
+
+    // Gradient descent step on every layer with weights
+    void UpdateWeights(float a_learningRate);
+
+    // Deep copy of every layer and its weights
+    Sequential Clone() const;
+
+private:
+    std::vector<TLayerPtr> m_layers;
+    size_t m_checkpointBudget;
+    CheckpointStats m_checkpointStats;
+
+    // Per layer histograms, empty while layer timing is off
+    bool m_layerTiming;
+    std::vector<Histogram*> m_forwardTimes;
+    std::vector<Histogram*> m_backwardTimes;
+
+    // Backward through layers [a_first, a_end) where only a_activations[a_first] was kept
+    TTensorPtr p_BackwardSegment(
+        const TTensorPtr& a_checkpoint, size_t a_first, size_t a_end,
+        const TTensorPtr& a_gradOutput, const TLayerHook& a_afterLayer);
+};
+
+} // namespace neural
@@ -0,0 +1,121 @@
+/*
+ * Weight Snapshots
+ *
+ * Lets other threads run a model (evaluation, serving) on a consistent
+ * version of the weights while training keeps updating them. The
+ * training thread publishes the weights it has every so often, readers
+ * pick up the latest published version without taking a lock.
+ *
+ * A snapshot only holds references to the weight tensors, so publishing
+ * is a few pointer copies. The layers see the weights are shared and
+ * write their next update into new tensors instead of over the old ones
+ * (see LinearLayer::UpdateWeights), so a snapshot never changes.
+ *
+ * Old snapshots are freed with epoch based reclamation: a reader marks
+ * its slot with the epoch it started in, and Publish frees a replaced
+ * snapshot once every reader that might have seen it is done.
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace neural
+{
+
+struct WeightSnapshot
+{
+    // Counts publishes from 1
+    uint64_t version;
+    // Weights of every layer that has weights, in layer order
+    std::vector<TTensorPtr> weights;
+};
+
+class WeightSnapshots
+{
+public:
+    // Up to a_maxReaders threads can hold a snapshot at once, more wait for a slot
+    explicit WeightSnapshots(size_t a_maxReaders = 64);
+
+    // No reader may be holding a snapshot any more
+    ~WeightSnapshots();
+
+    WeightSnapshots(const WeightSnapshots&) = delete;
+    WeightSnapshots& operator=(const WeightSnapshots&) = delete;
+
+    // A snapshot, valid as long as the guard lives. Readers drop it as soon
+    // as they are done so old snapshots can be freed.
+    class Guard
+    {
+    public:
+        Guard(Guard&& a_other);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        // nullptr until something is published
+        const WeightSnapshot* Get() const;
+        const WeightSnapshot* operator->() const;
+        const WeightSnapshot& operator*() const;
+
+    private:
+        friend class WeightSnapshots;
+        Guard(std::atomic<uint64_t>* a_slot, const WeightSnapshot* a_snapshot);
+
+        std::atomic<uint64_t>* m_slot;
+        const WeightSnapshot* m_snapshot;
+    };
+
+    // Makes a_model's current weights the latest snapshot and frees the
+    // replaced ones no reader can still see. Only one thread may publish.
+    void Publish(const Sequential& a_model);
+
+    // Latest snapshot, lock free
+    Guard Acquire();
+
+    // Points a_model's weights at a_snapshot's, no values are copied.
+    // a_model has to have the layers of the published model, ie. a Clone,
+    // and keeps the weights alive itself, so the guard can go right after.
+    static void Apply(const WeightSnapshot& a_snapshot, Sequential& a_model);
+
+    // Version of the latest snapshot, 0 before the first Publish
+    uint64_t Version() const;
+
+    // Replaced snapshots waiting for their readers
+    size_t NumRetired() const;
+
+private:
+    struct Retired
+    {
+        const WeightSnapshot* snapshot;
+        uint64_t epoch;
+    };
+
+    // Padded so readers in different slots don't share a cache line
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::atomic<const WeightSnapshot*> m_current;
+    std::atomic<uint64_t> m_epoch;
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_numSlots;
+
+    // Readers can't look at m_current outside a guard
+    std::atomic<uint64_t> m_version;
+
+    // Publishing thread only
+    std::vector<Retired> m_retired;
+
+    void p_Reclaim();
+};
+
+} // namespace neural
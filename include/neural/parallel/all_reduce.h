@@ -0,0 +1,27 @@
+/*
+ * All Reduce
+ *
+ * Combines the gradients of several replicas of a model into one.
+ */
+
+#pragma once
+
+#include "neural/math/tensor.h"
+
+#include <vector>
+
+namespace neural
+{
+
+class AllReduce
+{
+public:
+    // sum_i(a_weights[i] * a_tensors[i]) / sum_i(a_weights[i])
+    // Every thread owns a slice of the output and walks all the inputs over
+    // that slice, so the slice stays in cache and no two threads share a line.
+    static TTensorPtr WeightedMean(
+        const std::vector<TTensorPtr>& a_tensors,
+        const std::vector<float>& a_weights);
+};
+
+} // namespace neural
@@ -0,0 +1,103 @@
+/*
+ * Bounded Queue
+ *
+ * Blocking FIFO with a fixed capacity for handing work from one thread
+ * to the next. A full queue blocks the producer, so a fast stage can
+ * never run more than a_capacity items ahead of a slow one. Close()
+ * wakes everyone up so a thread that failed can't leave the others
+ * waiting forever.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace neural
+{
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t a_capacity)
+        : m_capacity(a_capacity == 0 ? 1 : a_capacity)
+        , m_closed(false)
+    {
+
+    }
+
+    // Blocks while the queue is full, false if it was closed
+    bool Push(const T& a_item)
+    {
+        std::unique_lock<std::mutex> l_lock(m_mutex);
+        m_notFull.wait(l_lock, [this]() { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+        {
+            return false;
+        }
+
+        m_items.push_back(a_item);
+        l_lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty, false if it was closed
+    bool Pop(T& a_outItem)
+    {
+        std::unique_lock<std::mutex> l_lock(m_mutex);
+        m_notEmpty.wait(l_lock, [this]() { return m_closed || !m_items.empty(); });
+        if (m_closed)
+        {
+            return false;
+        }
+
+        a_outItem = m_items.front();
+        m_items.pop_front();
+        l_lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // Fails every Push and Pop from now on, including ones already waiting
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> l_lock(m_mutex);
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    // Empties the queue and opens it again
+    void Reset()
+    {
+        std::lock_guard<std::mutex> l_lock(m_mutex);
+        m_items.clear();
+        m_closed = false;
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> l_lock(m_mutex);
+        return m_items.size();
+    }
+
+    size_t Capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_items;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+};
+
+} // namespace neural
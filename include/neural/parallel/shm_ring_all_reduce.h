@@ -0,0 +1,66 @@
+/*
+ * Shared Memory Ring All Reduce
+ *
+ * Sums a float vector over several processes on one machine. Every rank
+ * owns a buffer in a POSIX shared memory segment and the vector is cut
+ * into one chunk per rank. A reduce-scatter pass walks the chunks around
+ * the ring so each rank ends up with one fully summed chunk, then an
+ * all-gather pass walks those around so everyone has all of them. Each
+ * rank only touches 1/N of the data per step, so the work is spread
+ * evenly no matter how many ranks there are.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace neural
+{
+
+class ShmRingAllReduce
+{
+public:
+    // Creates the shared segment, call once before starting the ranks.
+    // a_maxFloats is the longest vector that will ever be reduced.
+    static void Create(const std::string& a_name, size_t a_worldSize, size_t a_maxFloats);
+
+    // Removes the segment, call once every rank is done with it
+    static void Unlink(const std::string& a_name);
+
+    // Attaches to a segment made by Create()
+    ShmRingAllReduce(const std::string& a_name, size_t a_rank);
+    ~ShmRingAllReduce();
+
+    // Replaces a_data on every rank with the element wise sum over all ranks
+    void SumInPlace(float* a_data, size_t a_size);
+
+    // Returns once every rank has called it
+    void Barrier();
+
+    size_t Rank() const;
+    size_t WorldSize() const;
+
+private:
+    struct Header
+    {
+        std::atomic<uint32_t> barrierCount;
+        std::atomic<uint32_t> barrierSense;
+        uint64_t worldSize;
+        uint64_t maxFloats;
+    };
+
+    size_t m_rank;
+    size_t m_mappedBytes;
+    Header* m_header;
+    float* m_buffers;
+    uint32_t m_localSense;
+
+    float* p_Buffer(size_t a_rank) const;
+
+    static size_t p_BytesFor(size_t a_worldSize, size_t a_maxFloats);
+    static size_t p_BufferStride(size_t a_maxFloats);
+};
+
+} // namespace neural
@@ -0,0 +1,102 @@
+/*
+ * Thread Pool
+ *
+ * Persistent worker threads with one task deque each. Workers pop their
+ * own newest task first and steal the oldest task from other workers
+ * when they run dry, so short loops don't pay for starting threads and
+ * independent work (loading the next example while running backward)
+ * can share the same threads. A thread waiting on a ParallelFor runs the
+ * loop's chunks nobody has started yet instead of blocking, which keeps
+ * nested calls deadlock free. It never picks up other queued tasks, so
+ * an op doesn't end up running a weight update or a prefetch on its stack.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neural
+{
+
+typedef std::function<void()> TTask;
+
+// Called with a half open range [begin, end)
+typedef std::function<void(size_t, size_t)> TRangeFn;
+
+class ThreadPool
+{
+public:
+    // With a_pinWorkers, worker i pins itself as thread i + 1 of Threading::PinThreads
+    explicit ThreadPool(size_t a_numWorkers, bool a_pinWorkers = false);
+    ~ThreadPool();
+
+    // Pool used by the library, sized from Threading::NumThreads() and
+    // resized on the next use after that changes
+    static ThreadPool& Instance();
+
+    // Runs a_task on a worker, the future rethrows anything it throws
+    std::future<void> Submit(const TTask& a_task);
+
+    // Splits [a_begin, a_end) into a_numChunks pieces and runs them on the pool.
+    // The calling thread runs chunks of this loop too and returns when all are done.
+    void ParallelFor(
+        size_t a_begin, size_t a_end, size_t a_numChunks,
+        const TRangeFn& a_fn);
+
+    // Runs one queued task on the calling thread, false if there was none
+    bool RunPendingTask();
+
+    // Starts or retires workers until there are a_numWorkers. A retired worker
+    // finishes the tasks in its own queue first. Not to be called from a worker.
+    void Resize(size_t a_numWorkers);
+
+    size_t NumWorkers() const;
+
+    // True if the calling thread is a worker of any pool
+    static bool InWorker();
+
+private:
+    // Most workers a pool grows to, so the queues never have to move
+    static const size_t kMaxWorkers = 256;
+
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<TTask> tasks;
+    };
+
+    // The first m_numQueues are made. Queues outlive retired workers, whatever
+    // was pushed to one after its worker left still gets stolen.
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::atomic<size_t> m_numQueues;
+
+    // Workers [0, m_numWorkers) are running, m_workers only changes under m_resizeMutex
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_numWorkers;
+    std::mutex m_resizeMutex;
+
+    bool m_pinWorkers;
+    std::atomic<bool> m_stop;
+    std::atomic<size_t> m_numPending;
+    std::atomic<size_t> m_nextQueue;
+
+    // Idle workers sleep here until something is pushed
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCond;
+
+    void p_WorkerLoop(size_t a_idx);
+    void p_Push(const TTask& a_task);
+
+    // Newest task from queue a_idx, otherwise, if a_steal, the oldest task we can steal
+    bool p_Pop(size_t a_idx, TTask& a_outTask, bool a_steal = true);
+};
+
+} // namespace neural
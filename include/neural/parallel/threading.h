@@ -0,0 +1,113 @@
+/*
+ * Threading
+ *
+ * One place that owns how many threads we use. OpenMP regions in the
+ * library and the BLAS thread pool are both sized from here, nested
+ * parallel regions are turned off, and every op has a minimum size
+ * below which it runs serially because forking threads costs more than
+ * it saves. Loops can run either as OpenMP regions or on our own
+ * work stealing ThreadPool.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace neural
+{
+
+class Threading
+{
+public:
+    // Kinds of parallel work, each with its own threshold
+    enum EOp
+    {
+        TRANSPOSE = 0,
+        ELEMENTWISE,
+        REDUCE,
+        GEMM,
+        NUM_OPS
+    };
+
+    // What runs ParallelFor
+    enum EBackend
+    {
+        OPENMP = 0,
+        THREAD_POOL
+    };
+
+    static void SetBackend(EBackend a_backend);
+    static EBackend Backend();
+
+    // Calls a_fn(begin, end) on pieces of [0, a_size) spread over our threads,
+    // or once over the whole range if a_work (defaults to a_size) is below the
+    // threshold for a_op
+    static void ParallelFor(
+        EOp a_op, size_t a_size,
+        const std::function<void(size_t, size_t)>& a_fn,
+        size_t a_work = 0);
+
+    // Number of threads for OpenMP and BLAS, 0 means one per core
+    static void SetNumThreads(size_t a_numThreads);
+    static size_t NumThreads();
+
+    // Pin thread i of our OpenMP team and of ThreadPool::Instance() (whose
+    // worker i is thread i + 1) to core (a_firstCore + i) % cores. Thread 0 is
+    // the caller, it keeps its cores since every thread it starts from then on
+    // (loaders, writers, other pools) would inherit them. Pool workers pin
+    // themselves when they start, so call this before the pool is first used.
+    static void PinThreads(size_t a_firstCore = 0);
+
+    // Pins the calling thread as thread a_threadIdx if PinThreads was called
+    static void PinCurrentThread(size_t a_threadIdx);
+
+    // Keep the calling thread, and every thread it starts from now on,
+    // on cores [a_firstCore, a_firstCore + a_numCores)
+    static void RestrictToCores(size_t a_firstCore, size_t a_numCores);
+
+    // Minimum amount of work (elements, or m*n*k for GEMM) before an op goes parallel
+    static void SetThreshold(EOp a_op, size_t a_minWork);
+    static size_t Threshold(EOp a_op);
+
+    // Threads to use for a_op over a_work, 1 if it should run serially.
+    // Always 1 when called from inside a parallel region or a pool task so we never nest.
+    static int ThreadsFor(EOp a_op, size_t a_work);
+
+    // Number of cores on this machine
+    static size_t NumCores();
+
+    // Size of the BLAS pool on its own, for when several of our threads call
+    // BLAS at once and each call should stay on its own thread
+    static void SetBlasThreads(size_t a_numThreads);
+
+    // While one is alive every op on the creating thread runs serially,
+    // for threads that are already one of many (ie. a data parallel replica)
+    class SerialScope
+    {
+    public:
+        SerialScope();
+        ~SerialScope();
+
+    private:
+        bool m_wasSerial;
+    };
+
+    // SetBlasThreads(a_numThreads) while one is alive, back to NumThreads()
+    // when it goes, even if what ran in between threw
+    class BlasThreadsScope
+    {
+    public:
+        explicit BlasThreadsScope(size_t a_numThreads);
+        ~BlasThreadsScope();
+
+        BlasThreadsScope(const BlasThreadsScope&) = delete;
+        BlasThreadsScope& operator=(const BlasThreadsScope&) = delete;
+    };
+
+private:
+    // Applies the defaults the first time anything asks for threads
+    static void p_Init();
+};
+
+} // namespace neural
@@ -0,0 +1,130 @@
+/*
+ * Inference Server
+ *
+ * Serves a frozen copy of a model to other local processes. Each
+ * connection sends one example at a time as raw floats and gets the
+ * model's output row back. Examples from every connection wait in one
+ * queue, and a single batching thread runs them through Forward
+ * together: a batch goes as soon as it holds a_maxBatch examples or one
+ * from every open connection, or a_maxWaitSeconds after its oldest
+ * example arrived, so one GEMM serves many clients under load and a lone
+ * client doesn't wait at all.
+ *
+ * Addresses are a Unix domain socket path, or "tcp:PORT" to listen on
+ * 127.0.0.1 instead (port 0 takes any free one).
+ *
+ * Requests, batch sizes and server side latency are recorded in
+ * Metrics::Instance() as serve_requests_total, serve_batch_size and
+ * serve_latency_seconds.
+ */
+
+#pragma once
+
+#include "neural/metrics/metrics.h"
+#include "neural/models/sequential.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace neural
+{
+
+class InferenceServer
+{
+public:
+    // a_inputShape is the shape of one example without the batch dimension,
+    // ie. {784}, or {1, 28, 28} for a convolutional model
+    InferenceServer(
+        const Sequential& a_model, const std::vector<size_t>& a_inputShape,
+        size_t a_maxBatch, double a_maxWaitSeconds);
+
+    // Stops serving and closes every connection
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer&) = delete;
+    InferenceServer& operator=(const InferenceServer&) = delete;
+
+    // Starts accepting connections on a_address, returns the address it
+    // really listens on (the port filled in for tcp:0)
+    std::string Listen(const std::string& a_address);
+
+    // Floats in one request and in one response
+    size_t InputSize() const;
+    size_t OutputSize() const;
+
+    // Examples served and Forward calls it took
+    size_t NumRequests() const;
+    size_t NumBatches() const;
+
+private:
+    struct Request
+    {
+        std::vector<float> input;
+        std::promise<std::vector<float>> output;
+        std::chrono::steady_clock::time_point arrived;
+    };
+
+    Sequential m_model;
+    std::vector<size_t> m_inputShape;
+    size_t m_inputSize;
+    size_t m_outputSize;
+    size_t m_maxBatch;
+    std::chrono::steady_clock::duration m_maxWait;
+
+    Counter& m_requestsMetric;
+    Histogram& m_batchSizeMetric;
+    Histogram& m_latencyMetric;
+
+    // Requests waiting for the batching thread
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Request*> m_queue;
+    size_t m_numRequests;
+    size_t m_numBatches;
+    bool m_stop;
+    std::thread m_batchThread;
+
+    // One detached thread per connection, counted so we can wait them out
+    int m_listenFd;
+    bool m_tcp;
+    std::string m_socketPath;
+    std::thread m_acceptThread;
+    size_t m_numConnections;
+    std::condition_variable m_connectionsCond;
+
+    void p_BatchLoop();
+    void p_AcceptLoop();
+    void p_ServeConnection(int a_fd);
+
+    // Runs a_batch through the model and answers every request in it
+    void p_RunBatch(std::vector<Request*>& a_batch);
+
+    bool p_Stopping() const;
+};
+
+// Blocking connection to an InferenceServer, one request at a time
+class InferenceClient
+{
+public:
+    InferenceClient(const std::string& a_address, size_t a_inputSize, size_t a_outputSize);
+    ~InferenceClient();
+
+    InferenceClient(const InferenceClient&) = delete;
+    InferenceClient& operator=(const InferenceClient&) = delete;
+
+    // a_input has InputSize floats, a_outOutput gets OutputSize
+    void Predict(const float* a_input, float* a_outOutput);
+
+private:
+    int m_fd;
+    size_t m_inputSize;
+    size_t m_outputSize;
+};
+
+} // namespace neural
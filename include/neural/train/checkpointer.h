@@ -0,0 +1,102 @@
+/*
+ * Checkpointer
+ *
+ * Periodic checkpoints of a model without pausing training for the disk.
+ * Save copies the weights of every layer that has any, and the trainer's
+ * state, into one of two buffers and returns; a background thread writes
+ * the other one to a temp file, fsyncs it and renames it over the last
+ * checkpoint, so a crash at any point leaves either the old checkpoint or
+ * the new one, never half of one. A Save while the previous snapshot is
+ * still waiting for the writer replaces it, so training never waits.
+ *
+ * The file is a magic number, the state, every weight tensor (rank, dims,
+ * float values, in the machine's byte order) and a CRC32 of all of it.
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace neural
+{
+
+// Where the trainer was, enough to carry on from the exact same step
+struct TrainState
+{
+    // Epoch, and the next example (or batch) in it
+    uint64_t epoch;
+    uint64_t iteration;
+    // Weight updates so far
+    uint64_t step;
+    // Philox::GlobalSeed() of the run, the shuffles and augmentations come from it
+    uint64_t seed;
+    // SGD is all the optimizer there is, its state is the learning rate
+    float learningRate;
+};
+
+class Checkpointer
+{
+public:
+    // Checkpoints go to a_path, through a_path.tmp
+    explicit Checkpointer(const std::string& a_path);
+
+    // Writes what is left to write first
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // Snapshots a_model's weights and a_state for the writer, never waits on it
+    void Save(const Sequential& a_model, const TrainState& a_state);
+
+    // Blocks until every snapshot so far is on disk, throws if a write failed
+    void Flush();
+
+    // Restores a_model (which has to have the same layers) and a_outState from
+    // a_path. False if there is no checkpoint, throws if it is corrupt or
+    // doesn't fit the model.
+    static bool Load(const std::string& a_path, Sequential& a_model, TrainState& a_outState);
+
+    const std::string& Path() const;
+
+    // Checkpoints written so far, and seconds the calling thread spent in Save
+    size_t NumWritten() const;
+    double SnapshotSeconds() const;
+
+private:
+    struct Snapshot
+    {
+        TrainState state;
+        std::vector<std::vector<size_t>> shapes;
+        std::vector<std::vector<float>> weights;
+    };
+
+    std::string m_path;
+
+    // m_pending is waiting for the writer, m_writing is being written, -1 for neither
+    Snapshot m_buffers[2];
+    int m_pending;
+    int m_writing;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_numWritten;
+    double m_snapshotSeconds;
+    std::string m_error;
+    bool m_stop;
+    std::thread m_thread;
+
+    void p_WriterLoop();
+
+    // Serializes a_snapshot to the temp file and renames it into place, throws on failure
+    void p_Write(const Snapshot& a_snapshot) const;
+};
+
+} // namespace neural
@@ -0,0 +1,50 @@
+/*
+ * Data Parallel Trainer
+ *
+ * Synchronous data parallel training inside one process. Each replica
+ * of the model trains on its own shard of the batch on its own thread,
+ * then the weight gradients of all replicas are averaged with
+ * AllReduce. Replica 0 applies the update once and the others take its
+ * new weights, sharing the buffers, so the replicas never drift apart.
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+#include "neural/loss/squared_error_loss.h"
+
+#include <vector>
+
+namespace neural
+{
+
+class DataParallelTrainer
+{
+public:
+    // Replica 0 is a_model itself, the others are clones of it
+    DataParallelTrainer(const Sequential& a_model, size_t a_numReplicas);
+
+    // One gradient descent step over the batch, returns the average loss.
+    // Every input is a single 1xN example and the model outputs a 1x1 prediction.
+    float Step(
+        const std::vector<TTensorPtr>& a_inputs,
+        const std::vector<float>& a_targets,
+        float a_learningRate);
+
+    size_t NumReplicas() const;
+    const Sequential& Replica(size_t a_idx) const;
+
+private:
+    std::vector<Sequential> m_replicas;
+    std::vector<SquaredErrorLoss> m_losses;
+
+    // Runs forward and backward over a_inputs[a_begin, a_end) on replica a_idx,
+    // returns the summed loss
+    float p_TrainShard(
+        size_t a_idx,
+        const std::vector<TTensorPtr>& a_inputs,
+        const std::vector<float>& a_targets,
+        size_t a_begin, size_t a_end);
+};
+
+} // namespace neural
@@ -0,0 +1,67 @@
+/*
+ * Hogwild Trainer
+ *
+ * Lock free asynchronous SGD (Hogwild, Niu et al. 2011). Worker threads
+ * each take the next example, run forward and backward against the one
+ * shared model with their own activation and gradient buffers, and
+ * write their update straight into the shared weights without locking.
+ * Updates from different threads can overwrite each other, which for
+ * small sparse-ish models costs less accuracy than synchronizing does.
+ */
+
+#pragma once
+
+#include "neural/data/mnist_dataloader.h"
+#include "neural/models/sequential.h"
+
+#include <functional>
+#include <vector>
+
+namespace neural
+{
+
+// Fills in example i, returns false if it could not be loaded
+typedef std::function<bool(size_t, TMutableTensorPtr&, TMutableTensorPtr&)> TExampleFn;
+
+// Average loss over the examples finished since the previous point
+struct TrainingCurvePoint
+{
+    size_t examples;
+    double seconds;
+    float avgLoss;
+};
+
+class HogwildTrainer
+{
+public:
+    // a_model is trained in place and shared by every worker. Train gives
+    // its weights buffers of their own first, so clones keep theirs.
+    HogwildTrainer(Sequential& a_model, size_t a_numWorkers);
+
+    // Runs one pass over examples [0, a_numExamples), a point is added to the
+    // curve every a_reportSeconds while the workers are running. If a worker
+    // throws the others stop at their next example and it is rethrown here.
+    void Train(
+        size_t a_numExamples, const TExampleFn& a_example,
+        float a_learningRate, double a_reportSeconds = 1.0);
+
+    // One pass over the dataloader
+    void Train(
+        const MNISTDataloader& a_dataloader,
+        float a_learningRate, double a_reportSeconds = 1.0);
+
+    // Convergence curve, accumulated over every call to Train
+    const std::vector<TrainingCurvePoint>& Curve() const;
+
+    // Throughput of all the workers together over every call to Train
+    double ExamplesPerSecond() const;
+
+private:
+    Sequential& m_model;
+    size_t m_numWorkers;
+    std::vector<TrainingCurvePoint> m_curve;
+    size_t m_totalExamples;
+    double m_totalSeconds;
+};
+
+} // namespace neural
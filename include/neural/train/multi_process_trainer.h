@@ -0,0 +1,45 @@
+/*
+ * Multi Process Trainer
+ *
+ * Synchronous data parallel training where every rank is its own process
+ * with its own copy of the model, BLAS and OpenMP pools. Each step every
+ * rank trains on its shard of the batch, then the gradients are summed
+ * over all ranks with a ShmRingAllReduce and every rank applies the same
+ * update.
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+#include "neural/loss/squared_error_loss.h"
+#include "neural/parallel/shm_ring_all_reduce.h"
+
+#include <vector>
+
+namespace neural
+{
+
+class MultiProcessTrainer
+{
+public:
+    // a_model has to start from the same weights on every rank
+    MultiProcessTrainer(Sequential& a_model, ShmRingAllReduce& a_comm);
+
+    // One step on this rank's shard, returns the average loss over all the shards.
+    // Every rank has to call Step the same number of times, a shard may be empty.
+    float Step(
+        const std::vector<TTensorPtr>& a_inputs,
+        const std::vector<float>& a_targets,
+        float a_learningRate);
+
+    // Length of the vector we all reduce for a_model, for ShmRingAllReduce::Create
+    static size_t NumFloats(const Sequential& a_model);
+
+private:
+    Sequential& m_model;
+    ShmRingAllReduce& m_comm;
+    SquaredErrorLoss m_loss;
+    std::vector<float> m_buffer;
+};
+
+} // namespace neural
@@ -0,0 +1,129 @@
+/*
+ * Pipeline Trainer
+ *
+ * Pipeline parallel training. The layers of a model are split into
+ * contiguous stages, each run by its own thread pinned to its own core
+ * so a stage's weights stay in that core's cache. A batch is cut into
+ * micro-batches that stream through the stages over bounded queues,
+ * forward one way and gradients back the other, following either the
+ * GPipe schedule (every forward, then every backward) or 1F1B (each
+ * stage alternates one forward and one backward once the pipeline is
+ * full, which caps the activations a stage holds at the number of
+ * stages). Stages also record how long they sat idle waiting on their
+ * neighbours, the pipeline bubble.
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+#include "neural/loss/squared_error_loss.h"
+#include "neural/parallel/bounded_queue.h"
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neural
+{
+
+// Busy and idle time of each stage, summed over steps
+struct PipelineStats
+{
+    size_t steps;
+    double seconds;
+    std::vector<double> busySeconds;
+
+    // Share of stage time spent waiting, averaged over the stages
+    double BubbleFraction() const;
+
+    // (S - 1) / (M + S - 1), what a perfectly balanced pipeline would idle
+    static double IdealBubbleFraction(size_t a_numStages, size_t a_numMicroBatches);
+};
+
+class PipelineTrainer
+{
+public:
+    enum ESchedule
+    {
+        GPIPE = 0,
+        ONE_F_ONE_B
+    };
+
+    // a_model is trained in place. a_queueCapacity of 0 lets each queue
+    // hold one micro-batch per stage, GPipe's gradient queues always hold
+    // every micro-batch.
+    PipelineTrainer(
+        Sequential& a_model, size_t a_numStages, size_t a_numMicroBatches,
+        ESchedule a_schedule = ONE_F_ONE_B, size_t a_queueCapacity = 0);
+    ~PipelineTrainer();
+
+    // One gradient descent step over the batch, returns the average loss.
+    // Every input is a single 1xN example and the model outputs a 1x1 prediction.
+    // If a stage throws the step is dropped, no weights change, and the
+    // exception is rethrown here.
+    float Step(
+        const std::vector<TTensorPtr>& a_inputs,
+        const std::vector<float>& a_targets,
+        float a_learningRate);
+
+    size_t NumStages() const;
+
+    // Stage a_stage runs layers [StageBegin(a_stage), StageBegin(a_stage + 1))
+    size_t StageBegin(size_t a_stage) const;
+
+    const PipelineStats& Stats() const;
+    void ResetStats();
+
+private:
+    // What travels between stages, a micro-batch's activations or gradients
+    struct Message
+    {
+        size_t microBatch;
+        TTensorPtr tensor;
+    };
+    typedef BoundedQueue<Message> TQueue;
+
+    Sequential& m_model;
+    size_t m_numMicroBatches;
+    ESchedule m_schedule;
+    std::vector<size_t> m_stageBegin;
+    SquaredErrorLoss m_loss;
+
+    // m_forward[s] feeds stage s + 1, m_backward[s] feeds stage s
+    std::vector<std::unique_ptr<TQueue>> m_forward;
+    std::vector<std::unique_ptr<TQueue>> m_backward;
+
+    // The current step, read by the stage threads
+    const std::vector<TTensorPtr>* m_inputs;
+    const std::vector<float>* m_targets;
+    float m_learningRate;
+    size_t m_stepMicroBatches;
+    float m_stepLoss;
+
+    // Stage threads wait for m_generation to change, then run one step
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_startCond;
+    std::condition_variable m_doneCond;
+    size_t m_generation;
+    size_t m_numRunning;
+    bool m_stop;
+    std::exception_ptr m_error;
+
+    PipelineStats m_stats;
+
+    void p_Partition(size_t a_numStages);
+    void p_StageLoop(size_t a_stage);
+
+    // Runs this step's schedule on stage a_stage, returns its busy seconds
+    double p_RunStage(size_t a_stage);
+
+    // Stacks the examples of micro-batch a_microBatch into one tensor
+    TTensorPtr p_MicroBatchInput(size_t a_microBatch) const;
+    void p_MicroBatchRange(size_t a_microBatch, size_t& a_outBegin, size_t& a_outEnd) const;
+};
+
+} // namespace neural
@@ -0,0 +1,72 @@
+/*
+ * Step Executor
+ *
+ * Runs a training step as per layer tasks instead of a whole backward
+ * pass followed by a whole update. A layer's weight gradient is final
+ * as soon as its Backward returns, so its update goes to the thread pool
+ * right then and runs while backward carries on through the layers
+ * before it. The next Forward only waits for a layer's update when it
+ * gets to that layer, so the last layers' updates can still be running
+ * while the first layers already work on the next example.
+ *
+ * Only one update per layer is ever in flight, and nothing else touches
+ * a layer between its Backward and the next Forward reaching it, so the
+ * layers need no locking. Read the weights (ie. to checkpoint them) only
+ * after Wait.
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+
+#include <future>
+#include <vector>
+
+namespace neural
+{
+
+class StepExecutor
+{
+public:
+    // a_model is trained in place
+    explicit StepExecutor(Sequential& a_model);
+
+    // Waits for the updates still running
+    ~StepExecutor();
+
+    StepExecutor(const StepExecutor&) = delete;
+    StepExecutor& operator=(const StepExecutor&) = delete;
+
+    // Sequential::Forward keeping the activations, each layer waits for its
+    // update from the last step just before it runs
+    TTensorPtr Forward(const TTensorPtr& a_input, std::vector<TTensorPtr>& a_outActivations);
+
+    // Sequential::Backward, queueing each layer's UpdateWeights(a_learningRate)
+    // as soon as its gradient is ready. Returns without waiting for them.
+    TTensorPtr Backward(
+        const std::vector<TTensorPtr>& a_activations,
+        const TTensorPtr& a_gradOutput,
+        float a_learningRate);
+
+    // Waits for every queued update, rethrows anything one threw
+    void Wait();
+
+    // Time spent in updates on the pool, and how much of it the calling
+    // thread sat waiting for them instead of carrying on, read after Wait
+    double UpdateSeconds() const;
+    double WaitSeconds() const;
+
+private:
+    Sequential& m_model;
+
+    // Update queued for each layer, invalid if there is none
+    std::vector<std::future<void>> m_pending;
+
+    // Per layer so the tasks never share a counter
+    std::vector<double> m_updateSeconds;
+    double m_waitSeconds;
+
+    void p_WaitFor(size_t a_layer);
+};
+
+} // namespace neural
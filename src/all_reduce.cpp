@@ -0,0 +1,70 @@
+/*
+ * All Reduce Implementation
+ *
+ */
+
+#include "neural/parallel/all_reduce.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+TTensorPtr AllReduce::WeightedMean(
+    const std::vector<TTensorPtr>& a_tensors,
+    const std::vector<float>& a_weights)
+{
+    if (a_tensors.empty() || a_tensors.size() != a_weights.size())
+    {
+        stringstream l_ss;
+        l_ss << "AllReduce::WeightedMean needs one weight per tensor, got "
+             << a_tensors.size() << " tensors and " << a_weights.size() << " weights";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    float l_totalWeight = 0.0;
+    vector<const float*> l_inputs;
+    for (size_t i = 0; i < a_tensors.size(); ++i)
+    {
+        if (a_tensors[i]->Shape() != a_tensors[0]->Shape())
+        {
+            stringstream l_ss;
+            l_ss << "AllReduce::WeightedMean shape mismatch "
+                 << a_tensors[i]->ShapeStr() << " != " << a_tensors[0]->ShapeStr();
+            LOG(ERROR) << l_ss.str() << endl;
+            throw(runtime_error(l_ss.str()));
+        }
+        l_inputs.push_back(a_tensors[i]->Data().data());
+        l_totalWeight += a_weights[i];
+    }
+
+    TMutableTensorPtr l_ret = Tensor::New(a_tensors[0]->Shape());
+    float* l_output = l_ret->MutableData().data();
+
+    Threading::ParallelFor(Threading::REDUCE, l_ret->Size(), [&](size_t a_begin, size_t a_end) {
+        for (size_t i = a_begin; i < a_end; ++i)
+        {
+            l_output[i] = 0.0;
+        }
+
+        for (size_t t = 0; t < l_inputs.size(); ++t)
+        {
+            const float* l_input = l_inputs[t];
+            float l_scale = a_weights[t] / l_totalWeight;
+            for (size_t i = a_begin; i < a_end; ++i)
+            {
+                l_output[i] += l_scale * l_input[i];
+            }
+        }
+    }, l_ret->Size() * l_inputs.size());
+
+    return l_ret;
+}
+
+} // namespace neural
@@ -0,0 +1,215 @@
+/*
+ * Augment Pipeline Implementation
+ *
+ */
+
+#include "neural/data/augment_pipeline.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+AugmentPipeline::AugmentPipeline(
+    const MNISTDataloader& a_dataloader, const Augmenter& a_augmenter,
+    size_t a_batchSize, size_t a_numWorkers, size_t a_queueDepth)
+    : m_dataloader(a_dataloader)
+    , m_augmenter(a_augmenter)
+    , m_batchSize(a_batchSize)
+    , m_queueDepth(a_queueDepth > 0 ? a_queueDepth : 2 * std::max(a_numWorkers, (size_t)1))
+    , m_background(a_dataloader.ZeroBackground() ? 0.0f : -1.0f)
+    , m_epoch(0)
+    , m_generation(0)
+    , m_numBatches(0)
+    , m_nextClaim(0)
+    , m_nextOut(0)
+    , m_stop(false)
+{
+    if (a_batchSize == 0 || a_numWorkers == 0)
+    {
+        stringstream l_ss;
+        l_ss << "AugmentPipeline needs a batch size and workers, got " << a_batchSize
+             << " and " << a_numWorkers;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    for (size_t i = 0; i < a_numWorkers; ++i)
+    {
+        m_threads.emplace_back(&AugmentPipeline::p_WorkerLoop, this);
+    }
+}
+
+AugmentPipeline::~AugmentPipeline()
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_stop = true;
+    }
+    m_workCond.notify_all();
+
+    for (thread& l_thread : m_threads)
+    {
+        l_thread.join();
+    }
+}
+
+void AugmentPipeline::StartEpoch(size_t a_epoch, size_t a_firstBatch)
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        ++m_generation;
+        m_epoch = a_epoch;
+        m_numBatches = (m_dataloader.DataLength() + m_batchSize - 1) / m_batchSize;
+        m_nextClaim = std::min(a_firstBatch, m_numBatches);
+        m_nextOut = m_nextClaim;
+        m_done.clear();
+        m_error = nullptr;
+    }
+    m_workCond.notify_all();
+}
+
+bool AugmentPipeline::Next(TTensorPtr& a_outInputs, std::vector<float>& a_outTargets)
+{
+    Batch l_batch;
+    {
+        unique_lock<mutex> l_lock(m_mutex);
+        if (m_nextOut >= m_numBatches)
+        {
+            return false;
+        }
+
+        m_doneCond.wait(l_lock, [this]() { return m_error || m_done.count(m_nextOut) > 0; });
+        if (m_error)
+        {
+            rethrow_exception(m_error);
+        }
+
+        auto l_it = m_done.find(m_nextOut);
+        l_batch = l_it->second;
+        m_done.erase(l_it);
+        ++m_nextOut;
+    }
+
+    // There is room for one more batch ahead of us
+    m_workCond.notify_one();
+    a_outInputs = l_batch.inputs;
+    a_outTargets.swap(l_batch.targets);
+    return true;
+}
+
+size_t AugmentPipeline::NumBatches() const
+{
+    return (m_dataloader.DataLength() + m_batchSize - 1) / m_batchSize;
+}
+
+size_t AugmentPipeline::PoolSize() const
+{
+    lock_guard<mutex> l_lock(m_poolMutex);
+    return m_pool.size();
+}
+
+void AugmentPipeline::p_WorkerLoop()
+{
+    // Each worker is one of many already, it shouldn't take threads from the trainer's ops
+    Threading::SerialScope l_serial;
+
+    unique_lock<mutex> l_lock(m_mutex);
+    while (true)
+    {
+        m_workCond.wait(l_lock, [this]() {
+            return m_stop || (!m_error && m_nextClaim < m_numBatches && m_nextClaim < m_nextOut + m_queueDepth);
+        });
+        if (m_stop)
+        {
+            return;
+        }
+
+        size_t l_batchIdx = m_nextClaim++;
+        size_t l_generation = m_generation;
+        size_t l_epoch = m_epoch;
+        l_lock.unlock();
+
+        Batch l_batch;
+        exception_ptr l_error;
+        try
+        {
+            p_MakeBatch(l_epoch, l_batchIdx, l_batch);
+        }
+        catch (...)
+        {
+            l_error = current_exception();
+        }
+
+        l_lock.lock();
+        // A new pass started while we worked, the batch goes back to the pool
+        if (l_generation != m_generation)
+        {
+            continue;
+        }
+
+        if (l_error)
+        {
+            m_error = l_error;
+        }
+        else
+        {
+            m_done[l_batchIdx] = l_batch;
+        }
+        m_doneCond.notify_all();
+    }
+}
+
+void AugmentPipeline::p_MakeBatch(size_t a_epoch, size_t a_batch, Batch& a_outBatch)
+{
+    size_t l_numData = m_dataloader.DataLength();
+    size_t l_begin = a_batch * m_batchSize;
+    size_t l_end = std::min(l_begin + m_batchSize, l_numData);
+
+    TMutableTensorPtr l_raw;
+    if (!m_dataloader.BatchAt(l_begin, l_end, l_raw, a_outBatch.targets))
+    {
+        stringstream l_ss;
+        l_ss << "AugmentPipeline could not read examples [" << l_begin << ", " << l_end << ")";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    vector<size_t> l_image = m_dataloader.ImageShape();
+    size_t l_imageSize = l_image[0] * l_image[1] * l_image[2];
+    a_outBatch.inputs = p_Acquire(l_raw->Shape());
+    const float* l_in = l_raw->Data().data();
+    float* l_out = a_outBatch.inputs->MutableData().data();
+    for (size_t i = 0; i < l_end - l_begin; ++i)
+    {
+        m_augmenter.Apply(
+            l_in + i * l_imageSize, l_out + i * l_imageSize,
+            l_image[0], l_image[1], l_image[2],
+            m_background, a_epoch * l_numData + l_begin + i);
+    }
+}
+
+TMutableTensorPtr AugmentPipeline::p_Acquire(const std::vector<size_t>& a_shape)
+{
+    // Only the pool holds it, so nobody can be reading it any more
+    lock_guard<mutex> l_lock(m_poolMutex);
+    for (const TMutableTensorPtr& l_tensor : m_pool)
+    {
+        if (l_tensor.use_count() == 1 && l_tensor->Shape() == a_shape)
+        {
+            return l_tensor;
+        }
+    }
+
+    m_pool.push_back(Tensor::New(a_shape));
+    return m_pool.back();
+}
+
+} // namespace neural
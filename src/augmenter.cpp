@@ -0,0 +1,207 @@
+/*
+ * Augmenter Implementation
+ *
+ */
+
+#include "neural/data/augmenter.h"
+#include "neural/math/philox.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+namespace neural
+{
+
+// Streams of one sample: the shift and rotation, the two elastic fields and the noise
+static const uint64_t kStreamsPerSample = 4;
+static const float kPi = 3.14159265358979f;
+
+Augmenter::Augmenter(const AugmentParams& a_params, uint64_t a_seed)
+    : m_params(a_params)
+    , m_seed(a_seed)
+{
+
+}
+
+AugmentParams Augmenter::DefaultParams()
+{
+    AugmentParams l_params;
+    l_params.maxShift = 2.0f;
+    l_params.maxRotation = 10.0f;
+    l_params.elasticAlpha = 34.0f;
+    l_params.elasticSigma = 4.0f;
+    l_params.noiseStddev = 0.05f;
+    return l_params;
+}
+
+void Augmenter::Apply(
+    const float* a_in, float* a_out,
+    size_t a_numChannels, size_t a_height, size_t a_width,
+    float a_background, uint64_t a_sampleId) const
+{
+    size_t l_planeSize = a_height * a_width;
+    uint64_t l_stream = a_sampleId * kStreamsPerSample;
+
+    // Output pixel to input pixel: undo the shift, then the rotation about the centre
+    Philox l_rng(m_seed, l_stream);
+    float l_angle = (2.0f * l_rng.UniformAt(0) - 1.0f) * m_params.maxRotation * kPi / 180.0f;
+    float l_shiftX = (2.0f * l_rng.UniformAt(1) - 1.0f) * m_params.maxShift;
+    float l_shiftY = (2.0f * l_rng.UniformAt(2) - 1.0f) * m_params.maxShift;
+    float l_cos = cos(l_angle);
+    float l_sin = sin(l_angle);
+    float l_centreX = 0.5f * (a_width - 1.0f);
+    float l_centreY = 0.5f * (a_height - 1.0f);
+
+    bool l_elastic = m_params.elasticAlpha > 0.0f;
+    vector<float> l_fieldX, l_fieldY;
+    if (l_elastic)
+    {
+        l_fieldX.resize(l_planeSize);
+        l_fieldY.resize(l_planeSize);
+        p_ElasticField(l_stream + 1, a_height, a_width, l_fieldX.data());
+        p_ElasticField(l_stream + 2, a_height, a_width, l_fieldY.data());
+    }
+
+    // Every source pixel index and weight of the image, into a copy of each
+    // plane with a border of background around it
+    size_t l_paddedWidth = a_width + 2;
+    vector<int> l_index(l_planeSize);
+    vector<float> l_weightX(l_planeSize), l_weightY(l_planeSize);
+    float l_maxX = (float)a_width;
+    float l_maxY = (float)a_height;
+    for (size_t y = 0; y < a_height; ++y)
+    {
+        float l_relY = y - l_centreY - l_shiftY;
+        size_t l_row = y * a_width;
+        const float* l_fx = l_elastic ? l_fieldX.data() + l_row : nullptr;
+        const float* l_fy = l_elastic ? l_fieldY.data() + l_row : nullptr;
+        #pragma omp simd
+        for (size_t x = 0; x < a_width; ++x)
+        {
+            float l_relX = x - l_centreX - l_shiftX;
+            float l_srcX = l_cos * l_relX + l_sin * l_relY + l_centreX + (l_fx ? l_fx[x] : 0.0f);
+            float l_srcY = -l_sin * l_relX + l_cos * l_relY + l_centreY + (l_fy ? l_fy[x] : 0.0f);
+
+            // Anything outside lands on the border, x0 in [-1, W - 1] so x0 + 1 is still in the copy
+            l_srcX = std::min(std::max(l_srcX, -1.0f), l_maxX);
+            l_srcY = std::min(std::max(l_srcY, -1.0f), l_maxY);
+            float l_x0 = std::min(floor(l_srcX), l_maxX - 1.0f);
+            float l_y0 = std::min(floor(l_srcY), l_maxY - 1.0f);
+            l_weightX[l_row + x] = l_srcX - l_x0;
+            l_weightY[l_row + x] = l_srcY - l_y0;
+            l_index[l_row + x] = (int)((l_y0 + 1.0f) * l_paddedWidth + l_x0 + 1.0f);
+        }
+    }
+
+    vector<float> l_padded((a_height + 2) * l_paddedWidth, a_background);
+    for (size_t c = 0; c < a_numChannels; ++c)
+    {
+        const float* l_in = a_in + c * l_planeSize;
+        float* l_out = a_out + c * l_planeSize;
+        for (size_t y = 0; y < a_height; ++y)
+        {
+            copy(l_in + y * a_width, l_in + (y + 1) * a_width, l_padded.begin() + (y + 1) * l_paddedWidth + 1);
+        }
+
+        const float* l_src = l_padded.data();
+        #pragma omp simd
+        for (size_t i = 0; i < l_planeSize; ++i)
+        {
+            int l_at = l_index[i];
+            float l_top = l_src[l_at] + l_weightX[i] * (l_src[l_at + 1] - l_src[l_at]);
+            float l_bottom = l_src[l_at + l_paddedWidth] +
+                             l_weightX[i] * (l_src[l_at + l_paddedWidth + 1] - l_src[l_at + l_paddedWidth]);
+            l_out[i] = l_top + l_weightY[i] * (l_bottom - l_top);
+        }
+    }
+
+    if (m_params.noiseStddev > 0.0f)
+    {
+        size_t l_size = a_numChannels * l_planeSize;
+        vector<float> l_noise(l_size);
+        Philox(m_seed, l_stream + 3).FillNormal(l_noise.data(), l_size, 0.0f, m_params.noiseStddev);
+        #pragma omp simd
+        for (size_t i = 0; i < l_size; ++i)
+        {
+            a_out[i] = std::min(std::max(a_out[i] + l_noise[i], a_background), 1.0f);
+        }
+    }
+}
+
+const AugmentParams& Augmenter::Params() const
+{
+    return m_params;
+}
+
+uint64_t Augmenter::Seed() const
+{
+    return m_seed;
+}
+
+void Augmenter::p_ElasticField(uint64_t a_stream, size_t a_height, size_t a_width, float* a_out) const
+{
+    size_t l_size = a_height * a_width;
+    vector<float> l_random(l_size), l_rows(l_size, 0.0f);
+    Philox(m_seed, a_stream).FillUniform(l_random.data(), l_size, -1.0f, 1.0f);
+
+    // Gaussian out to 3 sigma, scaled so the blur of the field comes out times alpha
+    float l_sigma = std::max(m_params.elasticSigma, 0.1f);
+    size_t l_radius = (size_t)ceil(3.0f * l_sigma);
+    vector<float> l_kernel(2 * l_radius + 1);
+    float l_sum = 0.0f;
+    for (size_t t = 0; t < l_kernel.size(); ++t)
+    {
+        float l_dist = (float)t - (float)l_radius;
+        l_kernel[t] = exp(-0.5f * l_dist * l_dist / (l_sigma * l_sigma));
+        l_sum += l_kernel[t];
+    }
+    for (float& l_tap : l_kernel)
+    {
+        l_tap *= m_params.elasticAlpha / l_sum;
+    }
+
+    // Along rows then along columns, one tap at a time over the part of
+    // the row it reaches, zero outside the image
+    for (size_t y = 0; y < a_height; ++y)
+    {
+        const float* l_in = l_random.data() + y * a_width;
+        float* l_out = l_rows.data() + y * a_width;
+        for (size_t t = 0; t < l_kernel.size(); ++t)
+        {
+            // out[x] += k[t] * in[x + t - radius]
+            ptrdiff_t l_offset = (ptrdiff_t)t - (ptrdiff_t)l_radius;
+            size_t l_begin = std::min((size_t)std::max(-l_offset, (ptrdiff_t)0), a_width);
+            size_t l_end = a_width - std::min((size_t)std::max(l_offset, (ptrdiff_t)0), a_width);
+            float l_tap = l_kernel[t];
+            #pragma omp simd
+            for (size_t x = l_begin; x < l_end; ++x)
+            {
+                l_out[x] += l_tap * l_in[(ptrdiff_t)x + l_offset];
+            }
+        }
+    }
+
+    fill(a_out, a_out + l_size, 0.0f);
+    for (size_t y = 0; y < a_height; ++y)
+    {
+        float* l_out = a_out + y * a_width;
+        size_t l_first = y > l_radius ? y - l_radius : 0;
+        size_t l_last = std::min(a_height, y + l_radius + 1);
+        for (size_t yy = l_first; yy < l_last; ++yy)
+        {
+            const float* l_in = l_rows.data() + yy * a_width;
+            float l_tap = l_kernel[yy + l_radius - y];
+            #pragma omp simd
+            for (size_t x = 0; x < a_width; ++x)
+            {
+                l_out[x] += l_tap * l_in[x];
+            }
+        }
+    }
+}
+
+} // namespace neural
@@ -0,0 +1,344 @@
+/*
+ * Checkpointer Implementation
+ *
+ */
+
+#include "neural/train/checkpointer.h"
+#include "neural/io/fd_io.h"
+
+#include <glog/logging.h>
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+static const char kMagic[8] = {'N', 'N', 'C', 'K', 'P', 'T', '0', '1'};
+
+static void Append(vector<uint8_t>& a_bytes, const void* a_data, size_t a_size)
+{
+    const uint8_t* l_data = static_cast<const uint8_t*>(a_data);
+    a_bytes.insert(a_bytes.end(), l_data, l_data + a_size);
+}
+
+// Reads values off the front of a checkpoint, throws if it runs out
+class CheckpointReader
+{
+public:
+    CheckpointReader(const vector<uint8_t>& a_bytes, size_t a_end, const string& a_path)
+        : m_bytes(a_bytes)
+        , m_pos(0)
+        , m_end(a_end)
+        , m_path(a_path)
+    {
+
+    }
+
+    void Read(void* a_out, size_t a_size)
+    {
+        if (a_size > m_end - m_pos)
+        {
+            FdIo::Throw("Checkpointer::Load " + m_path + " is truncated");
+        }
+        memcpy(a_out, m_bytes.data() + m_pos, a_size);
+        m_pos += a_size;
+    }
+
+    uint64_t ReadU64()
+    {
+        uint64_t l_value = 0;
+        Read(&l_value, sizeof(l_value));
+        return l_value;
+    }
+
+private:
+    const vector<uint8_t>& m_bytes;
+    size_t m_pos;
+    size_t m_end;
+    const string& m_path;
+};
+
+Checkpointer::Checkpointer(const std::string& a_path)
+    : m_path(a_path)
+    , m_pending(-1)
+    , m_writing(-1)
+    , m_numWritten(0)
+    , m_snapshotSeconds(0.0)
+    , m_stop(false)
+{
+    m_thread = thread(&Checkpointer::p_WriterLoop, this);
+}
+
+Checkpointer::~Checkpointer()
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+void Checkpointer::Save(const Sequential& a_model, const TrainState& a_state)
+{
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+
+    // Take back a snapshot the writer hasn't got to yet, otherwise the one it isn't writing
+    int l_slot = 0;
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        l_slot = m_pending >= 0 ? m_pending : (m_writing == 0 ? 1 : 0);
+        m_pending = -1;
+    }
+
+    // Same sizes every time, so after the first Save this only copies
+    Snapshot& l_snapshot = m_buffers[l_slot];
+    l_snapshot.state = a_state;
+    l_snapshot.shapes.clear();
+    size_t l_numWeights = 0;
+    for (const TLayerPtr& l_layer : a_model.Layers())
+    {
+        if (!l_layer->HasWeights())
+        {
+            continue;
+        }
+
+        TTensorPtr l_weights = l_layer->Weights();
+        l_snapshot.shapes.push_back(l_weights->Shape());
+        if (l_snapshot.weights.size() <= l_numWeights)
+        {
+            l_snapshot.weights.resize(l_numWeights + 1);
+        }
+        l_snapshot.weights[l_numWeights].assign(l_weights->Data().begin(), l_weights->Data().end());
+        ++l_numWeights;
+    }
+    l_snapshot.weights.resize(l_numWeights);
+
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_pending = l_slot;
+        m_snapshotSeconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+    }
+    m_cond.notify_all();
+}
+
+void Checkpointer::Flush()
+{
+    unique_lock<mutex> l_lock(m_mutex);
+    m_cond.wait(l_lock, [this]() { return m_pending < 0 && m_writing < 0; });
+    if (!m_error.empty())
+    {
+        string l_error = m_error;
+        m_error.clear();
+        throw(runtime_error(l_error));
+    }
+}
+
+bool Checkpointer::Load(const std::string& a_path, Sequential& a_model, TrainState& a_outState)
+{
+    ifstream l_infile(a_path, ios::binary);
+    if (!l_infile.good())
+    {
+        return false;
+    }
+    vector<uint8_t> l_bytes((istreambuf_iterator<char>(l_infile)), istreambuf_iterator<char>());
+
+    // Everything is checked before the model is touched
+    uint32_t l_crc = 0;
+    if (l_bytes.size() < sizeof(kMagic) + sizeof(l_crc) || memcmp(l_bytes.data(), kMagic, sizeof(kMagic)) != 0)
+    {
+        FdIo::Throw("Checkpointer::Load " + a_path + " is not a checkpoint");
+    }
+    size_t l_end = l_bytes.size() - sizeof(l_crc);
+    memcpy(&l_crc, l_bytes.data() + l_end, sizeof(l_crc));
+    if (l_crc != crc32(0, l_bytes.data(), l_end))
+    {
+        FdIo::Throw("Checkpointer::Load " + a_path + " is corrupt, its CRC doesn't match");
+    }
+
+    CheckpointReader l_reader(l_bytes, l_end, a_path);
+    char l_magic[sizeof(kMagic)];
+    l_reader.Read(l_magic, sizeof(l_magic));
+    TrainState l_state;
+    l_state.epoch = l_reader.ReadU64();
+    l_state.iteration = l_reader.ReadU64();
+    l_state.step = l_reader.ReadU64();
+    l_state.seed = l_reader.ReadU64();
+    l_reader.Read(&l_state.learningRate, sizeof(l_state.learningRate));
+
+    vector<TLayerPtr> l_layers;
+    for (const TLayerPtr& l_layer : a_model.Layers())
+    {
+        if (l_layer->HasWeights())
+        {
+            l_layers.push_back(l_layer);
+        }
+    }
+
+    size_t l_numWeights = l_reader.ReadU64();
+    if (l_numWeights != l_layers.size())
+    {
+        stringstream l_ss;
+        l_ss << "Checkpointer::Load " << a_path << " has " << l_numWeights
+             << " weight tensors but the model has " << l_layers.size();
+        FdIo::Throw(l_ss.str());
+    }
+
+    vector<TTensorPtr> l_weights;
+    for (size_t i = 0; i < l_numWeights; ++i)
+    {
+        vector<size_t> l_shape(l_reader.ReadU64());
+        for (size_t& l_dim : l_shape)
+        {
+            l_dim = l_reader.ReadU64();
+        }
+        if (l_shape != l_layers[i]->Weights()->Shape())
+        {
+            FdIo::Throw("Checkpointer::Load " + a_path + " weights " + Tensor::ShapeStr(l_shape) +
+                  " don't fit layer weights " + l_layers[i]->Weights()->ShapeStr());
+        }
+
+        TMutableTensorPtr l_tensor = Tensor::New(l_shape);
+        l_reader.Read(l_tensor->MutableData().data(), l_tensor->Size() * sizeof(float));
+        l_weights.push_back(l_tensor);
+    }
+
+    for (size_t i = 0; i < l_numWeights; ++i)
+    {
+        l_layers[i]->SetWeights(l_weights[i]);
+    }
+    a_outState = l_state;
+    return true;
+}
+
+const std::string& Checkpointer::Path() const
+{
+    return m_path;
+}
+
+size_t Checkpointer::NumWritten() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_numWritten;
+}
+
+double Checkpointer::SnapshotSeconds() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_snapshotSeconds;
+}
+
+void Checkpointer::p_WriterLoop()
+{
+    unique_lock<mutex> l_lock(m_mutex);
+    while (true)
+    {
+        m_cond.wait(l_lock, [this]() { return m_stop || m_pending >= 0; });
+        if (m_pending < 0)
+        {
+            return;
+        }
+
+        m_writing = m_pending;
+        m_pending = -1;
+        l_lock.unlock();
+
+        string l_error;
+        try
+        {
+            p_Write(m_buffers[m_writing]);
+        }
+        catch (const exception& e)
+        {
+            l_error = e.what();
+        }
+
+        l_lock.lock();
+        m_writing = -1;
+        if (l_error.empty())
+        {
+            ++m_numWritten;
+        }
+        else
+        {
+            m_error = l_error;
+        }
+        m_cond.notify_all();
+    }
+}
+
+void Checkpointer::p_Write(const Snapshot& a_snapshot) const
+{
+    vector<uint8_t> l_bytes;
+    Append(l_bytes, kMagic, sizeof(kMagic));
+    const TrainState& l_state = a_snapshot.state;
+    const uint64_t l_header[] = {l_state.epoch, l_state.iteration, l_state.step, l_state.seed};
+    Append(l_bytes, l_header, sizeof(l_header));
+    Append(l_bytes, &l_state.learningRate, sizeof(l_state.learningRate));
+
+    uint64_t l_numWeights = a_snapshot.weights.size();
+    Append(l_bytes, &l_numWeights, sizeof(l_numWeights));
+    for (size_t i = 0; i < a_snapshot.weights.size(); ++i)
+    {
+        uint64_t l_rank = a_snapshot.shapes[i].size();
+        Append(l_bytes, &l_rank, sizeof(l_rank));
+        for (size_t l_dim : a_snapshot.shapes[i])
+        {
+            uint64_t l_dim64 = l_dim;
+            Append(l_bytes, &l_dim64, sizeof(l_dim64));
+        }
+        Append(l_bytes, a_snapshot.weights[i].data(), a_snapshot.weights[i].size() * sizeof(float));
+    }
+    uint32_t l_crc = crc32(0, l_bytes.data(), l_bytes.size());
+    Append(l_bytes, &l_crc, sizeof(l_crc));
+
+    // All of it on disk under the temp name before it replaces the old one
+    string l_tmpFile = m_path + ".tmp";
+    int l_fd = open(l_tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (l_fd < 0)
+    {
+        FdIo::Throw("Checkpointer could not open " + l_tmpFile + ": " + strerror(errno));
+    }
+    if (!FdIo::WriteFully(l_fd, l_bytes.data(), l_bytes.size()))
+    {
+        string l_error = strerror(errno);
+        close(l_fd);
+        FdIo::Throw("Checkpointer could not write " + l_tmpFile + ": " + l_error);
+    }
+    if (fsync(l_fd) != 0)
+    {
+        string l_error = strerror(errno);
+        close(l_fd);
+        FdIo::Throw("Checkpointer could not fsync " + l_tmpFile + ": " + l_error);
+    }
+    close(l_fd);
+
+    if (rename(l_tmpFile.c_str(), m_path.c_str()) != 0)
+    {
+        FdIo::Throw("Checkpointer could not rename " + l_tmpFile + " to " + m_path + ": " + strerror(errno));
+    }
+
+    // And the rename itself, by syncing the directory
+    size_t l_slash = m_path.find_last_of('/');
+    string l_dir = l_slash == string::npos ? "." : m_path.substr(0, l_slash + 1);
+    int l_dirFd = open(l_dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (l_dirFd >= 0)
+    {
+        fsync(l_dirFd);
+        close(l_dirFd);
+    }
+}
+
+} // namespace neural
@@ -0,0 +1,310 @@
+/*
+ * Conv2D Layer Implementation
+ *
+ */
+
+#include "neural/layers/conv2d_layer.h"
+#include "neural/math/tensor_math.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+// Floats in one block of the unrolled matrix, 1MB fits in L2 on most cores
+static const size_t kIm2ColBlockFloats = 256 * 1024;
+
+Conv2DLayer::Conv2DLayer(
+    const TTensorPtr& a_weights, size_t a_inChannels, size_t a_kernelSize,
+    size_t a_stride, size_t a_padding, bool a_hasBias)
+    : WeightedLayer("Conv2DLayer", a_weights)
+    , m_inChannels(a_inChannels)
+    , m_outChannels(0)
+    , m_kernelSize(a_kernelSize)
+    , m_stride(a_stride)
+    , m_padding(a_padding)
+    , m_hasBias(a_hasBias)
+{
+    const vector<size_t>& l_shape = a_weights->Shape();
+    if (l_shape.size() != 2 || l_shape[0] != a_inChannels * a_kernelSize * a_kernelSize
+        || a_kernelSize == 0 || a_stride == 0)
+    {
+        stringstream l_ss;
+        l_ss << "Conv2DLayer weights " << a_weights->ShapeStr() << " don't fit " << a_inChannels
+             << " input channels with a " << a_kernelSize << "x" << a_kernelSize
+             << " kernel and stride " << a_stride;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+    m_outChannels = l_shape[1];
+
+    // Bias row starts at zero so every filter starts out centered
+    if (m_hasBias)
+    {
+        m_weights = TensorMath::AddRow(m_weights, 0.0)->ToMutable();
+    }
+}
+
+TTensorPtr Conv2DLayer::Forward(const TTensorPtr& a_input) const
+{
+    p_CheckInput(a_input);
+    size_t l_batchSize = a_input->Shape()[0];
+    size_t l_outHeight = OutSize(a_input->Shape()[2]);
+    size_t l_outWidth = OutSize(a_input->Shape()[3]);
+    size_t l_rowsPerImage = l_outHeight * l_outWidth;
+    size_t l_patchSize = p_PatchSize();
+
+    TMutableTensorPtr l_ret = Tensor::New({l_batchSize, m_outChannels, l_outHeight, l_outWidth});
+    float* l_out = l_ret->MutableData().data();
+
+    size_t l_imagesPerBlock = p_ImagesPerBlock(l_rowsPerImage);
+    for (size_t l_first = 0; l_first < l_batchSize; l_first += l_imagesPerBlock)
+    {
+        size_t l_count = std::min(l_imagesPerBlock, l_batchSize - l_first);
+        TMutableTensorPtr l_cols = Tensor::New({l_count * l_rowsPerImage, l_patchSize});
+        p_Im2Col(a_input, l_first, l_count, l_cols->MutableData().data());
+
+        // Row p of the product is output pixel p with one column per filter
+        TTensorPtr l_product = TensorMath::Multiply(l_cols, m_weights);
+        const float* l_productData = l_product->Data().data();
+
+        // Back to NCHW, every task writes one output plane
+        Threading::ParallelFor(Threading::TRANSPOSE, l_count * m_outChannels, [&](size_t a_begin, size_t a_end) {
+            for (size_t t = a_begin; t < a_end; ++t)
+            {
+                size_t b = t / m_outChannels;
+                size_t c = t % m_outChannels;
+                const float* l_src = l_productData + b * l_rowsPerImage * m_outChannels + c;
+                float* l_plane = l_out + ((l_first + b) * m_outChannels + c) * l_rowsPerImage;
+                for (size_t p = 0; p < l_rowsPerImage; ++p)
+                {
+                    l_plane[p] = l_src[p * m_outChannels];
+                }
+            }
+        }, l_count * l_rowsPerImage * m_outChannels);
+    }
+    return l_ret;
+}
+
+TTensorPtr Conv2DLayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
+{
+    TTensorPtr l_weightGrad;
+    TTensorPtr l_gradWrtInput = CalcGradients(a_origInput, a_gradInput, l_weightGrad);
+    m_weightGrads.push_back(l_weightGrad);
+    return l_gradWrtInput;
+}
+
+TTensorPtr Conv2DLayer::CalcGradients(
+    const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+    TTensorPtr& a_outWeightGrad) const
+{
+    p_CheckInput(a_origInput);
+    size_t l_batchSize = a_origInput->Shape()[0];
+    size_t l_outHeight = OutSize(a_origInput->Shape()[2]);
+    size_t l_outWidth = OutSize(a_origInput->Shape()[3]);
+    size_t l_rowsPerImage = l_outHeight * l_outWidth;
+    size_t l_patchSize = p_PatchSize();
+
+    vector<size_t> l_outShape = {l_batchSize, m_outChannels, l_outHeight, l_outWidth};
+    if (a_gradInput->Shape() != l_outShape)
+    {
+        stringstream l_ss;
+        l_ss << "Conv2DLayer::CalcGradients gradient shape " << a_gradInput->ShapeStr()
+             << " != output shape " << Tensor::ShapeStr(l_outShape);
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    // The bias only feeds forward, it gets no gradient back to the input
+    TTensorPtr l_weights = m_hasBias ? TensorMath::RemoveRow(m_weights) : TTensorPtr(m_weights);
+    TTensorPtr l_weightsT = TensorMath::Transpose(l_weights);
+
+    TMutableTensorPtr l_weightGrad = Tensor::Zeros(m_weights->Shape());
+    TMutableTensorPtr l_gradWrtInput = Tensor::Zeros(a_origInput->Shape());
+    const float* l_gradOut = a_gradInput->Data().data();
+
+    // Same blocks as Forward, the unrolled input is rebuilt instead of kept around
+    size_t l_imagesPerBlock = p_ImagesPerBlock(l_rowsPerImage);
+    for (size_t l_first = 0; l_first < l_batchSize; l_first += l_imagesPerBlock)
+    {
+        size_t l_count = std::min(l_imagesPerBlock, l_batchSize - l_first);
+        TMutableTensorPtr l_cols = Tensor::New({l_count * l_rowsPerImage, l_patchSize});
+        p_Im2Col(a_origInput, l_first, l_count, l_cols->MutableData().data());
+
+        // Output gradient from NCHW to one row per output pixel, like the forward product
+        TMutableTensorPtr l_grad = Tensor::New({l_count * l_rowsPerImage, m_outChannels});
+        float* l_gradData = l_grad->MutableData().data();
+        Threading::ParallelFor(Threading::TRANSPOSE, l_count * m_outChannels, [&](size_t a_begin, size_t a_end) {
+            for (size_t t = a_begin; t < a_end; ++t)
+            {
+                size_t b = t / m_outChannels;
+                size_t c = t % m_outChannels;
+                const float* l_plane = l_gradOut + ((l_first + b) * m_outChannels + c) * l_rowsPerImage;
+                float* l_dst = l_gradData + b * l_rowsPerImage * m_outChannels + c;
+                for (size_t p = 0; p < l_rowsPerImage; ++p)
+                {
+                    l_dst[p * m_outChannels] = l_plane[p];
+                }
+            }
+        }, l_count * l_rowsPerImage * m_outChannels);
+
+        // Same as LinearLayer on the unrolled input
+        TensorMath::Axpy(1.0, TensorMath::Multiply(TensorMath::Transpose(l_cols), l_grad), l_weightGrad);
+        TTensorPtr l_gradCols = TensorMath::Multiply(l_grad, l_weightsT);
+        p_Col2Im(l_gradCols->Data().data(), l_first, l_count, l_gradWrtInput);
+    }
+
+    a_outWeightGrad = l_weightGrad;
+    return l_gradWrtInput;
+}
+
+TLayerPtr Conv2DLayer::Clone() const
+{
+    shared_ptr<Conv2DLayer> l_clone(new Conv2DLayer(*this));
+    // Copy constructor shares the weights tensor, the clone needs its own
+    l_clone->m_weights = m_weights->ToMutable();
+    return l_clone;
+}
+
+size_t Conv2DLayer::InChannels() const
+{
+    return m_inChannels;
+}
+
+size_t Conv2DLayer::OutChannels() const
+{
+    return m_outChannels;
+}
+
+size_t Conv2DLayer::OutSize(size_t a_inSize) const
+{
+    return (a_inSize + 2 * m_padding - m_kernelSize) / m_stride + 1;
+}
+
+size_t Conv2DLayer::p_PatchSize() const
+{
+    return m_inChannels * m_kernelSize * m_kernelSize + (m_hasBias ? 1 : 0);
+}
+
+void Conv2DLayer::p_CheckInput(const TTensorPtr& a_input) const
+{
+    const vector<size_t>& l_shape = a_input->Shape();
+    if (l_shape.size() != 4 || l_shape[1] != m_inChannels
+        || l_shape[2] + 2 * m_padding < m_kernelSize
+        || l_shape[3] + 2 * m_padding < m_kernelSize)
+    {
+        stringstream l_ss;
+        l_ss << "Conv2DLayer needs NCHW input with " << m_inChannels << " channels of at least "
+             << m_kernelSize << "x" << m_kernelSize << " with padding, got " << a_input->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+size_t Conv2DLayer::p_ImagesPerBlock(size_t a_rowsPerImage) const
+{
+    return std::max((size_t)1, kIm2ColBlockFloats / std::max((size_t)1, a_rowsPerImage * p_PatchSize()));
+}
+
+void Conv2DLayer::p_Im2Col(const TTensorPtr& a_input, size_t a_first, size_t a_count, float* a_cols) const
+{
+    size_t l_height = a_input->Shape()[2];
+    size_t l_width = a_input->Shape()[3];
+    size_t l_outHeight = OutSize(l_height);
+    size_t l_outWidth = OutSize(l_width);
+    size_t l_rowsPerImage = l_outHeight * l_outWidth;
+    size_t l_patchSize = p_PatchSize();
+    size_t l_kernelArea = m_kernelSize * m_kernelSize;
+    const float* l_in = a_input->Data().data();
+
+    // Every (image, channel) task fills its own columns of its own rows
+    Threading::ParallelFor(Threading::ELEMENTWISE, a_count * m_inChannels, [&](size_t a_begin, size_t a_end) {
+        for (size_t t = a_begin; t < a_end; ++t)
+        {
+            size_t b = t / m_inChannels;
+            size_t c = t % m_inChannels;
+            const float* l_plane = l_in + ((a_first + b) * m_inChannels + c) * l_height * l_width;
+            float* l_rows = a_cols + b * l_rowsPerImage * l_patchSize;
+            for (size_t oh = 0; oh < l_outHeight; ++oh)
+            {
+                for (size_t ow = 0; ow < l_outWidth; ++ow)
+                {
+                    float* l_row = l_rows + (oh * l_outWidth + ow) * l_patchSize;
+                    float* l_patch = l_row + c * l_kernelArea;
+                    for (size_t ki = 0; ki < m_kernelSize; ++ki)
+                    {
+                        // Padding is everything outside the image, it reads as zero
+                        long l_ih = (long)(oh * m_stride + ki) - (long)m_padding;
+                        bool l_rowInside = l_ih >= 0 && l_ih < (long)l_height;
+                        for (size_t kj = 0; kj < m_kernelSize; ++kj)
+                        {
+                            long l_iw = (long)(ow * m_stride + kj) - (long)m_padding;
+                            bool l_inside = l_rowInside && l_iw >= 0 && l_iw < (long)l_width;
+                            l_patch[ki * m_kernelSize + kj] = l_inside ? l_plane[l_ih * l_width + l_iw] : 0.0f;
+                        }
+                    }
+
+                    if (m_hasBias && c == 0)
+                    {
+                        l_row[l_patchSize - 1] = 1.0f;
+                    }
+                }
+            }
+        }
+    }, a_count * l_rowsPerImage * l_patchSize);
+}
+
+void Conv2DLayer::p_Col2Im(const float* a_cols, size_t a_first, size_t a_count, const TMutableTensorPtr& a_input) const
+{
+    size_t l_height = a_input->Shape()[2];
+    size_t l_width = a_input->Shape()[3];
+    size_t l_outHeight = OutSize(l_height);
+    size_t l_outWidth = OutSize(l_width);
+    size_t l_rowsPerImage = l_outHeight * l_outWidth;
+    size_t l_kernelArea = m_kernelSize * m_kernelSize;
+    size_t l_numCols = m_inChannels * l_kernelArea;
+    float* l_in = a_input->MutableData().data();
+
+    // Overlapping patches add into the same pixels, but only within one
+    // (image, channel) plane, so every task still owns what it writes
+    Threading::ParallelFor(Threading::ELEMENTWISE, a_count * m_inChannels, [&](size_t a_begin, size_t a_end) {
+        for (size_t t = a_begin; t < a_end; ++t)
+        {
+            size_t b = t / m_inChannels;
+            size_t c = t % m_inChannels;
+            float* l_plane = l_in + ((a_first + b) * m_inChannels + c) * l_height * l_width;
+            const float* l_rows = a_cols + b * l_rowsPerImage * l_numCols;
+            for (size_t oh = 0; oh < l_outHeight; ++oh)
+            {
+                for (size_t ow = 0; ow < l_outWidth; ++ow)
+                {
+                    const float* l_patch = l_rows + (oh * l_outWidth + ow) * l_numCols + c * l_kernelArea;
+                    for (size_t ki = 0; ki < m_kernelSize; ++ki)
+                    {
+                        long l_ih = (long)(oh * m_stride + ki) - (long)m_padding;
+                        if (l_ih < 0 || l_ih >= (long)l_height)
+                        {
+                            continue;
+                        }
+                        for (size_t kj = 0; kj < m_kernelSize; ++kj)
+                        {
+                            long l_iw = (long)(ow * m_stride + kj) - (long)m_padding;
+                            if (l_iw >= 0 && l_iw < (long)l_width)
+                            {
+                                l_plane[l_ih * l_width + l_iw] += l_patch[ki * m_kernelSize + kj];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }, a_count * l_rowsPerImage * l_numCols);
+}
+
+} // namespace neural
@@ -0,0 +1,157 @@
+/*
+ * Data Parallel Trainer Implementation
+ *
+ */
+
+#include "neural/train/data_parallel_trainer.h"
+#include "neural/parallel/all_reduce.h"
+#include "neural/parallel/thread_pool.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+DataParallelTrainer::DataParallelTrainer(const Sequential& a_model, size_t a_numReplicas)
+{
+    if (a_numReplicas == 0)
+    {
+        a_numReplicas = 1;
+    }
+
+    m_replicas.push_back(a_model);
+    for (size_t i = 1; i < a_numReplicas; ++i)
+    {
+        m_replicas.push_back(a_model.Clone());
+    }
+    m_losses.resize(a_numReplicas);
+}
+
+float DataParallelTrainer::Step(
+    const std::vector<TTensorPtr>& a_inputs,
+    const std::vector<float>& a_targets,
+    float a_learningRate)
+{
+    if (a_inputs.empty() || a_inputs.size() != a_targets.size())
+    {
+        stringstream l_ss;
+        l_ss << "DataParallelTrainer::Step needs one target per input, got "
+             << a_inputs.size() << " inputs and " << a_targets.size() << " targets";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t l_numReplicas = m_replicas.size();
+    size_t l_batchSize = a_inputs.size();
+
+    // Forward and backward, one shard per replica
+    vector<float> l_shardLoss(l_numReplicas, 0.0);
+    vector<float> l_shardSize(l_numReplicas, 0.0);
+    {
+        // Every replica calls BLAS at the same time, so BLAS itself has to stay single threaded
+        Threading::BlasThreadsScope l_blas(l_numReplicas > 1 ? 1 : Threading::NumThreads());
+        ThreadPool::Instance().ParallelFor(0, l_numReplicas, l_numReplicas, [&](size_t a_begin, size_t a_end) {
+            Threading::SerialScope l_serial;
+            for (size_t r = a_begin; r < a_end; ++r)
+            {
+                size_t l_shardBegin = (l_batchSize * r) / l_numReplicas;
+                size_t l_shardEnd = (l_batchSize * (r + 1)) / l_numReplicas;
+                l_shardSize[r] = l_shardEnd - l_shardBegin;
+                l_shardLoss[r] = p_TrainShard(r, a_inputs, a_targets, l_shardBegin, l_shardEnd);
+            }
+        });
+    }
+
+    // Average each layer's gradient over the replicas, weighted by how many examples each saw
+    const vector<TLayerPtr>& l_layers = m_replicas[0].Layers();
+    vector<TTensorPtr> l_meanGrads(l_layers.size());
+    for (size_t l = 0; l < l_layers.size(); ++l)
+    {
+        if (!l_layers[l]->HasWeights())
+        {
+            continue;
+        }
+
+        vector<TTensorPtr> l_grads;
+        vector<float> l_weights;
+        for (size_t r = 0; r < l_numReplicas; ++r)
+        {
+            if (l_shardSize[r] > 0)
+            {
+                l_grads.push_back(m_replicas[r].Layers()[l]->CalcAvgWeightGrad());
+                l_weights.push_back(l_shardSize[r]);
+            }
+        }
+        l_meanGrads[l] = AllReduce::WeightedMean(l_grads, l_weights);
+    }
+
+    // One update, to replica 0. The others share its new weights, which
+    // costs no copy, and its next update steps into new tensors.
+    for (size_t l = 0; l < l_layers.size(); ++l)
+    {
+        if (l_meanGrads[l])
+        {
+            l_layers[l]->ApplyGradient(l_meanGrads[l], a_learningRate);
+        }
+    }
+    for (size_t r = 0; r < l_numReplicas; ++r)
+    {
+        const vector<TLayerPtr>& l_replicaLayers = m_replicas[r].Layers();
+        for (size_t l = 0; l < l_replicaLayers.size(); ++l)
+        {
+            if (r > 0 && l_meanGrads[l])
+            {
+                l_replicaLayers[l]->SetWeights(l_layers[l]->Weights());
+            }
+            l_replicaLayers[l]->ZeroGrad();
+        }
+    }
+
+    float l_totalLoss = 0.0;
+    for (size_t r = 0; r < l_numReplicas; ++r)
+    {
+        l_totalLoss += l_shardLoss[r];
+    }
+    return l_totalLoss / ((float)l_batchSize);
+}
+
+size_t DataParallelTrainer::NumReplicas() const
+{
+    return m_replicas.size();
+}
+
+const Sequential& DataParallelTrainer::Replica(size_t a_idx) const
+{
+    return m_replicas.at(a_idx);
+}
+
+float DataParallelTrainer::p_TrainShard(
+    size_t a_idx,
+    const std::vector<TTensorPtr>& a_inputs,
+    const std::vector<float>& a_targets,
+    size_t a_begin, size_t a_end)
+{
+    Sequential& l_model = m_replicas[a_idx];
+    SquaredErrorLoss& l_loss = m_losses[a_idx];
+
+    float l_lossSum = 0.0;
+    vector<TTensorPtr> l_activations;
+    for (size_t i = a_begin; i < a_end; ++i)
+    {
+        TTensorPtr l_pred = l_model.Forward(a_inputs[i], l_activations);
+        float l_predVal = l_pred->View<2>()(0, 0);
+        l_lossSum += l_loss.Forward(l_predVal, a_targets[i]);
+
+        float l_errorGrad = l_loss.Backward(l_predVal, a_targets[i]);
+        l_model.Backward(l_activations, Tensor::New({1, 1}, {l_errorGrad}));
+    }
+    l_loss.ZeroGrad();
+    return l_lossSum;
+}
+
+} // namespace neural
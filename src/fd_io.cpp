@@ -0,0 +1,110 @@
+/*
+ * File Descriptor I/O Implementation
+ *
+ */
+
+#include "neural/io/fd_io.h"
+
+#include <glog/logging.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+void FdIo::Throw(const std::string& a_what)
+{
+    LOG(ERROR) << a_what << endl;
+    throw(runtime_error(a_what));
+}
+
+bool FdIo::ReadFully(int a_fd, void* a_data, size_t a_size, const std::function<bool()>& a_stop)
+{
+    uint8_t* l_data = static_cast<uint8_t*>(a_data);
+    for (size_t l_done = 0; l_done < a_size;)
+    {
+        if (a_stop)
+        {
+            pollfd l_poll = {a_fd, POLLIN, 0};
+            int l_ready = poll(&l_poll, 1, kPollMs);
+            if (l_ready == 0 || (l_ready < 0 && errno == EINTR))
+            {
+                if (a_stop())
+                {
+                    return false;
+                }
+                continue;
+            }
+        }
+
+        ssize_t l_read = read(a_fd, l_data + l_done, a_size - l_done);
+        if (l_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (l_read <= 0)
+        {
+            return false;
+        }
+        l_done += l_read;
+    }
+    return true;
+}
+
+bool FdIo::WriteFully(int a_fd, const void* a_data, size_t a_size)
+{
+    const uint8_t* l_data = static_cast<const uint8_t*>(a_data);
+    bool l_socket = true;
+    for (size_t l_done = 0; l_done < a_size;)
+    {
+        // send() can turn SIGPIPE off, it only takes sockets though
+        ssize_t l_written = l_socket
+            ? send(a_fd, l_data + l_done, a_size - l_done, MSG_NOSIGNAL)
+            : write(a_fd, l_data + l_done, a_size - l_done);
+        if (l_written < 0 && l_socket && errno == ENOTSOCK)
+        {
+            l_socket = false;
+            continue;
+        }
+        if (l_written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (l_written <= 0)
+        {
+            return false;
+        }
+        l_done += l_written;
+    }
+    return true;
+}
+
+void FdIo::AcceptLoop(
+    int a_listenFd, const std::function<bool()>& a_stop,
+    const std::function<void(int)>& a_serve)
+{
+    while (!a_stop())
+    {
+        pollfd l_poll = {a_listenFd, POLLIN, 0};
+        if (poll(&l_poll, 1, kPollMs) <= 0)
+        {
+            continue;
+        }
+        int l_fd = accept(a_listenFd, nullptr, nullptr);
+        if (l_fd < 0)
+        {
+            continue;
+        }
+        a_serve(l_fd);
+    }
+}
+
+} // namespace neural
@@ -0,0 +1,66 @@
+/*
+ * Flatten Layer Implementation
+ *
+ */
+
+#include "neural/layers/flatten_layer.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+FlattenLayer::FlattenLayer()
+{
+
+}
+
+TTensorPtr FlattenLayer::Forward(const TTensorPtr& a_input) const
+{
+    if (a_input->Shape().empty())
+    {
+        stringstream l_ss;
+        l_ss << "FlattenLayer needs a batch dimension, got a scalar tensor";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t l_batchSize = a_input->Shape()[0];
+    size_t l_numCols = l_batchSize == 0 ? 0 : a_input->Size() / l_batchSize;
+    return a_input->Reshape({l_batchSize, l_numCols});
+}
+
+TTensorPtr FlattenLayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
+{
+    TTensorPtr l_weightGrad;
+    return CalcGradients(a_origInput, a_gradInput, l_weightGrad);
+}
+
+TTensorPtr FlattenLayer::CalcGradients(
+    const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+    TTensorPtr& a_outWeightGrad) const
+{
+    a_outWeightGrad = nullptr;
+    if (a_gradInput->Size() != a_origInput->Size())
+    {
+        stringstream l_ss;
+        l_ss << "FlattenLayer::CalcGradients gradient " << a_gradInput->ShapeStr()
+             << " doesn't fit input " << a_origInput->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    // Same values, the input's shape
+    return a_gradInput->Reshape(a_origInput->Shape());
+}
+
+TLayerPtr FlattenLayer::Clone() const
+{
+    return TLayerPtr(new FlattenLayer(*this));
+}
+
+} // namespace neural
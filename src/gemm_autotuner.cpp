@@ -0,0 +1,254 @@
+/*
+ * GEMM Autotuner Implementation
+ *
+ */
+
+#include "neural/math/gemm_autotuner.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+namespace neural
+{
+
+// Number of timed runs per kernel, we keep the fastest
+static const size_t kNumTuneRuns = 3;
+
+bool GemmAutotuner::Key::operator<(const Key& a_other) const
+{
+    if (m != a_other.m) return m < a_other.m;
+    if (n != a_other.n) return n < a_other.n;
+    if (k != a_other.k) return k < a_other.k;
+    return threads < a_other.threads;
+}
+
+GemmAutotuner::GemmAutotuner()
+    : m_enabled(false)
+    , m_dirty(false)
+{
+
+}
+
+GemmAutotuner::~GemmAutotuner()
+{
+    Save();
+}
+
+GemmAutotuner& GemmAutotuner::Instance()
+{
+    static GemmAutotuner l_instance;
+    return l_instance;
+}
+
+void GemmAutotuner::Enable(const std::string& a_cacheFile)
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_enabled = true;
+        m_cacheFile = a_cacheFile;
+        m_winners.clear();
+        m_dirty = false;
+    }
+    Load();
+}
+
+void GemmAutotuner::Disable()
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    m_enabled = false;
+}
+
+bool GemmAutotuner::IsEnabled() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_enabled;
+}
+
+const GemmKernel& GemmAutotuner::Select(size_t a_m, size_t a_n, size_t a_k)
+{
+    // Inside a pool worker or a serial scope the kernel runs on one thread
+    // whatever NumThreads() says, so that's the timing we want
+    Key l_key = {a_m, a_n, a_k, (size_t)Threading::ThreadsFor(Threading::GEMM, a_m * a_n * a_k)};
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        if (!m_enabled)
+        {
+            return Heuristic(a_m, a_n, a_k);
+        }
+
+        map<Key, string>::const_iterator l_it = m_winners.find(l_key);
+        if (l_it != m_winners.end())
+        {
+            const GemmKernel* l_kernel = GemmKernels::Find(l_it->second);
+            if (l_kernel)
+            {
+                return *l_kernel;
+            }
+        }
+    }
+
+    // Tune outside of the lock, other shapes can still be looked up meanwhile
+    string l_winner = p_Tune(l_key);
+    LOG(INFO) << "GemmAutotuner picked " << l_winner << " for "
+              << a_m << "x" << a_k << "*" << a_k << "x" << a_n
+              << " with " << l_key.threads << " threads" << endl;
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_winners[l_key] = l_winner;
+        m_dirty = true;
+    }
+
+    return *GemmKernels::Find(l_winner);
+}
+
+size_t GemmAutotuner::NumCached() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_winners.size();
+}
+
+bool GemmAutotuner::Load()
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    ifstream l_infile(m_cacheFile);
+    if (!l_infile.good())
+    {
+        return false;
+    }
+
+    string l_line;
+    while (getline(l_infile, l_line))
+    {
+        if (l_line.empty() || l_line[0] == '#')
+        {
+            continue;
+        }
+
+        stringstream l_ss(l_line);
+        Key l_key;
+        string l_name;
+        if (!(l_ss >> l_key.m >> l_key.n >> l_key.k >> l_key.threads >> l_name))
+        {
+            LOG(ERROR) << "GemmAutotuner::Load skipping bad line in "
+                       << m_cacheFile << ": " << l_line << endl;
+            continue;
+        }
+
+        // Kernels can be removed between runs, so ignore names we don't know
+        if (GemmKernels::Find(l_name))
+        {
+            m_winners[l_key] = l_name;
+        }
+    }
+    return true;
+}
+
+bool GemmAutotuner::Save()
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    if (m_cacheFile.empty())
+    {
+        return false;
+    }
+    if (!m_dirty)
+    {
+        return true;
+    }
+
+    // Write to a temp file and rename so a crash never leaves half a cache,
+    // the temp file is per process since --procs ranks share the cache
+    string l_tmpFile = m_cacheFile + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream l_outfile(l_tmpFile);
+        if (!l_outfile.good())
+        {
+            LOG(ERROR) << "GemmAutotuner::Save could not open " << l_tmpFile << endl;
+            return false;
+        }
+
+        l_outfile << "# m n k threads kernel" << endl;
+        for (const pair<const Key, string>& l_winner : m_winners)
+        {
+            l_outfile << l_winner.first.m << " "
+                      << l_winner.first.n << " "
+                      << l_winner.first.k << " "
+                      << l_winner.first.threads << " "
+                      << l_winner.second << endl;
+        }
+    }
+    if (rename(l_tmpFile.c_str(), m_cacheFile.c_str()) != 0)
+    {
+        remove(l_tmpFile.c_str());
+        return false;
+    }
+    m_dirty = false;
+    return true;
+}
+
+const GemmKernel& GemmAutotuner::Heuristic(size_t a_m, size_t a_n, size_t a_k)
+{
+    if (a_m == 1 || a_n == 1)
+    {
+        return *GemmKernels::Find("gemv");
+    }
+
+    if (a_m <= GemmKernels::kSmallMaxDim
+        && a_n <= GemmKernels::kSmallMaxDim
+        && a_k <= GemmKernels::kSmallMaxDim)
+    {
+        return *GemmKernels::Find("small");
+    }
+
+    return *GemmKernels::Find("blas");
+}
+
+std::string GemmAutotuner::p_Tune(const Key& a_key) const
+{
+    // Inputs don't matter for timing, but keep them away from denormals
+    vector<float> l_A(a_key.m * a_key.k, 0.5f);
+    vector<float> l_B(a_key.k * a_key.n, 0.25f);
+    vector<float> l_C(a_key.m * a_key.n);
+
+    string l_winner = Heuristic(a_key.m, a_key.n, a_key.k).name;
+    double l_bestSeconds = numeric_limits<double>::max();
+    for (const GemmKernel& l_kernel : GemmKernels::All())
+    {
+        if (!l_kernel.supports(a_key.m, a_key.n, a_key.k))
+        {
+            continue;
+        }
+
+        // Warm up caches and any lazily created thread pools
+        l_kernel.fn(a_key.m, a_key.n, a_key.k, l_A.data(), l_B.data(), l_C.data());
+
+        double l_kernelSeconds = numeric_limits<double>::max();
+        for (size_t i = 0; i < kNumTuneRuns; ++i)
+        {
+            chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+            l_kernel.fn(a_key.m, a_key.n, a_key.k, l_A.data(), l_B.data(), l_C.data());
+            chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+            l_kernelSeconds = std::min(l_kernelSeconds, l_elapsed.count());
+        }
+
+        if (l_kernelSeconds < l_bestSeconds)
+        {
+            l_bestSeconds = l_kernelSeconds;
+            l_winner = l_kernel.name;
+        }
+    }
+    return l_winner;
+}
+
+} // namespace neural
@@ -0,0 +1,227 @@
+/*
+ * GEMM Kernel Registry Implementation
+ *
+ */
+
+#include "neural/math/gemm_kernels.h"
+#include "neural/math/gemm_autotuner.h"
+#include "neural/parallel/threading.h"
+
+#include <cblas.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace neural
+{
+
+const size_t GemmKernels::kSmallMaxDim;
+
+// Block sizes for the built in GEMM, a 64x256 block of B is 64KB
+// which leaves room in L2 for the rows of A and C we are working on
+static const size_t kBlockM = 32;
+static const size_t kBlockK = 64;
+static const size_t kBlockN = 256;
+
+static bool SupportsAll(size_t a_m, size_t a_n, size_t a_k)
+{
+    return true;
+}
+
+static bool SupportsGemv(size_t a_m, size_t a_n, size_t a_k)
+{
+    return a_m == 1 || a_n == 1;
+}
+
+static bool SupportsSmall(size_t a_m, size_t a_n, size_t a_k)
+{
+    return a_m <= GemmKernels::kSmallMaxDim
+        && a_n <= GemmKernels::kSmallMaxDim
+        && a_k <= GemmKernels::kSmallMaxDim;
+}
+
+const std::vector<GemmKernel>& GemmKernels::All()
+{
+    static const vector<GemmKernel> l_kernels = {
+        {"blas",    &GemmKernels::Blas,    &SupportsAll},
+        {"blocked", &GemmKernels::Blocked, &SupportsAll},
+        {"gemv",    &GemmKernels::Gemv,    &SupportsGemv},
+        {"small",   &GemmKernels::Small,   &SupportsSmall}
+    };
+    return l_kernels;
+}
+
+const GemmKernel* GemmKernels::Find(const std::string& a_name)
+{
+    for (const GemmKernel& l_kernel : All())
+    {
+        if (l_kernel.name == a_name)
+        {
+            return &l_kernel;
+        }
+    }
+    return nullptr;
+}
+
+void GemmKernels::Blas(
+    size_t a_m, size_t a_n, size_t a_k,
+    const float* a_A, const float* a_B, float* a_C)
+{
+    int m = a_m;
+    int n = a_n;
+    int k = a_k;
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, 1.0,
+                a_A, k, a_B, n, 0.0, a_C, n);
+}
+
+void GemmKernels::Blocked(
+    size_t a_m, size_t a_n, size_t a_k,
+    const float* a_A, const float* a_B, float* a_C)
+{
+    memset(a_C, 0, sizeof(float) * a_m * a_n);
+
+    // Each thread owns blocks of rows of C, so no two threads write the same memory
+    size_t l_numRowBlocks = (a_m + kBlockM - 1) / kBlockM;
+    Threading::ParallelFor(Threading::GEMM, l_numRowBlocks, [&](size_t a_blockBegin, size_t a_blockEnd) {
+        for (size_t l_block = a_blockBegin; l_block < a_blockEnd; ++l_block)
+        {
+            size_t i0 = l_block * kBlockM;
+            size_t l_iEnd = std::min(i0 + kBlockM, a_m);
+            for (size_t k0 = 0; k0 < a_k; k0 += kBlockK)
+            {
+                size_t l_kEnd = std::min(k0 + kBlockK, a_k);
+                for (size_t j0 = 0; j0 < a_n; j0 += kBlockN)
+                {
+                    size_t l_jEnd = std::min(j0 + kBlockN, a_n);
+                    for (size_t i = i0; i < l_iEnd; ++i)
+                    {
+                        float* l_cRow = a_C + i * a_n;
+                        for (size_t k = k0; k < l_kEnd; ++k)
+                        {
+                            // i-k-j order so the inner loop streams over rows of B and C
+                            float l_a = a_A[i * a_k + k];
+                            const float* l_bRow = a_B + k * a_n;
+                            for (size_t j = j0; j < l_jEnd; ++j)
+                            {
+                                l_cRow[j] += l_a * l_bRow[j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }, a_m * a_n * a_k);
+}
+
+void GemmKernels::Gemv(
+    size_t a_m, size_t a_n, size_t a_k,
+    const float* a_A, const float* a_B, float* a_C)
+{
+    int m = a_m;
+    int n = a_n;
+    int k = a_k;
+    if (a_m == 1)
+    {
+        // 1xK * KxN is B^T * a
+        cblas_sgemv(CblasRowMajor, CblasTrans, k, n, 1.0,
+                    a_B, n, a_A, 1, 0.0, a_C, 1);
+    }
+    else if (a_n == 1)
+    {
+        // MxK * Kx1 is A * b
+        cblas_sgemv(CblasRowMajor, CblasNoTrans, m, k, 1.0,
+                    a_A, k, a_B, 1, 0.0, a_C, 1);
+    }
+    else
+    {
+        Blas(a_m, a_n, a_k, a_A, a_B, a_C);
+    }
+}
+
+void GemmKernels::Small(
+    size_t a_m, size_t a_n, size_t a_k,
+    const float* a_A, const float* a_B, float* a_C)
+{
+    for (size_t i = 0; i < a_m; ++i)
+    {
+        const float* l_aRow = a_A + i * a_k;
+        float* l_cRow = a_C + i * a_n;
+
+        // Four columns of C at a time, kept in registers over the whole k loop
+        size_t j = 0;
+        for (; j + 4 <= a_n; j += 4)
+        {
+            float c0 = 0.0f, c1 = 0.0f, c2 = 0.0f, c3 = 0.0f;
+            for (size_t k = 0; k < a_k; ++k)
+            {
+                const float* l_b = a_B + k * a_n + j;
+                float l_a = l_aRow[k];
+                c0 += l_a * l_b[0];
+                c1 += l_a * l_b[1];
+                c2 += l_a * l_b[2];
+                c3 += l_a * l_b[3];
+            }
+            l_cRow[j]     = c0;
+            l_cRow[j + 1] = c1;
+            l_cRow[j + 2] = c2;
+            l_cRow[j + 3] = c3;
+        }
+
+        // Left over columns
+        for (; j < a_n; ++j)
+        {
+            float c = 0.0f;
+            for (size_t k = 0; k < a_k; ++k)
+            {
+                c += l_aRow[k] * a_B[k * a_n + j];
+            }
+            l_cRow[j] = c;
+        }
+    }
+}
+
+void GemmKernels::Batched(
+    size_t a_batch, size_t a_m, size_t a_n, size_t a_k,
+    const float* a_A, size_t a_strideA,
+    const float* a_B, size_t a_strideB,
+    float* a_C)
+{
+    size_t l_strideC = a_m * a_n;
+
+#ifdef NEURAL_BLAS_BATCHED
+    // One call for the whole batch, the library spreads it over its own threads
+    cblas_sgemm_batch_strided(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                              a_m, a_n, a_k, 1.0,
+                              a_A, a_k, a_strideA,
+                              a_B, a_n, a_strideB,
+                              0.0, a_C, a_n, l_strideC, a_batch);
+#else
+    size_t l_work = a_batch * a_m * a_n * a_k;
+    int l_numThreads = Threading::ThreadsFor(Threading::GEMM, l_work);
+    if (l_numThreads > 1 && a_batch >= (size_t)l_numThreads)
+    {
+        // Enough products to keep every thread busy with whole ones. BLAS stays out
+        // of the worker threads so it doesn't start threads of its own.
+        const GemmKernel* l_small = Find("small");
+        TGemmFn l_fn = l_small->supports(a_m, a_n, a_k) ? l_small->fn : &GemmKernels::Blocked;
+        Threading::ParallelFor(Threading::GEMM, a_batch, [&](size_t a_begin, size_t a_end) {
+            for (size_t b = a_begin; b < a_end; ++b)
+            {
+                l_fn(a_m, a_n, a_k, a_A + b * a_strideA, a_B + b * a_strideB, a_C + b * l_strideC);
+            }
+        }, l_work);
+        return;
+    }
+
+    // Few big products, or too little work to fork, each one gets the whole machine.
+    // The kernel is picked once for the shape, not once per product.
+    const GemmKernel& l_kernel = GemmAutotuner::Instance().Select(a_m, a_n, a_k);
+    for (size_t b = 0; b < a_batch; ++b)
+    {
+        l_kernel.fn(a_m, a_n, a_k, a_A + b * a_strideA, a_B + b * a_strideB, a_C + b * l_strideC);
+    }
+#endif
+}
+
+} // namespace neural
@@ -0,0 +1,474 @@
+/*
+ * Gzip Stream Implementation
+ *
+ */
+
+#include "neural/data/gzip_stream.h"
+
+#include <glog/logging.h>
+#include <zlib.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+// Compressed bytes read from the file at a time, and decompressed bytes the
+// background thread hands over to the ring at a time
+static const size_t kInputBytes = 64 << 10;
+static const size_t kChunkBytes = 64 << 10;
+
+// Readers keep this much of the ring behind them, so reads that come in a
+// little out of order (ie. from several threads) still hit it
+static size_t KeepBehind(size_t a_ringBytes)
+{
+    return a_ringBytes / 4;
+}
+
+// One inflate from the start of the file or from an access point
+class GzipStream::Inflater
+{
+public:
+    explicit Inflater(GzipStream& a_stream)
+        : m_stream(a_stream)
+        , m_inited(false)
+        , m_ended(false)
+        , m_inPos(0)
+        , m_out(0)
+        , m_input(kInputBytes)
+        , m_history(kWindowBytes)
+        , m_historyTotal(0)
+    {
+
+    }
+
+    ~Inflater()
+    {
+        if (m_inited)
+        {
+            inflateEnd(&m_zs);
+        }
+    }
+
+    void Start(const TAccessPointPtr& a_point)
+    {
+        if (m_inited)
+        {
+            inflateEnd(&m_zs);
+            m_inited = false;
+        }
+        memset(&m_zs, 0, sizeof(m_zs));
+        m_ended = false;
+        m_historyTotal = 0;
+
+        if (!a_point)
+        {
+            // 15 bit window, +32 reads the gzip (or zlib) header itself
+            p_Check(inflateInit2(&m_zs, 15 + 32), "inflateInit2");
+            m_inited = true;
+            m_inPos = 0;
+            m_out = 0;
+            return;
+        }
+
+        // Raw deflate from the middle of the stream, the block may start part
+        // way into a byte and refers back to the window before it
+        p_Check(inflateInit2(&m_zs, -15), "inflateInit2");
+        m_inited = true;
+        m_inPos = a_point->in;
+        m_out = a_point->out;
+        if (a_point->bits > 0)
+        {
+            uint8_t l_byte = 0;
+            --m_inPos;
+            if (pread(m_stream.m_fd, &l_byte, 1, m_inPos) != 1)
+            {
+                m_stream.p_Throw("can't read the access point at " + to_string(m_inPos));
+            }
+            ++m_inPos;
+            p_Check(inflatePrime(&m_zs, a_point->bits, l_byte >> (8 - a_point->bits)), "inflatePrime");
+        }
+        p_Check(inflateSetDictionary(&m_zs, a_point->window.data(), a_point->window.size()), "inflateSetDictionary");
+        p_Remember(a_point->window.data(), a_point->window.size());
+    }
+
+    // Up to a_size bytes, fewer only at the end of the stream. With a_index
+    // access points are added to the stream's index on the way.
+    size_t Read(uint8_t* a_out, size_t a_size, bool a_index)
+    {
+        size_t l_done = 0;
+        while (l_done < a_size && !m_ended)
+        {
+            if (m_zs.avail_in == 0)
+            {
+                p_FillInput();
+            }
+
+            size_t l_want = std::min(a_size - l_done, (size_t)1 << 30);
+            m_zs.next_out = a_out + l_done;
+            m_zs.avail_out = l_want;
+            int l_ret = inflate(&m_zs, Z_BLOCK);
+            size_t l_produced = l_want - m_zs.avail_out;
+            p_Remember(a_out + l_done, l_produced);
+            l_done += l_produced;
+            m_out += l_produced;
+
+            if (l_ret == Z_STREAM_END)
+            {
+                m_ended = true;
+            }
+            else if (l_ret != Z_OK && l_ret != Z_BUF_ERROR)
+            {
+                m_stream.p_Throw(string("is corrupt: ") + (m_zs.msg ? m_zs.msg : "inflate failed"));
+            }
+
+            // Between two blocks and not after the last one, ie. somewhere we can restart
+            bool l_atBlock = (m_zs.data_type & 128) && !(m_zs.data_type & 64);
+            if (a_index && l_atBlock && m_stream.p_WantsPoint(m_out))
+            {
+                shared_ptr<AccessPoint> l_point(new AccessPoint());
+                l_point->out = m_out;
+                l_point->in = m_inPos - m_zs.avail_in;
+                l_point->bits = m_zs.data_type & 7;
+                l_point->window = p_Window();
+                m_stream.p_AddPoint(l_point);
+            }
+        }
+        return l_done;
+    }
+
+    // Inflates and drops everything up to decompressed offset a_offset
+    void SkipTo(size_t a_offset)
+    {
+        vector<uint8_t> l_scratch(kChunkBytes);
+        while (m_out < a_offset)
+        {
+            if (Read(l_scratch.data(), std::min(l_scratch.size(), a_offset - m_out), false) == 0)
+            {
+                m_stream.p_Throw("ends before byte " + to_string(a_offset));
+            }
+        }
+    }
+
+    size_t Out() const
+    {
+        return m_out;
+    }
+
+private:
+    GzipStream& m_stream;
+    z_stream m_zs;
+    bool m_inited;
+    bool m_ended;
+    // Next compressed byte to read, and decompressed bytes so far
+    uint64_t m_inPos;
+    uint64_t m_out;
+    std::vector<uint8_t> m_input;
+    // Last kWindowBytes of output, circular
+    std::vector<uint8_t> m_history;
+    uint64_t m_historyTotal;
+
+    void p_Check(int a_ret, const char* a_what)
+    {
+        if (a_ret != Z_OK)
+        {
+            m_stream.p_Throw(string(a_what) + " failed: " + (m_zs.msg ? m_zs.msg : to_string(a_ret)));
+        }
+    }
+
+    void p_FillInput()
+    {
+        ssize_t l_read = 0;
+        do
+        {
+            l_read = pread(m_stream.m_fd, m_input.data(), m_input.size(), m_inPos);
+        } while (l_read < 0 && errno == EINTR);
+
+        if (l_read < 0)
+        {
+            m_stream.p_Throw(string("can't be read: ") + strerror(errno));
+        }
+        if (l_read == 0)
+        {
+            m_stream.p_Throw("ends in the middle of the compressed stream");
+        }
+        m_inPos += l_read;
+        m_zs.next_in = m_input.data();
+        m_zs.avail_in = l_read;
+    }
+
+    void p_Remember(const uint8_t* a_data, size_t a_size)
+    {
+        if (a_size >= kWindowBytes)
+        {
+            a_data += a_size - kWindowBytes;
+            m_historyTotal += a_size - kWindowBytes;
+            a_size = kWindowBytes;
+        }
+        for (size_t l_done = 0; l_done < a_size;)
+        {
+            size_t l_pos = m_historyTotal % kWindowBytes;
+            size_t l_count = std::min(a_size - l_done, kWindowBytes - l_pos);
+            memcpy(m_history.data() + l_pos, a_data + l_done, l_count);
+            l_done += l_count;
+            m_historyTotal += l_count;
+        }
+    }
+
+    vector<uint8_t> p_Window() const
+    {
+        size_t l_size = std::min((size_t)m_historyTotal, kWindowBytes);
+        size_t l_start = (m_historyTotal - l_size) % kWindowBytes;
+        vector<uint8_t> l_window(l_size);
+        for (size_t i = 0; i < l_size; ++i)
+        {
+            l_window[i] = m_history[(l_start + i) % kWindowBytes];
+        }
+        return l_window;
+    }
+};
+
+GzipStream::GzipStream(int a_fd, const std::string& a_path, size_t a_ringBytes)
+    : m_fd(a_fd)
+    , m_path(a_path)
+    , m_ring(std::max(a_ringBytes, 2 * kChunkBytes))
+    , m_ringBegin(0)
+    , m_ringEnd(0)
+    , m_atEnd(false)
+    , m_restartAt(0)
+    , m_generation(0)
+    , m_lastMissEnd((size_t)-1)
+    , m_started(false)
+    , m_stop(false)
+{
+
+}
+
+GzipStream::~GzipStream()
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void GzipStream::Read(size_t a_offset, size_t a_size, uint8_t* a_out)
+{
+    size_t l_end = a_offset + a_size;
+    size_t l_pos = a_offset;
+    {
+        unique_lock<mutex> l_lock(m_mutex);
+        if (!m_started)
+        {
+            m_started = true;
+            m_thread = thread(&GzipStream::p_Produce, this);
+        }
+
+        // Hit if it starts in the ring or right where the thread is writing
+        bool l_inRing = l_pos >= m_ringBegin && l_pos <= m_ringEnd;
+        while (l_inRing && l_pos < l_end)
+        {
+            // Let the thread reuse what is far enough behind us
+            size_t l_keep = KeepBehind(m_ring.size());
+            m_ringBegin = std::max(m_ringBegin, l_pos > l_keep ? l_pos - l_keep : 0);
+            m_cond.notify_all();
+            m_cond.wait(l_lock, [&]() {
+                return m_ringEnd > l_pos || m_atEnd || l_pos < m_ringBegin || l_pos > m_ringEnd;
+            });
+
+            l_inRing = l_pos >= m_ringBegin && l_pos <= m_ringEnd;
+            if (l_inRing && m_ringEnd == l_pos)
+            {
+                p_Throw(m_error.empty() ? "ends before byte " + to_string(l_end) : m_error);
+            }
+
+            size_t l_count = l_inRing ? std::min(m_ringEnd, l_end) - l_pos : 0;
+            for (size_t l_done = 0; l_done < l_count;)
+            {
+                size_t l_ringPos = (l_pos + l_done) % m_ring.size();
+                size_t l_piece = std::min(l_count - l_done, m_ring.size() - l_ringPos);
+                memcpy(a_out + (l_pos - a_offset) + l_done, m_ring.data() + l_ringPos, l_piece);
+                l_done += l_piece;
+            }
+            l_pos += l_count;
+        }
+
+        if (l_pos == l_end)
+        {
+            return;
+        }
+    }
+
+    // Missed, or the thread moved away under us
+    ReadDirect(l_pos, l_end - l_pos, a_out + (l_pos - a_offset));
+
+    // Two misses in a row that follow each other look like a new sequential
+    // pass (ie. the next epoch), move the thread there
+    lock_guard<mutex> l_lock(m_mutex);
+    if (l_pos == m_lastMissEnd)
+    {
+        m_restartAt = l_end;
+        ++m_generation;
+        m_cond.notify_all();
+    }
+    m_lastMissEnd = l_end;
+}
+
+void GzipStream::ReadDirect(size_t a_offset, size_t a_size, uint8_t* a_out)
+{
+    Inflater l_inflater(*this);
+    l_inflater.Start(p_NearestPoint(a_offset));
+    l_inflater.SkipTo(a_offset);
+    if (l_inflater.Read(a_out, a_size, false) < a_size)
+    {
+        p_Throw("ends before byte " + to_string(a_offset + a_size));
+    }
+}
+
+size_t GzipStream::BuildIndex()
+{
+    // Carry on from the last point anyone got to
+    Inflater l_inflater(*this);
+    l_inflater.Start(p_NearestPoint((size_t)-1));
+    vector<uint8_t> l_scratch(kChunkBytes);
+    while (l_inflater.Read(l_scratch.data(), l_scratch.size(), true) == l_scratch.size())
+    {
+    }
+    return l_inflater.Out();
+}
+
+size_t GzipStream::NumAccessPoints() const
+{
+    lock_guard<mutex> l_lock(m_indexMutex);
+    return m_index.size();
+}
+
+void GzipStream::p_Produce()
+{
+    Inflater l_inflater(*this);
+    vector<uint8_t> l_chunk(kChunkBytes);
+    size_t l_generation = (size_t)-1;
+
+    unique_lock<mutex> l_lock(m_mutex);
+    while (true)
+    {
+        m_cond.wait(l_lock, [&]() {
+            return m_stop || m_generation != l_generation ||
+                   (!m_atEnd && m_ringEnd - m_ringBegin < m_ring.size());
+        });
+        if (m_stop)
+        {
+            return;
+        }
+
+        string l_error;
+        if (m_generation != l_generation)
+        {
+            // Start over from the access point before where the reader is
+            l_generation = m_generation;
+            size_t l_restartAt = m_restartAt;
+            l_lock.unlock();
+            try
+            {
+                l_inflater.Start(l_restartAt == 0 ? TAccessPointPtr() : p_NearestPoint(l_restartAt));
+            }
+            catch (const exception& e)
+            {
+                l_error = e.what();
+            }
+            l_lock.lock();
+            if (m_generation == l_generation)
+            {
+                m_ringBegin = l_inflater.Out();
+                m_ringEnd = l_inflater.Out();
+                m_atEnd = !l_error.empty();
+                m_error = l_error;
+                m_cond.notify_all();
+            }
+            continue;
+        }
+
+        size_t l_want = std::min(l_chunk.size(), m_ring.size() - (m_ringEnd - m_ringBegin));
+        l_lock.unlock();
+        size_t l_count = 0;
+        try
+        {
+            l_count = l_inflater.Read(l_chunk.data(), l_want, true);
+        }
+        catch (const exception& e)
+        {
+            l_error = e.what();
+        }
+        l_lock.lock();
+
+        // Moved while we were inflating, what we have is for the old place
+        if (m_generation != l_generation)
+        {
+            continue;
+        }
+
+        for (size_t l_done = 0; l_done < l_count;)
+        {
+            size_t l_ringPos = (m_ringEnd + l_done) % m_ring.size();
+            size_t l_piece = std::min(l_count - l_done, m_ring.size() - l_ringPos);
+            memcpy(m_ring.data() + l_ringPos, l_chunk.data() + l_done, l_piece);
+            l_done += l_piece;
+        }
+        m_ringEnd += l_count;
+        if (l_count < l_want || !l_error.empty())
+        {
+            m_atEnd = true;
+            m_error = l_error;
+        }
+        m_cond.notify_all();
+    }
+}
+
+GzipStream::TAccessPointPtr GzipStream::p_NearestPoint(size_t a_offset) const
+{
+    lock_guard<mutex> l_lock(m_indexMutex);
+    auto l_after = upper_bound(m_index.begin(), m_index.end(), a_offset,
+        [](size_t a_value, const TAccessPointPtr& a_point) { return a_value < a_point->out; });
+    return l_after == m_index.begin() ? TAccessPointPtr() : *(l_after - 1);
+}
+
+bool GzipStream::p_WantsPoint(size_t a_out) const
+{
+    lock_guard<mutex> l_lock(m_indexMutex);
+    size_t l_last = m_index.empty() ? 0 : m_index.back()->out;
+    return a_out >= l_last + kSpan;
+}
+
+void GzipStream::p_AddPoint(const TAccessPointPtr& a_point)
+{
+    // Someone else may have got there first
+    lock_guard<mutex> l_lock(m_indexMutex);
+    size_t l_last = m_index.empty() ? 0 : m_index.back()->out;
+    if (a_point->out >= l_last + kSpan)
+    {
+        m_index.push_back(a_point);
+    }
+}
+
+void GzipStream::p_Throw(const std::string& a_what) const
+{
+    stringstream l_ss;
+    l_ss << "GzipStream " << m_path << " " << a_what;
+    LOG(ERROR) << l_ss.str() << endl;
+    throw(runtime_error(l_ss.str()));
+}
+
+} // namespace neural
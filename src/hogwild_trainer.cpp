@@ -0,0 +1,243 @@
+/*
+ * Hogwild Trainer Implementation
+ *
+ */
+
+#include "neural/train/hogwild_trainer.h"
+#include "neural/loss/squared_error_loss.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace neural
+{
+
+// Progress of one worker, only ever written by that worker.
+// Padded to its own cache line so workers don't invalidate each other.
+struct alignas(64) WorkerProgress
+{
+    atomic<size_t> examples;
+    atomic<double> lossSum;
+
+    // Plain new (and std::vector) doesn't honour the alignment before C++17
+    static void* operator new(size_t a_size)
+    {
+        void* l_ptr = nullptr;
+        if (posix_memalign(&l_ptr, 64, a_size) != 0)
+        {
+            throw(bad_alloc());
+        }
+        return l_ptr;
+    }
+
+    static void operator delete(void* a_ptr)
+    {
+        free(a_ptr);
+    }
+};
+
+HogwildTrainer::HogwildTrainer(Sequential& a_model, size_t a_numWorkers)
+    : m_model(a_model)
+    , m_numWorkers(a_numWorkers > 0 ? a_numWorkers : 1)
+    , m_totalExamples(0)
+    , m_totalSeconds(0.0)
+{
+
+}
+
+void HogwildTrainer::Train(
+    size_t a_numExamples, const TExampleFn& a_example,
+    float a_learningRate, double a_reportSeconds)
+{
+    // Workers walk the layers themselves and need every activation
+    if (m_model.CheckpointBudget() != 0)
+    {
+        stringstream l_ss;
+        l_ss << "HogwildTrainer::Train doesn't support a model with a checkpoint budget";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    // Weights shared with a clone or a snapshot would be copied by the first
+    // write, and every worker writing at once would race to do it, so each
+    // layer gets a buffer of its own up front
+    for (const TLayerPtr& l_layer : m_model.Layers())
+    {
+        if (l_layer->HasWeights() && l_layer->Weights()->IsShared())
+        {
+            TTensorPtr l_weights = l_layer->Weights();
+            l_layer->SetWeights(Tensor::New(l_weights->Shape(), l_weights->Data()));
+        }
+    }
+
+    atomic<size_t> l_nextExample(0);
+    atomic<size_t> l_numRunning(m_numWorkers);
+    vector<unique_ptr<WorkerProgress>> l_progress;
+    for (size_t w = 0; w < m_numWorkers; ++w)
+    {
+        l_progress.emplace_back(new WorkerProgress());
+        l_progress.back()->examples = 0;
+        l_progress.back()->lossSum = 0.0;
+    }
+
+    mutex l_doneMutex;
+    condition_variable l_doneCond;
+    exception_ptr l_error;
+
+    // Workers each call BLAS on tiny matrices, BLAS threads would only get in the way
+    Threading::BlasThreadsScope l_blas(1);
+
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    vector<thread> l_workers;
+    for (size_t w = 0; w < m_numWorkers; ++w)
+    {
+        l_workers.emplace_back([&, w]() {
+            Threading::SerialScope l_serial;
+            const vector<TLayerPtr>& l_layers = m_model.Layers();
+            SquaredErrorLoss l_loss;
+            vector<TTensorPtr> l_activations;
+            WorkerProgress& l_myProgress = *l_progress[w];
+
+            try
+            {
+                for (size_t i = l_nextExample++; i < a_numExamples; i = l_nextExample++)
+                {
+                    TMutableTensorPtr l_input, l_output;
+                    if (!a_example(i, l_input, l_output))
+                    {
+                        continue;
+                    }
+                    float l_target = l_output->View<2>()(0, 0);
+
+                    TTensorPtr l_pred = m_model.Forward(l_input, l_activations);
+                    float l_predVal = l_pred->View<2>()(0, 0);
+                    float l_lossVal = l_loss.Forward(l_predVal, l_target);
+
+                    // Backward, writing each layer's update as soon as we have it
+                    TTensorPtr l_grad = Tensor::New({1, 1}, {l_loss.Backward(l_predVal, l_target)});
+                    l_loss.ZeroGrad();
+                    for (size_t l = l_layers.size(); l > 0; --l)
+                    {
+                        TTensorPtr l_weightGrad;
+                        l_grad = l_layers[l - 1]->CalcGradients(l_activations[l - 1], l_grad, l_weightGrad);
+                        if (l_weightGrad)
+                        {
+                            l_layers[l - 1]->ApplyGradient(l_weightGrad, a_learningRate);
+                        }
+                    }
+
+                    // Single writer, so a load and a store is enough
+                    l_myProgress.lossSum.store(l_myProgress.lossSum.load(memory_order_relaxed) + l_lossVal, memory_order_relaxed);
+                    l_myProgress.examples.store(l_myProgress.examples.load(memory_order_relaxed) + 1, memory_order_release);
+                }
+            }
+            catch (...)
+            {
+                // Keep the first error and stop the other workers at their next example
+                lock_guard<mutex> l_lock(l_doneMutex);
+                if (!l_error)
+                {
+                    l_error = current_exception();
+                }
+                l_nextExample = a_numExamples;
+            }
+
+            if (--l_numRunning == 0)
+            {
+                lock_guard<mutex> l_lock(l_doneMutex);
+                l_doneCond.notify_all();
+            }
+        });
+    }
+
+    // Sample the workers' progress for the convergence curve while they run
+    size_t l_lastExamples = 0;
+    double l_lastLossSum = 0.0;
+    bool l_done = false;
+    while (!l_done)
+    {
+        {
+            unique_lock<mutex> l_lock(l_doneMutex);
+            l_done = l_doneCond.wait_for(l_lock, chrono::duration<double>(a_reportSeconds),
+                                         [&]() { return l_numRunning == 0; });
+        }
+
+        size_t l_examples = 0;
+        double l_lossSum = 0.0;
+        for (const unique_ptr<WorkerProgress>& l_worker : l_progress)
+        {
+            l_examples += l_worker->examples.load(memory_order_acquire);
+            l_lossSum += l_worker->lossSum.load(memory_order_relaxed);
+        }
+
+        if (l_examples > l_lastExamples)
+        {
+            chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+            TrainingCurvePoint l_point;
+            l_point.examples = m_totalExamples + l_examples;
+            l_point.seconds = m_totalSeconds + l_elapsed.count();
+            l_point.avgLoss = (l_lossSum - l_lastLossSum) / (double)(l_examples - l_lastExamples);
+            m_curve.push_back(l_point);
+            LOG(INFO) << "Hogwild examples: " << l_point.examples
+                      << " seconds: " << l_point.seconds
+                      << " avgError: " << l_point.avgLoss << endl;
+
+            l_lastExamples = l_examples;
+            l_lastLossSum = l_lossSum;
+        }
+    }
+
+    for (thread& l_worker : l_workers)
+    {
+        l_worker.join();
+    }
+
+    if (l_error)
+    {
+        rethrow_exception(l_error);
+    }
+
+    chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+    m_totalExamples += l_lastExamples;
+    m_totalSeconds += l_elapsed.count();
+}
+
+void HogwildTrainer::Train(
+    const MNISTDataloader& a_dataloader,
+    float a_learningRate, double a_reportSeconds)
+{
+    Train(a_dataloader.DataLength(),
+          [&a_dataloader](size_t i, TMutableTensorPtr& a_input, TMutableTensorPtr& a_output) {
+              return a_dataloader.DataAt(i, a_input, a_output);
+          },
+          a_learningRate, a_reportSeconds);
+}
+
+const std::vector<TrainingCurvePoint>& HogwildTrainer::Curve() const
+{
+    return m_curve;
+}
+
+double HogwildTrainer::ExamplesPerSecond() const
+{
+    if (m_totalSeconds <= 0.0)
+    {
+        return 0.0;
+    }
+    return m_totalExamples / m_totalSeconds;
+}
+
+} // namespace neural
@@ -0,0 +1,459 @@
+/*
+ * IDX File Implementation
+ *
+ */
+
+#include "neural/data/idx_file.h"
+#include "neural/data/gzip_stream.h"
+
+#include <glog/logging.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+// Values are converted this many bytes at a time, small enough that the pread
+// buffer stays in L2 and big enough that a syscall is nothing next to it
+static const size_t kChunkBytes = 1 << 20;
+
+static const size_t kDefaultReadAhead = 8 << 20;
+
+static uint32_t ReadBigEndian32(const uint8_t* a_bytes)
+{
+    return ((uint32_t)a_bytes[0] << 24) | ((uint32_t)a_bytes[1] << 16) |
+           ((uint32_t)a_bytes[2] << 8) | (uint32_t)a_bytes[3];
+}
+
+static uint64_t ReadBigEndian64(const uint8_t* a_bytes)
+{
+    return ((uint64_t)ReadBigEndian32(a_bytes) << 32) | ReadBigEndian32(a_bytes + 4);
+}
+
+static size_t PageSize()
+{
+    static const size_t s_pageSize = sysconf(_SC_PAGESIZE);
+    return s_pageSize;
+}
+
+IdxFile::IdxFile(const std::string& a_path, EAccess a_access)
+    : m_path(a_path)
+    , m_type(UINT8)
+    , m_access(a_access)
+    , m_itemSize(0)
+    , m_headerBytes(0)
+    , m_fileBytes(0)
+    , m_fd(-1)
+    , m_map(nullptr)
+    , m_dropBehind(false)
+    , m_readAhead(kDefaultReadAhead)
+    , m_lastEnd(0)
+    , m_hintedUpTo(0)
+{
+    m_fd = open(m_path.c_str(), O_RDONLY);
+    p_Check(m_fd >= 0, "open");
+
+    struct stat l_stat;
+    if (fstat(m_fd, &l_stat) != 0)
+    {
+        close(m_fd);
+        p_Check(false, "fstat");
+    }
+    m_fileBytes = l_stat.st_size;
+
+    try
+    {
+        // Gzip magic, the size we go by is the decompressed one from the
+        // trailer (mod 2^32, see p_ReadHeader)
+        uint8_t l_gzip[4] = {0, 0, 0, 0};
+        if (m_fileBytes >= 18)
+        {
+            p_Pread(0, 2, l_gzip);
+        }
+        if (l_gzip[0] == 0x1f && l_gzip[1] == 0x8b)
+        {
+            p_Pread(m_fileBytes - sizeof(l_gzip), sizeof(l_gzip), l_gzip);
+            m_fileBytes = ((uint32_t)l_gzip[3] << 24) | ((uint32_t)l_gzip[2] << 16) |
+                          ((uint32_t)l_gzip[1] << 8) | (uint32_t)l_gzip[0];
+            m_access = GZIP;
+            m_gzip.reset(new GzipStream(m_fd, m_path));
+        }
+        else if (m_access == GZIP)
+        {
+            m_access = PREAD;
+        }
+        p_ReadHeader();
+    }
+    catch (...)
+    {
+        m_gzip.reset();
+        close(m_fd);
+        throw;
+    }
+
+    if (m_access == MMAP && m_fileBytes > 0)
+    {
+        void* l_map = mmap(nullptr, m_fileBytes, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (l_map == MAP_FAILED)
+        {
+            LOG(WARNING) << "IdxFile could not map " << m_path << ": " << strerror(errno)
+                         << ", reading it with pread" << endl;
+            m_access = PREAD;
+        }
+        else
+        {
+            m_map = static_cast<const uint8_t*>(l_map);
+            // We hint the windows ourselves, the kernel's own read around on
+            // every fault would just fight them on random access
+            madvise(l_map, m_fileBytes, MADV_RANDOM);
+        }
+    }
+
+    // Dropping behind only pays off when the file couldn't stay cached anyway,
+    // otherwise the next epoch would read it from disk again
+    size_t l_physBytes = (size_t)sysconf(_SC_PHYS_PAGES) * PageSize();
+    m_dropBehind = !m_gzip && m_fileBytes > l_physBytes / 2;
+}
+
+IdxFile::~IdxFile()
+{
+    // Stops its thread before the file goes away under it
+    m_gzip.reset();
+    if (m_map)
+    {
+        munmap(const_cast<uint8_t*>(m_map), m_fileBytes);
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+const std::string& IdxFile::Path() const
+{
+    return m_path;
+}
+
+IdxFile::EType IdxFile::Type() const
+{
+    return m_type;
+}
+
+IdxFile::EAccess IdxFile::Access() const
+{
+    return m_access;
+}
+
+const std::vector<size_t>& IdxFile::Shape() const
+{
+    return m_shape;
+}
+
+size_t IdxFile::NumItems() const
+{
+    return m_shape[0];
+}
+
+size_t IdxFile::ItemSize() const
+{
+    return m_itemSize;
+}
+
+size_t IdxFile::TypeSize(EType a_type)
+{
+    switch (a_type)
+    {
+    case UINT8:
+    case INT8:
+        return 1;
+    case INT16:
+        return 2;
+    case INT32:
+    case FLOAT32:
+        return 4;
+    case FLOAT64:
+        return 8;
+    }
+    return 0;
+}
+
+void IdxFile::ReadItems(size_t a_begin, size_t a_end, float* a_out) const
+{
+    if (a_begin > a_end || a_end > NumItems())
+    {
+        stringstream l_ss;
+        l_ss << "IdxFile::ReadItems cannot read items [" << a_begin << ", " << a_end
+             << ") of " << NumItems() << " in " << m_path;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t l_typeSize = TypeSize(m_type);
+    size_t l_offset = m_headerBytes + a_begin * m_itemSize * l_typeSize;
+    size_t l_count = (a_end - a_begin) * m_itemSize;
+    if (!m_gzip)
+    {
+        p_Hint(l_offset, l_count * l_typeSize);
+    }
+
+    if (m_map)
+    {
+        p_Convert(m_map + l_offset, l_count, a_out);
+        return;
+    }
+
+    // Chunk by chunk through one buffer, so a huge range doesn't need a huge
+    // second copy of itself in bytes
+    size_t l_valuesPerChunk = kChunkBytes / l_typeSize;
+    vector<uint8_t> l_buffer(std::min(l_count, l_valuesPerChunk) * l_typeSize);
+    for (size_t i = 0; i < l_count; i += l_valuesPerChunk)
+    {
+        size_t l_numValues = std::min(l_valuesPerChunk, l_count - i);
+        p_ReadBytes(l_offset + i * l_typeSize, l_numValues * l_typeSize, l_buffer.data());
+        p_Convert(l_buffer.data(), l_numValues, a_out + i);
+    }
+}
+
+void IdxFile::SetReadAhead(size_t a_bytes)
+{
+    m_readAhead = a_bytes;
+}
+
+size_t IdxFile::ReadAhead() const
+{
+    return m_readAhead;
+}
+
+void IdxFile::BuildIndex()
+{
+    if (m_gzip)
+    {
+        m_gzip->BuildIndex();
+    }
+}
+
+void IdxFile::p_Check(bool a_ok, const std::string& a_what) const
+{
+    if (!a_ok)
+    {
+        stringstream l_ss;
+        l_ss << "IdxFile " << a_what << " " << m_path << ": " << strerror(errno);
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+void IdxFile::p_Pread(size_t a_offset, size_t a_size, uint8_t* a_out) const
+{
+    size_t l_done = 0;
+    while (l_done < a_size)
+    {
+        ssize_t l_read = pread(m_fd, a_out + l_done, a_size - l_done, a_offset + l_done);
+        if (l_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (l_read == 0)
+        {
+            errno = EIO;
+        }
+        p_Check(l_read > 0, "pread");
+        l_done += l_read;
+    }
+}
+
+void IdxFile::p_ReadBytes(size_t a_offset, size_t a_size, uint8_t* a_out) const
+{
+    if (m_gzip)
+    {
+        m_gzip->Read(a_offset, a_size, a_out);
+    }
+    else
+    {
+        p_Pread(a_offset, a_size, a_out);
+    }
+}
+
+void IdxFile::p_ReadHeader()
+{
+    /*
+    [offset] [type]          [description]
+    0000     2 bytes         always 0
+    0002     unsigned byte   type code, 0x08 uint8 ... 0x0E float64
+    0003     unsigned byte   number of dimensions
+    0004     32 bit integer  size of dimension 0, MSB first
+    ........
+    xxxx     values, MSB first
+    */
+    // Read once, so on the calling thread, a GzipStream only starts its
+    // thread when the values are read (ie. after the tool forks)
+    auto l_read = [this](size_t a_offset, size_t a_size, uint8_t* a_out) {
+        if (m_gzip)
+        {
+            m_gzip->ReadDirect(a_offset, a_size, a_out);
+        }
+        else
+        {
+            p_Pread(a_offset, a_size, a_out);
+        }
+    };
+
+    stringstream l_ss;
+    uint8_t l_magic[4];
+    if (m_fileBytes < sizeof(l_magic))
+    {
+        l_ss << "IdxFile " << m_path << " is too short for a magic number";
+    }
+    else
+    {
+        l_read(0, sizeof(l_magic), l_magic);
+        m_type = (EType)l_magic[2];
+        if (l_magic[0] != 0 || l_magic[1] != 0 || TypeSize(m_type) == 0 || l_magic[3] == 0)
+        {
+            l_ss << "IdxFile " << m_path << " has a bad magic number 0x" << std::hex
+                 << ReadBigEndian32(l_magic);
+        }
+    }
+
+    if (l_ss.str().empty())
+    {
+        size_t l_rank = l_magic[3];
+        m_headerBytes = sizeof(l_magic) + l_rank * sizeof(uint32_t);
+        if (m_fileBytes < m_headerBytes)
+        {
+            l_ss << "IdxFile " << m_path << " is too short for " << l_rank << " dimensions";
+        }
+        else
+        {
+            vector<uint8_t> l_dims(l_rank * sizeof(uint32_t));
+            l_read(sizeof(l_magic), l_dims.size(), l_dims.data());
+            m_itemSize = 1;
+            for (size_t i = 0; i < l_rank; ++i)
+            {
+                m_shape.push_back(ReadBigEndian32(l_dims.data() + i * sizeof(uint32_t)));
+                m_itemSize *= i > 0 ? m_shape.back() : 1;
+            }
+
+            // Gzip only keeps the size mod 2^32, past that a short file is
+            // only found when it's read
+            size_t l_expected = m_headerBytes + m_shape[0] * m_itemSize * TypeSize(m_type);
+            bool l_knownSize = !m_gzip || (l_expected >> 32) == 0;
+            if (l_knownSize && m_fileBytes < l_expected)
+            {
+                l_ss << "IdxFile " << m_path << " has " << m_fileBytes << " bytes but its header says "
+                     << l_expected;
+            }
+        }
+    }
+
+    if (!l_ss.str().empty())
+    {
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+void IdxFile::p_Hint(size_t a_offset, size_t a_size) const
+{
+    size_t l_end = a_offset + a_size;
+    size_t l_readAhead = m_readAhead;
+    bool l_sequential = m_lastEnd.exchange(l_end) == a_offset;
+    if (!l_sequential || l_readAhead == 0)
+    {
+        return;
+    }
+
+    // Hint the next window once we are half way into the last one, so there is
+    // always about a window in flight. Racing readers at worst hint twice.
+    size_t l_hinted = m_hintedUpTo;
+    if (l_end + l_readAhead / 2 > l_hinted && l_end < m_fileBytes)
+    {
+        size_t l_from = std::max(l_hinted, l_end);
+        size_t l_to = std::min(l_end + l_readAhead, m_fileBytes);
+        m_hintedUpTo = l_to;
+        if (l_from < l_to)
+        {
+            if (m_map)
+            {
+                size_t l_aligned = l_from & ~(PageSize() - 1);
+                madvise(const_cast<uint8_t*>(m_map) + l_aligned, l_to - l_aligned, MADV_WILLNEED);
+            }
+            else
+            {
+                posix_fadvise(m_fd, l_from, l_to - l_from, POSIX_FADV_WILLNEED);
+            }
+        }
+    }
+
+    // Pages a whole window behind us won't be read again this pass
+    if (m_dropBehind && a_offset > l_readAhead)
+    {
+        size_t l_dropEnd = (a_offset - l_readAhead) & ~(PageSize() - 1);
+        size_t l_dropBegin = l_dropEnd > l_readAhead ? l_dropEnd - l_readAhead : 0;
+        if (m_map)
+        {
+            madvise(const_cast<uint8_t*>(m_map) + l_dropBegin, l_dropEnd - l_dropBegin, MADV_DONTNEED);
+        }
+        posix_fadvise(m_fd, l_dropBegin, l_dropEnd - l_dropBegin, POSIX_FADV_DONTNEED);
+    }
+}
+
+void IdxFile::p_Convert(const uint8_t* a_in, size_t a_count, float* a_out) const
+{
+    switch (m_type)
+    {
+    case UINT8:
+        for (size_t i = 0; i < a_count; ++i)
+        {
+            a_out[i] = (float)a_in[i];
+        }
+        break;
+    case INT8:
+        for (size_t i = 0; i < a_count; ++i)
+        {
+            a_out[i] = (float)(int8_t)a_in[i];
+        }
+        break;
+    case INT16:
+        for (size_t i = 0; i < a_count; ++i)
+        {
+            a_out[i] = (float)(int16_t)(((uint16_t)a_in[2 * i] << 8) | a_in[2 * i + 1]);
+        }
+        break;
+    case INT32:
+        for (size_t i = 0; i < a_count; ++i)
+        {
+            a_out[i] = (float)(int32_t)ReadBigEndian32(a_in + 4 * i);
+        }
+        break;
+    case FLOAT32:
+        for (size_t i = 0; i < a_count; ++i)
+        {
+            uint32_t l_bits = ReadBigEndian32(a_in + 4 * i);
+            memcpy(&a_out[i], &l_bits, sizeof(float));
+        }
+        break;
+    case FLOAT64:
+        for (size_t i = 0; i < a_count; ++i)
+        {
+            uint64_t l_bits = ReadBigEndian64(a_in + 8 * i);
+            double l_val;
+            memcpy(&l_val, &l_bits, sizeof(double));
+            a_out[i] = (float)l_val;
+        }
+        break;
+    }
+}
+
+} // namespace neural
@@ -0,0 +1,383 @@
+/*
+ * Inference Server Implementation
+ *
+ */
+
+#include "neural/serve/inference_server.h"
+#include "neural/io/fd_io.h"
+
+#include <glog/logging.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+static const string kTcpPrefix = "tcp:";
+
+// Fills in a sockaddr for a path or tcp:PORT on 127.0.0.1
+static socklen_t MakeAddress(const string& a_address, sockaddr_storage& a_outAddr)
+{
+    memset(&a_outAddr, 0, sizeof(a_outAddr));
+    if (a_address.compare(0, kTcpPrefix.size(), kTcpPrefix) == 0)
+    {
+        sockaddr_in* l_addr = reinterpret_cast<sockaddr_in*>(&a_outAddr);
+        l_addr->sin_family = AF_INET;
+        l_addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        l_addr->sin_port = htons(stoul(a_address.substr(kTcpPrefix.size())));
+        return sizeof(sockaddr_in);
+    }
+
+    sockaddr_un* l_addr = reinterpret_cast<sockaddr_un*>(&a_outAddr);
+    if (a_address.empty() || a_address.size() >= sizeof(l_addr->sun_path))
+    {
+        FdIo::Throw("Inference socket path '" + a_address + "' is empty or too long");
+    }
+    l_addr->sun_family = AF_UNIX;
+    strncpy(l_addr->sun_path, a_address.c_str(), sizeof(l_addr->sun_path) - 1);
+    return sizeof(sockaddr_un);
+}
+
+InferenceServer::InferenceServer(
+    const Sequential& a_model, const std::vector<size_t>& a_inputShape,
+    size_t a_maxBatch, double a_maxWaitSeconds)
+    : m_model(a_model.Clone())
+    , m_inputShape(a_inputShape)
+    , m_inputSize(1)
+    , m_outputSize(0)
+    , m_maxBatch(a_maxBatch)
+    , m_maxWait(chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(a_maxWaitSeconds)))
+    , m_requestsMetric(Metrics::Instance().GetCounter("serve_requests_total"))
+    , m_batchSizeMetric(Metrics::Instance().GetHistogram(
+        "serve_batch_size", "", Histogram::ExponentialBounds(1.0, 2.0, 11)))
+    , m_latencyMetric(Metrics::Instance().GetHistogram("serve_latency_seconds"))
+    , m_numRequests(0)
+    , m_numBatches(0)
+    , m_stop(false)
+    , m_listenFd(-1)
+    , m_tcp(false)
+    , m_numConnections(0)
+{
+    if (a_maxBatch == 0 || a_maxWaitSeconds < 0.0)
+    {
+        stringstream l_ss;
+        l_ss << "InferenceServer needs a batch size and a wait time, got " << a_maxBatch
+             << " and " << a_maxWaitSeconds;
+        FdIo::Throw(l_ss.str());
+    }
+
+    for (size_t l_dim : a_inputShape)
+    {
+        m_inputSize *= l_dim;
+    }
+
+    // One example through the model tells us the size of its output
+    vector<size_t> l_shape(1, 1);
+    l_shape.insert(l_shape.end(), a_inputShape.begin(), a_inputShape.end());
+    m_outputSize = m_model.Forward(Tensor::New(l_shape))->Size();
+
+    m_batchThread = thread(&InferenceServer::p_BatchLoop, this);
+}
+
+InferenceServer::~InferenceServer()
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+
+    if (m_acceptThread.joinable())
+    {
+        m_acceptThread.join();
+    }
+    m_batchThread.join();
+
+    // Connections notice within a poll interval, or right away if they were waiting on a batch
+    {
+        unique_lock<mutex> l_lock(m_mutex);
+        m_connectionsCond.wait(l_lock, [this]() { return m_numConnections == 0; });
+    }
+
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+    }
+    if (!m_socketPath.empty())
+    {
+        unlink(m_socketPath.c_str());
+    }
+}
+
+std::string InferenceServer::Listen(const std::string& a_address)
+{
+    if (m_listenFd >= 0)
+    {
+        FdIo::Throw("InferenceServer is already listening");
+    }
+
+    sockaddr_storage l_addr;
+    socklen_t l_addrLen = MakeAddress(a_address, l_addr);
+    m_tcp = l_addr.ss_family == AF_INET;
+    if (!m_tcp)
+    {
+        // Left over from a server that didn't shut down cleanly
+        unlink(a_address.c_str());
+    }
+
+    m_listenFd = socket(l_addr.ss_family, SOCK_STREAM, 0);
+    int l_on = 1;
+    if (m_tcp)
+    {
+        setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &l_on, sizeof(l_on));
+    }
+    if (m_listenFd < 0 ||
+        ::bind(m_listenFd, (sockaddr*)&l_addr, l_addrLen) != 0 ||
+        listen(m_listenFd, 64) != 0 ||
+        getsockname(m_listenFd, (sockaddr*)&l_addr, &l_addrLen) != 0)
+    {
+        string l_error = strerror(errno);
+        if (m_listenFd >= 0)
+        {
+            close(m_listenFd);
+            m_listenFd = -1;
+        }
+        FdIo::Throw("InferenceServer could not listen on " + a_address + ": " + l_error);
+    }
+
+    string l_address = a_address;
+    if (m_tcp)
+    {
+        l_address = kTcpPrefix + to_string(ntohs(reinterpret_cast<sockaddr_in*>(&l_addr)->sin_port));
+    }
+    else
+    {
+        m_socketPath = a_address;
+    }
+
+    m_acceptThread = thread(&InferenceServer::p_AcceptLoop, this);
+    return l_address;
+}
+
+size_t InferenceServer::InputSize() const
+{
+    return m_inputSize;
+}
+
+size_t InferenceServer::OutputSize() const
+{
+    return m_outputSize;
+}
+
+size_t InferenceServer::NumRequests() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_numRequests;
+}
+
+size_t InferenceServer::NumBatches() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_numBatches;
+}
+
+void InferenceServer::p_BatchLoop()
+{
+    unique_lock<mutex> l_lock(m_mutex);
+    while (true)
+    {
+        m_cond.wait(l_lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_stop)
+        {
+            break;
+        }
+
+        // Fill the batch up until the oldest request has waited long enough.
+        // A connection only has one request out, so once every connection
+        // is queued nothing else can come.
+        chrono::steady_clock::time_point l_deadline = m_queue.front()->arrived + m_maxWait;
+        m_cond.wait_until(l_lock, l_deadline, [this]() {
+            return m_stop || m_queue.size() >= std::min(m_maxBatch, m_numConnections);
+        });
+        if (m_stop)
+        {
+            break;
+        }
+
+        vector<Request*> l_batch;
+        while (!m_queue.empty() && l_batch.size() < m_maxBatch)
+        {
+            l_batch.push_back(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_numRequests += l_batch.size();
+        ++m_numBatches;
+
+        l_lock.unlock();
+        p_RunBatch(l_batch);
+        l_lock.lock();
+    }
+
+    // Nothing can be queued once m_stop is set, so these are the last ones
+    for (Request* l_request : m_queue)
+    {
+        l_request->output.set_exception(make_exception_ptr(runtime_error("InferenceServer stopped")));
+    }
+    m_queue.clear();
+}
+
+void InferenceServer::p_RunBatch(std::vector<Request*>& a_batch)
+{
+    try
+    {
+        vector<size_t> l_shape(1, a_batch.size());
+        l_shape.insert(l_shape.end(), m_inputShape.begin(), m_inputShape.end());
+        TMutableTensorPtr l_inputs = Tensor::New(l_shape);
+        float* l_in = l_inputs->MutableData().data();
+        for (size_t i = 0; i < a_batch.size(); ++i)
+        {
+            copy(a_batch[i]->input.begin(), a_batch[i]->input.end(), l_in + i * m_inputSize);
+        }
+
+        TTensorPtr l_outputs = m_model.Forward(l_inputs);
+        const float* l_out = l_outputs->Data().data();
+        chrono::steady_clock::time_point l_now = chrono::steady_clock::now();
+        for (size_t i = 0; i < a_batch.size(); ++i)
+        {
+            m_latencyMetric.Record(chrono::duration<double>(l_now - a_batch[i]->arrived).count());
+            a_batch[i]->output.set_value(vector<float>(l_out + i * m_outputSize, l_out + (i + 1) * m_outputSize));
+        }
+        m_requestsMetric.Add(a_batch.size());
+        m_batchSizeMetric.Record(a_batch.size());
+    }
+    catch (...)
+    {
+        for (Request* l_request : a_batch)
+        {
+            l_request->output.set_exception(current_exception());
+        }
+    }
+}
+
+void InferenceServer::p_AcceptLoop()
+{
+    FdIo::AcceptLoop(m_listenFd, [this]() { return p_Stopping(); }, [this](int a_fd) {
+        // Responses are small and latency is the point
+        if (m_tcp)
+        {
+            int l_on = 1;
+            setsockopt(a_fd, IPPROTO_TCP, TCP_NODELAY, &l_on, sizeof(l_on));
+        }
+
+        {
+            lock_guard<mutex> l_lock(m_mutex);
+            ++m_numConnections;
+        }
+        thread(&InferenceServer::p_ServeConnection, this, a_fd).detach();
+    });
+}
+
+void InferenceServer::p_ServeConnection(int a_fd)
+{
+    function<bool()> l_stopping = [this]() { return p_Stopping(); };
+    Request l_request;
+    l_request.input.resize(m_inputSize);
+    while (FdIo::ReadFully(a_fd, l_request.input.data(), m_inputSize * sizeof(float), l_stopping))
+    {
+        l_request.output = promise<vector<float>>();
+        future<vector<float>> l_output = l_request.output.get_future();
+        l_request.arrived = chrono::steady_clock::now();
+        {
+            lock_guard<mutex> l_lock(m_mutex);
+            if (m_stop)
+            {
+                break;
+            }
+            m_queue.push_back(&l_request);
+        }
+        m_cond.notify_all();
+
+        vector<float> l_result;
+        try
+        {
+            l_result = l_output.get();
+        }
+        catch (const exception& e)
+        {
+            LOG(WARNING) << "InferenceServer dropping a connection: " << e.what() << endl;
+            break;
+        }
+        if (!FdIo::WriteFully(a_fd, l_result.data(), l_result.size() * sizeof(float)))
+        {
+            break;
+        }
+    }
+    close(a_fd);
+
+    // The batching thread may have been waiting on this connection
+    lock_guard<mutex> l_lock(m_mutex);
+    --m_numConnections;
+    m_connectionsCond.notify_all();
+    m_cond.notify_all();
+}
+
+bool InferenceServer::p_Stopping() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_stop;
+}
+
+InferenceClient::InferenceClient(const std::string& a_address, size_t a_inputSize, size_t a_outputSize)
+    : m_fd(-1)
+    , m_inputSize(a_inputSize)
+    , m_outputSize(a_outputSize)
+{
+    sockaddr_storage l_addr;
+    socklen_t l_addrLen = MakeAddress(a_address, l_addr);
+    m_fd = socket(l_addr.ss_family, SOCK_STREAM, 0);
+    if (m_fd < 0 || connect(m_fd, (sockaddr*)&l_addr, l_addrLen) != 0)
+    {
+        string l_error = strerror(errno);
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+        FdIo::Throw("InferenceClient could not connect to " + a_address + ": " + l_error);
+    }
+
+    if (l_addr.ss_family == AF_INET)
+    {
+        int l_on = 1;
+        setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &l_on, sizeof(l_on));
+    }
+}
+
+InferenceClient::~InferenceClient()
+{
+    close(m_fd);
+}
+
+void InferenceClient::Predict(const float* a_input, float* a_outOutput)
+{
+    if (!FdIo::WriteFully(m_fd, a_input, m_inputSize * sizeof(float)) ||
+        !FdIo::ReadFully(m_fd, a_outOutput, m_outputSize * sizeof(float)))
+    {
+        FdIo::Throw("InferenceClient lost the connection to the server");
+    }
+}
+
+} // namespace neural
@@ -8,16 +8,14 @@
 
 #include <glog/logging.h>
 
-#include <sstream>
-
 using namespace std;
 
 namespace neural
 {
 
 LinearLayer::LinearLayer(const TTensorPtr& a_weights, bool a_hasBias)
-    : m_hasBias(a_hasBias)
-    , m_weights(a_weights->ToMutable()) // weights are learnable, hence mutable
+    : WeightedLayer("LinearLayer", a_weights)
+    , m_hasBias(a_hasBias)
 {
     // if there is a bias, add an extra row to the weights
     if (m_hasBias)
@@ -45,6 +43,16 @@ TTensorPtr LinearLayer::Forward(const TTensorPtr& a_input) const
 }
 
 TTensorPtr LinearLayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
+{
+    TTensorPtr l_weightGrad;
+    TTensorPtr gradWrtOutput = CalcGradients(a_origInput, a_gradInput, l_weightGrad);
+    m_weightGrads.push_back(l_weightGrad);
+    return gradWrtOutput;
+}
+
+TTensorPtr LinearLayer::CalcGradients(
+    const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+    TTensorPtr& a_outWeightGrad) const
 {
     // orig input might have had bias
     TTensorPtr l_input = a_origInput;
@@ -59,73 +67,58 @@ TTensorPtr LinearLayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr
   //  LOG(INFO) << "LinearLayer::Backward transpose inputs " << l_input->ShapeStr() << "^T" << endl;
     TTensorPtr l_inputT = TensorMath::Transpose(l_input);
   //  LOG(INFO) << "LinearLayer::Backward weights gradient computation " << l_inputT->ShapeStr() << "*" << a_gradInput->ShapeStr() << endl;
-    TTensorPtr gradWrtWeights = TensorMath::Multiply(l_inputT, a_gradInput);
-    m_weightGrads.push_back(gradWrtWeights);
+    a_outWeightGrad = TensorMath::Multiply(l_inputT, a_gradInput);
 
-    // Gradient wrt output
-    // Added logging to see speed of transpose operation vs. speed of mat mul
-    //LOG(INFO) << "LinearLayer::Backward transpose m_weights " << m_weights->ShapeStr() << "^T" << endl;
-    TTensorPtr l_weightsT = TensorMath::Transpose(m_weights);
-    //LOG(INFO) << "End LinearLayer::Backward output gradient computation " << a_gradInput->ShapeStr() << "*" << m_weights->ShapeStr() << "^T" << endl;
-    TTensorPtr gradWrtOutput = TensorMath::Multiply(a_gradInput, l_weightsT);
-    //LOG(INFO) << "End LinearLayer::Backward gradient computation" << endl;
+    return p_GradWrtInput(a_gradInput);
+}
 
+TTensorPtr LinearLayer::Forward(const TSparseTensorPtr& a_input) const
+{
+    TSparseTensorPtr l_input = a_input;
     if (m_hasBias)
     {
-        gradWrtOutput = TensorMath::RemoveCol(gradWrtOutput);
+        l_input = l_input->AddCol(1.0);
     }
-
-    return gradWrtOutput;
+    return TensorMath::Multiply(l_input, m_weights);
 }
 
-void LinearLayer::UpdateWeights(float a_learningRate)
+TTensorPtr LinearLayer::Backward(const TSparseTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
 {
-    //LOG(INFO) << "LinearLayer::UpdateWeights Start Update " << m_weights->ShapeStr() << " num grads: " << m_weightGrads.size() << endl;
-    TTensorPtr l_gradient = CalcAvgWeightGrad();
-    //LOG(INFO) << "LinearLayer::UpdateWeights done CalcAvgWeightGrad()" << endl;
-
-    std::vector<float>& l_weightData = m_weights->MutableData();
-    const std::vector<float>& l_gradientData = l_gradient->Data();
-
-    #pragma omp parallel for
-    for (size_t i = 0; i < l_weightData.size(); ++i)
+    TSparseTensorPtr l_input = a_origInput;
+    if (m_hasBias)
     {
-        l_weightData.at(i) -= a_learningRate * l_gradientData.at(i);
+        l_input = l_input->AddCol(1.0);
     }
 
-    // clear gradients
-    m_weightGrads.clear();
-    //LOG(INFO) << "LinearLayer::UpdateWeights End Update " << m_weights->ShapeStr() << endl;
+    // The transpose of CSR input is CSC for free, no dense transpose needed
+    m_weightGrads.push_back(TensorMath::Multiply(l_input->Transpose(), a_gradInput));
+    return p_GradWrtInput(a_gradInput);
 }
 
-TTensorPtr LinearLayer::CalcAvgWeightGrad() const
+TLayerPtr LinearLayer::Clone() const
 {
-    // Init with zeros
-    TMutableTensorPtr average = Tensor::Zeros(m_weightGrads.at(0)->Shape());
-    std::vector<float>& l_averageData = average->MutableData();
-
-    // Sum up
-    for (const TTensorPtr& grad : m_weightGrads)
-    {
-        const std::vector<float>& l_gradientData = grad->Data();
-
-        #pragma omp parallel for
-        for (size_t i = 0; i < l_gradientData.size(); ++i)
-        {
-            l_averageData[i] += l_gradientData[i];
-        }
-    }
+    shared_ptr<LinearLayer> l_clone(new LinearLayer(*this));
+    // Copy constructor shares the weights tensor, the clone needs its own
+    l_clone->m_weights = m_weights->ToMutable();
+    return l_clone;
+}
 
-    // Average
-    float numGrads = (float)m_weightGrads.size();
+TTensorPtr LinearLayer::p_GradWrtInput(const TTensorPtr& a_gradInput) const
+{
+    // Gradient wrt output
+    // Added logging to see speed of transpose operation vs. speed of mat mul
+    //LOG(INFO) << "LinearLayer::Backward transpose m_weights " << m_weights->ShapeStr() << "^T" << endl;
+    TTensorPtr l_weightsT = TensorMath::Transpose(m_weights);
+    //LOG(INFO) << "End LinearLayer::Backward output gradient computation " << a_gradInput->ShapeStr() << "*" << m_weights->ShapeStr() << "^T" << endl;
+    TTensorPtr gradWrtOutput = TensorMath::Multiply(a_gradInput, l_weightsT);
+    //LOG(INFO) << "End LinearLayer::Backward gradient computation" << endl;
 
-    #pragma omp parallel for
-    for (size_t i = 0; i < l_averageData.size(); ++i)
+    if (m_hasBias)
     {
-        l_averageData[i] /= numGrads;
+        gradWrtOutput = TensorMath::RemoveCol(gradWrtOutput);
     }
 
-    return average;
+    return gradWrtOutput;
 }
 
 } // namespace neural
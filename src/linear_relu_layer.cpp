@@ -0,0 +1,258 @@
+/*
+ * Linear ReLU Layer Implementation
+ *
+ */
+
+#include "neural/layers/linear_relu_layer.h"
+#include "neural/math/gemm_autotuner.h"
+#include "neural/math/gemm_kernels.h"
+#include "neural/math/tensor_math.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+// Rows of output per GEMM + epilogue block, same as the blocked GEMM's row
+// block so a block of C is still in L2 when the epilogue gets to it
+static const size_t kEpilogueRows = 32;
+
+LinearReLULayer::LinearReLULayer(const TTensorPtr& a_weights, bool a_hasBias)
+    : LinearLayer(a_weights, a_hasBias)
+    , m_maskCache(new MaskCache())
+{
+
+}
+
+TTensorPtr LinearReLULayer::Forward(const TTensorPtr& a_input) const
+{
+    return p_Forward(a_input, nullptr);
+}
+
+TTensorPtr LinearReLULayer::ForwardForBackward(const TTensorPtr& a_input) const
+{
+    shared_ptr<ReLUMask> l_mask(new ReLUMask());
+    TTensorPtr l_ret = p_Forward(a_input, l_mask.get());
+
+    lock_guard<mutex> l_lock(m_maskCache->mutex);
+    // Drop bits of inputs that are gone without a Backward
+    for (auto l_it = m_maskCache->masks.begin(); l_it != m_maskCache->masks.end();)
+    {
+        l_it = l_it->second.first.expired() ? m_maskCache->masks.erase(l_it) : std::next(l_it);
+    }
+    m_maskCache->masks[a_input.get()] = make_pair(weak_ptr<const Tensor>(a_input), TReLUMaskPtr(l_mask));
+    return l_ret;
+}
+
+TMutableTensorPtr LinearReLULayer::p_Forward(const TTensorPtr& a_input, ReLUMask* a_outMask) const
+{
+    p_CheckInput(a_input);
+    size_t m = a_input->Shape().at(0);
+    size_t k = a_input->Shape().at(1);
+    size_t n = m_weights->Shape().at(1);
+
+    TMutableTensorPtr l_ret = Tensor::New({m, n});
+    if (a_outMask)
+    {
+        a_outMask->rows = m;
+        a_outMask->cols = n;
+        a_outMask->wordsPerRow = (n + 63) / 64;
+        a_outMask->bits.assign(m * a_outMask->wordsPerRow, 0);
+    }
+
+    // The bias is the last weight row, the GEMM just stops before it so the
+    // input needs no column of ones
+    const float* A = a_input->Data().data();
+    const float* B = m_weights->Data().data();
+    float* C = l_ret->MutableData().data();
+
+    size_t l_numBlocks = (m + kEpilogueRows - 1) / kEpilogueRows;
+    int l_numThreads = Threading::ThreadsFor(Threading::GEMM, m * n * k);
+    if (l_numThreads > 1 && l_numBlocks >= (size_t)l_numThreads)
+    {
+        // Every thread runs GEMM and epilogue on its own blocks of rows. BLAS stays
+        // out of the worker threads so it doesn't start threads of its own.
+        const GemmKernel* l_small = GemmKernels::Find("small");
+        TGemmFn l_fn = l_small->supports(kEpilogueRows, n, k) ? l_small->fn : &GemmKernels::Blocked;
+        Threading::ParallelFor(Threading::GEMM, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+            for (size_t b = a_begin; b < a_end; ++b)
+            {
+                size_t i0 = b * kEpilogueRows;
+                size_t l_rows = std::min(kEpilogueRows, m - i0);
+                l_fn(l_rows, n, k, A + i0 * k, B, C + i0 * n);
+                p_Epilogue(C, i0, l_rows, n, a_outMask);
+            }
+        }, m * n * k);
+    }
+    else
+    {
+        // Too few rows to split, ie. one example, the whole machine goes into one
+        // GEMM and the output is small enough to still be in cache after it
+        GemmAutotuner::Instance().Select(m, n, k).fn(m, n, k, A, B, C);
+        Threading::ParallelFor(Threading::ELEMENTWISE, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+            for (size_t b = a_begin; b < a_end; ++b)
+            {
+                size_t i0 = b * kEpilogueRows;
+                p_Epilogue(C, i0, std::min(kEpilogueRows, m - i0), n, a_outMask);
+            }
+        }, m * n);
+    }
+    return l_ret;
+}
+
+TTensorPtr LinearReLULayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
+{
+    TTensorPtr l_weightGrad;
+    TTensorPtr l_gradWrtInput = CalcGradients(a_origInput, a_gradInput, l_weightGrad);
+    m_weightGrads.push_back(l_weightGrad);
+    return l_gradWrtInput;
+}
+
+TTensorPtr LinearReLULayer::CalcGradients(
+    const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+    TTensorPtr& a_outWeightGrad) const
+{
+    p_CheckInput(a_origInput);
+    TReLUMaskPtr l_mask = p_TakeMask(a_origInput);
+    if (!l_mask)
+    {
+        shared_ptr<ReLUMask> l_redone(new ReLUMask());
+        p_Forward(a_origInput, l_redone.get());
+        l_mask = l_redone;
+    }
+
+    size_t m = a_origInput->Shape().at(0);
+    size_t k = a_origInput->Shape().at(1);
+    size_t n = m_weights->Shape().at(1);
+    if (a_gradInput->Shape() != vector<size_t>({m, n}))
+    {
+        stringstream l_ss;
+        l_ss << "LinearReLULayer::CalcGradients gradient shape " << a_gradInput->ShapeStr()
+             << " != output shape " << m << "x" << n;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    // Through the ReLU, the gradient only passes where the output was positive
+    TMutableTensorPtr l_grad = a_gradInput->ToMutable();
+    float* l_gradData = l_grad->MutableData().data();
+    Threading::ParallelFor(Threading::ELEMENTWISE, m, [&](size_t a_begin, size_t a_end) {
+        for (size_t i = a_begin; i < a_end; ++i)
+        {
+            const uint64_t* l_bits = l_mask->bits.data() + i * l_mask->wordsPerRow;
+            float* l_row = l_gradData + i * n;
+            for (size_t j = 0; j < n; ++j)
+            {
+                l_row[j] = ((l_bits[j / 64] >> (j % 64)) & 1) ? l_row[j] : 0.0f;
+            }
+        }
+    }, m * n);
+
+    // Then the same as LinearLayer, the bias row of the gradient is the column sums
+    TTensorPtr l_inputGrad = TensorMath::Multiply(TensorMath::Transpose(a_origInput), l_grad);
+    if (m_hasBias)
+    {
+        TMutableTensorPtr l_weightGrad = Tensor::New(m_weights->Shape());
+        TTensorPtr l_biasGrad = TensorMath::Sum(l_grad, 0);
+        float* l_weightGradData = l_weightGrad->MutableData().data();
+        std::copy(l_inputGrad->Data().begin(), l_inputGrad->Data().end(), l_weightGradData);
+        std::copy(l_biasGrad->Data().begin(), l_biasGrad->Data().end(), l_weightGradData + k * n);
+        a_outWeightGrad = l_weightGrad;
+    }
+    else
+    {
+        a_outWeightGrad = l_inputGrad;
+    }
+
+    return p_GradWrtInput(l_grad);
+}
+
+TLayerPtr LinearReLULayer::Clone() const
+{
+    shared_ptr<LinearReLULayer> l_clone(new LinearReLULayer(*this));
+    // Copy constructor shares the weights and the masks, the clone needs its own
+    l_clone->m_weights = m_weights->ToMutable();
+    l_clone->m_maskCache.reset(new MaskCache());
+    return l_clone;
+}
+
+size_t LinearReLULayer::NumPendingMasks() const
+{
+    lock_guard<mutex> l_lock(m_maskCache->mutex);
+    return m_maskCache->masks.size();
+}
+
+void LinearReLULayer::p_CheckInput(const TTensorPtr& a_input) const
+{
+    size_t l_inputRows = m_weights->Shape().at(0) - (m_hasBias ? 1 : 0);
+    if (a_input->Shape().size() != 2 || a_input->Shape().at(1) != l_inputRows)
+    {
+        stringstream l_ss;
+        l_ss << "LinearReLULayer input " << a_input->ShapeStr() << " doesn't fit weights "
+             << m_weights->ShapeStr() << (m_hasBias ? " with bias" : "");
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+void LinearReLULayer::p_Epilogue(float* a_output, size_t a_first, size_t a_rows, size_t a_cols, ReLUMask* a_mask) const
+{
+    const float* l_bias = m_hasBias ? m_weights->Data().data() + (m_weights->Shape().at(0) - 1) * a_cols : nullptr;
+    for (size_t i = a_first; i < a_first + a_rows; ++i)
+    {
+        float* l_row = a_output + i * a_cols;
+        if (l_bias)
+        {
+            for (size_t j = 0; j < a_cols; ++j)
+            {
+                l_row[j] += l_bias[j];
+            }
+        }
+
+        // Same as ReLULayer, zero stays and only negatives are cut
+        if (!a_mask)
+        {
+            for (size_t j = 0; j < a_cols; ++j)
+            {
+                l_row[j] = l_row[j] >= 0.0f ? l_row[j] : 0.0f;
+            }
+            continue;
+        }
+        uint64_t* l_bits = a_mask->bits.data() + i * a_mask->wordsPerRow;
+        for (size_t j0 = 0; j0 < a_cols; j0 += 64)
+        {
+            size_t l_end = std::min(j0 + 64, a_cols);
+            uint64_t l_word = 0;
+            for (size_t j = j0; j < l_end; ++j)
+            {
+                bool l_on = l_row[j] >= 0.0f;
+                l_word |= (uint64_t)l_on << (j - j0);
+                l_row[j] = l_on ? l_row[j] : 0.0f;
+            }
+            l_bits[j0 / 64] = l_word;
+        }
+    }
+}
+
+LinearReLULayer::TReLUMaskPtr LinearReLULayer::p_TakeMask(const TTensorPtr& a_input) const
+{
+    lock_guard<mutex> l_lock(m_maskCache->mutex);
+    auto l_it = m_maskCache->masks.find(a_input.get());
+    if (l_it == m_maskCache->masks.end())
+    {
+        return nullptr;
+    }
+
+    // Same address but a different tensor if the old one was freed
+    TReLUMaskPtr l_mask = l_it->second.first.lock() == a_input ? l_it->second.second : nullptr;
+    m_maskCache->masks.erase(l_it);
+    return l_mask;
+}
+
+} // namespace neural
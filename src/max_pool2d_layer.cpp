@@ -0,0 +1,156 @@
+/*
+ * Max Pool 2D Layer Implementation
+ *
+ */
+
+#include "neural/layers/max_pool2d_layer.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+MaxPool2DLayer::MaxPool2DLayer(size_t a_kernelSize, size_t a_stride)
+    : m_kernelSize(a_kernelSize)
+    , m_stride(a_stride == 0 ? a_kernelSize : a_stride)
+{
+    if (m_kernelSize == 0)
+    {
+        stringstream l_ss;
+        l_ss << "MaxPool2DLayer needs a kernel of at least 1x1";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+TTensorPtr MaxPool2DLayer::Forward(const TTensorPtr& a_input) const
+{
+    p_CheckInput(a_input);
+    const vector<size_t>& l_shape = a_input->Shape();
+    size_t l_numPlanes = l_shape[0] * l_shape[1];
+    size_t l_height = l_shape[2];
+    size_t l_width = l_shape[3];
+    size_t l_outHeight = OutSize(l_height);
+    size_t l_outWidth = OutSize(l_width);
+
+    TMutableTensorPtr l_ret = Tensor::New({l_shape[0], l_shape[1], l_outHeight, l_outWidth});
+    const float* l_in = a_input->Data().data();
+    float* l_out = l_ret->MutableData().data();
+
+    // One task per (image, channel) plane
+    Threading::ParallelFor(Threading::ELEMENTWISE, l_numPlanes, [&](size_t a_begin, size_t a_end) {
+        for (size_t p = a_begin; p < a_end; ++p)
+        {
+            const float* l_plane = l_in + p * l_height * l_width;
+            float* l_outPlane = l_out + p * l_outHeight * l_outWidth;
+            for (size_t oh = 0; oh < l_outHeight; ++oh)
+            {
+                for (size_t ow = 0; ow < l_outWidth; ++ow)
+                {
+                    l_outPlane[oh * l_outWidth + ow] = l_plane[p_ArgMax(l_plane, l_width, oh, ow)];
+                }
+            }
+        }
+    }, a_input->Size());
+    return l_ret;
+}
+
+TTensorPtr MaxPool2DLayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
+{
+    TTensorPtr l_weightGrad;
+    return CalcGradients(a_origInput, a_gradInput, l_weightGrad);
+}
+
+TTensorPtr MaxPool2DLayer::CalcGradients(
+    const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+    TTensorPtr& a_outWeightGrad) const
+{
+    a_outWeightGrad = nullptr;
+    p_CheckInput(a_origInput);
+    const vector<size_t>& l_shape = a_origInput->Shape();
+    size_t l_numPlanes = l_shape[0] * l_shape[1];
+    size_t l_height = l_shape[2];
+    size_t l_width = l_shape[3];
+    size_t l_outHeight = OutSize(l_height);
+    size_t l_outWidth = OutSize(l_width);
+
+    vector<size_t> l_outShape = {l_shape[0], l_shape[1], l_outHeight, l_outWidth};
+    if (a_gradInput->Shape() != l_outShape)
+    {
+        stringstream l_ss;
+        l_ss << "MaxPool2DLayer::CalcGradients gradient shape " << a_gradInput->ShapeStr()
+             << " != output shape " << Tensor::ShapeStr(l_outShape);
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    TMutableTensorPtr l_ret = Tensor::Zeros(l_shape);
+    const float* l_in = a_origInput->Data().data();
+    const float* l_gradOut = a_gradInput->Data().data();
+    float* l_gradIn = l_ret->MutableData().data();
+
+    // Overlapping windows can pick the same input, but never across planes
+    Threading::ParallelFor(Threading::ELEMENTWISE, l_numPlanes, [&](size_t a_begin, size_t a_end) {
+        for (size_t p = a_begin; p < a_end; ++p)
+        {
+            const float* l_plane = l_in + p * l_height * l_width;
+            const float* l_gradPlane = l_gradOut + p * l_outHeight * l_outWidth;
+            float* l_gradInPlane = l_gradIn + p * l_height * l_width;
+            for (size_t oh = 0; oh < l_outHeight; ++oh)
+            {
+                for (size_t ow = 0; ow < l_outWidth; ++ow)
+                {
+                    l_gradInPlane[p_ArgMax(l_plane, l_width, oh, ow)] += l_gradPlane[oh * l_outWidth + ow];
+                }
+            }
+        }
+    }, a_origInput->Size());
+    return l_ret;
+}
+
+TLayerPtr MaxPool2DLayer::Clone() const
+{
+    return TLayerPtr(new MaxPool2DLayer(*this));
+}
+
+size_t MaxPool2DLayer::OutSize(size_t a_inSize) const
+{
+    return (a_inSize - m_kernelSize) / m_stride + 1;
+}
+
+void MaxPool2DLayer::p_CheckInput(const TTensorPtr& a_input) const
+{
+    const vector<size_t>& l_shape = a_input->Shape();
+    if (l_shape.size() != 4 || l_shape[2] < m_kernelSize || l_shape[3] < m_kernelSize)
+    {
+        stringstream l_ss;
+        l_ss << "MaxPool2DLayer needs NCHW input of at least " << m_kernelSize << "x"
+             << m_kernelSize << ", got " << a_input->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+size_t MaxPool2DLayer::p_ArgMax(const float* a_plane, size_t a_width, size_t a_oh, size_t a_ow) const
+{
+    size_t l_best = (a_oh * m_stride) * a_width + a_ow * m_stride;
+    for (size_t ki = 0; ki < m_kernelSize; ++ki)
+    {
+        const float* l_row = a_plane + (a_oh * m_stride + ki) * a_width + a_ow * m_stride;
+        for (size_t kj = 0; kj < m_kernelSize; ++kj)
+        {
+            if (l_row[kj] > a_plane[l_best])
+            {
+                l_best = (l_row - a_plane) + kj;
+            }
+        }
+    }
+    return l_best;
+}
+
+} // namespace neural
@@ -0,0 +1,291 @@
+/*
+ * Metrics Implementation
+ *
+ */
+
+#include "neural/metrics/metrics.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+// Cache line of bucket counts
+static const size_t kBucketsPerLine = 64 / sizeof(atomic<uint64_t>);
+
+static void* AlignedAlloc(size_t a_size)
+{
+    void* l_ptr = nullptr;
+    if (posix_memalign(&l_ptr, 64, a_size) != 0)
+    {
+        throw(bad_alloc());
+    }
+    return l_ptr;
+}
+
+Counter::Counter()
+{
+    for (Shard& l_shard : m_shards)
+    {
+        l_shard.value.store(0, memory_order_relaxed);
+    }
+}
+
+void* Counter::operator new(size_t a_size)
+{
+    return AlignedAlloc(a_size);
+}
+
+void Counter::operator delete(void* a_ptr)
+{
+    free(a_ptr);
+}
+
+void Counter::Add(uint64_t a_value)
+{
+    m_shards[Metrics::ThreadShard()].value.fetch_add(a_value, memory_order_relaxed);
+}
+
+uint64_t Counter::Value() const
+{
+    uint64_t l_sum = 0;
+    for (const Shard& l_shard : m_shards)
+    {
+        l_sum += l_shard.value.load(memory_order_relaxed);
+    }
+    return l_sum;
+}
+
+Histogram::Histogram(const std::vector<double>& a_bounds)
+    : m_bounds(a_bounds)
+    , m_stride((a_bounds.size() + 1 + kBucketsPerLine - 1) / kBucketsPerLine * kBucketsPerLine)
+    , m_buckets(new atomic<uint64_t>[m_stride * kMetricShards])
+{
+    if (!is_sorted(m_bounds.begin(), m_bounds.end()))
+    {
+        stringstream l_ss;
+        l_ss << "Histogram bounds have to be sorted";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    for (Shard& l_shard : m_shards)
+    {
+        l_shard.count.store(0, memory_order_relaxed);
+        l_shard.sum.store(0.0, memory_order_relaxed);
+    }
+    for (size_t i = 0; i < m_stride * kMetricShards; ++i)
+    {
+        m_buckets[i].store(0, memory_order_relaxed);
+    }
+}
+
+void* Histogram::operator new(size_t a_size)
+{
+    return AlignedAlloc(a_size);
+}
+
+void Histogram::operator delete(void* a_ptr)
+{
+    free(a_ptr);
+}
+
+std::vector<double> Histogram::ExponentialBounds(double a_first, double a_factor, size_t a_count)
+{
+    vector<double> l_bounds;
+    double l_bound = a_first;
+    for (size_t i = 0; i < a_count; ++i)
+    {
+        l_bounds.push_back(l_bound);
+        l_bound *= a_factor;
+    }
+    return l_bounds;
+}
+
+const std::vector<double>& Histogram::DefaultBounds()
+{
+    static const vector<double> s_bounds = ExponentialBounds(1e-6, 2.0, 41);
+    return s_bounds;
+}
+
+void Histogram::Record(double a_value)
+{
+    size_t l_shard = Metrics::ThreadShard();
+    size_t l_bucket = lower_bound(m_bounds.begin(), m_bounds.end(), a_value) - m_bounds.begin();
+    m_buckets[l_shard * m_stride + l_bucket].fetch_add(1, memory_order_relaxed);
+    m_shards[l_shard].count.fetch_add(1, memory_order_relaxed);
+
+    // Nobody else uses this shard most of the time, so this goes through first try
+    atomic<double>& l_sum = m_shards[l_shard].sum;
+    double l_old = l_sum.load(memory_order_relaxed);
+    while (!l_sum.compare_exchange_weak(l_old, l_old + a_value, memory_order_relaxed))
+    {
+    }
+}
+
+Histogram::Snapshot Histogram::Read() const
+{
+    Snapshot l_snapshot;
+    l_snapshot.count = 0;
+    l_snapshot.sum = 0.0;
+    l_snapshot.buckets.assign(m_bounds.size() + 1, 0);
+    for (size_t s = 0; s < kMetricShards; ++s)
+    {
+        l_snapshot.count += m_shards[s].count.load(memory_order_relaxed);
+        l_snapshot.sum += m_shards[s].sum.load(memory_order_relaxed);
+        for (size_t b = 0; b < l_snapshot.buckets.size(); ++b)
+        {
+            l_snapshot.buckets[b] += m_buckets[s * m_stride + b].load(memory_order_relaxed);
+        }
+    }
+    return l_snapshot;
+}
+
+const std::vector<double>& Histogram::Bounds() const
+{
+    return m_bounds;
+}
+
+double Histogram::Snapshot::Mean() const
+{
+    return count > 0 ? sum / count : 0.0;
+}
+
+double Histogram::Snapshot::Quantile(const std::vector<double>& a_bounds, double a_quantile) const
+{
+    uint64_t l_total = 0;
+    for (uint64_t l_count : buckets)
+    {
+        l_total += l_count;
+    }
+    if (l_total == 0)
+    {
+        return 0.0;
+    }
+
+    double l_rank = a_quantile * l_total;
+    uint64_t l_below = 0;
+    for (size_t b = 0; b < buckets.size(); ++b)
+    {
+        if (buckets[b] > 0 && l_below + buckets[b] >= l_rank)
+        {
+            // The last bucket has no upper bound, its lower one is the best we have
+            if (b == a_bounds.size())
+            {
+                return a_bounds.empty() ? 0.0 : a_bounds.back();
+            }
+            double l_lower = b > 0 ? a_bounds[b - 1] : std::min(0.0, a_bounds[0]);
+            double l_fraction = (l_rank - l_below) / buckets[b];
+            return l_lower + (a_bounds[b] - l_lower) * std::max(0.0, l_fraction);
+        }
+        l_below += buckets[b];
+    }
+    return a_bounds.empty() ? 0.0 : a_bounds.back();
+}
+
+Histogram::Snapshot Histogram::Snapshot::operator-(const Snapshot& a_earlier) const
+{
+    Snapshot l_diff = *this;
+    l_diff.count -= a_earlier.count;
+    l_diff.sum -= a_earlier.sum;
+    for (size_t b = 0; b < l_diff.buckets.size() && b < a_earlier.buckets.size(); ++b)
+    {
+        l_diff.buckets[b] -= a_earlier.buckets[b];
+    }
+    return l_diff;
+}
+
+ScopedTimer::ScopedTimer(Histogram& a_histogram)
+    : m_histogram(a_histogram)
+    , m_start(chrono::steady_clock::now())
+{
+
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    chrono::duration<double> l_elapsed = chrono::steady_clock::now() - m_start;
+    m_histogram.Record(l_elapsed.count());
+}
+
+Metrics& Metrics::Instance()
+{
+    static Metrics s_metrics;
+    return s_metrics;
+}
+
+Counter& Metrics::GetCounter(const std::string& a_name, const std::string& a_labels)
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    const Entry* l_entry = p_Find(a_name, a_labels);
+    if (l_entry && !l_entry->counter)
+    {
+        stringstream l_ss;
+        l_ss << "Metrics " << a_name << "{" << a_labels << "} is already a histogram";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+    if (l_entry)
+    {
+        return *l_entry->counter;
+    }
+
+    m_counters.emplace_back(new Counter());
+    Entry l_new = {a_name, a_labels, m_counters.back().get(), nullptr};
+    m_index[a_name + "{" + a_labels + "}"] = m_entries.size();
+    m_entries.push_back(l_new);
+    return *m_counters.back();
+}
+
+Histogram& Metrics::GetHistogram(
+    const std::string& a_name, const std::string& a_labels, const std::vector<double>& a_bounds)
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    const Entry* l_entry = p_Find(a_name, a_labels);
+    if (l_entry && !l_entry->histogram)
+    {
+        stringstream l_ss;
+        l_ss << "Metrics " << a_name << "{" << a_labels << "} is already a counter";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+    if (l_entry)
+    {
+        return *l_entry->histogram;
+    }
+
+    m_histograms.emplace_back(new Histogram(a_bounds));
+    Entry l_new = {a_name, a_labels, nullptr, m_histograms.back().get()};
+    m_index[a_name + "{" + a_labels + "}"] = m_entries.size();
+    m_entries.push_back(l_new);
+    return *m_histograms.back();
+}
+
+std::vector<Metrics::Entry> Metrics::Entries() const
+{
+    lock_guard<mutex> l_lock(m_mutex);
+    return m_entries;
+}
+
+size_t Metrics::ThreadShard()
+{
+    static atomic<size_t> s_nextShard(0);
+    static thread_local size_t s_shard = s_nextShard.fetch_add(1, memory_order_relaxed) % kMetricShards;
+    return s_shard;
+}
+
+const Metrics::Entry* Metrics::p_Find(const std::string& a_name, const std::string& a_labels) const
+{
+    map<string, size_t>::const_iterator l_it = m_index.find(a_name + "{" + a_labels + "}");
+    return l_it == m_index.end() ? nullptr : &m_entries[l_it->second];
+}
+
+} // namespace neural
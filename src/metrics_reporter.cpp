@@ -0,0 +1,313 @@
+/*
+ * Metrics Reporter Implementation
+ *
+ */
+
+#include "neural/metrics/metrics_reporter.h"
+#include "neural/io/fd_io.h"
+
+#include <glog/logging.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+static string Labeled(const string& a_name, const string& a_labels)
+{
+    return a_labels.empty() ? a_name : a_name + "{" + a_labels + "}";
+}
+
+// Labels have quotes of their own, they are doubled in CSV
+static string CsvQuoted(const string& a_value)
+{
+    string l_quoted = "\"";
+    for (char l_char : a_value)
+    {
+        l_quoted += l_char == '"' ? "\"\"" : string(1, l_char);
+    }
+    return l_quoted + "\"";
+}
+
+MetricsReporter::MetricsReporter(double a_intervalSeconds, Metrics& a_metrics)
+    : m_interval(a_intervalSeconds)
+    , m_metrics(a_metrics)
+    , m_stdout(false)
+    , m_start(chrono::steady_clock::now())
+    , m_last(m_start)
+    , m_stop(false)
+    , m_listenFd(-1)
+{
+    if (a_intervalSeconds <= 0.0)
+    {
+        stringstream l_ss;
+        l_ss << "MetricsReporter interval has to be positive, got " << a_intervalSeconds;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+MetricsReporter::~MetricsReporter()
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    if (m_serverThread.joinable())
+    {
+        m_serverThread.join();
+    }
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+    }
+
+    Report();
+}
+
+void MetricsReporter::ToStdout()
+{
+    m_stdout = true;
+}
+
+void MetricsReporter::ToCsv(const std::string& a_path)
+{
+    m_csv.open(a_path, ios::out | ios::trunc);
+    if (!m_csv.good())
+    {
+        stringstream l_ss;
+        l_ss << "MetricsReporter could not open " << a_path;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+    m_csv << "seconds,name,labels,count,rate,mean,p50,p99" << endl;
+}
+
+uint16_t MetricsReporter::ServePrometheus(uint16_t a_port)
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0)
+    {
+        stringstream l_ss;
+        l_ss << "MetricsReporter could not make a socket: " << strerror(errno);
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    int l_on = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &l_on, sizeof(l_on));
+
+    sockaddr_in l_addr;
+    memset(&l_addr, 0, sizeof(l_addr));
+    l_addr.sin_family = AF_INET;
+    l_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    l_addr.sin_port = htons(a_port);
+    socklen_t l_addrLen = sizeof(l_addr);
+    if (::bind(m_listenFd, (sockaddr*)&l_addr, sizeof(l_addr)) != 0 ||
+        listen(m_listenFd, 8) != 0 ||
+        getsockname(m_listenFd, (sockaddr*)&l_addr, &l_addrLen) != 0)
+    {
+        stringstream l_ss;
+        l_ss << "MetricsReporter could not listen on 127.0.0.1:" << a_port << ": " << strerror(errno);
+        close(m_listenFd);
+        m_listenFd = -1;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    m_serverThread = thread(&MetricsReporter::p_ServeLoop, this);
+    return ntohs(l_addr.sin_port);
+}
+
+void MetricsReporter::Start()
+{
+    m_thread = thread(&MetricsReporter::p_ReportLoop, this);
+}
+
+void MetricsReporter::Report()
+{
+    lock_guard<mutex> l_lock(m_reportMutex);
+    chrono::steady_clock::time_point l_now = chrono::steady_clock::now();
+    double l_seconds = chrono::duration<double>(l_now - m_start).count();
+    double l_elapsed = chrono::duration<double>(l_now - m_last).count();
+    m_last = l_now;
+
+    stringstream l_out;
+    for (const Metrics::Entry& l_entry : m_metrics.Entries())
+    {
+        string l_key = Labeled(l_entry.name, l_entry.labels);
+        if (l_entry.counter)
+        {
+            uint64_t l_value = l_entry.counter->Value();
+            double l_rate = l_elapsed > 0.0 ? (l_value - m_lastCounters[l_key]) / l_elapsed : 0.0;
+            m_lastCounters[l_key] = l_value;
+
+            l_out << "metrics " << l_key << " " << l_value << " (" << l_rate << "/s)" << endl;
+            if (m_csv.is_open())
+            {
+                m_csv << l_seconds << "," << l_entry.name << "," << CsvQuoted(l_entry.labels) << ","
+                      << l_value << "," << l_rate << ",,," << endl;
+            }
+            continue;
+        }
+
+        const vector<double>& l_bounds = l_entry.histogram->Bounds();
+        Histogram::Snapshot l_total = l_entry.histogram->Read();
+        Histogram::Snapshot l_window = l_total;
+        map<string, Histogram::Snapshot>::iterator l_last = m_lastHistograms.find(l_key);
+        if (l_last != m_lastHistograms.end())
+        {
+            l_window = l_total - l_last->second;
+        }
+        m_lastHistograms[l_key] = l_total;
+
+        // Nothing new to say about it
+        if (l_window.count == 0)
+        {
+            continue;
+        }
+
+        double l_rate = l_elapsed > 0.0 ? l_window.count / l_elapsed : 0.0;
+        double l_p50 = l_window.Quantile(l_bounds, 0.5);
+        double l_p99 = l_window.Quantile(l_bounds, 0.99);
+        l_out << "metrics " << l_key << " n=" << l_window.count << " (" << l_rate << "/s)"
+              << " mean=" << l_window.Mean() << " p50=" << l_p50 << " p99=" << l_p99 << endl;
+        if (m_csv.is_open())
+        {
+            m_csv << l_seconds << "," << l_entry.name << "," << CsvQuoted(l_entry.labels) << ","
+                  << l_window.count << "," << l_rate << "," << l_window.Mean() << ","
+                  << l_p50 << "," << l_p99 << endl;
+        }
+    }
+
+    if (m_stdout)
+    {
+        cout << l_out.str() << flush;
+    }
+    if (m_csv.is_open())
+    {
+        m_csv.flush();
+    }
+}
+
+std::string MetricsReporter::PrometheusText(const Metrics& a_metrics)
+{
+    stringstream l_out;
+    l_out << setprecision(17);
+
+    // Every line of a name has to come together after its TYPE line
+    vector<Metrics::Entry> l_entries = a_metrics.Entries();
+    map<string, size_t> l_firstOfName;
+    for (size_t i = 0; i < l_entries.size(); ++i)
+    {
+        l_firstOfName.insert(make_pair(l_entries[i].name, i));
+    }
+    stable_sort(l_entries.begin(), l_entries.end(),
+        [&l_firstOfName](const Metrics::Entry& a_left, const Metrics::Entry& a_right) {
+            return l_firstOfName[a_left.name] < l_firstOfName[a_right.name];
+        });
+
+    for (size_t i = 0; i < l_entries.size(); ++i)
+    {
+        const Metrics::Entry& l_entry = l_entries[i];
+        if (i == 0 || l_entries[i - 1].name != l_entry.name)
+        {
+            l_out << "# TYPE " << l_entry.name << (l_entry.counter ? " counter" : " histogram") << "\n";
+        }
+
+        if (l_entry.counter)
+        {
+            l_out << Labeled(l_entry.name, l_entry.labels) << " " << l_entry.counter->Value() << "\n";
+            continue;
+        }
+
+        const vector<double>& l_bounds = l_entry.histogram->Bounds();
+        Histogram::Snapshot l_snapshot = l_entry.histogram->Read();
+        string l_prefix = l_entry.labels.empty() ? "" : l_entry.labels + ",";
+        uint64_t l_cumulative = 0;
+        for (size_t b = 0; b < l_bounds.size(); ++b)
+        {
+            l_cumulative += l_snapshot.buckets[b];
+            l_out << l_entry.name << "_bucket{" << l_prefix << "le=\"" << l_bounds[b] << "\"} "
+                  << l_cumulative << "\n";
+        }
+        l_cumulative += l_snapshot.buckets.back();
+        l_out << l_entry.name << "_bucket{" << l_prefix << "le=\"+Inf\"} " << l_cumulative << "\n";
+        l_out << Labeled(l_entry.name + "_sum", l_entry.labels) << " " << l_snapshot.sum << "\n";
+        l_out << Labeled(l_entry.name + "_count", l_entry.labels) << " " << l_cumulative << "\n";
+    }
+    return l_out.str();
+}
+
+void MetricsReporter::p_ReportLoop()
+{
+    unique_lock<mutex> l_lock(m_mutex);
+    while (!m_stop)
+    {
+        if (m_cond.wait_for(l_lock, chrono::duration<double>(m_interval), [this]() { return m_stop; }))
+        {
+            return;
+        }
+
+        l_lock.unlock();
+        Report();
+        l_lock.lock();
+    }
+}
+
+void MetricsReporter::p_ServeLoop()
+{
+    function<bool()> l_stopping = [this]() {
+        lock_guard<mutex> l_lock(m_mutex);
+        return m_stop;
+    };
+    FdIo::AcceptLoop(m_listenFd, l_stopping, [this](int a_fd) {
+        // The request itself doesn't matter, read up to the end of its header
+        string l_request;
+        char l_buffer[1024];
+        pollfd l_client = {a_fd, POLLIN, 0};
+        while (l_request.find("\r\n\r\n") == string::npos && poll(&l_client, 1, FdIo::kPollMs) > 0)
+        {
+            ssize_t l_read = read(a_fd, l_buffer, sizeof(l_buffer));
+            if (l_read <= 0)
+            {
+                break;
+            }
+            l_request.append(l_buffer, l_read);
+        }
+
+        string l_body = PrometheusText(m_metrics);
+        stringstream l_response;
+        l_response << "HTTP/1.0 200 OK\r\n"
+                   << "Content-Type: text/plain; version=0.0.4\r\n"
+                   << "Content-Length: " << l_body.size() << "\r\n"
+                   << "Connection: close\r\n\r\n"
+                   << l_body;
+        string l_bytes = l_response.str();
+        FdIo::WriteFully(a_fd, l_bytes.data(), l_bytes.size());
+        close(a_fd);
+    });
+}
+
+} // namespace neural
@@ -3,18 +3,40 @@
  */
 
 #include "neural/data/mnist_dataloader.h"
+#include "neural/parallel/thread_pool.h"
+#include "neural/parallel/threading.h"
 
 #include <glog/logging.h>
 
 #include <sstream>
 #include <fstream>
+#include <stdexcept>
 
 using namespace std;
 
 namespace neural
 {
 
-MNISTDataloader::MNISTDataloader(const std::string& a_path, bool a_isTrain)
+// One thread loading ahead next to the OpenMP threads, started on first use
+static ThreadPool& LoadingPool()
+{
+    static ThreadPool l_pool(1);
+    return l_pool;
+}
+
+MNISTDataloader::MNISTDataloader()
+    : m_numData(0)
+    , m_zeroBackground(false)
+    , m_layout(FLAT)
+    , m_numChannels(1)
+    , m_imageWidth(0)
+    , m_imageHeight(0)
+{
+
+}
+
+MNISTDataloader::MNISTDataloader(const std::string& a_path, bool a_isTrain, IdxFile::EAccess a_access)
+    : MNISTDataloader()
 {
     // Determine the file prefix depending on if it is train or test data
     string l_filePrefix = "train";
@@ -23,36 +45,26 @@ MNISTDataloader::MNISTDataloader(const std::string& a_path, bool a_isTrain)
         l_filePrefix = "t10k";
     }
 
-    // Define the image file path
-    m_imageFile = a_path + "/" + l_filePrefix + "-images-idx3-ubyte";
-    if (!p_FileExists(m_imageFile))
+    // The files as downloaded, if they haven't been unpacked
+    string l_imageFile = a_path + "/" + l_filePrefix + "-images-idx3-ubyte";
+    string l_labelFile = a_path + "/" + l_filePrefix + "-labels-idx1-ubyte";
+    if (!p_FileExists(l_imageFile) && p_FileExists(l_imageFile + ".gz"))
     {
-        LOG(ERROR) << "Image file does not exist: "
-                   << m_imageFile << endl;
-        return;
+        l_imageFile += ".gz";
     }
-
-    // Define the label file path
-    m_labelFile = a_path + "/" + l_filePrefix + "-labels-idx1-ubyte";
-    if (!p_FileExists(m_labelFile))
+    if (!p_FileExists(l_labelFile) && p_FileExists(l_labelFile + ".gz"))
     {
-        LOG(ERROR) << "Label file does not exist: "
-                   << m_labelFile << endl;
-        return;
+        l_labelFile += ".gz";
     }
+    p_Open(l_imageFile, l_labelFile, a_access);
+}
 
-    LOG(INFO) << "Got Image File: " << m_imageFile << endl;
-    LOG(INFO) << "Got Label File: " << m_labelFile << endl;
-
-    // Read num data
-    m_numData = p_ReadNumImages(m_imageFile);
-    LOG(INFO) << "Got Number of Images: " << m_numData << endl;
-
-    // Read image sizes
-    m_imageWidth = p_ReadImageWidth(m_imageFile);
-    m_imageHeight = p_ReadImageHeight(m_imageFile);
-
-    LOG(INFO) << "Image size: " << m_imageWidth << "x" << m_imageHeight << endl;
+MNISTDataloader MNISTDataloader::FromFiles(
+    const std::string& a_imageFile, const std::string& a_labelFile, IdxFile::EAccess a_access)
+{
+    MNISTDataloader l_dataloader;
+    l_dataloader.p_Open(a_imageFile, a_labelFile, a_access);
+    return l_dataloader;
 }
 
 size_t MNISTDataloader::DataLength() const
@@ -60,6 +72,11 @@ size_t MNISTDataloader::DataLength() const
     return m_numData;
 }
 
+std::vector<size_t> MNISTDataloader::ImageShape() const
+{
+    return {m_numChannels, m_imageHeight, m_imageWidth};
+}
+
 bool MNISTDataloader::DataAt(
     size_t a_dataIdx,
     TMutableTensorPtr& a_outInput,
@@ -100,123 +117,214 @@ bool MNISTDataloader::DataAt(
         return false;
     }
 
-    // Read image data
-    vector<uint8_t> l_imageData;
-    size_t l_bytesPerData = m_imageWidth * m_imageWidth;
-    l_imageData.resize(l_bytesPerData);
+    vector<float> l_imageData, l_labels;
+    p_ReadExamples(a_dataIdx, a_dataIdx + 1, l_imageData, l_labels);
+
+    a_outInput = Tensor::New(p_BatchShape(1));
+    a_outOutput = Tensor::New({1, 1}, {l_labels[0]});
+
+    // Pixels are row major in both layouts, only the shape differs
+    float* l_inputData = a_outInput->MutableData().data();
+    float l_min = m_zeroBackground ? 0.0 : -1.0;
+    for (size_t i = 0; i < l_imageData.size(); ++i)
     {
-        size_t l_headerBytes = sizeof(int32_t) * 4; // skip magic number, num images, and image sizes
-        size_t l_dataOffset = (a_dataIdx * l_bytesPerData) + l_headerBytes;
-        ifstream l_infile;
-        l_infile.open(m_imageFile, ios::binary | ios::in); 
-        l_infile.seekg(l_dataOffset, ios::beg); // move n bytes into the file 
-        l_infile.read(reinterpret_cast<char*>(l_imageData.data()), sizeof(uint8_t) * l_bytesPerData);
-        l_infile.close();
+        l_inputData[i] = p_Scale(l_imageData[i], l_min);
     }
+    return true;
+}
 
-    // Read label data
-    uint8_t l_label;
+std::future<bool> MNISTDataloader::DataAtAsync(
+    size_t a_dataIdx,
+    TMutableTensorPtr& a_outInput,
+    TMutableTensorPtr& a_outOutput) const
+{
+    shared_ptr<promise<bool>> l_result(new promise<bool>());
+    ThreadPool& l_pool = Threading::Backend() == Threading::THREAD_POOL ? ThreadPool::Instance() : LoadingPool();
+    l_pool.Submit([this, a_dataIdx, &a_outInput, &a_outOutput, l_result]() {
+        l_result->set_value(DataAt(a_dataIdx, a_outInput, a_outOutput));
+    });
+    return l_result->get_future();
+}
+
+void MNISTDataloader::SetZeroBackground(bool a_zeroBackground)
+{
+    m_zeroBackground = a_zeroBackground;
+}
+
+bool MNISTDataloader::ZeroBackground() const
+{
+    return m_zeroBackground;
+}
+
+void MNISTDataloader::SetLayout(ELayout a_layout)
+{
+    m_layout = a_layout;
+}
+
+void MNISTDataloader::SetReadAhead(size_t a_bytes)
+{
+    if (m_images)
+    {
+        m_images->SetReadAhead(a_bytes);
+        m_labels->SetReadAhead(a_bytes);
+    }
+}
+
+void MNISTDataloader::BuildIndex()
+{
+    if (m_images)
     {
-        size_t l_headerBytes = sizeof(int32_t) * 2;
-        size_t l_dataOffset = l_headerBytes + a_dataIdx;
-        ifstream l_infile;
-        l_infile.open(m_labelFile, ios::binary | ios::in); 
-        l_infile.seekg(l_dataOffset, ios::beg); // move n bytes into the file 
-        l_infile.read(reinterpret_cast<char*>(&l_label), sizeof(uint8_t));
-        l_infile.close();
+        m_images->BuildIndex();
+        m_labels->BuildIndex();
     }
+}
 
-    a_outInput = Tensor::Zeros({1, m_imageWidth*m_imageHeight})->ToMutable();
-    a_outOutput = Tensor::Zeros({1, 1})->ToMutable();
+MNISTDataloader::ELayout MNISTDataloader::Layout() const
+{
+    return m_layout;
+}
 
-    float l_class = (float)l_label;
+bool MNISTDataloader::BatchAt(
+    size_t a_begin, size_t a_end,
+    TMutableTensorPtr& a_outInputs,
+    std::vector<float>& a_outTargets) const
+{
+    if (a_begin >= a_end || a_end > DataLength())
+    {
+        LOG(ERROR) << "MNISTDataloader::BatchAt cannot access data ["
+                   << a_begin << ", " << a_end << ") of " << DataLength() << endl;
+        return false;
+    }
 
-    a_outOutput->SetAt({0, 0}, l_class);
+    vector<float> l_imageData;
+    p_ReadExamples(a_begin, a_end, l_imageData, a_outTargets);
 
-    for (size_t i = 0; i < m_imageHeight; ++i)
+    a_outInputs = Tensor::New(p_BatchShape(a_end - a_begin));
+    float* l_inputData = a_outInputs->MutableData().data();
+    float l_min = m_zeroBackground ? 0.0 : -1.0;
+    for (size_t i = 0; i < l_imageData.size(); ++i)
     {
-        for (size_t j = 0; j < m_imageWidth; ++j)
-        {
-            size_t l_imgDataOffset = (i * m_imageWidth) + j;
-            float l_val = (float)l_imageData.at(l_imgDataOffset);
-            a_outInput->SetAt({0, l_imgDataOffset}, p_TransformToInterval(l_val, 0.0, 255.0, -1.0, 1.0));
-        }
+        l_inputData[i] = p_Scale(l_imageData[i], l_min);
     }
     return true;
 }
 
-/*
-http://yann.lecun.com/exdb/mnist/
-All the integers in the files are stored in the MSB first (high endian) format used by most non-Intel processors.
-Users of Intel processors and other low-endian machines must flip the bytes of the header.
-
-p_ReverseInt() impl from
-https://stackoverflow.com/questions/8286668/how-to-read-mnist-data-in-c
-*/
-int32_t MNISTDataloader::p_ReverseInt(int32_t a_int) const
+bool MNISTDataloader::SparseBatchAt(
+    size_t a_begin, size_t a_end,
+    TSparseTensorPtr& a_outInputs,
+    std::vector<float>& a_outTargets) const
 {
-    unsigned char c1, c2, c3, c4;
+    if (a_begin >= a_end || a_end > DataLength())
+    {
+        LOG(ERROR) << "MNISTDataloader::SparseBatchAt cannot access data ["
+                   << a_begin << ", " << a_end << ") of " << DataLength() << endl;
+        return false;
+    }
 
-    c1 = a_int & 255;
-    c2 = (a_int >> 8) & 255;
-    c3 = (a_int >> 16) & 255;
-    c4 = (a_int >> 24) & 255;
+    size_t l_numExamples = a_end - a_begin;
+    size_t l_bytesPerData = m_numChannels * m_imageWidth * m_imageHeight;
+    vector<float> l_imageData, l_labels;
+    p_ReadExamples(a_begin, a_end, l_imageData, l_labels);
 
-    return ((int32_t)c1 << 24) + ((int32_t)c2 << 16) + ((int32_t)c3 << 8) + c4;
+    shared_ptr<SparseTensor> l_inputs(new SparseTensor(l_numExamples, l_bytesPerData));
+    vector<uint32_t> l_indices;
+    vector<float> l_values;
+    a_outTargets.clear();
+    for (size_t i = 0; i < l_numExamples; ++i)
+    {
+        l_indices.clear();
+        l_values.clear();
+        const float* l_image = l_imageData.data() + i * l_bytesPerData;
+        for (size_t j = 0; j < l_bytesPerData; ++j)
+        {
+            // Background pixels are 0, which is exactly what we leave out
+            if (l_image[j] != 0.0f)
+            {
+                l_indices.push_back(j);
+                l_values.push_back(p_Scale(l_image[j], 0.0));
+            }
+        }
+        l_inputs->AppendOuter(l_indices, l_values);
+        a_outTargets.push_back(l_labels[i]);
+    }
+    a_outInputs = l_inputs;
+    return true;
 }
 
-size_t MNISTDataloader::p_ReadNumImages(const std::string& a_file) const
+void MNISTDataloader::p_Open(
+    const std::string& a_imageFile, const std::string& a_labelFile, IdxFile::EAccess a_access)
 {
-    /*
-    [offset] [type]          [value]          [description] 
-    0000     32 bit integer  0x00000803(2051) magic number 
-    0004     32 bit integer  60000            number of images 
-    */
-    return p_ReadIntAt(a_file, 1); // num images is the 2nd line
+    if (!p_FileExists(a_imageFile))
+    {
+        LOG(ERROR) << "Image file does not exist: "
+                   << a_imageFile << endl;
+        return;
+    }
+
+    if (!p_FileExists(a_labelFile))
+    {
+        LOG(ERROR) << "Label file does not exist: "
+                   << a_labelFile << endl;
+        return;
+    }
+
+    LOG(INFO) << "Got Image File: " << a_imageFile << endl;
+    LOG(INFO) << "Got Label File: " << a_labelFile << endl;
+
+    shared_ptr<IdxFile> l_images(new IdxFile(a_imageFile, a_access));
+    shared_ptr<IdxFile> l_labels(new IdxFile(a_labelFile, a_access));
+
+    // [N, W], [N, H, W] or [N, C, H, W] images, one label each
+    const vector<size_t>& l_shape = l_images->Shape();
+    if (l_shape.size() < 2 || l_shape.size() > 4 || l_labels->ItemSize() != 1 ||
+        l_labels->NumItems() != l_images->NumItems())
+    {
+        stringstream l_ss;
+        l_ss << "MNISTDataloader images " << Tensor::ShapeStr(l_shape) << " don't fit labels "
+             << Tensor::ShapeStr(l_labels->Shape());
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    m_images = l_images;
+    m_labels = l_labels;
+    m_numData = m_images->NumItems();
+    m_numChannels = l_shape.size() == 4 ? l_shape[1] : 1;
+    m_imageHeight = l_shape.size() >= 3 ? l_shape[l_shape.size() - 2] : 1;
+    m_imageWidth = l_shape.back();
+
+    LOG(INFO) << "Got Number of Images: " << m_numData << endl;
+    LOG(INFO) << "Image size: " << m_imageWidth << "x" << m_imageHeight << endl;
 }
 
-size_t MNISTDataloader::p_ReadImageHeight(const std::string& a_file) const
+std::vector<size_t> MNISTDataloader::p_BatchShape(size_t a_numExamples) const
 {
-    /*
-    [offset] [type]          [value]          [description] 
-    0000     32 bit integer  0x00000803(2051) magic number 
-    0004     32 bit integer  60000            number of images 
-    0008     32 bit integer  28               number of rows 
-    0012     32 bit integer  28               number of columns 
-    */
-    return p_ReadIntAt(a_file, 2); // height is num rows @ 2
+    if (m_layout == NCHW)
+    {
+        return {a_numExamples, m_numChannels, m_imageHeight, m_imageWidth};
+    }
+    return {a_numExamples, m_numChannels * m_imageWidth * m_imageHeight};
 }
 
-size_t MNISTDataloader::p_ReadImageWidth(const std::string& a_file) const
+void MNISTDataloader::p_ReadExamples(
+    size_t a_begin, size_t a_end,
+    std::vector<float>& a_outPixels, std::vector<float>& a_outLabels) const
 {
-    /*
-    [offset] [type]          [value]          [description] 
-    0000     32 bit integer  0x00000803(2051) magic number 
-    0004     32 bit integer  60000            number of images 
-    0008     32 bit integer  28               number of rows 
-    0012     32 bit integer  28               number of columns 
-    */
-    return p_ReadIntAt(a_file, 3); // width is num cols @ 3
+    // The examples are next to each other in the files, so read them all at once
+    size_t l_numExamples = a_end - a_begin;
+    a_outPixels.resize(l_numExamples * m_images->ItemSize());
+    m_images->ReadItems(a_begin, a_end, a_outPixels.data());
+    a_outLabels.resize(l_numExamples);
+    m_labels->ReadItems(a_begin, a_end, a_outLabels.data());
 }
 
-size_t MNISTDataloader::p_ReadIntAt(const std::string& a_file, size_t a_idx) const
+float MNISTDataloader::p_Scale(float a_pixel, float a_min) const
 {
-    /*
-    [offset] [type]          [value]          [description] 
-    0000     32 bit integer  0x00000803(2051) magic number 
-    0004     32 bit integer  60000            number of images 
-    0008     32 bit integer  28               number of rows 
-    0012     32 bit integer  28               number of columns 
-    */
-    size_t l_dataOffset = sizeof(int32_t) * a_idx; // skip header
-    ifstream l_infile;
-    l_infile.open(a_file, ios::binary | ios::in); 
-    l_infile.seekg(l_dataOffset, ios::beg); // move n bytes into the file 
-    int32_t l_val;
-    l_infile.read(reinterpret_cast<char*>(&l_val), sizeof(int32_t));
-    l_infile.close();
-    l_val = p_ReverseInt(l_val);
-    return l_val;
+    if (m_images->Type() == IdxFile::UINT8)
+    {
+        return p_TransformToInterval(a_pixel, 0.0, 255.0, a_min, 1.0);
+    }
+    return a_pixel;
 }
 
 bool MNISTDataloader::p_FileExists(const std::string& a_file) const
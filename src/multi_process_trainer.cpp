@@ -0,0 +1,134 @@
+/*
+ * Multi Process Trainer Implementation
+ *
+ */
+
+#include "neural/train/multi_process_trainer.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+// Besides the gradients we reduce the number of examples and the summed loss
+static const size_t kNumExtraFloats = 2;
+
+MultiProcessTrainer::MultiProcessTrainer(Sequential& a_model, ShmRingAllReduce& a_comm)
+    : m_model(a_model)
+    , m_comm(a_comm)
+    , m_buffer(NumFloats(a_model), 0.0)
+{
+
+}
+
+float MultiProcessTrainer::Step(
+    const std::vector<TTensorPtr>& a_inputs,
+    const std::vector<float>& a_targets,
+    float a_learningRate)
+{
+    if (a_inputs.size() != a_targets.size())
+    {
+        stringstream l_ss;
+        l_ss << "MultiProcessTrainer::Step needs one target per input, got "
+             << a_inputs.size() << " inputs and " << a_targets.size() << " targets";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    // Forward and backward over our shard
+    float l_lossSum = 0.0;
+    vector<TTensorPtr> l_activations;
+    for (size_t i = 0; i < a_inputs.size(); ++i)
+    {
+        TTensorPtr l_pred = m_model.Forward(a_inputs[i], l_activations);
+        float l_predVal = l_pred->View<2>()(0, 0);
+        l_lossSum += m_loss.Forward(l_predVal, a_targets[i]);
+
+        float l_errorGrad = m_loss.Backward(l_predVal, a_targets[i]);
+        m_model.Backward(l_activations, Tensor::New({1, 1}, {l_errorGrad}));
+    }
+    m_loss.ZeroGrad();
+
+    // Pack sum of gradients (average * count) for every layer, then count and loss
+    float l_numExamples = (float)a_inputs.size();
+    const vector<TLayerPtr>& l_layers = m_model.Layers();
+    float* l_out = m_buffer.data();
+    for (const TLayerPtr& l_layer : l_layers)
+    {
+        if (!l_layer->HasWeights())
+        {
+            continue;
+        }
+
+        size_t l_size = l_layer->Weights()->Size();
+        if (a_inputs.empty())
+        {
+            std::fill(l_out, l_out + l_size, 0.0f);
+        }
+        else
+        {
+            TTensorPtr l_avgGrad = l_layer->CalcAvgWeightGrad();
+            const float* l_grad = l_avgGrad->Data().data();
+            for (size_t i = 0; i < l_size; ++i)
+            {
+                l_out[i] = l_grad[i] * l_numExamples;
+            }
+        }
+        l_out += l_size;
+    }
+    l_out[0] = l_numExamples;
+    l_out[1] = l_lossSum;
+
+    m_comm.SumInPlace(m_buffer.data(), m_buffer.size());
+
+    float l_totalExamples = m_buffer[m_buffer.size() - 2];
+    float l_totalLoss = m_buffer[m_buffer.size() - 1];
+    if (l_totalExamples == 0.0)
+    {
+        return 0.0;
+    }
+
+    // Same average gradient on every rank, so every rank makes the same update
+    const float* l_in = m_buffer.data();
+    for (const TLayerPtr& l_layer : l_layers)
+    {
+        if (!l_layer->HasWeights())
+        {
+            continue;
+        }
+
+        TTensorPtr l_weights = l_layer->Weights();
+        TMutableTensorPtr l_grad = Tensor::New(l_weights->Shape());
+        float* l_gradData = l_grad->MutableData().data();
+        for (size_t i = 0; i < l_grad->Size(); ++i)
+        {
+            l_gradData[i] = l_in[i] / l_totalExamples;
+        }
+        l_in += l_grad->Size();
+
+        l_layer->ApplyGradient(l_grad, a_learningRate);
+        l_layer->ZeroGrad();
+    }
+
+    return l_totalLoss / l_totalExamples;
+}
+
+size_t MultiProcessTrainer::NumFloats(const Sequential& a_model)
+{
+    size_t l_numFloats = kNumExtraFloats;
+    for (const TLayerPtr& l_layer : a_model.Layers())
+    {
+        if (l_layer->HasWeights())
+        {
+            l_numFloats += l_layer->Weights()->Size();
+        }
+    }
+    return l_numFloats;
+}
+
+} // namespace neural
@@ -0,0 +1,236 @@
+/*
+ * Philox Implementation
+ *
+ */
+
+#include "neural/math/philox.h"
+#include "neural/parallel/threading.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace neural
+{
+
+// Philox4x32 multipliers and Weyl key increments
+static const uint32_t kMul0 = 0xD2511F53;
+static const uint32_t kMul1 = 0xCD9E8D57;
+static const uint32_t kWeyl0 = 0x9E3779B9;
+static const uint32_t kWeyl1 = 0xBB67AE85;
+static const size_t kNumRounds = 10;
+
+// Blocks generated together, the rounds run over the batch as plain arrays
+// so the compiler can keep several blocks in one vector register
+static const size_t kBatchBlocks = 16;
+
+static const float kTwoPi = 6.28318530717958647692f;
+
+static atomic<uint64_t> s_globalSeed(chrono::system_clock::now().time_since_epoch().count());
+static atomic<uint64_t> s_nextStream(0);
+
+// Top 24 bits as a float in [0, 1)
+static inline float ToUnit(uint32_t a_bits)
+{
+    return (float)(a_bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Same but in (0, 1], for logs
+static inline float ToUnitNonZero(uint32_t a_bits)
+{
+    return (float)((a_bits >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+Philox::Philox(uint64_t a_seed, uint64_t a_stream)
+    : m_seed(a_seed)
+    , m_stream(a_stream)
+{
+
+}
+
+Philox Philox::Next()
+{
+    return Philox(s_globalSeed, s_nextStream++);
+}
+
+void Philox::SetGlobalSeed(uint64_t a_seed)
+{
+    s_globalSeed = a_seed;
+    s_nextStream = 0;
+}
+
+uint64_t Philox::GlobalSeed()
+{
+    return s_globalSeed;
+}
+
+void Philox::Block(uint64_t a_seed, uint64_t a_stream, uint64_t a_counter, uint32_t a_out[4])
+{
+    uint32_t c0 = (uint32_t)a_counter;
+    uint32_t c1 = (uint32_t)(a_counter >> 32);
+    uint32_t c2 = (uint32_t)a_stream;
+    uint32_t c3 = (uint32_t)(a_stream >> 32);
+    uint32_t k0 = (uint32_t)a_seed;
+    uint32_t k1 = (uint32_t)(a_seed >> 32);
+
+    for (size_t r = 0; r < kNumRounds; ++r)
+    {
+        uint64_t l_prod0 = (uint64_t)kMul0 * c0;
+        uint64_t l_prod1 = (uint64_t)kMul1 * c2;
+        uint32_t l_hi0 = (uint32_t)(l_prod0 >> 32);
+        uint32_t l_hi1 = (uint32_t)(l_prod1 >> 32);
+        c0 = l_hi1 ^ c1 ^ k0;
+        c1 = (uint32_t)l_prod1;
+        c2 = l_hi0 ^ c3 ^ k1;
+        c3 = (uint32_t)l_prod0;
+        k0 += kWeyl0;
+        k1 += kWeyl1;
+    }
+
+    a_out[0] = c0;
+    a_out[1] = c1;
+    a_out[2] = c2;
+    a_out[3] = c3;
+}
+
+uint32_t Philox::At(size_t a_idx) const
+{
+    uint32_t l_block[4];
+    Block(m_seed, m_stream, a_idx / 4, l_block);
+    return l_block[a_idx % 4];
+}
+
+float Philox::UniformAt(size_t a_idx) const
+{
+    return ToUnit(At(a_idx));
+}
+
+void Philox::FillUniform(float* a_data, size_t a_size, float a_min, float a_max) const
+{
+    float l_range = a_max - a_min;
+    size_t l_numBlocks = (a_size + 3) / 4;
+    Threading::ParallelFor(Threading::ELEMENTWISE, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+        uint32_t l_bits[4 * kBatchBlocks];
+        for (size_t b = a_begin; b < a_end; b += kBatchBlocks)
+        {
+            size_t l_numBatch = std::min(kBatchBlocks, a_end - b);
+            p_Blocks(b, l_numBatch, l_bits);
+
+            size_t l_first = b * 4;
+            size_t l_count = std::min(l_numBatch * 4, a_size - l_first);
+            for (size_t i = 0; i < l_count; ++i)
+            {
+                a_data[l_first + i] = a_min + l_range * ToUnit(l_bits[i]);
+            }
+        }
+    }, a_size);
+}
+
+void Philox::FillNormal(float* a_data, size_t a_size, float a_mean, float a_stddev) const
+{
+    size_t l_numBlocks = (a_size + 3) / 4;
+    Threading::ParallelFor(Threading::ELEMENTWISE, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+        uint32_t l_bits[4 * kBatchBlocks];
+        float l_normals[4 * kBatchBlocks];
+        for (size_t b = a_begin; b < a_end; b += kBatchBlocks)
+        {
+            size_t l_numBatch = std::min(kBatchBlocks, a_end - b);
+            p_Blocks(b, l_numBatch, l_bits);
+
+            // Box-Muller, every pair of words gives two normals
+            for (size_t i = 0; i < l_numBatch * 4; i += 2)
+            {
+                float l_radius = sqrt(-2.0f * log(ToUnitNonZero(l_bits[i])));
+                float l_angle = kTwoPi * ToUnit(l_bits[i + 1]);
+                l_normals[i] = l_radius * cos(l_angle);
+                l_normals[i + 1] = l_radius * sin(l_angle);
+            }
+
+            size_t l_first = b * 4;
+            size_t l_count = std::min(l_numBatch * 4, a_size - l_first);
+            for (size_t i = 0; i < l_count; ++i)
+            {
+                a_data[l_first + i] = a_mean + a_stddev * l_normals[i];
+            }
+        }
+    }, a_size);
+}
+
+void Philox::FillDropoutMask(float* a_mask, size_t a_size, float a_keepProb) const
+{
+    float l_scale = a_keepProb > 0.0f ? 1.0f / a_keepProb : 0.0f;
+    FillUniform(a_mask, a_size, 0.0f, 1.0f);
+    Threading::ParallelFor(Threading::ELEMENTWISE, a_size, [&](size_t a_begin, size_t a_end) {
+        for (size_t i = a_begin; i < a_end; ++i)
+        {
+            a_mask[i] = a_mask[i] < a_keepProb ? l_scale : 0.0f;
+        }
+    });
+}
+
+void Philox::Shuffle(std::vector<size_t>& a_values) const
+{
+    // Swap position i with a position in [0, i] picked by value i, multiply and
+    // shift maps 32 random bits onto the range without a division
+    for (size_t i = a_values.size(); i > 1; --i)
+    {
+        size_t j = (size_t)(((uint64_t)At(i - 1) * (uint64_t)i) >> 32);
+        std::swap(a_values[i - 1], a_values[j]);
+    }
+}
+
+uint64_t Philox::Seed() const
+{
+    return m_seed;
+}
+
+uint64_t Philox::Stream() const
+{
+    return m_stream;
+}
+
+void Philox::p_Blocks(size_t a_firstBlock, size_t a_numBlocks, uint32_t* a_out) const
+{
+    uint32_t c0[kBatchBlocks], c1[kBatchBlocks], c2[kBatchBlocks], c3[kBatchBlocks];
+    for (size_t b = 0; b < kBatchBlocks; ++b)
+    {
+        uint64_t l_counter = a_firstBlock + b;
+        c0[b] = (uint32_t)l_counter;
+        c1[b] = (uint32_t)(l_counter >> 32);
+        c2[b] = (uint32_t)m_stream;
+        c3[b] = (uint32_t)(m_stream >> 32);
+    }
+
+    uint32_t k0 = (uint32_t)m_seed;
+    uint32_t k1 = (uint32_t)(m_seed >> 32);
+    for (size_t r = 0; r < kNumRounds; ++r)
+    {
+        // Same round as Block() on every lane, no branches so it vectorizes
+        for (size_t b = 0; b < kBatchBlocks; ++b)
+        {
+            uint64_t l_prod0 = (uint64_t)kMul0 * c0[b];
+            uint64_t l_prod1 = (uint64_t)kMul1 * c2[b];
+            uint32_t l_hi0 = (uint32_t)(l_prod0 >> 32);
+            uint32_t l_hi1 = (uint32_t)(l_prod1 >> 32);
+            c0[b] = l_hi1 ^ c1[b] ^ k0;
+            c1[b] = (uint32_t)l_prod1;
+            c2[b] = l_hi0 ^ c3[b] ^ k1;
+            c3[b] = (uint32_t)l_prod0;
+        }
+        k0 += kWeyl0;
+        k1 += kWeyl1;
+    }
+
+    for (size_t b = 0; b < a_numBlocks; ++b)
+    {
+        a_out[4 * b] = c0[b];
+        a_out[4 * b + 1] = c1[b];
+        a_out[4 * b + 2] = c2[b];
+        a_out[4 * b + 3] = c3[b];
+    }
+}
+
+} // namespace neural
@@ -0,0 +1,467 @@
+/*
+ * Pipeline Trainer Implementation
+ *
+ */
+
+#include "neural/train/pipeline_trainer.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+double PipelineStats::BubbleFraction() const
+{
+    if (seconds <= 0.0 || busySeconds.empty())
+    {
+        return 0.0;
+    }
+
+    double l_idle = 0.0;
+    for (double l_busy : busySeconds)
+    {
+        l_idle += std::max(0.0, seconds - l_busy);
+    }
+    return l_idle / (seconds * busySeconds.size());
+}
+
+double PipelineStats::IdealBubbleFraction(size_t a_numStages, size_t a_numMicroBatches)
+{
+    if (a_numStages == 0 || a_numMicroBatches == 0)
+    {
+        return 0.0;
+    }
+    return (double)(a_numStages - 1) / (double)(a_numMicroBatches + a_numStages - 1);
+}
+
+PipelineTrainer::PipelineTrainer(
+    Sequential& a_model, size_t a_numStages, size_t a_numMicroBatches,
+    ESchedule a_schedule, size_t a_queueCapacity)
+    : m_model(a_model)
+    , m_numMicroBatches(std::max((size_t)1, a_numMicroBatches))
+    , m_schedule(a_schedule)
+    , m_inputs(nullptr)
+    , m_targets(nullptr)
+    , m_learningRate(0.0)
+    , m_stepMicroBatches(0)
+    , m_stepLoss(0.0)
+    , m_generation(0)
+    , m_numRunning(0)
+    , m_stop(false)
+{
+    size_t l_numLayers = m_model.Layers().size();
+    if (a_numStages == 0 || a_numStages > l_numLayers)
+    {
+        stringstream l_ss;
+        l_ss << "PipelineTrainer needs between 1 and " << l_numLayers
+             << " stages for this model, got " << a_numStages;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    p_Partition(a_numStages);
+
+    // Under GPipe a stage only starts taking gradients once all its forwards are done,
+    // so the gradients of every micro-batch have to fit in its queue meanwhile
+    size_t l_capacity = a_queueCapacity == 0 ? a_numStages : a_queueCapacity;
+    size_t l_backwardCapacity = l_capacity;
+    if (m_schedule == GPIPE)
+    {
+        l_backwardCapacity = std::max(l_capacity, m_numMicroBatches);
+    }
+
+    for (size_t s = 0; s < a_numStages; ++s)
+    {
+        m_forward.emplace_back(new TQueue(l_capacity));
+        m_backward.emplace_back(new TQueue(l_backwardCapacity));
+    }
+
+    ResetStats();
+
+    for (size_t s = 0; s < a_numStages; ++s)
+    {
+        m_threads.emplace_back(&PipelineTrainer::p_StageLoop, this, s);
+    }
+}
+
+PipelineTrainer::~PipelineTrainer()
+{
+    {
+        lock_guard<mutex> l_lock(m_mutex);
+        m_stop = true;
+    }
+    m_startCond.notify_all();
+
+    for (thread& l_thread : m_threads)
+    {
+        l_thread.join();
+    }
+}
+
+float PipelineTrainer::Step(
+    const std::vector<TTensorPtr>& a_inputs,
+    const std::vector<float>& a_targets,
+    float a_learningRate)
+{
+    if (a_inputs.empty() || a_inputs.size() != a_targets.size())
+    {
+        stringstream l_ss;
+        l_ss << "PipelineTrainer::Step needs one target per input, got "
+             << a_inputs.size() << " inputs and " << a_targets.size() << " targets";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    m_inputs = &a_inputs;
+    m_targets = &a_targets;
+    m_learningRate = a_learningRate;
+    m_stepMicroBatches = std::min(m_numMicroBatches, a_inputs.size());
+    m_stepLoss = 0.0;
+    for (size_t s = 0; s < NumStages(); ++s)
+    {
+        m_forward[s]->Reset();
+        m_backward[s]->Reset();
+    }
+
+    // Every stage calls BLAS at the same time, so BLAS itself has to stay single threaded
+    size_t l_numStages = NumStages();
+    if (l_numStages > 1)
+    {
+        Threading::SetBlasThreads(1);
+    }
+
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    exception_ptr l_error;
+    {
+        unique_lock<mutex> l_lock(m_mutex);
+        m_error = nullptr;
+        m_numRunning = l_numStages;
+        ++m_generation;
+        m_startCond.notify_all();
+        m_doneCond.wait(l_lock, [this]() { return m_numRunning == 0; });
+        l_error = m_error;
+    }
+    chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+
+    if (l_numStages > 1)
+    {
+        Threading::SetBlasThreads(Threading::NumThreads());
+    }
+
+    if (l_error)
+    {
+        // Stages that got this far kept gradients of the micro-batches they saw,
+        // the next step must not apply them. The queues still hold activations.
+        for (const TLayerPtr& l_layer : m_model.Layers())
+        {
+            l_layer->ZeroGrad();
+        }
+        m_loss.ZeroGrad();
+        for (size_t s = 0; s < l_numStages; ++s)
+        {
+            m_forward[s]->Reset();
+            m_backward[s]->Reset();
+        }
+        rethrow_exception(l_error);
+    }
+
+    ++m_stats.steps;
+    m_stats.seconds += l_elapsed.count();
+    return m_stepLoss / ((float)a_inputs.size());
+}
+
+size_t PipelineTrainer::NumStages() const
+{
+    return m_stageBegin.size() - 1;
+}
+
+size_t PipelineTrainer::StageBegin(size_t a_stage) const
+{
+    return m_stageBegin.at(a_stage);
+}
+
+const PipelineStats& PipelineTrainer::Stats() const
+{
+    return m_stats;
+}
+
+void PipelineTrainer::ResetStats()
+{
+    m_stats.steps = 0;
+    m_stats.seconds = 0.0;
+    m_stats.busySeconds.assign(NumStages(), 0.0);
+}
+
+void PipelineTrainer::p_Partition(size_t a_numStages)
+{
+    // Balance the stages by number of weights, layers without weights cost one
+    const vector<TLayerPtr>& l_layers = m_model.Layers();
+    vector<double> l_costs;
+    double l_totalCost = 0.0;
+    for (const TLayerPtr& l_layer : l_layers)
+    {
+        double l_cost = l_layer->HasWeights() ? (double)l_layer->Weights()->Size() : 1.0;
+        l_costs.push_back(l_cost);
+        l_totalCost += l_cost;
+    }
+
+    m_stageBegin.assign(1, 0);
+    double l_cost = 0.0;
+    for (size_t l = 0; l < l_layers.size(); ++l)
+    {
+        l_cost += l_costs[l];
+        size_t l_stage = m_stageBegin.size() - 1;
+        size_t l_layersLeft = l_layers.size() - (l + 1);
+        size_t l_stagesLeft = a_numStages - (l_stage + 1);
+        if (l_stagesLeft == 0)
+        {
+            break;
+        }
+
+        // Cut once this stage has its share, or when every remaining layer needs its own stage
+        if (l_cost >= l_totalCost * (l_stage + 1) / a_numStages || l_layersLeft == l_stagesLeft)
+        {
+            m_stageBegin.push_back(l + 1);
+        }
+    }
+    m_stageBegin.push_back(l_layers.size());
+}
+
+void PipelineTrainer::p_StageLoop(size_t a_stage)
+{
+    // With several stages each one is a single thread on its own core
+    unique_ptr<Threading::SerialScope> l_serial;
+    if (NumStages() > 1)
+    {
+        l_serial.reset(new Threading::SerialScope());
+        if (Threading::NumCores() >= NumStages())
+        {
+            Threading::RestrictToCores(a_stage, 1);
+        }
+    }
+
+    size_t l_generation = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> l_lock(m_mutex);
+            m_startCond.wait(l_lock, [&]() { return m_stop || m_generation != l_generation; });
+            if (m_stop)
+            {
+                return;
+            }
+            l_generation = m_generation;
+        }
+
+        double l_busySeconds = 0.0;
+        try
+        {
+            l_busySeconds = p_RunStage(a_stage);
+        }
+        catch (...)
+        {
+            {
+                lock_guard<mutex> l_lock(m_mutex);
+                m_error = current_exception();
+            }
+
+            // Wake the other stages, they may be waiting on us
+            for (size_t s = 0; s < NumStages(); ++s)
+            {
+                m_forward[s]->Close();
+                m_backward[s]->Close();
+            }
+        }
+
+        {
+            lock_guard<mutex> l_lock(m_mutex);
+            m_stats.busySeconds[a_stage] += l_busySeconds;
+            --m_numRunning;
+        }
+        m_doneCond.notify_all();
+    }
+}
+
+double PipelineTrainer::p_RunStage(size_t a_stage)
+{
+    const vector<TLayerPtr>& l_layers = m_model.Layers();
+    size_t l_begin = m_stageBegin[a_stage];
+    size_t l_end = m_stageBegin[a_stage + 1];
+    size_t l_numStages = NumStages();
+    size_t l_numMicroBatches = m_stepMicroBatches;
+    bool l_isFirst = (a_stage == 0);
+    bool l_isLast = (a_stage + 1 == l_numStages);
+
+    // Inputs to each of our layers, kept per micro-batch until its backward
+    vector<vector<TTensorPtr>> l_activations(l_numMicroBatches);
+    double l_busySeconds = 0.0;
+    size_t l_nextForward = 0;
+
+    // Layers each push one gradient per micro-batch and average them, scaling by
+    // M / B makes that average the mean over the whole batch
+    float l_gradScale = (float)l_numMicroBatches / (float)m_inputs->size();
+
+    auto l_backwardCompute = [&](const Message& a_grad) {
+        TTensorPtr l_grad = a_grad.tensor;
+        vector<TTensorPtr>& l_stageActivations = l_activations[a_grad.microBatch];
+        for (size_t l = l_end; l > l_begin; --l)
+        {
+            l_grad = l_layers[l - 1]->Backward(l_stageActivations[l - 1 - l_begin], l_grad);
+        }
+        l_stageActivations.clear();
+        return Message{a_grad.microBatch, l_grad};
+    };
+
+    auto l_forward = [&]() {
+        Message l_in;
+        if (l_isFirst)
+        {
+            l_in.microBatch = l_nextForward++;
+            l_in.tensor = p_MicroBatchInput(l_in.microBatch);
+        }
+        else if (!m_forward[a_stage - 1]->Pop(l_in))
+        {
+            return false;
+        }
+
+        chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+        TTensorPtr l_output = l_in.tensor;
+        vector<TTensorPtr>& l_stageActivations = l_activations[l_in.microBatch];
+        for (size_t l = l_begin; l < l_end; ++l)
+        {
+            l_stageActivations.push_back(l_output);
+            l_output = l_layers[l]->ForwardForBackward(l_output);
+        }
+
+        if (!l_isLast)
+        {
+            l_busySeconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+            return m_forward[a_stage]->Push(Message{l_in.microBatch, l_output});
+        }
+
+        // The last stage turns predictions into gradients and goes straight into backward
+        size_t l_exampleBegin = 0, l_exampleEnd = 0;
+        p_MicroBatchRange(l_in.microBatch, l_exampleBegin, l_exampleEnd);
+        TMutableTensorPtr l_errorGrad = Tensor::New({l_exampleEnd - l_exampleBegin, 1});
+        if (l_output->Shape().size() != 2 || l_output->Shape()[0] != l_exampleEnd - l_exampleBegin || l_output->Shape()[1] == 0)
+        {
+            stringstream l_ss;
+            l_ss << "PipelineTrainer needs one prediction per example, got " << l_output->ShapeStr()
+                 << " for " << l_exampleEnd - l_exampleBegin << " examples";
+            LOG(ERROR) << l_ss.str() << endl;
+            throw(runtime_error(l_ss.str()));
+        }
+        TensorView<2, const float> l_outputView = l_output->View<2>();
+        TensorView<2> l_errorGradView = l_errorGrad->MutableView<2>();
+        for (size_t i = l_exampleBegin; i < l_exampleEnd; ++i)
+        {
+            float l_predVal = l_outputView(i - l_exampleBegin, 0);
+            m_stepLoss += m_loss.Forward(l_predVal, (*m_targets)[i]);
+            l_errorGradView(i - l_exampleBegin, 0) = m_loss.Backward(l_predVal, (*m_targets)[i]) * l_gradScale;
+        }
+        m_loss.ZeroGrad();
+
+        Message l_grad = l_backwardCompute(Message{l_in.microBatch, l_errorGrad});
+        l_busySeconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+        return l_isFirst || m_backward[a_stage - 1]->Push(l_grad);
+    };
+
+    auto l_backward = [&]() {
+        Message l_in;
+        if (!m_backward[a_stage]->Pop(l_in))
+        {
+            return false;
+        }
+
+        chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+        Message l_grad = l_backwardCompute(l_in);
+        l_busySeconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+        return l_isFirst || m_backward[a_stage - 1]->Push(l_grad);
+    };
+
+    if (l_isLast)
+    {
+        for (size_t i = 0; i < l_numMicroBatches; ++i)
+        {
+            if (!l_forward())
+            {
+                return l_busySeconds;
+            }
+        }
+    }
+    else
+    {
+        // GPipe runs every forward first, 1F1B only runs far enough ahead to fill the pipeline
+        size_t l_warmup = l_numMicroBatches;
+        if (m_schedule == ONE_F_ONE_B)
+        {
+            l_warmup = std::min(l_numStages - a_stage - 1, l_numMicroBatches);
+        }
+
+        for (size_t i = 0; i < l_warmup; ++i)
+        {
+            if (!l_forward())
+            {
+                return l_busySeconds;
+            }
+        }
+        for (size_t i = l_warmup; i < l_numMicroBatches; ++i)
+        {
+            if (!l_forward() || !l_backward())
+            {
+                return l_busySeconds;
+            }
+        }
+        for (size_t i = 0; i < l_warmup; ++i)
+        {
+            if (!l_backward())
+            {
+                return l_busySeconds;
+            }
+        }
+    }
+
+    // Every stage updates its own layers once all the micro-batches are back
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    for (size_t l = l_begin; l < l_end; ++l)
+    {
+        l_layers[l]->UpdateWeights(m_learningRate);
+    }
+    l_busySeconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+    return l_busySeconds;
+}
+
+TTensorPtr PipelineTrainer::p_MicroBatchInput(size_t a_microBatch) const
+{
+    size_t l_begin = 0, l_end = 0;
+    p_MicroBatchRange(a_microBatch, l_begin, l_end);
+
+    size_t l_numCols = (*m_inputs)[l_begin]->Size();
+    vector<float> l_data;
+    l_data.reserve((l_end - l_begin) * l_numCols);
+    for (size_t i = l_begin; i < l_end; ++i)
+    {
+        const vector<float>& l_example = (*m_inputs)[i]->Data();
+        l_data.insert(l_data.end(), l_example.begin(), l_example.end());
+    }
+    // Examples are [1, ...], stacked they are [n, ...]
+    vector<size_t> l_shape = (*m_inputs)[l_begin]->Shape();
+    l_shape[0] = l_end - l_begin;
+    return Tensor::New(l_shape, l_data);
+}
+
+void PipelineTrainer::p_MicroBatchRange(size_t a_microBatch, size_t& a_outBegin, size_t& a_outEnd) const
+{
+    size_t l_batchSize = m_inputs->size();
+    a_outBegin = (l_batchSize * a_microBatch) / m_stepMicroBatches;
+    a_outEnd = (l_batchSize * (a_microBatch + 1)) / m_stepMicroBatches;
+}
+
+} // namespace neural
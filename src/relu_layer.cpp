@@ -4,8 +4,7 @@
  */
 
 #include "neural/layers/relu_layer.h"
-
-#include <algorithm>
+#include "neural/math/tensor_expr.h"
 
 using namespace std;
 
@@ -19,39 +18,29 @@ ReLULayer::ReLULayer()
 
 TTensorPtr ReLULayer::Forward(const TTensorPtr& a_input) const
 {
-    // initialize our return matrix with the input
-    TMutableTensorPtr l_ret = a_input->ToMutable();
- 
-    // walk over rows
-    for (size_t i = 0; i < a_input->Shape().at(0); ++i)
-    {
-        // walk over cols
-        for (size_t j = 0; j < a_input->Shape().at(1); ++j)
-        {
-            // max(0,x)
-            l_ret->SetAt({i,j}, std::max(0.0f, l_ret->At({i,j})));
-        }
-    }
-    return l_ret;
+    // Elementwise, so any rank works, ie. NCHW activations of a Conv2DLayer
+    return Evaluate(Max(Lazy(a_input), 0.0f));
 }
 
 TTensorPtr ReLULayer::Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput)
 {
-    TMutableTensorPtr grad = a_gradInput->ToMutable();
-
-    // walk over rows
-    for (size_t i = 0; i < a_gradInput->Shape().at(0); ++i)
-    {
-        // walk over cols
-        for (size_t j = 0; j < a_gradInput->Shape().at(1); ++j)
-        {
-            if (a_origInput->At({i,j}) < 0)
-            {
-                grad->SetAt({i,j}, 0.0);
-            }
-        }
-    }
-    return grad;
+    TTensorPtr l_weightGrad;
+    return CalcGradients(a_origInput, a_gradInput, l_weightGrad);
+}
+
+TTensorPtr ReLULayer::CalcGradients(
+    const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+    TTensorPtr& a_outWeightGrad) const
+{
+    // nothing to learn
+    a_outWeightGrad = nullptr;
+
+    return Evaluate(Where(Lazy(a_origInput) < 0.0f, 0.0f, Lazy(a_gradInput)));
+}
+
+TLayerPtr ReLULayer::Clone() const
+{
+    return TLayerPtr(new ReLULayer(*this));
 }
 
 } // namespace neural
@@ -0,0 +1,255 @@
+/*
+ * Sequential Model Implementation
+ *
+ */
+
+#include "neural/models/sequential.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+static size_t ActivationBytes(const TTensorPtr& a_activation)
+{
+    return a_activation ? a_activation->Size() * sizeof(float) : 0;
+}
+
+Sequential::Sequential()
+    : m_checkpointBudget(0)
+    , m_checkpointStats()
+    , m_layerTiming(false)
+{
+
+}
+
+void Sequential::Add(const TLayerPtr& a_layer)
+{
+    m_layers.push_back(a_layer);
+    if (m_layerTiming)
+    {
+        SetLayerTiming(true);
+    }
+}
+
+const std::vector<TLayerPtr>& Sequential::Layers() const
+{
+    return m_layers;
+}
+
+TTensorPtr Sequential::Forward(const TTensorPtr& a_input) const
+{
+    TTensorPtr l_output = a_input;
+    for (const TLayerPtr& l_layer : m_layers)
+    {
+        l_output = l_layer->Forward(l_output);
+    }
+    return l_output;
+}
+
+TTensorPtr Sequential::Forward(
+    const TTensorPtr& a_input,
+    std::vector<TTensorPtr>& a_outActivations,
+    const TLayerHook& a_beforeLayer) const
+{
+    a_outActivations.clear();
+
+    // Drop activations until the ones dropped since the last checkpoint would
+    // go over half the budget, then keep one. The model input is always kept,
+    // the caller is holding it anyway.
+    size_t l_segmentBudget = m_checkpointBudget / 2;
+    size_t l_segmentBytes = 0;
+    TTensorPtr l_output = a_input;
+    for (size_t i = 0; i < m_layers.size(); ++i)
+    {
+        size_t l_bytes = ActivationBytes(l_output);
+        if (m_checkpointBudget == 0 || a_outActivations.empty() || l_segmentBytes + l_bytes > l_segmentBudget)
+        {
+            a_outActivations.push_back(l_output);
+            l_segmentBytes = 0;
+        }
+        else
+        {
+            a_outActivations.push_back(TTensorPtr());
+            l_segmentBytes += l_bytes;
+        }
+
+        if (a_beforeLayer)
+        {
+            a_beforeLayer(i);
+        }
+        if (m_forwardTimes.empty())
+        {
+            l_output = m_layers[i]->ForwardForBackward(l_output);
+        }
+        else
+        {
+            ScopedTimer l_timer(*m_forwardTimes[i]);
+            l_output = m_layers[i]->ForwardForBackward(l_output);
+        }
+    }
+    return l_output;
+}
+
+TTensorPtr Sequential::Backward(
+    const std::vector<TTensorPtr>& a_activations,
+    const TTensorPtr& a_gradOutput,
+    const TLayerHook& a_afterLayer)
+{
+    if (a_activations.size() != m_layers.size())
+    {
+        stringstream l_ss;
+        l_ss << "Sequential::Backward got " << a_activations.size()
+             << " activations for " << m_layers.size() << " layers";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    if (!m_layers.empty() && !a_activations[0])
+    {
+        stringstream l_ss;
+        l_ss << "Sequential::Backward needs the input of the first layer";
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    m_checkpointStats = CheckpointStats();
+    for (const TTensorPtr& l_activation : a_activations)
+    {
+        m_checkpointStats.keptBytes += ActivationBytes(l_activation);
+    }
+    m_checkpointStats.allBytes = m_checkpointStats.keptBytes;
+    m_checkpointStats.peakBytes = m_checkpointStats.keptBytes;
+
+    // Last segment first, each one starts at a kept activation and runs up to
+    // the next one
+    TTensorPtr l_grad = a_gradOutput;
+    size_t l_end = m_layers.size();
+    while (l_end > 0)
+    {
+        size_t l_first = l_end - 1;
+        while (!a_activations[l_first])
+        {
+            --l_first;
+        }
+        l_grad = p_BackwardSegment(a_activations[l_first], l_first, l_end, l_grad, a_afterLayer);
+        l_end = l_first;
+    }
+
+    chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+    m_checkpointStats.backwardSeconds = l_elapsed.count();
+    return l_grad;
+}
+
+void Sequential::SetCheckpointBudget(size_t a_bytes)
+{
+    m_checkpointBudget = a_bytes;
+}
+
+size_t Sequential::CheckpointBudget() const
+{
+    return m_checkpointBudget;
+}
+
+const CheckpointStats& Sequential::LastCheckpointStats() const
+{
+    return m_checkpointStats;
+}
+
+void Sequential::SetLayerTiming(bool a_enabled)
+{
+    m_layerTiming = a_enabled;
+    m_forwardTimes.clear();
+    m_backwardTimes.clear();
+    if (!a_enabled)
+    {
+        return;
+    }
+
+    // Looked up once here, the hot loops only touch the histograms
+    for (size_t i = 0; i < m_layers.size(); ++i)
+    {
+        string l_labels = "layer=\"" + to_string(i) + "\"";
+        m_forwardTimes.push_back(&Metrics::Instance().GetHistogram("layer_forward_seconds", l_labels));
+        m_backwardTimes.push_back(&Metrics::Instance().GetHistogram("layer_backward_seconds", l_labels));
+    }
+}
+
+bool Sequential::LayerTiming() const
+{
+    return m_layerTiming;
+}
+
+TTensorPtr Sequential::p_BackwardSegment(
+    const TTensorPtr& a_checkpoint, size_t a_first, size_t a_end,
+    const TTensorPtr& a_gradOutput, const TLayerHook& a_afterLayer)
+{
+    // Redo the forwards from the checkpoint, only this segment is alive
+    // on top of the checkpoints until it goes out of scope
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    vector<TTensorPtr> l_segment(1, a_checkpoint);
+    size_t l_segmentBytes = 0;
+    for (size_t i = a_first; i + 1 < a_end; ++i)
+    {
+        l_segment.push_back(m_layers[i]->ForwardForBackward(l_segment.back()));
+        l_segmentBytes += ActivationBytes(l_segment.back());
+    }
+    if (l_segment.size() > 1)
+    {
+        chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+        m_checkpointStats.recomputeSeconds += l_elapsed.count();
+        m_checkpointStats.recomputedLayers += l_segment.size() - 1;
+        m_checkpointStats.allBytes += l_segmentBytes;
+        m_checkpointStats.peakBytes = std::max(
+            m_checkpointStats.peakBytes, m_checkpointStats.keptBytes + l_segmentBytes);
+    }
+
+    TTensorPtr l_grad = a_gradOutput;
+    for (size_t i = a_end; i > a_first; --i)
+    {
+        if (m_backwardTimes.empty())
+        {
+            l_grad = m_layers[i - 1]->Backward(l_segment[i - 1 - a_first], l_grad);
+        }
+        else
+        {
+            ScopedTimer l_timer(*m_backwardTimes[i - 1]);
+            l_grad = m_layers[i - 1]->Backward(l_segment[i - 1 - a_first], l_grad);
+        }
+        if (a_afterLayer)
+        {
+            a_afterLayer(i - 1);
+        }
+    }
+    return l_grad;
+}
+
+void Sequential::UpdateWeights(float a_learningRate)
+{
+    // Last layer first, same order we get gradients in
+    for (size_t i = m_layers.size(); i > 0; --i)
+    {
+        m_layers[i - 1]->UpdateWeights(a_learningRate);
+    }
+}
+
+Sequential Sequential::Clone() const
+{
+    Sequential l_clone;
+    l_clone.SetCheckpointBudget(m_checkpointBudget);
+    for (const TLayerPtr& l_layer : m_layers)
+    {
+        l_clone.Add(l_layer->Clone());
+    }
+    l_clone.SetLayerTiming(LayerTiming());
+    return l_clone;
+}
+
+} // namespace neural
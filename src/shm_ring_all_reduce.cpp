@@ -0,0 +1,218 @@
+/*
+ * Shared Memory Ring All Reduce Implementation
+ *
+ */
+
+#include "neural/parallel/shm_ring_all_reduce.h"
+
+#include <glog/logging.h>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace neural
+{
+
+// Keep every rank's buffer on its own cache lines
+static const size_t kCacheLine = 64;
+
+static void ThrowErrno(const string& a_what, const string& a_name)
+{
+    stringstream l_ss;
+    l_ss << a_what << " " << a_name << ": " << strerror(errno);
+    LOG(ERROR) << l_ss.str() << endl;
+    throw(runtime_error(l_ss.str()));
+}
+
+// Chunk c of a vector split over the ranks is [c * size / N, (c + 1) * size / N)
+static size_t ChunkBegin(size_t a_chunk, size_t a_size, size_t a_worldSize)
+{
+    return (a_chunk * a_size) / a_worldSize;
+}
+
+void ShmRingAllReduce::Create(const std::string& a_name, size_t a_worldSize, size_t a_maxFloats)
+{
+    int l_fd = shm_open(a_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (l_fd < 0)
+    {
+        ThrowErrno("ShmRingAllReduce::Create shm_open", a_name);
+    }
+
+    size_t l_bytes = p_BytesFor(a_worldSize, a_maxFloats);
+    if (ftruncate(l_fd, l_bytes) != 0)
+    {
+        close(l_fd);
+        ThrowErrno("ShmRingAllReduce::Create ftruncate", a_name);
+    }
+
+    void* l_mem = mmap(nullptr, l_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0);
+    close(l_fd);
+    if (l_mem == MAP_FAILED)
+    {
+        ThrowErrno("ShmRingAllReduce::Create mmap", a_name);
+    }
+
+    // Lock free atomics work across processes since they are just memory
+    Header* l_header = new (l_mem) Header();
+    l_header->barrierCount = 0;
+    l_header->barrierSense = 0;
+    l_header->worldSize = a_worldSize;
+    l_header->maxFloats = a_maxFloats;
+    munmap(l_mem, l_bytes);
+}
+
+void ShmRingAllReduce::Unlink(const std::string& a_name)
+{
+    shm_unlink(a_name.c_str());
+}
+
+ShmRingAllReduce::ShmRingAllReduce(const std::string& a_name, size_t a_rank)
+    : m_rank(a_rank)
+    , m_mappedBytes(0)
+    , m_header(nullptr)
+    , m_buffers(nullptr)
+    , m_localSense(0)
+{
+    int l_fd = shm_open(a_name.c_str(), O_RDWR, 0600);
+    if (l_fd < 0)
+    {
+        ThrowErrno("ShmRingAllReduce shm_open", a_name);
+    }
+
+    struct stat l_stat;
+    if (fstat(l_fd, &l_stat) != 0)
+    {
+        close(l_fd);
+        ThrowErrno("ShmRingAllReduce fstat", a_name);
+    }
+    m_mappedBytes = l_stat.st_size;
+
+    void* l_mem = mmap(nullptr, m_mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0);
+    close(l_fd);
+    if (l_mem == MAP_FAILED)
+    {
+        ThrowErrno("ShmRingAllReduce mmap", a_name);
+    }
+
+    m_header = static_cast<Header*>(l_mem);
+    m_buffers = reinterpret_cast<float*>(static_cast<char*>(l_mem) + kCacheLine);
+
+    if (m_rank >= m_header->worldSize)
+    {
+        stringstream l_ss;
+        l_ss << "ShmRingAllReduce rank " << m_rank << " >= world size " << m_header->worldSize;
+        munmap(l_mem, m_mappedBytes);
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+ShmRingAllReduce::~ShmRingAllReduce()
+{
+    munmap(m_header, m_mappedBytes);
+}
+
+void ShmRingAllReduce::SumInPlace(float* a_data, size_t a_size)
+{
+    if (a_size > m_header->maxFloats)
+    {
+        stringstream l_ss;
+        l_ss << "ShmRingAllReduce::SumInPlace size " << a_size
+             << " > max " << m_header->maxFloats;
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t l_worldSize = m_header->worldSize;
+    size_t l_prev = (m_rank + l_worldSize - 1) % l_worldSize;
+    float* l_mine = p_Buffer(m_rank);
+    const float* l_theirs = p_Buffer(l_prev);
+
+    memcpy(l_mine, a_data, sizeof(float) * a_size);
+    Barrier();
+
+    // Reduce-scatter, at step s we add chunk (rank - s - 1) from the previous rank.
+    // The previous rank finished summing that chunk in step s - 1, and nobody else
+    // writes to it this step, so one barrier per step is enough.
+    for (size_t s = 0; s + 1 < l_worldSize; ++s)
+    {
+        size_t l_chunk = (m_rank + 2 * l_worldSize - s - 1) % l_worldSize;
+        size_t l_end = ChunkBegin(l_chunk + 1, a_size, l_worldSize);
+        for (size_t i = ChunkBegin(l_chunk, a_size, l_worldSize); i < l_end; ++i)
+        {
+            l_mine[i] += l_theirs[i];
+        }
+        Barrier();
+    }
+
+    // We now own the full sum of chunk (rank + 1), pass the sums around the ring
+    for (size_t s = 0; s + 1 < l_worldSize; ++s)
+    {
+        size_t l_chunk = (m_rank + l_worldSize - s) % l_worldSize;
+        size_t l_begin = ChunkBegin(l_chunk, a_size, l_worldSize);
+        memcpy(l_mine + l_begin, l_theirs + l_begin, sizeof(float) * (ChunkBegin(l_chunk + 1, a_size, l_worldSize) - l_begin));
+        Barrier();
+    }
+
+    memcpy(a_data, l_mine, sizeof(float) * a_size);
+
+    // Nobody may overwrite their buffer for the next call until everyone has copied out
+    Barrier();
+}
+
+void ShmRingAllReduce::Barrier()
+{
+    // Sense reversing barrier, the last rank in flips the sense to release everyone
+    m_localSense = 1 - m_localSense;
+    if (m_header->barrierCount.fetch_add(1) + 1 == m_header->worldSize)
+    {
+        m_header->barrierCount = 0;
+        m_header->barrierSense = m_localSense;
+    }
+    else
+    {
+        while (m_header->barrierSense != m_localSense)
+        {
+            sched_yield();
+        }
+    }
+}
+
+size_t ShmRingAllReduce::Rank() const
+{
+    return m_rank;
+}
+
+size_t ShmRingAllReduce::WorldSize() const
+{
+    return m_header->worldSize;
+}
+
+float* ShmRingAllReduce::p_Buffer(size_t a_rank) const
+{
+    return m_buffers + a_rank * (p_BufferStride(m_header->maxFloats) / sizeof(float));
+}
+
+size_t ShmRingAllReduce::p_BytesFor(size_t a_worldSize, size_t a_maxFloats)
+{
+    // Header gets its own cache line, then one buffer per rank
+    return kCacheLine + a_worldSize * p_BufferStride(a_maxFloats);
+}
+
+size_t ShmRingAllReduce::p_BufferStride(size_t a_maxFloats)
+{
+    size_t l_bytes = sizeof(float) * a_maxFloats;
+    return ((l_bytes + kCacheLine - 1) / kCacheLine) * kCacheLine;
+}
+
+} // namespace neural
@@ -0,0 +1,242 @@
+/*
+ * Sparse Tensor Implementation
+ *
+ */
+
+#include "neural/math/sparse_tensor.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+SparseTensor::SparseTensor(size_t a_rows, size_t a_cols, EFormat a_format)
+    : m_format(a_format)
+    , m_shape({a_rows, a_cols})
+    , m_offsets(new vector<size_t>(1, 0))
+    , m_indices(new vector<uint32_t>())
+    , m_values(new vector<float>())
+{
+
+}
+
+TSparseTensorPtr SparseTensor::FromDense(const TTensorPtr& a_dense, EFormat a_format)
+{
+    TSparseTensorPtr l_csr = FromDenseIfSparse(a_dense, 1.0);
+    return a_format == CSR ? l_csr : l_csr->ToFormat(a_format);
+}
+
+TSparseTensorPtr SparseTensor::FromDenseIfSparse(const TTensorPtr& a_dense, float a_maxDensity)
+{
+    if (a_dense->Shape().size() != 2)
+    {
+        stringstream l_ss;
+        l_ss << "SparseTensor::FromDense needs a matrix, got " << a_dense->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t l_rows = a_dense->Shape().at(0);
+    size_t l_cols = a_dense->Shape().at(1);
+    size_t l_maxNonZeros = (size_t)(a_maxDensity * (float)(l_rows * l_cols));
+    const float* l_data = a_dense->Data().data();
+
+    shared_ptr<SparseTensor> l_sparse(new SparseTensor(l_rows, l_cols, CSR));
+    vector<size_t>& l_offsets = *l_sparse->m_offsets;
+    vector<uint32_t>& l_indices = *l_sparse->m_indices;
+    vector<float>& l_values = *l_sparse->m_values;
+    l_offsets.reserve(l_rows + 1);
+    for (size_t i = 0; i < l_rows; ++i)
+    {
+        const float* l_row = l_data + i * l_cols;
+        for (size_t j = 0; j < l_cols; ++j)
+        {
+            if (l_row[j] != 0.0f)
+            {
+                l_indices.push_back(j);
+                l_values.push_back(l_row[j]);
+            }
+        }
+
+        // Dense enough that the dense kernels win, stop counting
+        if (l_values.size() > l_maxNonZeros)
+        {
+            return nullptr;
+        }
+        l_offsets.push_back(l_values.size());
+    }
+    return l_sparse;
+}
+
+TTensorPtr SparseTensor::ToDense() const
+{
+    TMutableTensorPtr l_dense = Tensor::Zeros(m_shape);
+    float* l_data = l_dense->MutableData().data();
+    size_t l_cols = m_shape[1];
+    for (size_t o = 0; o < NumOuter(); ++o)
+    {
+        for (size_t p = (*m_offsets)[o]; p < (*m_offsets)[o + 1]; ++p)
+        {
+            size_t l_inner = (*m_indices)[p];
+            size_t l_offset = (m_format == CSR) ? o * l_cols + l_inner : l_inner * l_cols + o;
+            l_data[l_offset] = (*m_values)[p];
+        }
+    }
+    return l_dense;
+}
+
+TSparseTensorPtr SparseTensor::ToFormat(EFormat a_format) const
+{
+    shared_ptr<SparseTensor> l_ret(new SparseTensor(*this));
+    if (a_format == m_format)
+    {
+        return l_ret;
+    }
+
+    // Counting sort of the non zeros by their inner index
+    size_t l_numOuter = NumOuter();
+    size_t l_numInner = (m_format == CSR) ? m_shape[1] : m_shape[0];
+    size_t l_nnz = NumNonZeros();
+    l_ret->m_format = a_format;
+    l_ret->m_offsets.reset(new vector<size_t>(l_numInner + 1, 0));
+    l_ret->m_indices.reset(new vector<uint32_t>(l_nnz));
+    l_ret->m_values.reset(new vector<float>(l_nnz));
+
+    vector<size_t>& l_offsets = *l_ret->m_offsets;
+    for (size_t p = 0; p < l_nnz; ++p)
+    {
+        ++l_offsets[(*m_indices)[p] + 1];
+    }
+    for (size_t i = 0; i < l_numInner; ++i)
+    {
+        l_offsets[i + 1] += l_offsets[i];
+    }
+
+    vector<size_t> l_next(l_offsets.begin(), l_offsets.end() - 1);
+    for (size_t o = 0; o < l_numOuter; ++o)
+    {
+        for (size_t p = (*m_offsets)[o]; p < (*m_offsets)[o + 1]; ++p)
+        {
+            size_t l_dst = l_next[(*m_indices)[p]]++;
+            (*l_ret->m_indices)[l_dst] = o;
+            (*l_ret->m_values)[l_dst] = (*m_values)[p];
+        }
+    }
+    return l_ret;
+}
+
+TSparseTensorPtr SparseTensor::Transpose() const
+{
+    shared_ptr<SparseTensor> l_ret(new SparseTensor(*this));
+    l_ret->m_format = (m_format == CSR) ? CSC : CSR;
+    l_ret->m_shape = {m_shape[1], m_shape[0]};
+    return l_ret;
+}
+
+TSparseTensorPtr SparseTensor::AddCol(float a_val) const
+{
+    TSparseTensorPtr l_csr = ToFormat(CSR);
+    size_t l_rows = m_shape[0];
+    size_t l_cols = m_shape[1];
+
+    shared_ptr<SparseTensor> l_ret(new SparseTensor(l_rows, l_cols + 1, CSR));
+    l_ret->m_offsets->reserve(l_rows + 1);
+    l_ret->m_indices->reserve(NumNonZeros() + l_rows);
+    l_ret->m_values->reserve(NumNonZeros() + l_rows);
+    for (size_t i = 0; i < l_rows; ++i)
+    {
+        size_t l_begin = l_csr->Offsets()[i];
+        size_t l_end = l_csr->Offsets()[i + 1];
+        l_ret->m_indices->insert(l_ret->m_indices->end(),
+                                 l_csr->Indices().begin() + l_begin, l_csr->Indices().begin() + l_end);
+        l_ret->m_values->insert(l_ret->m_values->end(),
+                                l_csr->Values().begin() + l_begin, l_csr->Values().begin() + l_end);
+        if (a_val != 0.0f)
+        {
+            l_ret->m_indices->push_back(l_cols);
+            l_ret->m_values->push_back(a_val);
+        }
+        l_ret->m_offsets->push_back(l_ret->m_values->size());
+    }
+    return m_format == CSR ? TSparseTensorPtr(l_ret) : l_ret->ToFormat(m_format);
+}
+
+void SparseTensor::AppendOuter(const std::vector<uint32_t>& a_indices, const std::vector<float>& a_values)
+{
+    size_t l_numInner = (m_format == CSR) ? m_shape[1] : m_shape[0];
+    if (a_indices.size() != a_values.size() || NumOuter() >= ((m_format == CSR) ? m_shape[0] : m_shape[1]))
+    {
+        stringstream l_ss;
+        l_ss << "SparseTensor::AppendOuter got " << a_indices.size() << " indices and "
+             << a_values.size() << " values after " << NumOuter() << " of " << ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    for (uint32_t l_idx : a_indices)
+    {
+        if (l_idx >= l_numInner)
+        {
+            stringstream l_ss;
+            l_ss << "SparseTensor::AppendOuter index " << l_idx << " out of range for " << ShapeStr();
+            LOG(ERROR) << l_ss.str() << endl;
+            throw(runtime_error(l_ss.str()));
+        }
+    }
+
+    m_indices->insert(m_indices->end(), a_indices.begin(), a_indices.end());
+    m_values->insert(m_values->end(), a_values.begin(), a_values.end());
+    m_offsets->push_back(m_values->size());
+}
+
+SparseTensor::EFormat SparseTensor::Format() const
+{
+    return m_format;
+}
+
+const std::vector<size_t>& SparseTensor::Shape() const
+{
+    return m_shape;
+}
+
+std::string SparseTensor::ShapeStr() const
+{
+    return Tensor::ShapeStr(m_shape);
+}
+
+size_t SparseTensor::NumNonZeros() const
+{
+    return m_values->size();
+}
+
+float SparseTensor::Density() const
+{
+    size_t l_size = m_shape[0] * m_shape[1];
+    return l_size == 0 ? 0.0f : (float)NumNonZeros() / (float)l_size;
+}
+
+size_t SparseTensor::NumOuter() const
+{
+    return m_offsets->size() - 1;
+}
+
+const std::vector<size_t>& SparseTensor::Offsets() const
+{
+    return *m_offsets;
+}
+
+const std::vector<uint32_t>& SparseTensor::Indices() const
+{
+    return *m_indices;
+}
+
+const std::vector<float>& SparseTensor::Values() const
+{
+    return *m_values;
+}
+
+} // namespace neural
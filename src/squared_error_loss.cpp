@@ -4,6 +4,7 @@
  */
 
 #include "neural/loss/squared_error_loss.h"
+#include "neural/math/tensor_math.h"
 
 using namespace std;
 
@@ -25,12 +26,7 @@ float SquaredErrorLoss::Backward(float input, float target)
 
 float SquaredErrorLoss::GetAvgGrad() const
 {
-    float sum = 0.0;
-    for (size_t i = 0; i < m_grads.size(); ++i)
-    {
-        sum += m_grads.at(i);
-    }
-    return sum / ((float) m_grads.size());
+    return TensorMath::Mean(m_grads.data(), m_grads.size());
 }
 
 void SquaredErrorLoss::ZeroGrad()
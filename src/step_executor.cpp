@@ -0,0 +1,120 @@
+/*
+ * Step Executor Implementation
+ *
+ */
+
+#include "neural/train/step_executor.h"
+#include "neural/parallel/thread_pool.h"
+
+#include <chrono>
+
+using namespace std;
+
+namespace neural
+{
+
+StepExecutor::StepExecutor(Sequential& a_model)
+    : m_model(a_model)
+    , m_pending(a_model.Layers().size())
+    , m_updateSeconds(a_model.Layers().size(), 0.0)
+    , m_waitSeconds(0.0)
+{
+
+}
+
+StepExecutor::~StepExecutor()
+{
+    // The tasks point at our members, so they have to finish first
+    for (future<void>& l_pending : m_pending)
+    {
+        if (l_pending.valid())
+        {
+            l_pending.wait();
+        }
+    }
+}
+
+TTensorPtr StepExecutor::Forward(const TTensorPtr& a_input, std::vector<TTensorPtr>& a_outActivations)
+{
+    return m_model.Forward(a_input, a_outActivations, [this](size_t a_layer) {
+        p_WaitFor(a_layer);
+    });
+}
+
+TTensorPtr StepExecutor::Backward(
+    const std::vector<TTensorPtr>& a_activations,
+    const TTensorPtr& a_gradOutput,
+    float a_learningRate)
+{
+    // Nothing is left to overlap with the first layer's update, and the next
+    // Forward needs it straight away, so it runs here with all our threads
+    const vector<TLayerPtr>& l_layers = m_model.Layers();
+    size_t l_first = 0;
+    while (l_first < l_layers.size() && !l_layers[l_first]->HasWeights())
+    {
+        ++l_first;
+    }
+
+    return m_model.Backward(a_activations, a_gradOutput, [&](size_t a_layer) {
+        if (!l_layers[a_layer]->HasWeights())
+        {
+            return;
+        }
+
+        Layer* l_layer = l_layers[a_layer].get();
+        double* l_seconds = &m_updateSeconds[a_layer];
+        if (a_layer == l_first)
+        {
+            chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+            l_layer->UpdateWeights(a_learningRate);
+            double l_elapsed = chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+            *l_seconds += l_elapsed;
+            m_waitSeconds += l_elapsed;
+            return;
+        }
+
+        // Forward waited for the last one before this Backward could run
+        m_pending[a_layer] = ThreadPool::Instance().Submit([l_layer, l_seconds, a_learningRate]() {
+            chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+            l_layer->UpdateWeights(a_learningRate);
+            *l_seconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+        });
+    });
+}
+
+void StepExecutor::Wait()
+{
+    for (size_t i = 0; i < m_pending.size(); ++i)
+    {
+        p_WaitFor(i);
+    }
+}
+
+double StepExecutor::UpdateSeconds() const
+{
+    double l_total = 0.0;
+    for (double l_seconds : m_updateSeconds)
+    {
+        l_total += l_seconds;
+    }
+    return l_total;
+}
+
+double StepExecutor::WaitSeconds() const
+{
+    return m_waitSeconds;
+}
+
+void StepExecutor::p_WaitFor(size_t a_layer)
+{
+    if (!m_pending[a_layer].valid())
+    {
+        return;
+    }
+
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    m_pending[a_layer].get();
+    m_waitSeconds += chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+}
+
+} // namespace neural
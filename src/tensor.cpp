@@ -3,10 +3,13 @@
  */
 
 #include "neural/math/tensor.h"
+#include "neural/math/philox.h"
 
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
 #include <sstream>
-#include <chrono>
-#include <random>
 
 using namespace std;
 
@@ -15,18 +18,19 @@ namespace neural
 
 Tensor::Tensor(const std::vector<size_t>& a_shape)
     : m_shape(a_shape)
+    , m_data(make_shared<vector<float>>(p_CalcSize(a_shape)))
     , m_strideSizes(p_ComputeStrideSizes(m_shape))
 {
-    m_data.resize(p_CalcSize(a_shape));
+
 }
 
 Tensor::Tensor(const std::vector<size_t>& a_shape,
                const std::vector<float>& a_data)
     : m_shape(a_shape)
-    , m_data(a_data)
+    , m_data(make_shared<vector<float>>(a_data))
     , m_strideSizes(p_ComputeStrideSizes(m_shape))
 {
-    m_data.resize(p_CalcSize(a_shape));
+    m_data->resize(p_CalcSize(a_shape));
 }
 
 TMutableTensorPtr Tensor::New(const std::vector<size_t>& a_shape)
@@ -43,24 +47,44 @@ TMutableTensorPtr Tensor::New(
 TMutableTensorPtr Tensor::Random(const std::vector<size_t>& a_shape, 
                           float a_min, float a_max)
 {
-    // construct a trivial random generator engine from a time-based seed:
-    static unsigned l_seed = std::chrono::system_clock::now().time_since_epoch().count();
-    static std::default_random_engine l_generator(l_seed);
+    TMutableTensorPtr l_tensor = New(a_shape);
+    Philox::Next().FillUniform(l_tensor->MutableData().data(), l_tensor->Size(), a_min, a_max);
+    return l_tensor;
+}
 
-    static std::normal_distribution<float> l_distribution(a_min, a_max);
+TMutableTensorPtr Tensor::RandomNormal(const std::vector<size_t>& a_shape,
+                                       float a_mean, float a_stddev)
+{
+    TMutableTensorPtr l_tensor = New(a_shape);
+    Philox::Next().FillNormal(l_tensor->MutableData().data(), l_tensor->Size(), a_mean, a_stddev);
+    return l_tensor;
+}
 
-    size_t l_size(1);
-    for (size_t i = 0; i < a_shape.size(); ++i)
-    {
-        l_size *= a_shape[i];
-    }
-    vector<float> l_data;
-    for (size_t i = 0; i < l_size; ++i)
+// Our weights are fan in x fan out, for more dimensions the last one is fan out
+static void FanInOut(const std::vector<size_t>& a_shape, float& a_outFanIn, float& a_outFanOut)
+{
+    size_t l_size = 1;
+    for (size_t l_dim : a_shape)
     {
-        l_data.push_back(l_distribution(l_generator));
+        l_size *= l_dim;
     }
+    a_outFanOut = a_shape.empty() ? 1.0f : (float)a_shape.back();
+    a_outFanIn = a_outFanOut > 0.0f ? (float)l_size / a_outFanOut : 0.0f;
+}
 
-    return New(a_shape, l_data);
+TMutableTensorPtr Tensor::XavierUniform(const std::vector<size_t>& a_shape)
+{
+    float l_fanIn = 0.0, l_fanOut = 0.0;
+    FanInOut(a_shape, l_fanIn, l_fanOut);
+    float l_limit = sqrt(6.0f / std::max(1.0f, l_fanIn + l_fanOut));
+    return Random(a_shape, -l_limit, l_limit);
+}
+
+TMutableTensorPtr Tensor::HeNormal(const std::vector<size_t>& a_shape)
+{
+    float l_fanIn = 0.0, l_fanOut = 0.0;
+    FanInOut(a_shape, l_fanIn, l_fanOut);
+    return RandomNormal(a_shape, 0.0, sqrt(2.0f / std::max(1.0f, l_fanIn)));
 }
 
 TMutableTensorPtr Tensor::Constant(const std::vector<size_t>& a_shape, float a_val)
@@ -86,15 +110,39 @@ TMutableTensorPtr Tensor::Ones(const std::vector<size_t>& a_shape)
 
 TMutableTensorPtr Tensor::ToMutable() const
 {
-    return TMutableTensorPtr(new Tensor(m_shape, m_data));
+    return TMutableTensorPtr(new Tensor(*this));
+}
+
+TMutableTensorPtr Tensor::Reshape(const std::vector<size_t>& a_shape) const
+{
+    if (p_CalcSize(a_shape) != Size())
+    {
+        stringstream l_ss;
+        l_ss << "Tensor::Reshape can't make " << ShapeStr() << " into " << ShapeStr(a_shape);
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    TMutableTensorPtr l_ret(new Tensor(*this));
+    l_ret->m_shape = a_shape;
+    l_ret->m_strideSizes = p_ComputeStrideSizes(a_shape);
+    return l_ret;
+}
+
+bool Tensor::IsShared() const
+{
+    return m_data.use_count() > 1;
 }
 
 void Tensor::SetAll(float a_val)
 {
-    for (size_t i = 0; i < p_CalcSize(m_shape); ++i)
+    // Everything gets overwritten, so a shared buffer doesn't need copying
+    if (IsShared())
     {
-        m_data[i] = a_val;
+        m_data = make_shared<vector<float>>(Size(), a_val);
+        return;
     }
+    std::fill(m_data->begin(), m_data->end(), a_val);
 }
 
 const std::vector<size_t>& Tensor::Shape() const
@@ -120,29 +168,40 @@ std::string Tensor::ShapeStr() const
 
 size_t Tensor::Size() const
 {
-    return m_data.size();
+    return m_data->size();
 }
   
 const std::vector<float>& Tensor::Data() const
 {
-    return m_data;
+    return *m_data;
 }
 
 std::vector<float>& Tensor::MutableData()
 {
-    return m_data;
+    p_Detach();
+    return *m_data;
 }
 
 float Tensor::At(const std::vector<size_t>& a_idx) const
 {
     size_t l_offset = p_DataOffsetFromIdx(a_idx);
-    return m_data[l_offset];
+    return (*m_data)[l_offset];
 }
 
 void Tensor::SetAt(const std::vector<size_t>& a_idx, float a_val)
 {
     size_t l_offset = p_DataOffsetFromIdx(a_idx);
-    m_data[l_offset] = a_val;
+    p_Detach();
+    (*m_data)[l_offset] = a_val;
+}
+
+void Tensor::p_Detach()
+{
+    // Only reference, the common case, costs one atomic load
+    if (m_data.use_count() > 1)
+    {
+        m_data = make_shared<vector<float>>(*m_data);
+    }
 }
 
 size_t Tensor::p_CalcSize(const std::vector<size_t>& a_shape) const
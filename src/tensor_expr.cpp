@@ -0,0 +1,29 @@
+/*
+ * Tensor Expressions Implementation
+ *
+ */
+
+#include "neural/math/tensor_expr.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+void ThrowExprShapeMismatch(
+    const std::string& a_where,
+    const std::vector<size_t>& a_expected,
+    const std::vector<size_t>& a_got)
+{
+    stringstream l_ss;
+    l_ss << a_where << " shape " << Tensor::ShapeStr(a_got)
+         << " != " << Tensor::ShapeStr(a_expected);
+    LOG(ERROR) << l_ss.str() << endl;
+    throw(runtime_error(l_ss.str()));
+}
+
+} // namespace neural
@@ -5,9 +5,14 @@
  */
 
 #include "neural/math/tensor_math.h"
+#include "neural/math/gemm_autotuner.h"
+#include "neural/math/gemm_kernels.h"
+#include "neural/math/tensor_expr.h"
+#include "neural/parallel/threading.h"
 
 #include <glog/logging.h>
-#include <cblas.h>  
+#include <algorithm>
+#include <atomic>
 #include <sstream>
 
 using namespace std;
@@ -15,6 +20,184 @@ using namespace std;
 namespace neural
 {
 
+// SpMM does about density * k multiply-adds per output where GEMM does k, but
+// far less regularly, so it only wins well below the break even density.
+// Checking density costs a pass over a_lhs and skips the tuned GEMM, so it is
+// off unless asked for (ie. for zero background MNIST) and only for wide outputs.
+static atomic<float> s_sparseThreshold(0.0f);
+static const size_t kSparseMinCols = 8;
+
+// Columns of the output each SpMM task owns, 64 floats is four cache lines
+static const size_t kSpmmBlockN = 64;
+
+// Reductions keep this many partial results side by side, which the
+// compiler turns into one vector register of accumulators
+static const size_t kReduceLanes = 8;
+
+// Pairwise reductions split in half until at most this many values are left
+static const size_t kPairwiseBase = 128;
+
+// Rows summed in a straight line before splitting, for reductions over an outer axis
+static const size_t kPairwiseRows = 16;
+
+// Values per parallel reduction task. Fixed, not per thread, so the order
+// of the additions never depends on the number of threads.
+static const size_t kReduceBlock = 8192;
+
+// Columns per task when reducing over an outer axis, small enough for the stack
+static const size_t kReduceColBlock = 256;
+
+// Pairwise sum of a_size values
+static float PairwiseSum(const float* a_data, size_t a_size)
+{
+    if (a_size > kPairwiseBase)
+    {
+        // Keep the split on a multiple of the lanes so both halves stay aligned
+        size_t l_half = (a_size / 2 + kReduceLanes - 1) / kReduceLanes * kReduceLanes;
+        return PairwiseSum(a_data, l_half) + PairwiseSum(a_data + l_half, a_size - l_half);
+    }
+
+    float l_lanes[kReduceLanes] = {0.0f};
+    size_t i = 0;
+    for (; i + kReduceLanes <= a_size; i += kReduceLanes)
+    {
+        for (size_t l = 0; l < kReduceLanes; ++l)
+        {
+            l_lanes[l] += a_data[i + l];
+        }
+    }
+    for (; i < a_size; ++i)
+    {
+        l_lanes[i % kReduceLanes] += a_data[i];
+    }
+
+    // Lanes are combined as a tree as well
+    for (size_t l_width = kReduceLanes / 2; l_width > 0; l_width /= 2)
+    {
+        for (size_t l = 0; l < l_width; ++l)
+        {
+            l_lanes[l] += l_lanes[l + l_width];
+        }
+    }
+    return l_lanes[0];
+}
+
+// Largest of a_size > 0 values
+static float LanesMax(const float* a_data, size_t a_size)
+{
+    float l_lanes[kReduceLanes];
+    for (size_t l = 0; l < kReduceLanes; ++l)
+    {
+        l_lanes[l] = a_data[0];
+    }
+
+    size_t i = 0;
+    for (; i + kReduceLanes <= a_size; i += kReduceLanes)
+    {
+        for (size_t l = 0; l < kReduceLanes; ++l)
+        {
+            l_lanes[l] = a_data[i + l] > l_lanes[l] ? a_data[i + l] : l_lanes[l];
+        }
+    }
+    for (; i < a_size; ++i)
+    {
+        l_lanes[0] = a_data[i] > l_lanes[0] ? a_data[i] : l_lanes[0];
+    }
+
+    float l_max = l_lanes[0];
+    for (size_t l = 1; l < kReduceLanes; ++l)
+    {
+        l_max = l_lanes[l] > l_max ? l_lanes[l] : l_max;
+    }
+    return l_max;
+}
+
+// Index of the first largest of a_size > 0 values
+static size_t FirstArgMax(const float* a_data, size_t a_size)
+{
+    size_t l_best = 0;
+    for (size_t i = 1; i < a_size; ++i)
+    {
+        if (a_data[i] > a_data[l_best])
+        {
+            l_best = i;
+        }
+    }
+    return l_best;
+}
+
+// a_out[j] = sum over k < a_count of a_data[k * a_stride + j], for j < a_width <= kReduceColBlock.
+// Pairwise over k, each step is a vectorized add of two rows.
+static void PairwiseSumRows(const float* a_data, size_t a_count, size_t a_stride, size_t a_width, float* a_out)
+{
+    if (a_count > kPairwiseRows)
+    {
+        size_t l_half = a_count / 2;
+        float l_rest[kReduceColBlock];
+        PairwiseSumRows(a_data, l_half, a_stride, a_width, a_out);
+        PairwiseSumRows(a_data + l_half * a_stride, a_count - l_half, a_stride, a_width, l_rest);
+        for (size_t j = 0; j < a_width; ++j)
+        {
+            a_out[j] += l_rest[j];
+        }
+        return;
+    }
+
+    for (size_t j = 0; j < a_width; ++j)
+    {
+        a_out[j] = 0.0f;
+    }
+    for (size_t k = 0; k < a_count; ++k)
+    {
+        const float* l_row = a_data + k * a_stride;
+        for (size_t j = 0; j < a_width; ++j)
+        {
+            a_out[j] += l_row[j];
+        }
+    }
+}
+
+// Splits a_shape around a_axis into outer x axis x inner, throws if there is no such axis
+static void SplitAxis(
+    const char* a_op, const TTensorPtr& a_tensor, size_t a_axis,
+    size_t& a_outOuter, size_t& a_outCount, size_t& a_outInner, vector<size_t>& a_outShape)
+{
+    const vector<size_t>& l_shape = a_tensor->Shape();
+    if (a_axis >= l_shape.size())
+    {
+        stringstream l_ss;
+        l_ss << "TensorMath::" << a_op << " axis " << a_axis << " out of range for " << a_tensor->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    a_outOuter = 1;
+    a_outInner = 1;
+    for (size_t i = 0; i < a_axis; ++i)
+    {
+        a_outOuter *= l_shape[i];
+    }
+    for (size_t i = a_axis + 1; i < l_shape.size(); ++i)
+    {
+        a_outInner *= l_shape[i];
+    }
+    a_outCount = l_shape[a_axis];
+    a_outShape = l_shape;
+    a_outShape.erase(a_outShape.begin() + a_axis);
+}
+
+// Max and ArgMax have no value for nothing
+static void CheckNotEmpty(const char* a_op, const TTensorPtr& a_tensor, size_t a_count)
+{
+    if (a_count == 0)
+    {
+        stringstream l_ss;
+        l_ss << "TensorMath::" << a_op << " of an empty range in " << a_tensor->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
 TTensorPtr TensorMath::Multiply(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs)
 {
     if (a_lhs->Shape().size() != 2 || a_rhs->Shape().size() != 2)
@@ -39,9 +222,20 @@ TTensorPtr TensorMath::Multiply(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs
         throw(runtime_error(l_ss.str()));
     }
 
+    // Inputs like MNIST pixels are mostly zeros, skip them with SpMM
+    float l_sparseThreshold = s_sparseThreshold;
+    if (l_sparseThreshold > 0.0f && a_rhs->Shape().at(1) >= kSparseMinCols)
+    {
+        TSparseTensorPtr l_sparse = SparseTensor::FromDenseIfSparse(a_lhs, l_sparseThreshold);
+        if (l_sparse)
+        {
+            return Multiply(l_sparse, a_rhs);
+        }
+    }
+
     // initialize our return matrix with the correct shape,
     // ie the outer sizes of our inputs and rhs
-    TMutableTensorPtr l_ret = Tensor::Zeros({a_lhs->Shape().at(0), a_rhs->Shape().at(1)})->ToMutable();
+    TMutableTensorPtr l_ret = Tensor::Zeros({a_lhs->Shape().at(0), a_rhs->Shape().at(1)});
 
     /*
     M
@@ -61,13 +255,399 @@ TTensorPtr TensorMath::Multiply(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs
     const float* B = a_rhs->Data().data();
     float* C = l_ret->MutableData().data();
 
-    // BLAS mat mul
-    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, 1.0,
-                A, k, B, n, 0.0, C, n);
+    // Our shapes are very skewed (1x785*785x300, Bx301*301x1, ...)
+    // so let the autotuner pick between BLAS and the built in kernels
+    const GemmKernel& l_kernel = GemmAutotuner::Instance().Select(m, n, k);
+    l_kernel.fn(m, n, k, A, B, C);
+
+    return l_ret;
+}
+
+TTensorPtr TensorMath::Multiply(const TSparseTensorPtr& a_lhs, const TTensorPtr& a_rhs)
+{
+    if (a_rhs->Shape().size() != 2 || a_lhs->Shape().at(1) != a_rhs->Shape().at(0))
+    {
+        stringstream l_ss;
+        l_ss << "TensorMath::Multiply Inner dimensions of matrices must match "
+             << a_lhs->ShapeStr() << " * " << a_rhs->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t m = a_lhs->Shape().at(0);
+    size_t n = a_rhs->Shape().at(1);
+    TMutableTensorPtr l_ret = Tensor::Zeros({m, n});
+
+    const size_t* l_offsets = a_lhs->Offsets().data();
+    const uint32_t* l_indices = a_lhs->Indices().data();
+    const float* l_values = a_lhs->Values().data();
+    const float* B = a_rhs->Data().data();
+    float* C = l_ret->MutableData().data();
+
+    // Every task owns a block of columns of C so no two tasks write the same memory
+    size_t l_numColBlocks = (n + kSpmmBlockN - 1) / kSpmmBlockN;
+    size_t l_work = a_lhs->NumNonZeros() * n;
+    if (a_lhs->Format() == SparseTensor::CSR)
+    {
+        // Row i of C is the sum of the rows of B picked by the non zeros of row i of A,
+        // so rows can be split over tasks as well
+        Threading::ParallelFor(Threading::GEMM, m * l_numColBlocks, [&](size_t a_begin, size_t a_end) {
+            for (size_t t = a_begin; t < a_end; ++t)
+            {
+                size_t i = t / l_numColBlocks;
+                size_t j0 = (t % l_numColBlocks) * kSpmmBlockN;
+                size_t l_jEnd = std::min(j0 + kSpmmBlockN, n);
+                float* l_cRow = C + i * n;
+                for (size_t p = l_offsets[i]; p < l_offsets[i + 1]; ++p)
+                {
+                    float l_a = l_values[p];
+                    const float* l_bRow = B + l_indices[p] * n;
+                    for (size_t j = j0; j < l_jEnd; ++j)
+                    {
+                        l_cRow[j] += l_a * l_bRow[j];
+                    }
+                }
+            }
+        }, l_work);
+    }
+    else
+    {
+        // Column k of A scatters row k of B into the rows of C, only columns can be split
+        size_t l_numCols = a_lhs->NumOuter();
+        Threading::ParallelFor(Threading::GEMM, l_numColBlocks, [&](size_t a_begin, size_t a_end) {
+            for (size_t l_block = a_begin; l_block < a_end; ++l_block)
+            {
+                size_t j0 = l_block * kSpmmBlockN;
+                size_t l_jEnd = std::min(j0 + kSpmmBlockN, n);
+                for (size_t k = 0; k < l_numCols; ++k)
+                {
+                    const float* l_bRow = B + k * n;
+                    for (size_t p = l_offsets[k]; p < l_offsets[k + 1]; ++p)
+                    {
+                        float l_a = l_values[p];
+                        float* l_cRow = C + l_indices[p] * n;
+                        for (size_t j = j0; j < l_jEnd; ++j)
+                        {
+                            l_cRow[j] += l_a * l_bRow[j];
+                        }
+                    }
+                }
+            }
+        }, l_work);
+    }
 
     return l_ret;
 }
 
+TTensorPtr TensorMath::Add(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs)
+{
+    return Evaluate(Lazy(a_lhs) + Lazy(a_rhs));
+}
+
+TTensorPtr TensorMath::Subtract(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs)
+{
+    return Evaluate(Lazy(a_lhs) - Lazy(a_rhs));
+}
+
+TTensorPtr TensorMath::Hadamard(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs)
+{
+    return Evaluate(Lazy(a_lhs) * Lazy(a_rhs));
+}
+
+TTensorPtr TensorMath::Scale(const TTensorPtr& a_tensor, float a_alpha)
+{
+    return Evaluate(a_alpha * Lazy(a_tensor));
+}
+
+void TensorMath::Axpy(float a_alpha, const TTensorPtr& a_x, const TMutableTensorPtr& a_y)
+{
+    Lazy(a_y) += a_alpha * Lazy(a_x);
+}
+
+float TensorMath::Sum(const float* a_data, size_t a_size)
+{
+    // Small inputs skip the partials vector and the fork
+    if (a_size <= kReduceBlock)
+    {
+        return PairwiseSum(a_data, a_size);
+    }
+
+    size_t l_numBlocks = (a_size + kReduceBlock - 1) / kReduceBlock;
+    vector<float> l_partials(l_numBlocks);
+    Threading::ParallelFor(Threading::REDUCE, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+        for (size_t b = a_begin; b < a_end; ++b)
+        {
+            size_t l_first = b * kReduceBlock;
+            l_partials[b] = PairwiseSum(a_data + l_first, std::min(kReduceBlock, a_size - l_first));
+        }
+    }, a_size);
+    return PairwiseSum(l_partials.data(), l_numBlocks);
+}
+
+float TensorMath::Mean(const float* a_data, size_t a_size)
+{
+    return Sum(a_data, a_size) / (float)a_size;
+}
+
+float TensorMath::Sum(const TTensorPtr& a_tensor)
+{
+    return Sum(a_tensor->Data().data(), a_tensor->Size());
+}
+
+float TensorMath::Mean(const TTensorPtr& a_tensor)
+{
+    return Mean(a_tensor->Data().data(), a_tensor->Size());
+}
+
+float TensorMath::Max(const TTensorPtr& a_tensor)
+{
+    size_t l_size = a_tensor->Size();
+    CheckNotEmpty("Max", a_tensor, l_size);
+    const float* l_data = a_tensor->Data().data();
+
+    size_t l_numBlocks = (l_size + kReduceBlock - 1) / kReduceBlock;
+    vector<float> l_partials(l_numBlocks);
+    Threading::ParallelFor(Threading::REDUCE, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+        for (size_t b = a_begin; b < a_end; ++b)
+        {
+            size_t l_first = b * kReduceBlock;
+            l_partials[b] = LanesMax(l_data + l_first, std::min(kReduceBlock, l_size - l_first));
+        }
+    }, l_size);
+    return LanesMax(l_partials.data(), l_numBlocks);
+}
+
+size_t TensorMath::ArgMax(const TTensorPtr& a_tensor)
+{
+    size_t l_size = a_tensor->Size();
+    CheckNotEmpty("ArgMax", a_tensor, l_size);
+    const float* l_data = a_tensor->Data().data();
+
+    size_t l_numBlocks = (l_size + kReduceBlock - 1) / kReduceBlock;
+    vector<size_t> l_partials(l_numBlocks);
+    Threading::ParallelFor(Threading::REDUCE, l_numBlocks, [&](size_t a_begin, size_t a_end) {
+        for (size_t b = a_begin; b < a_end; ++b)
+        {
+            size_t l_first = b * kReduceBlock;
+            l_partials[b] = l_first + FirstArgMax(l_data + l_first, std::min(kReduceBlock, l_size - l_first));
+        }
+    }, l_size);
+
+    // Blocks in order with a strict compare keeps the first on ties
+    size_t l_best = l_partials[0];
+    for (size_t b = 1; b < l_numBlocks; ++b)
+    {
+        if (l_data[l_partials[b]] > l_data[l_best])
+        {
+            l_best = l_partials[b];
+        }
+    }
+    return l_best;
+}
+
+TTensorPtr TensorMath::Sum(const TTensorPtr& a_tensor, size_t a_axis)
+{
+    size_t l_outer = 0, l_count = 0, l_inner = 0;
+    vector<size_t> l_shape;
+    SplitAxis("Sum", a_tensor, a_axis, l_outer, l_count, l_inner, l_shape);
+
+    TMutableTensorPtr l_ret = Tensor::New(l_shape);
+    const float* l_in = a_tensor->Data().data();
+    float* l_out = l_ret->MutableData().data();
+
+    if (l_inner == 1)
+    {
+        // Reducing the last axis, every output is one contiguous row
+        Threading::ParallelFor(Threading::REDUCE, l_outer, [&](size_t a_begin, size_t a_end) {
+            for (size_t o = a_begin; o < a_end; ++o)
+            {
+                l_out[o] = PairwiseSum(l_in + o * l_count, l_count);
+            }
+        }, l_outer * l_count);
+        return l_ret;
+    }
+
+    // Otherwise add whole rows together, each task owns a block of output columns
+    size_t l_numColBlocks = (l_inner + kReduceColBlock - 1) / kReduceColBlock;
+    Threading::ParallelFor(Threading::REDUCE, l_outer * l_numColBlocks, [&](size_t a_begin, size_t a_end) {
+        for (size_t t = a_begin; t < a_end; ++t)
+        {
+            size_t o = t / l_numColBlocks;
+            size_t j0 = (t % l_numColBlocks) * kReduceColBlock;
+            size_t l_width = std::min(kReduceColBlock, l_inner - j0);
+            PairwiseSumRows(l_in + o * l_count * l_inner + j0, l_count, l_inner, l_width, l_out + o * l_inner + j0);
+        }
+    }, l_outer * l_count * l_inner);
+    return l_ret;
+}
+
+TTensorPtr TensorMath::Mean(const TTensorPtr& a_tensor, size_t a_axis)
+{
+    TMutableTensorPtr l_sum = Sum(a_tensor, a_axis)->ToMutable();
+    Lazy(l_sum) /= (float)a_tensor->Shape()[a_axis];
+    return l_sum;
+}
+
+TTensorPtr TensorMath::Max(const TTensorPtr& a_tensor, size_t a_axis)
+{
+    size_t l_outer = 0, l_count = 0, l_inner = 0;
+    vector<size_t> l_shape;
+    SplitAxis("Max", a_tensor, a_axis, l_outer, l_count, l_inner, l_shape);
+    CheckNotEmpty("Max", a_tensor, l_count);
+
+    TMutableTensorPtr l_ret = Tensor::New(l_shape);
+    const float* l_in = a_tensor->Data().data();
+    float* l_out = l_ret->MutableData().data();
+
+    // Same split as Sum, whole rows per task for the last axis, column blocks otherwise
+    size_t l_numColBlocks = (l_inner + kReduceColBlock - 1) / kReduceColBlock;
+    Threading::ParallelFor(Threading::REDUCE, l_outer * l_numColBlocks, [&](size_t a_begin, size_t a_end) {
+        for (size_t t = a_begin; t < a_end; ++t)
+        {
+            size_t o = t / l_numColBlocks;
+            if (l_inner == 1)
+            {
+                l_out[o] = LanesMax(l_in + o * l_count, l_count);
+                continue;
+            }
+
+            // Running max of the rows, vectorized over the columns
+            size_t j0 = (t % l_numColBlocks) * kReduceColBlock;
+            size_t l_width = std::min(kReduceColBlock, l_inner - j0);
+            const float* l_block = l_in + o * l_count * l_inner + j0;
+            float* l_outRow = l_out + o * l_inner + j0;
+            std::copy(l_block, l_block + l_width, l_outRow);
+            for (size_t k = 1; k < l_count; ++k)
+            {
+                const float* l_row = l_block + k * l_inner;
+                for (size_t j = 0; j < l_width; ++j)
+                {
+                    l_outRow[j] = l_row[j] > l_outRow[j] ? l_row[j] : l_outRow[j];
+                }
+            }
+        }
+    }, l_outer * l_count * l_inner);
+    return l_ret;
+}
+
+std::vector<size_t> TensorMath::ArgMax(const TTensorPtr& a_tensor, size_t a_axis)
+{
+    size_t l_outer = 0, l_count = 0, l_inner = 0;
+    vector<size_t> l_shape;
+    SplitAxis("ArgMax", a_tensor, a_axis, l_outer, l_count, l_inner, l_shape);
+    CheckNotEmpty("ArgMax", a_tensor, l_count);
+
+    vector<size_t> l_ret(l_outer * l_inner, 0);
+    const float* l_in = a_tensor->Data().data();
+
+    size_t l_numColBlocks = (l_inner + kReduceColBlock - 1) / kReduceColBlock;
+    Threading::ParallelFor(Threading::REDUCE, l_outer * l_numColBlocks, [&](size_t a_begin, size_t a_end) {
+        for (size_t t = a_begin; t < a_end; ++t)
+        {
+            size_t o = t / l_numColBlocks;
+            if (l_inner == 1)
+            {
+                l_ret[o] = FirstArgMax(l_in + o * l_count, l_count);
+                continue;
+            }
+
+            // Track the best value next to its index so the compare stays vectorizable
+            size_t j0 = (t % l_numColBlocks) * kReduceColBlock;
+            size_t l_width = std::min(kReduceColBlock, l_inner - j0);
+            const float* l_block = l_in + o * l_count * l_inner + j0;
+            size_t* l_outRow = l_ret.data() + o * l_inner + j0;
+            float l_best[kReduceColBlock];
+            std::copy(l_block, l_block + l_width, l_best);
+            for (size_t k = 1; k < l_count; ++k)
+            {
+                const float* l_row = l_block + k * l_inner;
+                for (size_t j = 0; j < l_width; ++j)
+                {
+                    bool l_better = l_row[j] > l_best[j];
+                    l_best[j] = l_better ? l_row[j] : l_best[j];
+                    l_outRow[j] = l_better ? k : l_outRow[j];
+                }
+            }
+        }
+    }, l_outer * l_count * l_inner);
+    return l_ret;
+}
+
+// Batch size, rows and cols of an operand of BatchedMultiply, a_outStride is 0 when it is shared
+static void BatchedOperand(
+    const TTensorPtr& a_tensor, size_t& a_outBatch, size_t& a_outRows, size_t& a_outCols, size_t& a_outStride)
+{
+    const vector<size_t>& l_shape = a_tensor->Shape();
+    if (l_shape.size() != 2 && l_shape.size() != 3)
+    {
+        stringstream l_ss;
+        l_ss << "TensorMath::BatchedMultiply needs rank 2 or 3 tensors, got " << a_tensor->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    a_outBatch = l_shape.size() == 3 ? l_shape[0] : 1;
+    a_outRows = l_shape[l_shape.size() - 2];
+    a_outCols = l_shape[l_shape.size() - 1];
+    a_outStride = a_outBatch == 1 ? 0 : a_outRows * a_outCols;
+}
+
+TTensorPtr TensorMath::BatchedMultiply(const TTensorPtr& a_lhs, const TTensorPtr& a_rhs)
+{
+    size_t l_lhsBatch = 0, m = 0, k = 0, l_strideA = 0;
+    size_t l_rhsBatch = 0, l_rhsRows = 0, n = 0, l_strideB = 0;
+    BatchedOperand(a_lhs, l_lhsBatch, m, k, l_strideA);
+    BatchedOperand(a_rhs, l_rhsBatch, l_rhsRows, n, l_strideB);
+
+    if (k != l_rhsRows || (l_lhsBatch != l_rhsBatch && l_lhsBatch != 1 && l_rhsBatch != 1))
+    {
+        stringstream l_ss;
+        l_ss << "TensorMath::BatchedMultiply shapes don't line up "
+             << a_lhs->ShapeStr() << " * " << a_rhs->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    size_t l_batch = l_lhsBatch == 1 ? l_rhsBatch : l_lhsBatch;
+    TMutableTensorPtr l_ret = Tensor::New({l_batch, m, n});
+    const float* A = a_lhs->Data().data();
+    const float* B = a_rhs->Data().data();
+    float* C = l_ret->MutableData().data();
+
+    if (l_strideB == 0)
+    {
+        // With a shared right hand side the batch stacks into one tall (B*M)xK * KxN
+        // GEMM, which beats any number of small ones
+        size_t l_rows = l_batch * m;
+        if (l_strideA == 0)
+        {
+            GemmAutotuner::Instance().Select(m, n, k).fn(m, n, k, A, B, C);
+            for (size_t b = 1; b < l_batch; ++b)
+            {
+                std::copy(C, C + m * n, C + b * m * n);
+            }
+        }
+        else
+        {
+            GemmAutotuner::Instance().Select(l_rows, n, k).fn(l_rows, n, k, A, B, C);
+        }
+        return l_ret;
+    }
+
+    GemmKernels::Batched(l_batch, m, n, k, A, l_strideA, B, l_strideB, C);
+    return l_ret;
+}
+
+void TensorMath::SetSparseThreshold(float a_maxDensity)
+{
+    s_sparseThreshold = a_maxDensity;
+}
+
+float TensorMath::SparseThreshold()
+{
+    return s_sparseThreshold;
+}
+
 TTensorPtr TensorMath::Transpose(const TTensorPtr& a_mat)
 {
     if (a_mat->Shape().size() != 2)
@@ -79,14 +659,17 @@ TTensorPtr TensorMath::Transpose(const TTensorPtr& a_mat)
     size_t y = a_mat->Shape().at(1);
     
     TMutableTensorPtr l_ret = Tensor::New({y, x});
+    float* l_retData = l_ret->MutableData().data();
+    const float* l_matData = a_mat->Data().data();
 
-    #pragma omp parallel for
-    for(size_t n = 0; n < x*y; ++n)
-    {
-        size_t i = n/x;
-        size_t j = n%x;
-        l_ret->MutableData()[n] = a_mat->Data()[y*j + i];
-    }
+    Threading::ParallelFor(Threading::TRANSPOSE, x*y, [&](size_t a_begin, size_t a_end) {
+        for(size_t n = a_begin; n < a_end; ++n)
+        {
+            size_t i = n/x;
+            size_t j = n%x;
+            l_retData[n] = l_matData[y*j + i];
+        }
+    });
 
     return l_ret;
 }
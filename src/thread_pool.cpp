@@ -0,0 +1,314 @@
+/*
+ * Thread Pool Implementation
+ *
+ */
+
+#include "neural/parallel/thread_pool.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <exception>
+
+using namespace std;
+
+namespace neural
+{
+
+// How many times an idle worker looks for work before going to sleep,
+// tasks tend to arrive in bursts so this saves a wake up most of the time
+static const size_t kSpinCount = 256;
+
+// Which pool and queue the current thread works for, if any
+static thread_local ThreadPool* s_workerPool = nullptr;
+static thread_local size_t s_workerIdx = 0;
+
+// Chunks of one ParallelFor, shared with the tasks it queues. Whoever
+// gets to a chunk first runs it, tasks that come too late find none left.
+struct LoopChunks
+{
+    atomic<size_t> next;
+    atomic<size_t> done;
+    exception_ptr error;
+    mutex errorMutex;
+};
+
+ThreadPool::ThreadPool(size_t a_numWorkers, bool a_pinWorkers)
+    : m_queues(kMaxWorkers)
+    , m_numQueues(0)
+    , m_numWorkers(0)
+    , m_pinWorkers(a_pinWorkers)
+    , m_stop(false)
+    , m_numPending(0)
+    , m_nextQueue(0)
+{
+    Resize(a_numWorkers);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> l_lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_sleepCond.notify_all();
+
+    lock_guard<mutex> l_lock(m_resizeMutex);
+    for (thread& l_worker : m_workers)
+    {
+        l_worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::Instance()
+{
+    // The thread calling ParallelFor works too, so one less worker than threads
+    static ThreadPool l_pool(Threading::NumThreads() - 1, true);
+
+    // Follow SetNumThreads, a worker can't since it might be one of the ones to go
+    size_t l_numWorkers = std::max((size_t)1, Threading::NumThreads() - 1);
+    if (l_pool.NumWorkers() != l_numWorkers && !InWorker())
+    {
+        l_pool.Resize(l_numWorkers);
+    }
+    return l_pool;
+}
+
+std::future<void> ThreadPool::Submit(const TTask& a_task)
+{
+    shared_ptr<packaged_task<void()>> l_task(new packaged_task<void()>(a_task));
+    future<void> l_future = l_task->get_future();
+    p_Push([l_task]() { (*l_task)(); });
+    return l_future;
+}
+
+void ThreadPool::ParallelFor(
+    size_t a_begin, size_t a_end, size_t a_numChunks,
+    const TRangeFn& a_fn)
+{
+    if (a_end <= a_begin)
+    {
+        return;
+    }
+
+    size_t l_size = a_end - a_begin;
+    a_numChunks = std::max((size_t)1, std::min(a_numChunks, l_size));
+    if (a_numChunks == 1)
+    {
+        a_fn(a_begin, a_end);
+        return;
+    }
+
+    shared_ptr<LoopChunks> l_chunks(new LoopChunks());
+    l_chunks->next = 0;
+    l_chunks->done = 0;
+
+    // A chunk is only claimed before we return, so a_fn is still there when it runs
+    size_t l_chunkSize = l_size / a_numChunks;
+    size_t l_remainder = l_size % a_numChunks;
+    TTask l_runChunks = [l_chunks, &a_fn, a_begin, a_numChunks, l_chunkSize, l_remainder]() {
+        for (size_t i = l_chunks->next++; i < a_numChunks; i = l_chunks->next++)
+        {
+            size_t l_chunkBegin = a_begin + i * l_chunkSize + std::min(i, l_remainder);
+            size_t l_chunkEnd = l_chunkBegin + l_chunkSize + (i < l_remainder ? 1 : 0);
+            try
+            {
+                a_fn(l_chunkBegin, l_chunkEnd);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> l_lock(l_chunks->errorMutex);
+                l_chunks->error = current_exception();
+            }
+            ++l_chunks->done;
+        }
+    };
+
+    for (size_t i = 1; i < a_numChunks; ++i)
+    {
+        p_Push(l_runChunks);
+    }
+
+    // Run whatever the workers haven't started, then wait for the ones they have
+    l_runChunks();
+    while (l_chunks->done < a_numChunks)
+    {
+        this_thread::yield();
+    }
+
+    if (l_chunks->error)
+    {
+        rethrow_exception(l_chunks->error);
+    }
+}
+
+bool ThreadPool::RunPendingTask()
+{
+    size_t l_idx = (s_workerPool == this) ? s_workerIdx : (m_nextQueue % m_numWorkers);
+    TTask l_task;
+    if (!p_Pop(l_idx, l_task))
+    {
+        return false;
+    }
+    l_task();
+    return true;
+}
+
+void ThreadPool::Resize(size_t a_numWorkers)
+{
+    a_numWorkers = std::max((size_t)1, a_numWorkers);
+    if (a_numWorkers > kMaxWorkers)
+    {
+        LOG(WARNING) << "ThreadPool::Resize " << a_numWorkers << " workers, capped at " << kMaxWorkers << endl;
+        a_numWorkers = kMaxWorkers;
+    }
+
+    lock_guard<mutex> l_lock(m_resizeMutex);
+    size_t l_oldNumWorkers = m_numWorkers;
+    if (a_numWorkers < l_oldNumWorkers)
+    {
+        {
+            lock_guard<mutex> l_sleepLock(m_sleepMutex);
+            m_numWorkers = a_numWorkers;
+        }
+        m_sleepCond.notify_all();
+        for (size_t i = a_numWorkers; i < l_oldNumWorkers; ++i)
+        {
+            m_workers[i].join();
+        }
+        m_workers.resize(a_numWorkers);
+        return;
+    }
+
+    for (size_t i = m_numQueues; i < a_numWorkers; ++i)
+    {
+        m_queues[i].reset(new WorkerQueue());
+        m_numQueues = i + 1;
+    }
+    m_numWorkers = a_numWorkers;
+    for (size_t i = l_oldNumWorkers; i < a_numWorkers; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::p_WorkerLoop, this, i);
+    }
+}
+
+size_t ThreadPool::NumWorkers() const
+{
+    return m_numWorkers;
+}
+
+bool ThreadPool::InWorker()
+{
+    return s_workerPool != nullptr;
+}
+
+void ThreadPool::p_WorkerLoop(size_t a_idx)
+{
+    s_workerPool = this;
+    s_workerIdx = a_idx;
+    if (m_pinWorkers)
+    {
+        Threading::PinCurrentThread(a_idx + 1);
+    }
+
+    while (true)
+    {
+        // Retired by Resize, only our own queue is left to finish
+        TTask l_task;
+        bool l_retired = a_idx >= m_numWorkers;
+        if (p_Pop(a_idx, l_task, !l_retired))
+        {
+            l_task();
+            continue;
+        }
+        if (l_retired)
+        {
+            return;
+        }
+
+        bool l_hasWork = false;
+        for (size_t i = 0; i < kSpinCount && !l_hasWork; ++i)
+        {
+            this_thread::yield();
+            l_hasWork = m_numPending > 0;
+        }
+        if (l_hasWork)
+        {
+            continue;
+        }
+
+        unique_lock<mutex> l_lock(m_sleepMutex);
+        m_sleepCond.wait(l_lock, [this, a_idx]() { return m_stop || m_numPending > 0 || a_idx >= m_numWorkers; });
+        if (m_stop && m_numPending == 0)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::p_Push(const TTask& a_task)
+{
+    // Workers push to their own queue so the task stays on a warm core,
+    // everyone else spreads tasks round robin
+    size_t l_idx = (s_workerPool == this) ? s_workerIdx : (m_nextQueue++ % m_numWorkers);
+
+    // Counted before it is queued, otherwise it could be popped and counted
+    // down first. Taking the lock means a worker can't miss this between
+    // checking and sleeping.
+    {
+        lock_guard<mutex> l_lock(m_sleepMutex);
+        ++m_numPending;
+    }
+    {
+        WorkerQueue& l_queue = *m_queues[l_idx];
+        lock_guard<mutex> l_lock(l_queue.mutex);
+        l_queue.tasks.push_back(a_task);
+    }
+    m_sleepCond.notify_one();
+}
+
+bool ThreadPool::p_Pop(size_t a_idx, TTask& a_outTask, bool a_steal)
+{
+    if (m_numPending == 0)
+    {
+        return false;
+    }
+
+    // Our own newest task is the one most likely still in cache
+    if (s_workerPool == this)
+    {
+        WorkerQueue& l_queue = *m_queues[a_idx];
+        lock_guard<mutex> l_lock(l_queue.mutex);
+        if (!l_queue.tasks.empty())
+        {
+            a_outTask = std::move(l_queue.tasks.back());
+            l_queue.tasks.pop_back();
+            --m_numPending;
+            return true;
+        }
+    }
+
+    if (!a_steal)
+    {
+        return false;
+    }
+
+    // Steal the oldest task from someone else
+    size_t l_numQueues = m_numQueues;
+    for (size_t i = 0; i < l_numQueues; ++i)
+    {
+        WorkerQueue& l_queue = *m_queues[(a_idx + i) % l_numQueues];
+        lock_guard<mutex> l_lock(l_queue.mutex);
+        if (!l_queue.tasks.empty())
+        {
+            a_outTask = std::move(l_queue.tasks.front());
+            l_queue.tasks.pop_front();
+            --m_numPending;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace neural
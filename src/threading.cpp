@@ -0,0 +1,241 @@
+/*
+ * Threading Implementation
+ *
+ */
+
+#include "neural/parallel/threading.h"
+#include "neural/parallel/thread_pool.h"
+
+#include <glog/logging.h>
+#include <omp.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+// Only OpenBLAS lets us size its pool at runtime, weak so we still link against other BLAS
+extern "C" void openblas_set_num_threads(int a_numThreads) __attribute__((weak));
+
+namespace neural
+{
+
+static once_flag s_initFlag;
+static atomic<size_t> s_numThreads(1);
+static atomic<int> s_backend(Threading::OPENMP);
+static thread_local bool s_serial = false;
+
+// First core of PinThreads, -1 until it is called
+static atomic<long> s_pinFirstCore(-1);
+
+// Defaults picked from timing our 785x300 and 301x1 layers,
+// smaller than this and the fork/join is more expensive than the loop
+static atomic<size_t> s_thresholds[Threading::NUM_OPS] = {
+    {64 * 64},    // TRANSPOSE
+    {32 * 1024},  // ELEMENTWISE
+    {32 * 1024},  // REDUCE
+    {64 * 64 * 64} // GEMM
+};
+
+static void ApplyBlasThreads(size_t a_numThreads)
+{
+    if (openblas_set_num_threads)
+    {
+        openblas_set_num_threads(a_numThreads);
+    }
+}
+
+static void ApplyNumThreads(size_t a_numThreads)
+{
+    omp_set_num_threads(a_numThreads);
+    ApplyBlasThreads(a_numThreads);
+}
+
+void Threading::p_Init()
+{
+    call_once(s_initFlag, []() {
+        // Respect OMP_NUM_THREADS if it was set
+        s_numThreads = omp_get_max_threads();
+
+        // Our parallel regions never spawn more threads from inside
+        omp_set_max_active_levels(1);
+        ApplyNumThreads(s_numThreads);
+    });
+}
+
+void Threading::SetNumThreads(size_t a_numThreads)
+{
+    p_Init();
+    if (a_numThreads == 0)
+    {
+        a_numThreads = NumCores();
+    }
+    s_numThreads = a_numThreads;
+    ApplyNumThreads(a_numThreads);
+    LOG(INFO) << "Threading::SetNumThreads " << a_numThreads << endl;
+}
+
+size_t Threading::NumThreads()
+{
+    p_Init();
+    return s_numThreads;
+}
+
+void Threading::PinThreads(size_t a_firstCore)
+{
+    int l_numThreads = NumThreads();
+
+#ifdef __linux__
+    s_pinFirstCore = a_firstCore;
+
+    // OpenMP keeps its threads alive between regions, so pinning each once
+    // sticks. The master is the calling thread and stays as it is.
+    #pragma omp parallel num_threads(l_numThreads)
+    {
+        if (omp_get_thread_num() > 0)
+        {
+            PinCurrentThread(omp_get_thread_num());
+        }
+    }
+#else
+    LOG(ERROR) << "Threading::PinThreads is only supported on Linux" << endl;
+#endif
+}
+
+void Threading::PinCurrentThread(size_t a_threadIdx)
+{
+#ifdef __linux__
+    long l_firstCore = s_pinFirstCore;
+    if (l_firstCore < 0)
+    {
+        return;
+    }
+
+    cpu_set_t l_set;
+    CPU_ZERO(&l_set);
+    CPU_SET((l_firstCore + a_threadIdx) % NumCores(), &l_set);
+    if (sched_setaffinity(0, sizeof(l_set), &l_set) != 0)
+    {
+        LOG(ERROR) << "Threading::PinCurrentThread could not pin thread " << a_threadIdx << endl;
+    }
+#endif
+}
+
+void Threading::RestrictToCores(size_t a_firstCore, size_t a_numCores)
+{
+#ifdef __linux__
+    size_t l_numCores = NumCores();
+    cpu_set_t l_set;
+    CPU_ZERO(&l_set);
+    for (size_t i = 0; i < a_numCores; ++i)
+    {
+        CPU_SET((a_firstCore + i) % l_numCores, &l_set);
+    }
+    if (sched_setaffinity(0, sizeof(l_set), &l_set) != 0)
+    {
+        LOG(ERROR) << "Threading::RestrictToCores could not restrict to cores "
+                   << a_firstCore << "-" << (a_firstCore + a_numCores - 1) << endl;
+    }
+#else
+    LOG(ERROR) << "Threading::RestrictToCores is only supported on Linux" << endl;
+#endif
+}
+
+void Threading::SetBackend(EBackend a_backend)
+{
+    s_backend = a_backend;
+}
+
+Threading::EBackend Threading::Backend()
+{
+    return (EBackend)s_backend.load();
+}
+
+void Threading::ParallelFor(
+    EOp a_op, size_t a_size,
+    const std::function<void(size_t, size_t)>& a_fn,
+    size_t a_work)
+{
+    int l_numThreads = ThreadsFor(a_op, a_work == 0 ? a_size : a_work);
+    if (l_numThreads <= 1 || a_size <= 1)
+    {
+        a_fn(0, a_size);
+        return;
+    }
+
+    if (Backend() == THREAD_POOL)
+    {
+        ThreadPool::Instance().ParallelFor(0, a_size, l_numThreads, a_fn);
+        return;
+    }
+
+    // Same static split ThreadPool::ParallelFor uses, one piece per thread
+    #pragma omp parallel num_threads(l_numThreads)
+    {
+        size_t l_numPieces = omp_get_num_threads();
+        size_t l_piece = omp_get_thread_num();
+        size_t l_begin = (a_size * l_piece) / l_numPieces;
+        size_t l_end = (a_size * (l_piece + 1)) / l_numPieces;
+        if (l_begin < l_end)
+        {
+            a_fn(l_begin, l_end);
+        }
+    }
+}
+
+void Threading::SetThreshold(EOp a_op, size_t a_minWork)
+{
+    s_thresholds[a_op] = a_minWork;
+}
+
+size_t Threading::Threshold(EOp a_op)
+{
+    return s_thresholds[a_op];
+}
+
+int Threading::ThreadsFor(EOp a_op, size_t a_work)
+{
+    if (s_serial || omp_in_parallel() || ThreadPool::InWorker() || a_work < s_thresholds[a_op])
+    {
+        return 1;
+    }
+    return NumThreads();
+}
+
+size_t Threading::NumCores()
+{
+    long l_numCores = sysconf(_SC_NPROCESSORS_ONLN);
+    return l_numCores > 0 ? l_numCores : 1;
+}
+
+void Threading::SetBlasThreads(size_t a_numThreads)
+{
+    p_Init();
+    ApplyBlasThreads(std::max((size_t)1, a_numThreads));
+}
+
+Threading::SerialScope::SerialScope()
+    : m_wasSerial(s_serial)
+{
+    s_serial = true;
+}
+
+Threading::SerialScope::~SerialScope()
+{
+    s_serial = m_wasSerial;
+}
+
+Threading::BlasThreadsScope::BlasThreadsScope(size_t a_numThreads)
+{
+    SetBlasThreads(a_numThreads);
+}
+
+Threading::BlasThreadsScope::~BlasThreadsScope()
+{
+    SetBlasThreads(NumThreads());
+}
+
+} // namespace neural
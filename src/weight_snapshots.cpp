@@ -0,0 +1,195 @@
+/*
+ * Weight Snapshots Implementation
+ *
+ */
+
+#include "neural/models/weight_snapshots.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace neural
+{
+
+// A free slot, epochs start at 1
+static const uint64_t kFree = 0;
+
+WeightSnapshots::WeightSnapshots(size_t a_maxReaders)
+    : m_current(nullptr)
+    , m_epoch(1)
+    , m_slots(new Slot[std::max(a_maxReaders, (size_t)1)])
+    , m_numSlots(std::max(a_maxReaders, (size_t)1))
+    , m_version(0)
+{
+    for (size_t i = 0; i < m_numSlots; ++i)
+    {
+        m_slots[i].epoch.store(kFree);
+    }
+}
+
+WeightSnapshots::~WeightSnapshots()
+{
+    for (const Retired& l_retired : m_retired)
+    {
+        delete l_retired.snapshot;
+    }
+    delete m_current.load();
+}
+
+WeightSnapshots::Guard::Guard(std::atomic<uint64_t>* a_slot, const WeightSnapshot* a_snapshot)
+    : m_slot(a_slot)
+    , m_snapshot(a_snapshot)
+{
+
+}
+
+WeightSnapshots::Guard::Guard(Guard&& a_other)
+    : m_slot(a_other.m_slot)
+    , m_snapshot(a_other.m_snapshot)
+{
+    a_other.m_slot = nullptr;
+    a_other.m_snapshot = nullptr;
+}
+
+WeightSnapshots::Guard::~Guard()
+{
+    if (m_slot)
+    {
+        m_slot->store(kFree, memory_order_release);
+    }
+}
+
+const WeightSnapshot* WeightSnapshots::Guard::Get() const
+{
+    return m_snapshot;
+}
+
+const WeightSnapshot* WeightSnapshots::Guard::operator->() const
+{
+    return m_snapshot;
+}
+
+const WeightSnapshot& WeightSnapshots::Guard::operator*() const
+{
+    return *m_snapshot;
+}
+
+void WeightSnapshots::Publish(const Sequential& a_model)
+{
+    // New tensor objects on the same buffers, so the layers see them shared
+    // and don't write over them
+    WeightSnapshot* l_snapshot = new WeightSnapshot();
+    l_snapshot->version = m_version.load() + 1;
+    for (const TLayerPtr& l_layer : a_model.Layers())
+    {
+        if (l_layer->HasWeights())
+        {
+            l_snapshot->weights.push_back(l_layer->Weights()->ToMutable());
+        }
+    }
+
+    // Readers that start after the epoch moves on can only see the new one
+    const WeightSnapshot* l_old = m_current.exchange(l_snapshot);
+    uint64_t l_epoch = m_epoch.fetch_add(1);
+    m_version.store(l_snapshot->version);
+    if (l_old)
+    {
+        Retired l_retired = {l_old, l_epoch};
+        m_retired.push_back(l_retired);
+    }
+    p_Reclaim();
+}
+
+WeightSnapshots::Guard WeightSnapshots::Acquire()
+{
+    // Claim a free slot with the epoch we start in, then read the snapshot.
+    // Both are sequentially consistent so Publish either sees our slot or
+    // we see its snapshot.
+    size_t l_start = hash<thread::id>()(this_thread::get_id());
+    while (true)
+    {
+        uint64_t l_epoch = m_epoch.load();
+        for (size_t i = 0; i < m_numSlots; ++i)
+        {
+            Slot& l_slot = m_slots[(l_start + i) % m_numSlots];
+            uint64_t l_free = kFree;
+            if (l_slot.epoch.load(memory_order_relaxed) == kFree && l_slot.epoch.compare_exchange_strong(l_free, l_epoch))
+            {
+                return Guard(&l_slot.epoch, m_current.load());
+            }
+        }
+        this_thread::yield();
+    }
+}
+
+void WeightSnapshots::Apply(const WeightSnapshot& a_snapshot, Sequential& a_model)
+{
+    vector<TLayerPtr> l_layers;
+    for (const TLayerPtr& l_layer : a_model.Layers())
+    {
+        if (l_layer->HasWeights())
+        {
+            l_layers.push_back(l_layer);
+        }
+    }
+
+    if (l_layers.size() != a_snapshot.weights.size())
+    {
+        stringstream l_ss;
+        l_ss << "WeightSnapshots::Apply snapshot has " << a_snapshot.weights.size()
+             << " weight tensors but the model has " << l_layers.size();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    for (size_t i = 0; i < l_layers.size(); ++i)
+    {
+        l_layers[i]->SetWeights(a_snapshot.weights[i]);
+    }
+}
+
+uint64_t WeightSnapshots::Version() const
+{
+    return m_version.load();
+}
+
+size_t WeightSnapshots::NumRetired() const
+{
+    return m_retired.size();
+}
+
+void WeightSnapshots::p_Reclaim()
+{
+    // Oldest epoch a reader is still in, they may see anything retired since
+    uint64_t l_oldest = UINT64_MAX;
+    for (size_t i = 0; i < m_numSlots; ++i)
+    {
+        uint64_t l_epoch = m_slots[i].epoch.load();
+        if (l_epoch != kFree)
+        {
+            l_oldest = std::min(l_oldest, l_epoch);
+        }
+    }
+
+    vector<Retired> l_kept;
+    for (const Retired& l_retired : m_retired)
+    {
+        if (l_retired.epoch < l_oldest)
+        {
+            delete l_retired.snapshot;
+        }
+        else
+        {
+            l_kept.push_back(l_retired);
+        }
+    }
+    m_retired.swap(l_kept);
+}
+
+} // namespace neural
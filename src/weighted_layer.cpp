@@ -0,0 +1,135 @@
+/*
+ * Weighted Layer Implementation
+ *
+ */
+
+#include "neural/layers/weighted_layer.h"
+#include "neural/math/tensor_expr.h"
+#include "neural/parallel/threading.h"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace neural
+{
+
+WeightedLayer::WeightedLayer(const std::string& a_name, const TTensorPtr& a_weights)
+    : m_name(a_name)
+    , m_weights(a_weights->ToMutable()) // weights are learnable, hence mutable
+{
+
+}
+
+bool WeightedLayer::HasWeights() const
+{
+    return true;
+}
+
+TTensorPtr WeightedLayer::Weights() const
+{
+    return m_weights;
+}
+
+void WeightedLayer::SetWeights(const TTensorPtr& a_weights)
+{
+    if (a_weights->Shape() != m_weights->Shape())
+    {
+        stringstream l_ss;
+        l_ss << m_name << "::SetWeights shape " << a_weights->ShapeStr()
+             << " != weights shape " << m_weights->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+
+    // Shares the buffer until one of us writes to it
+    m_weights = a_weights->ToMutable();
+}
+
+TTensorPtr WeightedLayer::CalcAvgWeightGrad() const
+{
+    TMutableTensorPtr l_average = p_SumWeightGrads();
+    Lazy(l_average) /= (float)m_weightGrads.size();
+    return l_average;
+}
+
+void WeightedLayer::ApplyGradient(const TTensorPtr& a_gradient, float a_learningRate)
+{
+    p_CheckGradientShape(a_gradient);
+    auto l_step = a_learningRate * Lazy(a_gradient);
+
+    // Shared ie. with the other replicas of a DataParallelTrainer
+    if (m_weights->IsShared())
+    {
+        m_weights = Evaluate(Lazy(TTensorPtr(m_weights)) - l_step);
+    }
+    else
+    {
+        Lazy(m_weights) -= l_step;
+    }
+}
+
+void WeightedLayer::ZeroGrad()
+{
+    m_weightGrads.clear();
+}
+
+void WeightedLayer::UpdateWeights(float a_learningRate)
+{
+    // With one gradient there is nothing to sum, the average and the step
+    // fuse into one pass over the weights without an average tensor
+    TTensorPtr l_gradient = m_weightGrads.size() == 1 ? m_weightGrads[0] : p_SumWeightGrads();
+    p_CheckGradientShape(l_gradient);
+    float l_numGrads = (float)m_weightGrads.size();
+    auto l_step = a_learningRate * (Lazy(l_gradient) / l_numGrads);
+
+    // Someone holds on to the old weights (ie. a published WeightSnapshot),
+    // stepping into a new tensor saves copying them before stepping in place
+    if (m_weights->IsShared())
+    {
+        m_weights = Evaluate(Lazy(TTensorPtr(m_weights)) - l_step);
+    }
+    else
+    {
+        Lazy(m_weights) -= l_step;
+    }
+    ZeroGrad();
+}
+
+TMutableTensorPtr WeightedLayer::p_SumWeightGrads() const
+{
+    // Init with zeros
+    TMutableTensorPtr l_sum = Tensor::Zeros(m_weightGrads.at(0)->Shape());
+    float* l_sumData = l_sum->MutableData().data();
+
+    // Each thread sums its own slice over all the gradients,
+    // so we only fork once no matter how many gradients we have
+    Threading::ParallelFor(Threading::ELEMENTWISE, l_sum->Size(), [&](size_t a_begin, size_t a_end) {
+        for (const TTensorPtr& grad : m_weightGrads)
+        {
+            const float* l_gradientData = grad->Data().data();
+            for (size_t i = a_begin; i < a_end; ++i)
+            {
+                l_sumData[i] += l_gradientData[i];
+            }
+        }
+    });
+
+    return l_sum;
+}
+
+void WeightedLayer::p_CheckGradientShape(const TTensorPtr& a_gradient) const
+{
+    if (a_gradient->Shape() != m_weights->Shape())
+    {
+        stringstream l_ss;
+        l_ss << m_name << "::ApplyGradient gradient shape " << a_gradient->ShapeStr()
+             << " != weights shape " << m_weights->ShapeStr();
+        LOG(ERROR) << l_ss.str() << endl;
+        throw(runtime_error(l_ss.str()));
+    }
+}
+
+} // namespace neural
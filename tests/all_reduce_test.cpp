@@ -0,0 +1,53 @@
+/*
+ * All Reduce Test
+ *
+ */
+
+#include "neural/parallel/all_reduce.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(AllReduceTest, TestWeightedMean)
+{
+    vector<TTensorPtr> l_tensors = {
+        Tensor::New({1,3}, {1.0, 2.0, 3.0}),
+        Tensor::New({1,3}, {4.0, 5.0, 6.0})
+    };
+
+    // Second tensor saw three times as many examples
+    TTensorPtr l_mean = AllReduce::WeightedMean(l_tensors, {1.0, 3.0});
+    EXPECT_EQ(1, l_mean->Shape().at(0));
+    EXPECT_EQ(3, l_mean->Shape().at(1));
+    EXPECT_FLOAT_EQ(3.25, l_mean->At({0,0}));
+    EXPECT_FLOAT_EQ(4.25, l_mean->At({0,1}));
+    EXPECT_FLOAT_EQ(5.25, l_mean->At({0,2}));
+}
+
+TEST(AllReduceTest, TestLargeTensor)
+{
+    vector<TTensorPtr> l_tensors;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        l_tensors.push_back(Tensor::Constant({785, 300}, (float)i));
+    }
+
+    TTensorPtr l_mean = AllReduce::WeightedMean(l_tensors, {1.0, 1.0, 1.0, 1.0});
+    for (size_t i = 0; i < l_mean->Size(); ++i)
+    {
+        ASSERT_FLOAT_EQ(1.5, l_mean->Data()[i]) << "@" << i;
+    }
+}
+
+TEST(AllReduceTest, TestShapeMismatchThrows)
+{
+    vector<TTensorPtr> l_tensors = {
+        Tensor::New({1,3}),
+        Tensor::New({3,1})
+    };
+    EXPECT_THROW(AllReduce::WeightedMean(l_tensors, {1.0, 1.0}), runtime_error);
+    EXPECT_THROW(AllReduce::WeightedMean(l_tensors, {1.0}), runtime_error);
+}
@@ -0,0 +1,126 @@
+/*
+ * Augment Pipeline Test
+ *
+ */
+
+#include "neural/data/augment_pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <stdexcept>
+
+using namespace neural;
+using namespace std;
+
+// 10 uint8 4x4 images, image i is all 20 * i, and labels i
+static MNISTDataloader MakeDataloader()
+{
+    vector<uint8_t> l_images = {0, 0, IdxFile::UINT8, 3, 0, 0, 0, 10, 0, 0, 0, 4, 0, 0, 0, 4};
+    vector<uint8_t> l_labels = {0, 0, IdxFile::UINT8, 1, 0, 0, 0, 10};
+    for (size_t i = 0; i < 10; ++i)
+    {
+        l_images.insert(l_images.end(), 16, (uint8_t)(20 * i));
+        l_labels.push_back((uint8_t)i);
+    }
+    ofstream(string("augment_pipeline_test_images.idx"), ios::binary)
+        .write(reinterpret_cast<const char*>(l_images.data()), l_images.size());
+    ofstream(string("augment_pipeline_test_labels.idx"), ios::binary)
+        .write(reinterpret_cast<const char*>(l_labels.data()), l_labels.size());
+
+    MNISTDataloader l_dataloader = MNISTDataloader::FromFiles(
+        "augment_pipeline_test_images.idx", "augment_pipeline_test_labels.idx");
+    remove("augment_pipeline_test_images.idx");
+    remove("augment_pipeline_test_labels.idx");
+    return l_dataloader;
+}
+
+// Every batch of one pass
+static vector<TTensorPtr> RunEpoch(AugmentPipeline& a_pipeline, size_t a_epoch, vector<float>& a_outTargets)
+{
+    vector<TTensorPtr> l_batches;
+    a_outTargets.clear();
+    a_pipeline.StartEpoch(a_epoch);
+    TTensorPtr l_inputs;
+    vector<float> l_targets;
+    while (a_pipeline.Next(l_inputs, l_targets))
+    {
+        l_batches.push_back(l_inputs);
+        a_outTargets.insert(a_outTargets.end(), l_targets.begin(), l_targets.end());
+    }
+    return l_batches;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(AugmentPipelineTest, TestOrderAndReproducible)
+{
+    MNISTDataloader l_dataloader = MakeDataloader();
+    Augmenter l_augmenter(Augmenter::DefaultParams(), 11);
+    AugmentPipeline l_one(l_dataloader, l_augmenter, 3, 1);
+    AugmentPipeline l_four(l_dataloader, l_augmenter, 3, 4, 1);
+    EXPECT_EQ(4, l_four.NumBatches());
+
+    vector<float> l_targets, l_fourTargets;
+    vector<TTensorPtr> l_batches = RunEpoch(l_one, 0, l_targets);
+    vector<TTensorPtr> l_fourBatches = RunEpoch(l_four, 0, l_fourTargets);
+    EXPECT_EQ(vector<float>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), l_targets);
+    EXPECT_EQ(l_targets, l_fourTargets);
+    ASSERT_EQ(4, l_batches.size());
+    EXPECT_EQ(vector<size_t>({1, 16}), l_batches[3]->Shape());
+
+    // Same images however many workers, each one the augmentation of its own sample
+    for (size_t b = 0; b < l_batches.size(); ++b)
+    {
+        EXPECT_EQ(l_batches[b]->Data(), l_fourBatches[b]->Data()) << "batch " << b;
+        for (size_t i = 0; i < l_batches[b]->Shape()[0]; ++i)
+        {
+            size_t l_example = 3 * b + i;
+            vector<float> l_raw(16, 2.0f * (20.0f * l_example) / 255.0f - 1.0f), l_expected(16);
+            l_augmenter.Apply(l_raw.data(), l_expected.data(), 1, 4, 4, -1.0f, l_example);
+            for (size_t j = 0; j < 16; ++j)
+            {
+                EXPECT_NEAR(l_expected[j], l_batches[b]->Data()[i * 16 + j], 1e-5);
+            }
+        }
+    }
+
+    // The next epoch gets other distortions
+    vector<TTensorPtr> l_next = RunEpoch(l_four, 1, l_fourTargets);
+    EXPECT_NE(l_batches[0]->Data(), l_next[0]->Data());
+}
+
+TEST(AugmentPipelineTest, TestPoolReuse)
+{
+    MNISTDataloader l_dataloader = MakeDataloader();
+    AugmentPipeline l_pipeline(l_dataloader, Augmenter(Augmenter::DefaultParams(), 3), 2, 2, 2);
+
+    // Batches dropped as soon as they are used go back to the pool
+    for (size_t l_epoch = 0; l_epoch < 5; ++l_epoch)
+    {
+        l_pipeline.StartEpoch(l_epoch);
+        TTensorPtr l_inputs;
+        vector<float> l_targets;
+        size_t l_numBatches = 0;
+        while (l_pipeline.Next(l_inputs, l_targets))
+        {
+            EXPECT_EQ(2, l_targets.size());
+            ++l_numBatches;
+        }
+        EXPECT_EQ(5, l_numBatches);
+        l_inputs.reset();
+    }
+
+    // At most the queue, one per worker in flight and the one we held
+    EXPECT_LE(l_pipeline.PoolSize(), 2 + 2 + 1);
+
+    // Starting over half way through drops the rest of the pass
+    l_pipeline.StartEpoch(0);
+    TTensorPtr l_inputs;
+    vector<float> l_targets;
+    ASSERT_TRUE(l_pipeline.Next(l_inputs, l_targets));
+    l_pipeline.StartEpoch(1);
+    ASSERT_TRUE(l_pipeline.Next(l_inputs, l_targets));
+    EXPECT_EQ(vector<float>({0, 1}), l_targets);
+
+    EXPECT_THROW(AugmentPipeline(l_dataloader, Augmenter(Augmenter::DefaultParams(), 3), 0, 2), runtime_error);
+}
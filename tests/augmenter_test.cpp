@@ -0,0 +1,121 @@
+/*
+ * Augmenter Test
+ *
+ */
+
+#include "neural/data/augmenter.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace neural;
+using namespace std;
+
+// A 2 channel 8x10 image with a bright square in the middle on a -1 background
+static vector<float> MakeImage()
+{
+    vector<float> l_image(2 * 8 * 10, -1.0f);
+    for (size_t c = 0; c < 2; ++c)
+    {
+        for (size_t y = 3; y < 5; ++y)
+        {
+            for (size_t x = 4; x < 6; ++x)
+            {
+                l_image[c * 80 + y * 10 + x] = c == 0 ? 1.0f : 0.5f;
+            }
+        }
+    }
+    return l_image;
+}
+
+static AugmentParams NoParams()
+{
+    AugmentParams l_params;
+    l_params.maxShift = 0.0f;
+    l_params.maxRotation = 0.0f;
+    l_params.elasticAlpha = 0.0f;
+    l_params.elasticSigma = 0.0f;
+    l_params.noiseStddev = 0.0f;
+    return l_params;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(AugmenterTest, TestIdentity)
+{
+    vector<float> l_image = MakeImage(), l_out(l_image.size());
+    Augmenter l_augmenter(NoParams(), 1);
+    l_augmenter.Apply(l_image.data(), l_out.data(), 2, 8, 10, -1.0f, 5);
+    for (size_t i = 0; i < l_image.size(); ++i)
+    {
+        EXPECT_NEAR(l_image[i], l_out[i], 1e-5) << "pixel " << i;
+    }
+}
+
+TEST(AugmenterTest, TestSameSampleSameImage)
+{
+    vector<float> l_image = MakeImage();
+    vector<float> l_first(l_image.size()), l_again(l_image.size()), l_other(l_image.size());
+    Augmenter l_augmenter(Augmenter::DefaultParams(), 42);
+    l_augmenter.Apply(l_image.data(), l_first.data(), 2, 8, 10, -1.0f, 7);
+    l_augmenter.Apply(l_image.data(), l_again.data(), 2, 8, 10, -1.0f, 7);
+    l_augmenter.Apply(l_image.data(), l_other.data(), 2, 8, 10, -1.0f, 8);
+    EXPECT_EQ(l_first, l_again);
+    EXPECT_NE(l_first, l_other);
+
+    // Another seed, other distortions
+    Augmenter(Augmenter::DefaultParams(), 43).Apply(l_image.data(), l_again.data(), 2, 8, 10, -1.0f, 7);
+    EXPECT_NE(l_first, l_again);
+
+    // Everything stays in range
+    for (float l_pixel : l_first)
+    {
+        EXPECT_GE(l_pixel, -1.0f);
+        EXPECT_LE(l_pixel, 1.0f);
+    }
+}
+
+TEST(AugmenterTest, TestGeometry)
+{
+    // Rotation and shift only keep the bright pixels about where they were and
+    // move both channels the same way
+    AugmentParams l_params = NoParams();
+    l_params.maxShift = 1.0f;
+    l_params.maxRotation = 15.0f;
+    Augmenter l_augmenter(l_params, 9);
+
+    vector<float> l_image = MakeImage(), l_out(l_image.size());
+    for (uint64_t l_sample = 0; l_sample < 20; ++l_sample)
+    {
+        l_augmenter.Apply(l_image.data(), l_out.data(), 2, 8, 10, -1.0f, l_sample);
+        float l_mass = 0.0f, l_sumX = 0.0f, l_sumY = 0.0f;
+        for (size_t y = 0; y < 8; ++y)
+        {
+            for (size_t x = 0; x < 10; ++x)
+            {
+                float l_weight = l_out[y * 10 + x] + 1.0f;
+                l_mass += l_weight;
+                l_sumX += l_weight * x;
+                l_sumY += l_weight * y;
+
+                // Second channel is the first one scaled onto [-1, 0.5]
+                EXPECT_NEAR(l_out[80 + y * 10 + x], -1.0f + 0.75f * l_weight, 1e-5);
+            }
+        }
+        ASSERT_GT(l_mass, 0.0f);
+        EXPECT_NEAR(4.5f, l_sumX / l_mass, 1.5f) << "sample " << l_sample;
+        EXPECT_NEAR(3.5f, l_sumY / l_mass, 1.5f) << "sample " << l_sample;
+    }
+
+    // Elastic and noise on their own still change the image
+    l_params = NoParams();
+    l_params.elasticAlpha = 34.0f;
+    l_params.elasticSigma = 4.0f;
+    Augmenter(l_params, 9).Apply(l_image.data(), l_out.data(), 2, 8, 10, -1.0f, 0);
+    EXPECT_NE(l_image, l_out);
+    l_params = NoParams();
+    l_params.noiseStddev = 0.1f;
+    Augmenter(l_params, 9).Apply(l_image.data(), l_out.data(), 2, 8, 10, -1.0f, 0);
+    EXPECT_NE(l_image, l_out);
+}
@@ -0,0 +1,69 @@
+/*
+ * Bounded Queue Test
+ *
+ */
+
+#include "neural/parallel/bounded_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(BoundedQueueTest, TestFifo)
+{
+    BoundedQueue<int> l_queue(3);
+    EXPECT_EQ(3, l_queue.Capacity());
+    EXPECT_TRUE(l_queue.Push(1));
+    EXPECT_TRUE(l_queue.Push(2));
+    EXPECT_EQ(2, l_queue.Size());
+
+    int l_item = 0;
+    EXPECT_TRUE(l_queue.Pop(l_item));
+    EXPECT_EQ(1, l_item);
+    EXPECT_TRUE(l_queue.Pop(l_item));
+    EXPECT_EQ(2, l_item);
+    EXPECT_EQ(0, l_queue.Size());
+}
+
+TEST(BoundedQueueTest, TestProducerNeverRunsAhead)
+{
+    BoundedQueue<int> l_queue(2);
+    size_t l_maxSize = 0;
+    thread l_producer([&]() {
+        for (int i = 0; i < 1000; ++i)
+        {
+            l_queue.Push(i);
+        }
+    });
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        l_maxSize = std::max(l_maxSize, l_queue.Size());
+        int l_item = -1;
+        ASSERT_TRUE(l_queue.Pop(l_item));
+        ASSERT_EQ(i, l_item);
+    }
+    l_producer.join();
+    EXPECT_LE(l_maxSize, 2);
+}
+
+TEST(BoundedQueueTest, TestCloseWakesWaiters)
+{
+    BoundedQueue<int> l_queue(1);
+    bool l_popped = true;
+    thread l_consumer([&]() {
+        int l_item = 0;
+        l_popped = l_queue.Pop(l_item);
+    });
+    l_queue.Close();
+    l_consumer.join();
+    EXPECT_FALSE(l_popped);
+    EXPECT_FALSE(l_queue.Push(1));
+
+    l_queue.Reset();
+    EXPECT_TRUE(l_queue.Push(1));
+}
@@ -0,0 +1,129 @@
+/*
+ * Checkpointer Test
+ *
+ */
+
+#include "neural/train/checkpointer.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+using namespace neural;
+using namespace std;
+
+static TrainState MakeState(uint64_t a_step)
+{
+    TrainState l_state = {2, 17, a_step, 1234, 0.25f};
+    return l_state;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(CheckpointerTest, TestSaveAndLoad)
+{
+    string l_file("checkpointer_test.ckpt");
+    remove(l_file.c_str());
+    Sequential l_model = MakeRandomModel({{3, 4}, {4, 1}});
+    Sequential l_restored = MakeRandomModel({{3, 4}, {4, 1}});
+    TrainState l_state;
+    EXPECT_FALSE(Checkpointer::Load(l_file, l_restored, l_state));
+
+    vector<float> l_saved = l_model.Layers()[0]->Weights()->Data();
+    {
+        Checkpointer l_checkpointer(l_file);
+        l_checkpointer.Save(l_model, MakeState(100));
+
+        // Training carries on, the snapshot doesn't see it
+        l_model.Layers()[0]->ApplyGradient(Tensor::Ones(l_model.Layers()[0]->Weights()->Shape()), 1.0f);
+        l_checkpointer.Flush();
+        EXPECT_EQ(1, l_checkpointer.NumWritten());
+    }
+
+    ASSERT_TRUE(Checkpointer::Load(l_file, l_restored, l_state));
+    EXPECT_EQ(2, l_state.epoch);
+    EXPECT_EQ(17, l_state.iteration);
+    EXPECT_EQ(100, l_state.step);
+    EXPECT_EQ(1234, l_state.seed);
+    EXPECT_EQ(0.25f, l_state.learningRate);
+    EXPECT_EQ(l_saved, l_restored.Layers()[0]->Weights()->Data());
+    EXPECT_NE(l_saved, l_model.Layers()[0]->Weights()->Data());
+
+    // Both models now give what the saved one did
+    TTensorPtr l_input = Tensor::New({1, 3}, {0.5f, -1.0f, 2.0f});
+    Sequential l_original = MakeRandomModel({{3, 4}, {4, 1}});
+    l_original.Layers()[0]->SetWeights(Tensor::New(l_model.Layers()[0]->Weights()->Shape(), l_saved));
+    l_original.Layers()[2]->SetWeights(l_model.Layers()[2]->Weights());
+    EXPECT_EQ(l_original.Forward(l_input)->Data(), l_restored.Forward(l_input)->Data());
+    remove(l_file.c_str());
+}
+
+TEST(CheckpointerTest, TestLastSaveWins)
+{
+    string l_file("checkpointer_test.ckpt");
+    Sequential l_model = MakeRandomModel({{3, 8}, {8, 1}});
+    {
+        // Many saves in a row never wait, the last one is what ends up on disk
+        Checkpointer l_checkpointer(l_file);
+        for (uint64_t l_step = 1; l_step <= 50; ++l_step)
+        {
+            l_checkpointer.Save(l_model, MakeState(l_step));
+        }
+        l_checkpointer.Flush();
+        EXPECT_GE(l_checkpointer.NumWritten(), 1);
+        EXPECT_LE(l_checkpointer.NumWritten(), 50);
+        EXPECT_GT(l_checkpointer.SnapshotSeconds(), 0.0);
+
+        // Saved by the destructor
+        l_checkpointer.Save(l_model, MakeState(51));
+    }
+
+    Sequential l_restored = MakeRandomModel({{3, 8}, {8, 1}});
+    TrainState l_state;
+    ASSERT_TRUE(Checkpointer::Load(l_file, l_restored, l_state));
+    EXPECT_EQ(51, l_state.step);
+    ifstream l_tmp(l_file + ".tmp");
+    EXPECT_FALSE(l_tmp.good());
+    remove(l_file.c_str());
+}
+
+TEST(CheckpointerTest, TestBadCheckpoints)
+{
+    string l_file("checkpointer_test.ckpt");
+    Sequential l_model = MakeRandomModel({{3, 4}, {4, 1}});
+    {
+        Checkpointer l_checkpointer(l_file);
+        l_checkpointer.Save(l_model, MakeState(1));
+    }
+
+    // Another architecture, its weights are left alone
+    Sequential l_other = MakeRandomModel({{3, 5}, {5, 1}});
+    vector<float> l_before = l_other.Layers()[0]->Weights()->Data();
+    TrainState l_state;
+    EXPECT_THROW(Checkpointer::Load(l_file, l_other, l_state), runtime_error);
+    EXPECT_EQ(l_before, l_other.Layers()[0]->Weights()->Data());
+
+    // One flipped byte
+    {
+        fstream l_outfile(l_file, ios::binary | ios::in | ios::out);
+        l_outfile.seekp(20);
+        l_outfile.put(0x55);
+    }
+    EXPECT_THROW(Checkpointer::Load(l_file, l_model, l_state), runtime_error);
+
+    // Not a checkpoint at all
+    {
+        ofstream l_outfile(l_file);
+        l_outfile << "hello";
+    }
+    EXPECT_THROW(Checkpointer::Load(l_file, l_model, l_state), runtime_error);
+
+    // Nowhere to write to, Flush reports it
+    Checkpointer l_checkpointer("checkpointer_test_missing_dir/model.ckpt");
+    l_checkpointer.Save(l_model, MakeState(1));
+    EXPECT_THROW(l_checkpointer.Flush(), runtime_error);
+    EXPECT_EQ(0, l_checkpointer.NumWritten());
+    remove(l_file.c_str());
+}
@@ -0,0 +1,139 @@
+/*
+ * Conv2D Layer Test
+ *
+ */
+
+#include "neural/layers/conv2d_layer.h"
+#include "neural/math/tensor_math.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// Straight from the definition, weights are (c, ki, kj) x out channel with the bias row last
+static float DirectConv(
+    const TTensorPtr& a_input, const TTensorPtr& a_weights, size_t a_kernelSize,
+    size_t a_stride, size_t a_padding, size_t b, size_t o, size_t oh, size_t ow)
+{
+    size_t l_inChannels = a_input->Shape()[1];
+    float l_sum = a_weights->At({l_inChannels * a_kernelSize * a_kernelSize, o});
+    for (size_t c = 0; c < l_inChannels; ++c)
+    {
+        for (size_t ki = 0; ki < a_kernelSize; ++ki)
+        {
+            for (size_t kj = 0; kj < a_kernelSize; ++kj)
+            {
+                long ih = (long)(oh * a_stride + ki) - (long)a_padding;
+                long iw = (long)(ow * a_stride + kj) - (long)a_padding;
+                if (ih < 0 || iw < 0 || ih >= (long)a_input->Shape()[2] || iw >= (long)a_input->Shape()[3])
+                {
+                    continue;
+                }
+                size_t row = (c * a_kernelSize + ki) * a_kernelSize + kj;
+                l_sum += a_input->At({b, c, (size_t)ih, (size_t)iw}) * a_weights->At({row, o});
+            }
+        }
+    }
+    return l_sum;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(Conv2DLayerTest, TestForwardMatchesDirect)
+{
+    TTensorPtr input = Tensor::Random({2, 3, 7, 6}, -1.0, 1.0);
+    TTensorPtr weights = Tensor::Random({3 * 3 * 3, 4}, -1.0, 1.0);
+    Conv2DLayer layer(weights, 3, 3, 2, 1);
+    EXPECT_EQ(4, layer.OutSize(7));
+    EXPECT_EQ(3, layer.OutSize(6));
+    EXPECT_EQ(4, layer.OutChannels());
+
+    // Give the bias a value so it gets checked too
+    TMutableTensorPtr withBias = layer.Weights()->ToMutable();
+    for (size_t o = 0; o < 4; ++o)
+    {
+        withBias->SetAt({27, o}, 0.25f * o);
+    }
+    layer.ApplyGradient(TensorMath::Subtract(layer.Weights(), withBias), 1.0);
+
+    TTensorPtr output = layer.Forward(input);
+    ASSERT_EQ(vector<size_t>({2, 4, 4, 3}), output->Shape());
+    for (size_t b = 0; b < 2; ++b)
+    {
+        for (size_t o = 0; o < 4; ++o)
+        {
+            for (size_t oh = 0; oh < 4; ++oh)
+            {
+                for (size_t ow = 0; ow < 3; ++ow)
+                {
+                    EXPECT_NEAR(DirectConv(input, layer.Weights(), 3, 2, 1, b, o, oh, ow),
+                                output->At({b, o, oh, ow}), 1e-4);
+                }
+            }
+        }
+    }
+}
+
+TEST(Conv2DLayerTest, TestGradientsMatchNumeric)
+{
+    TTensorPtr input = Tensor::Random({2, 2, 5, 5}, -1.0, 1.0);
+    TTensorPtr weights = Tensor::Random({2 * 3 * 3, 3}, -1.0, 1.0);
+    Conv2DLayer layer(weights, 2, 3, 1, 1);
+
+    // Loss is sum(output * probe), so the gradient wrt the output is probe
+    TTensorPtr probe = Tensor::Random({2, 3, 5, 5}, -1.0, 1.0);
+    auto loss = [&](const Conv2DLayer& a_layer, const TTensorPtr& a_input) {
+        return TensorMath::Sum(TensorMath::Hadamard(a_layer.Forward(a_input), probe));
+    };
+
+    TTensorPtr weightGrad;
+    TTensorPtr inputGrad = layer.CalcGradients(input, probe, weightGrad);
+    ASSERT_EQ(input->Shape(), inputGrad->Shape());
+    ASSERT_EQ(layer.Weights()->Shape(), weightGrad->Shape());
+
+    float eps = 1e-2;
+    for (size_t i = 0; i < input->Size(); i += 7)
+    {
+        TMutableTensorPtr plus = input->ToMutable();
+        TMutableTensorPtr minus = input->ToMutable();
+        plus->MutableData()[i] += eps;
+        minus->MutableData()[i] -= eps;
+        float numeric = (loss(layer, plus) - loss(layer, minus)) / (2 * eps);
+        EXPECT_NEAR(numeric, inputGrad->Data()[i], 1e-2) << "input " << i;
+    }
+
+    for (size_t i = 0; i < weightGrad->Size(); ++i)
+    {
+        TMutableTensorPtr step = Tensor::Zeros(weightGrad->Shape());
+        step->MutableData()[i] = eps;
+        shared_ptr<Conv2DLayer> plus = static_pointer_cast<Conv2DLayer>(layer.Clone());
+        shared_ptr<Conv2DLayer> minus = static_pointer_cast<Conv2DLayer>(layer.Clone());
+        plus->ApplyGradient(step, -1.0);
+        minus->ApplyGradient(step, 1.0);
+        float numeric = (loss(*plus, input) - loss(*minus, input)) / (2 * eps);
+        EXPECT_NEAR(numeric, weightGrad->Data()[i], 1e-2) << "weight " << i;
+    }
+}
+
+TEST(Conv2DLayerTest, TestUpdateWeights)
+{
+    TTensorPtr weights = Tensor::Zeros({4, 1});
+    Conv2DLayer layer(weights, 1, 2, 1, 0, false);
+    TTensorPtr input = Tensor::Ones({1, 1, 2, 2});
+    TTensorPtr gradOut = Tensor::Ones({1, 1, 1, 1});
+
+    layer.Backward(input, gradOut);
+    layer.Backward(input, gradOut);
+    layer.UpdateWeights(0.5);
+    EXPECT_EQ(vector<float>({-0.5, -0.5, -0.5, -0.5}), layer.Weights()->Data());
+}
+
+TEST(Conv2DLayerTest, TestBadShapesThrow)
+{
+    EXPECT_THROW(Conv2DLayer(Tensor::Zeros({10, 2}), 1, 3), runtime_error);
+
+    Conv2DLayer layer(Tensor::Zeros({9, 2}), 1, 3);
+    EXPECT_THROW(layer.Forward(Tensor::Zeros({1, 784})), runtime_error);
+    EXPECT_THROW(layer.Forward(Tensor::Zeros({1, 2, 5, 5})), runtime_error);
+    EXPECT_THROW(layer.Forward(Tensor::Zeros({1, 1, 2, 2})), runtime_error);
+}
@@ -0,0 +1,103 @@
+/*
+ * Data Parallel Trainer Test
+ *
+ */
+
+#include "neural/train/data_parallel_trainer.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// Weights of the two linear layers, every model starts from the same ones
+static vector<TTensorPtr> Weights()
+{
+    return {
+        Tensor::New({4,3}, {
+            0.1, -0.2, 0.3,
+            0.4, 0.5, -0.6,
+            -0.7, 0.8, 0.9,
+            0.1, 0.2, 0.3
+        }),
+        Tensor::New({3,1}, {
+            0.5,
+            -0.5,
+            0.25
+        })
+    };
+}
+
+static void MakeBatch(size_t a_batchSize, vector<TTensorPtr>& a_outInputs, vector<float>& a_outTargets)
+{
+    for (size_t i = 0; i < a_batchSize; ++i)
+    {
+        float x = (float)i / (float)a_batchSize;
+        a_outInputs.push_back(Tensor::New({1,4}, {x, 1.0f - x, x * x, 0.5f}));
+        a_outTargets.push_back(2.0f * x);
+    }
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(DataParallelTrainerTest, TestReplicasMatchSingleReplica)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    MakeBatch(10, l_inputs, l_targets);
+
+    DataParallelTrainer l_single(MakeModel(Weights()), 1);
+    DataParallelTrainer l_parallel(MakeModel(Weights()), 3);
+    EXPECT_EQ(3, l_parallel.NumReplicas());
+
+    for (size_t l_step = 0; l_step < 5; ++l_step)
+    {
+        float l_singleLoss = l_single.Step(l_inputs, l_targets, 0.1);
+        float l_parallelLoss = l_parallel.Step(l_inputs, l_targets, 0.1);
+        EXPECT_NEAR(l_singleLoss, l_parallelLoss, 1e-4);
+    }
+
+    // Averaging the gradients over shards is the same as averaging over the batch,
+    // and every replica applied the same update
+    for (size_t i = 0; i < l_inputs.size(); ++i)
+    {
+        float l_expected = l_single.Replica(0).Forward(l_inputs[i])->At({0,0});
+        for (size_t r = 0; r < l_parallel.NumReplicas(); ++r)
+        {
+            EXPECT_NEAR(l_expected, l_parallel.Replica(r).Forward(l_inputs[i])->At({0,0}), 1e-4);
+        }
+    }
+
+    // Only replica 0 stepped, the others share its weights
+    for (size_t r = 1; r < l_parallel.NumReplicas(); ++r)
+    {
+        EXPECT_EQ(l_parallel.Replica(0).Layers()[0]->Weights()->Data().data(),
+                  l_parallel.Replica(r).Layers()[0]->Weights()->Data().data());
+    }
+}
+
+TEST(DataParallelTrainerTest, TestLossDecreases)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    MakeBatch(16, l_inputs, l_targets);
+
+    DataParallelTrainer l_trainer(MakeModel(Weights()), 4);
+    float l_firstLoss = l_trainer.Step(l_inputs, l_targets, 0.05);
+    float l_lastLoss = l_firstLoss;
+    for (size_t l_step = 0; l_step < 50; ++l_step)
+    {
+        l_lastLoss = l_trainer.Step(l_inputs, l_targets, 0.05);
+    }
+    EXPECT_LT(l_lastLoss, l_firstLoss);
+}
+
+TEST(DataParallelTrainerTest, TestMoreReplicasThanExamples)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    MakeBatch(2, l_inputs, l_targets);
+
+    DataParallelTrainer l_trainer(MakeModel(Weights()), 4);
+    EXPECT_NO_THROW(l_trainer.Step(l_inputs, l_targets, 0.1));
+}
@@ -0,0 +1,63 @@
+/*
+ * File Descriptor I/O Test
+ *
+ */
+
+#include "neural/io/fd_io.h"
+
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(FdIoTest, TestPipeAndSocket)
+{
+    // A pipe isn't a socket, WriteFully falls back to write()
+    int l_pipe[2];
+    ASSERT_EQ(0, pipe(l_pipe));
+    string l_sent("hello pipe");
+    EXPECT_TRUE(FdIo::WriteFully(l_pipe[1], l_sent.data(), l_sent.size()));
+    string l_received(l_sent.size(), '\0');
+    EXPECT_TRUE(FdIo::ReadFully(l_pipe[0], &l_received[0], l_received.size()));
+    EXPECT_EQ(l_sent, l_received);
+
+    // End of file before the whole buffer
+    close(l_pipe[1]);
+    EXPECT_FALSE(FdIo::ReadFully(l_pipe[0], &l_received[0], 1));
+    close(l_pipe[0]);
+
+    // Writing to a socket whose peer is gone fails instead of raising SIGPIPE
+    int l_socks[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, l_socks));
+    close(l_socks[1]);
+    EXPECT_FALSE(FdIo::WriteFully(l_socks[0], l_sent.data(), l_sent.size()));
+    close(l_socks[0]);
+}
+
+TEST(FdIoTest, TestReadStops)
+{
+    int l_socks[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, l_socks));
+
+    // Nothing ever arrives, the stop function gets us out
+    atomic<int> l_numChecks(0);
+    char l_byte = 0;
+    EXPECT_FALSE(FdIo::ReadFully(l_socks[0], &l_byte, 1, [&]() { return ++l_numChecks == 2; }));
+    EXPECT_EQ(2, l_numChecks);
+
+    close(l_socks[0]);
+    close(l_socks[1]);
+}
+
+TEST(FdIoTest, TestThrow)
+{
+    EXPECT_THROW(FdIo::Throw("FdIoTest"), runtime_error);
+}
@@ -0,0 +1,29 @@
+/*
+ * Flatten Layer Test
+ *
+ */
+
+#include "neural/layers/flatten_layer.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(FlattenLayerTest, TestForwardBackward)
+{
+    TTensorPtr input = Tensor::Random({2, 3, 2, 2});
+    FlattenLayer layer;
+
+    TTensorPtr output = layer.Forward(input);
+    EXPECT_EQ(vector<size_t>({2, 12}), output->Shape());
+    EXPECT_EQ(input->Data(), output->Data());
+
+    TTensorPtr grad = Tensor::Random({2, 12});
+    TTensorPtr inputGrad = layer.Backward(input, grad);
+    EXPECT_EQ(input->Shape(), inputGrad->Shape());
+    EXPECT_EQ(grad->Data(), inputGrad->Data());
+
+    EXPECT_THROW(layer.Backward(input, Tensor::Zeros({2, 11})), runtime_error);
+}
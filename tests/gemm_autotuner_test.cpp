@@ -0,0 +1,107 @@
+/*
+ * GEMM Autotuner Test
+ *
+ */
+
+#include "neural/math/gemm_autotuner.h"
+#include "neural/parallel/threading.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(GemmAutotunerTest, TestHeuristicWhenDisabled)
+{
+    GemmAutotuner l_tuner;
+    EXPECT_FALSE(l_tuner.IsEnabled());
+    EXPECT_EQ("gemv", l_tuner.Select(1, 300, 785).name);
+    EXPECT_EQ("gemv", l_tuner.Select(16, 1, 301).name);
+    EXPECT_EQ("small", l_tuner.Select(4, 4, 4).name);
+    EXPECT_EQ("blas", l_tuner.Select(785, 300, 16).name);
+    EXPECT_EQ(0, l_tuner.NumCached());
+}
+
+TEST(GemmAutotunerTest, TestTunedWinnersPersist)
+{
+    string l_cacheFile("gemm_autotuner_test.cache");
+    remove(l_cacheFile.c_str());
+
+    string l_winner;
+    {
+        GemmAutotuner l_tuner;
+        l_tuner.Enable(l_cacheFile);
+        EXPECT_EQ(0, l_tuner.NumCached());
+
+        const GemmKernel& l_kernel = l_tuner.Select(8, 1, 301);
+        EXPECT_TRUE(l_kernel.supports(8, 1, 301));
+        l_winner = l_kernel.name;
+        EXPECT_EQ(1, l_tuner.NumCached());
+
+        // Same shape again is a cache hit
+        EXPECT_EQ(l_winner, l_tuner.Select(8, 1, 301).name);
+        EXPECT_EQ(1, l_tuner.NumCached());
+    }
+
+    // A new tuner picks the winner back up from disk
+    GemmAutotuner l_tuner;
+    l_tuner.Enable(l_cacheFile);
+    EXPECT_EQ(1, l_tuner.NumCached());
+    EXPECT_EQ(l_winner, l_tuner.Select(8, 1, 301).name);
+
+    remove(l_cacheFile.c_str());
+}
+
+TEST(GemmAutotunerTest, TestSavesOnceWithThreadsTheKernelGets)
+{
+    string l_cacheFile("gemm_autotuner_save_test.cache");
+    remove(l_cacheFile.c_str());
+
+    size_t l_oldThreads = Threading::NumThreads();
+    Threading::SetNumThreads(4);
+    GemmAutotuner l_tuner;
+    l_tuner.Enable(l_cacheFile);
+    {
+        Threading::SerialScope l_serial;
+        l_tuner.Select(8, 1, 301);
+    }
+
+    // Nothing is written until we ask
+    EXPECT_FALSE(ifstream(l_cacheFile).good());
+    EXPECT_TRUE(l_tuner.Save());
+
+    // The multiply ran on one thread inside the serial scope
+    ifstream l_infile(l_cacheFile);
+    string l_header;
+    getline(l_infile, l_header);
+    size_t l_m = 0, l_n = 0, l_k = 0, l_threads = 0;
+    l_infile >> l_m >> l_n >> l_k >> l_threads;
+    EXPECT_EQ(8, l_m);
+    EXPECT_EQ(1, l_n);
+    EXPECT_EQ(301, l_k);
+    EXPECT_EQ(1, l_threads);
+
+    Threading::SetNumThreads(l_oldThreads);
+    remove(l_cacheFile.c_str());
+}
+
+TEST(GemmAutotunerTest, TestLoadSkipsUnknownKernels)
+{
+    string l_cacheFile("gemm_autotuner_unknown_test.cache");
+    {
+        ofstream l_outfile(l_cacheFile);
+        l_outfile << "# m n k threads kernel" << endl;
+        l_outfile << "2 2 2 1 not_a_kernel" << endl;
+        l_outfile << "garbage" << endl;
+    }
+
+    GemmAutotuner l_tuner;
+    l_tuner.Enable(l_cacheFile);
+    EXPECT_EQ(0, l_tuner.NumCached());
+
+    remove(l_cacheFile.c_str());
+}
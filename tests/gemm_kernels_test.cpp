@@ -0,0 +1,128 @@
+/*
+ * GEMM Kernels Test
+ *
+ */
+
+#include "neural/math/gemm_kernels.h"
+#include "neural/parallel/threading.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+using namespace neural;
+using namespace std;
+
+// Fills a matrix with small values that are exact in float
+static vector<float> MakeMatrix(size_t a_rows, size_t a_cols, size_t a_seed)
+{
+    vector<float> l_data(a_rows * a_cols);
+    for (size_t i = 0; i < l_data.size(); ++i)
+    {
+        l_data[i] = (float)((i * 7 + a_seed) % 11) - 5.0f;
+    }
+    return l_data;
+}
+
+static void ExpectKernelMatchesBlas(const GemmKernel& a_kernel, size_t m, size_t n, size_t k)
+{
+    vector<float> A = MakeMatrix(m, k, 1);
+    vector<float> B = MakeMatrix(k, n, 2);
+    vector<float> l_expected(m * n);
+    vector<float> l_result(m * n, -1.0f);
+
+    GemmKernels::Blas(m, n, k, A.data(), B.data(), l_expected.data());
+    a_kernel.fn(m, n, k, A.data(), B.data(), l_result.data());
+
+    for (size_t i = 0; i < l_expected.size(); ++i)
+    {
+        EXPECT_NEAR(l_expected[i], l_result[i], 1e-3 * fabs(l_expected[i]) + 1e-3)
+            << a_kernel.name << " " << m << "x" << k << "*" << k << "x" << n << " @" << i;
+    }
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(GemmKernelsTest, TestFind)
+{
+    EXPECT_TRUE(GemmKernels::Find("blas"));
+    EXPECT_TRUE(GemmKernels::Find("blocked"));
+    EXPECT_TRUE(GemmKernels::Find("gemv"));
+    EXPECT_TRUE(GemmKernels::Find("small"));
+    EXPECT_FALSE(GemmKernels::Find("does_not_exist"));
+}
+
+TEST(GemmKernelsTest, TestKernelsMatchBlas)
+{
+    // The shapes from our network plus a few odd ones
+    size_t l_shapes[][3] = {
+        {1, 300, 785},
+        {16, 1, 301},
+        {785, 300, 16},
+        {5, 7, 3},
+        {32, 32, 32},
+        {33, 257, 65}
+    };
+
+    for (const GemmKernel& l_kernel : GemmKernels::All())
+    {
+        for (size_t i = 0; i < sizeof(l_shapes) / sizeof(l_shapes[0]); ++i)
+        {
+            size_t m = l_shapes[i][0];
+            size_t n = l_shapes[i][1];
+            size_t k = l_shapes[i][2];
+            if (l_kernel.supports(m, n, k))
+            {
+                ExpectKernelMatchesBlas(l_kernel, m, n, k);
+            }
+        }
+    }
+}
+
+TEST(GemmKernelsTest, TestSupports)
+{
+    const GemmKernel* l_gemv = GemmKernels::Find("gemv");
+    EXPECT_TRUE(l_gemv->supports(1, 300, 785));
+    EXPECT_TRUE(l_gemv->supports(16, 1, 301));
+    EXPECT_FALSE(l_gemv->supports(785, 300, 16));
+
+    const GemmKernel* l_small = GemmKernels::Find("small");
+    EXPECT_TRUE(l_small->supports(32, 32, 32));
+    EXPECT_FALSE(l_small->supports(1, 300, 785));
+}
+
+TEST(GemmKernelsTest, TestBatchedMatchesBlas)
+{
+    // Small and blocked sized products, parallel over the batch and one by one
+    const size_t l_shapes[][3] = {{3, 5, 4}, {40, 33, 70}};
+    for (const size_t* l_shape : l_shapes)
+    {
+        size_t m = l_shape[0], n = l_shape[1], k = l_shape[2];
+        size_t l_batch = 6;
+        vector<float> A = MakeMatrix(l_batch * m, k, 1);
+        vector<float> B = MakeMatrix(k, n, 2);
+        vector<float> l_result(l_batch * m * n, -1.0f);
+
+        for (size_t l_threshold : {(size_t)1, (size_t)-1})
+        {
+            size_t l_oldThreshold = Threading::Threshold(Threading::GEMM);
+            size_t l_oldThreads = Threading::NumThreads();
+            Threading::SetThreshold(Threading::GEMM, l_threshold);
+            Threading::SetNumThreads(3);
+            // B is shared, stride 0
+            GemmKernels::Batched(l_batch, m, n, k, A.data(), m * k, B.data(), 0, l_result.data());
+            Threading::SetThreshold(Threading::GEMM, l_oldThreshold);
+            Threading::SetNumThreads(l_oldThreads);
+
+            vector<float> l_expected(m * n);
+            for (size_t b = 0; b < l_batch; ++b)
+            {
+                GemmKernels::Blas(m, n, k, A.data() + b * m * k, B.data(), l_expected.data());
+                for (size_t i = 0; i < m * n; ++i)
+                {
+                    EXPECT_NEAR(l_expected[i], l_result[b * m * n + i], 1e-3 * fabs(l_expected[i]) + 1e-3)
+                        << m << "x" << k << "*" << k << "x" << n << " batch " << b << " @" << i;
+                }
+            }
+        }
+    }
+}
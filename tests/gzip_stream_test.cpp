@@ -0,0 +1,150 @@
+/*
+ * Gzip Stream Test
+ *
+ */
+
+#include "neural/data/gzip_stream.h"
+#include "neural/data/idx_file.h"
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+using namespace neural;
+using namespace std;
+
+// Bytes that don't compress to nothing, so the file has many deflate blocks
+static vector<uint8_t> MakeBytes(size_t a_size)
+{
+    mt19937 l_rng(7);
+    vector<uint8_t> l_bytes(a_size);
+    for (size_t i = 0; i < a_size; ++i)
+    {
+        l_bytes[i] = (uint8_t)(i % 251 < 100 ? l_rng() % 16 : i);
+    }
+    return l_bytes;
+}
+
+static void WriteGzip(const string& a_file, const vector<uint8_t>& a_bytes)
+{
+    gzFile l_gz = gzopen(a_file.c_str(), "wb");
+    ASSERT_TRUE(l_gz != nullptr);
+    ASSERT_EQ((int)a_bytes.size(), gzwrite(l_gz, a_bytes.data(), a_bytes.size()));
+    gzclose(l_gz);
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(GzipStreamTest, TestSequentialAndRandomReads)
+{
+    // Several times the ring so it wraps and the index gets many points
+    string l_file("gzip_stream_test.gz");
+    vector<uint8_t> l_bytes = MakeBytes(3 << 20);
+    WriteGzip(l_file, l_bytes);
+
+    int l_fd = open(l_file.c_str(), O_RDONLY);
+    ASSERT_GE(l_fd, 0);
+    {
+        GzipStream l_stream(l_fd, l_file, 256 << 10);
+        vector<uint8_t> l_read(10000);
+        for (size_t l_offset = 0; l_offset < l_bytes.size(); l_offset += l_read.size())
+        {
+            size_t l_size = min(l_read.size(), l_bytes.size() - l_offset);
+            l_stream.Read(l_offset, l_size, l_read.data());
+            ASSERT_TRUE(equal(l_read.begin(), l_read.begin() + l_size, l_bytes.begin() + l_offset))
+                << "offset " << l_offset;
+        }
+        EXPECT_GE(l_stream.NumAccessPoints(), 4);
+
+        // Backwards and all over the place go through the index
+        mt19937 l_rng(3);
+        for (size_t i = 0; i < 50; ++i)
+        {
+            size_t l_offset = l_rng() % (l_bytes.size() - l_read.size());
+            l_stream.Read(l_offset, l_read.size(), l_read.data());
+            ASSERT_TRUE(equal(l_read.begin(), l_read.end(), l_bytes.begin() + l_offset)) << "offset " << l_offset;
+        }
+
+        // The last bytes, and past the end
+        l_stream.Read(l_bytes.size() - 5, 5, l_read.data());
+        EXPECT_EQ(l_bytes.back(), l_read[4]);
+        EXPECT_THROW(l_stream.Read(l_bytes.size() - 5, 6, l_read.data()), runtime_error);
+    }
+
+    // Indexed up front, a read in the middle needs no first pass
+    {
+        GzipStream l_stream(l_fd, l_file);
+        EXPECT_EQ(l_bytes.size(), l_stream.BuildIndex());
+        // Points only go between deflate blocks, so at least a span apart
+        EXPECT_GE(l_stream.NumAccessPoints(), 4);
+        EXPECT_LE(l_stream.NumAccessPoints(), l_bytes.size() / GzipStream::kSpan);
+        vector<uint8_t> l_read(100);
+        l_stream.ReadDirect(2 << 20, l_read.size(), l_read.data());
+        EXPECT_TRUE(equal(l_read.begin(), l_read.end(), l_bytes.begin() + (2 << 20)));
+    }
+    close(l_fd);
+    remove(l_file.c_str());
+}
+
+TEST(GzipStreamTest, TestCorruptFile)
+{
+    string l_file("gzip_stream_test.gz");
+    vector<uint8_t> l_bytes = MakeBytes(1 << 20);
+    WriteGzip(l_file, l_bytes);
+
+    // Cut off half way through
+    ASSERT_EQ(0, truncate(l_file.c_str(), 100000));
+    int l_fd = open(l_file.c_str(), O_RDONLY);
+    ASSERT_GE(l_fd, 0);
+    {
+        GzipStream l_stream(l_fd, l_file);
+        vector<uint8_t> l_read(1000);
+        l_stream.Read(0, l_read.size(), l_read.data());
+        EXPECT_TRUE(equal(l_read.begin(), l_read.end(), l_bytes.begin()));
+        EXPECT_THROW(l_stream.Read(900000, l_read.size(), l_read.data()), runtime_error);
+        EXPECT_THROW(l_stream.BuildIndex(), runtime_error);
+    }
+    close(l_fd);
+    remove(l_file.c_str());
+}
+
+TEST(GzipStreamTest, TestIdxFile)
+{
+    // Same values compressed and not
+    string l_plain("gzip_stream_test.idx"), l_file("gzip_stream_test.idx.gz");
+    vector<uint8_t> l_bytes = {0, 0, IdxFile::UINT8, 2, 0, 0, 0x27, 0x10, 0, 0, 0, 100};
+    vector<uint8_t> l_values = MakeBytes(10000 * 100);
+    l_bytes.insert(l_bytes.end(), l_values.begin(), l_values.end());
+    WriteGzip(l_file, l_bytes);
+    {
+        ofstream l_outfile(l_plain, ios::binary);
+        l_outfile.write(reinterpret_cast<const char*>(l_bytes.data()), l_bytes.size());
+    }
+
+    IdxFile l_gzip(l_file), l_idx(l_plain);
+    EXPECT_EQ(IdxFile::GZIP, l_gzip.Access());
+    EXPECT_EQ(vector<size_t>({10000, 100}), l_gzip.Shape());
+    vector<float> l_expected(100 * 100), l_read(100 * 100);
+    for (size_t l_begin : {0, 100, 5000, 200, 9900})
+    {
+        l_idx.ReadItems(l_begin, l_begin + 100, l_expected.data());
+        l_gzip.ReadItems(l_begin, l_begin + 100, l_read.data());
+        EXPECT_EQ(l_expected, l_read) << "item " << l_begin;
+    }
+    l_gzip.BuildIndex();
+    l_gzip.ReadItems(9999, 10000, l_read.data());
+    EXPECT_EQ((float)l_values.back(), l_read[99]);
+
+    // Header that says more than the file has
+    l_bytes.resize(l_bytes.size() - 1);
+    WriteGzip(l_file, l_bytes);
+    EXPECT_THROW(IdxFile l_short(l_file), runtime_error);
+    remove(l_file.c_str());
+    remove(l_plain.c_str());
+}
@@ -0,0 +1,118 @@
+/*
+ * Hogwild Trainer Test
+ *
+ */
+
+#include "neural/train/hogwild_trainer.h"
+#include "neural/layers/linear_layer.h"
+#include "neural/layers/relu_layer.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+using namespace neural;
+using namespace std;
+
+// y = 2 * x0 - x1 on a small grid
+static bool ExampleAt(size_t i, TMutableTensorPtr& a_outInput, TMutableTensorPtr& a_outOutput)
+{
+    float x0 = (float)(i % 10) / 10.0f;
+    float x1 = (float)((i / 10) % 10) / 10.0f;
+    a_outInput = Tensor::New({1,2}, {x0, x1});
+    a_outOutput = Tensor::New({1,1}, {2.0f * x0 - x1});
+    return true;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(HogwildTrainerTest, TestLossDecreases)
+{
+    Sequential l_model;
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::New({2,1}, {0.0, 0.0}))));
+
+    HogwildTrainer l_trainer(l_model, 3);
+
+    // Loss on the whole grid before and after a few passes
+    float l_before = 0.0;
+    float l_after = 0.0;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        TMutableTensorPtr l_input, l_output;
+        ExampleAt(i, l_input, l_output);
+        float l_diff = l_model.Forward(l_input)->At({0,0}) - l_output->At({0,0});
+        l_before += l_diff * l_diff;
+    }
+
+    for (size_t l_epoch = 0; l_epoch < 20; ++l_epoch)
+    {
+        l_trainer.Train(100, &ExampleAt, 0.05, 0.01);
+    }
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        TMutableTensorPtr l_input, l_output;
+        ExampleAt(i, l_input, l_output);
+        float l_diff = l_model.Forward(l_input)->At({0,0}) - l_output->At({0,0});
+        l_after += l_diff * l_diff;
+    }
+
+    EXPECT_LT(l_after, l_before * 0.1);
+}
+
+TEST(HogwildTrainerTest, TestCurveAndThroughput)
+{
+    Sequential l_model;
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::New({2,3}))));
+    l_model.Add(TLayerPtr(new ReLULayer()));
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::New({3,1}))));
+
+    HogwildTrainer l_trainer(l_model, 2);
+    l_trainer.Train(500, &ExampleAt, 0.01, 0.01);
+
+    // We always get a final point that covers every example
+    ASSERT_FALSE(l_trainer.Curve().empty());
+    EXPECT_EQ(500, l_trainer.Curve().back().examples);
+    EXPECT_GT(l_trainer.ExamplesPerSecond(), 0.0);
+
+    // Curve keeps counting across calls
+    l_trainer.Train(500, &ExampleAt, 0.01, 0.01);
+    EXPECT_EQ(1000, l_trainer.Curve().back().examples);
+}
+
+TEST(HogwildTrainerTest, TestSharedWeightsAreUnsharedFirst)
+{
+    Sequential l_model;
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::New({2,1}, {0.0, 0.0}))));
+    Sequential l_clone = l_model.Clone();
+    ASSERT_TRUE(l_model.Layers()[0]->Weights()->IsShared());
+
+    HogwildTrainer l_trainer(l_model, 3);
+    l_trainer.Train(100, &ExampleAt, 0.05, 0.01);
+
+    EXPECT_FALSE(l_model.Layers()[0]->Weights()->IsShared());
+    EXPECT_EQ(vector<float>({0.0, 0.0, 1.0}), l_clone.Layers()[0]->Weights()->Data());
+}
+
+TEST(HogwildTrainerTest, TestWorkerErrorStopsTraining)
+{
+    Sequential l_model;
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::New({2,1}, {0.0, 0.0}))));
+
+    // Example 50 can't be loaded, the rest of the pass is abandoned
+    atomic<size_t> l_numLoaded(0);
+    HogwildTrainer l_trainer(l_model, 3);
+    EXPECT_THROW(l_trainer.Train(100000,
+                     [&](size_t i, TMutableTensorPtr& a_input, TMutableTensorPtr& a_output) {
+                         if (i == 50)
+                         {
+                             throw(runtime_error("bad example"));
+                         }
+                         ++l_numLoaded;
+                         return ExampleAt(i, a_input, a_output);
+                     }, 0.01, 0.01),
+                 runtime_error);
+    EXPECT_LT(l_numLoaded, 100000 - 1);
+
+    // The trainer is still usable
+    l_trainer.Train(100, &ExampleAt, 0.01, 0.01);
+}
@@ -0,0 +1,184 @@
+/*
+ * IDX File Test
+ *
+ */
+
+#include "neural/data/idx_file.h"
+#include "neural/data/mnist_dataloader.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fstream>
+
+using namespace neural;
+using namespace std;
+
+// Writes an IDX file with a_values stored as a_type, big endian
+static void WriteIdx(
+    const string& a_file, uint8_t a_type, const vector<uint32_t>& a_shape,
+    const vector<double>& a_values, size_t a_truncate = 0)
+{
+    vector<uint8_t> l_bytes = {0, 0, a_type, (uint8_t)a_shape.size()};
+    for (uint32_t l_dim : a_shape)
+    {
+        for (int b = 3; b >= 0; --b)
+        {
+            l_bytes.push_back((uint8_t)(l_dim >> (8 * b)));
+        }
+    }
+
+    size_t l_typeSize = IdxFile::TypeSize((IdxFile::EType)a_type);
+    for (double l_value : a_values)
+    {
+        uint64_t l_bits = 0;
+        if (a_type == IdxFile::FLOAT32)
+        {
+            float l_float = (float)l_value;
+            uint32_t l_bits32;
+            memcpy(&l_bits32, &l_float, sizeof(float));
+            l_bits = l_bits32;
+        }
+        else if (a_type == IdxFile::FLOAT64)
+        {
+            memcpy(&l_bits, &l_value, sizeof(double));
+        }
+        else
+        {
+            l_bits = (uint64_t)(int64_t)l_value;
+        }
+        for (int b = (int)l_typeSize - 1; b >= 0; --b)
+        {
+            l_bytes.push_back((uint8_t)(l_bits >> (8 * b)));
+        }
+    }
+
+    ofstream l_outfile(a_file, ios::binary);
+    l_outfile.write(reinterpret_cast<const char*>(l_bytes.data()), l_bytes.size() - a_truncate);
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(IdxFileTest, TestEveryType)
+{
+    string l_file("idx_file_test.idx");
+    const uint8_t l_types[] = {
+        IdxFile::UINT8, IdxFile::INT8, IdxFile::INT16, IdxFile::INT32, IdxFile::FLOAT32, IdxFile::FLOAT64};
+    for (uint8_t l_type : l_types)
+    {
+        bool l_signed = l_type != IdxFile::UINT8;
+        bool l_float = l_type == IdxFile::FLOAT32 || l_type == IdxFile::FLOAT64;
+        vector<double> l_values;
+        for (size_t i = 0; i < 3 * 2 * 2; ++i)
+        {
+            double l_value = l_signed ? (double)i - 5.0 : (double)i * 20.0;
+            l_values.push_back(l_float ? l_value + 0.25 : l_value);
+        }
+        WriteIdx(l_file, l_type, {3, 2, 2}, l_values);
+
+        for (IdxFile::EAccess l_access : {IdxFile::MMAP, IdxFile::PREAD})
+        {
+            IdxFile l_idx(l_file, l_access);
+            EXPECT_EQ(l_type, l_idx.Type());
+            EXPECT_EQ(l_access, l_idx.Access());
+            EXPECT_EQ(vector<size_t>({3, 2, 2}), l_idx.Shape());
+            EXPECT_EQ(3, l_idx.NumItems());
+            EXPECT_EQ(4, l_idx.ItemSize());
+
+            // All of it, then the last two items on their own
+            vector<float> l_all(12), l_tail(8);
+            l_idx.ReadItems(0, 3, l_all.data());
+            l_idx.ReadItems(1, 3, l_tail.data());
+            for (size_t i = 0; i < l_values.size(); ++i)
+            {
+                EXPECT_EQ((float)l_values[i], l_all[i]) << "type " << (int)l_type << " value " << i;
+            }
+            for (size_t i = 0; i < l_tail.size(); ++i)
+            {
+                EXPECT_EQ((float)l_values[i + 4], l_tail[i]);
+            }
+            EXPECT_THROW(l_idx.ReadItems(2, 4, l_all.data()), runtime_error);
+        }
+    }
+    remove(l_file.c_str());
+}
+
+TEST(IdxFileTest, TestRankOneAndReadAhead)
+{
+    string l_file("idx_file_test.idx");
+    vector<double> l_values;
+    for (size_t i = 0; i < 5000; ++i)
+    {
+        l_values.push_back((double)(i % 10));
+    }
+    WriteIdx(l_file, IdxFile::UINT8, {5000}, l_values);
+
+    // Small windows so sequential reads go past several of them
+    for (IdxFile::EAccess l_access : {IdxFile::MMAP, IdxFile::PREAD})
+    {
+        IdxFile l_idx(l_file, l_access);
+        l_idx.SetReadAhead(1024);
+        EXPECT_EQ(1, l_idx.ItemSize());
+        vector<float> l_read(100);
+        for (size_t l_begin = 0; l_begin < 5000; l_begin += 100)
+        {
+            l_idx.ReadItems(l_begin, l_begin + 100, l_read.data());
+            EXPECT_EQ((float)(l_begin % 10), l_read[0]);
+            EXPECT_EQ((float)((l_begin + 99) % 10), l_read[99]);
+        }
+    }
+    remove(l_file.c_str());
+}
+
+TEST(IdxFileTest, TestBadFiles)
+{
+    string l_file("idx_file_test.idx");
+    EXPECT_THROW(IdxFile("idx_file_test_missing.idx"), runtime_error);
+
+    // First two bytes aren't zero
+    WriteIdx(l_file, IdxFile::UINT8, {2}, {1.0, 2.0});
+    {
+        fstream l_outfile(l_file, ios::binary | ios::in | ios::out);
+        l_outfile.put(1);
+    }
+    EXPECT_THROW(IdxFile l_idx(l_file), runtime_error);
+
+    // Unknown type code
+    WriteIdx(l_file, 0x0A, {2}, {});
+    EXPECT_THROW(IdxFile l_idx(l_file), runtime_error);
+
+    // Fewer values than the header says
+    WriteIdx(l_file, IdxFile::INT16, {2, 2}, {1.0, 2.0, 3.0, 4.0}, 1);
+    EXPECT_THROW(IdxFile l_idx(l_file), runtime_error);
+    remove(l_file.c_str());
+}
+
+TEST(IdxFileTest, TestDataloaderFromFiles)
+{
+    // 2 float32 images of 2x3 with 3 channels, int32 labels
+    string l_images("idx_file_test_images.idx"), l_labels("idx_file_test_labels.idx");
+    vector<double> l_pixels;
+    for (size_t i = 0; i < 2 * 3 * 2 * 3; ++i)
+    {
+        l_pixels.push_back(0.5 * i);
+    }
+    WriteIdx(l_images, IdxFile::FLOAT32, {2, 3, 2, 3}, l_pixels);
+    WriteIdx(l_labels, IdxFile::INT32, {2}, {7.0, 300.0});
+
+    MNISTDataloader l_dataloader = MNISTDataloader::FromFiles(l_images, l_labels, IdxFile::PREAD);
+    EXPECT_EQ(2, l_dataloader.DataLength());
+
+    // Float pixels are taken as is
+    l_dataloader.SetLayout(MNISTDataloader::NCHW);
+    TMutableTensorPtr l_input, l_output;
+    ASSERT_TRUE(l_dataloader.DataAt(1, l_input, l_output));
+    EXPECT_EQ(vector<size_t>({1, 3, 2, 3}), l_input->Shape());
+    EXPECT_EQ(0.5f * 18, l_input->At({0, 0, 0, 0}));
+    EXPECT_EQ(0.5f * 35, l_input->At({0, 2, 1, 2}));
+    EXPECT_EQ(300.0f, l_output->At({0, 0}));
+
+    // Labels that don't match the images
+    WriteIdx(l_labels, IdxFile::UINT8, {3}, {1.0, 2.0, 3.0});
+    EXPECT_THROW(MNISTDataloader::FromFiles(l_images, l_labels), runtime_error);
+    remove(l_images.c_str());
+    remove(l_labels.c_str());
+}
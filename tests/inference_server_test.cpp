@@ -0,0 +1,103 @@
+/*
+ * Inference Server Test
+ *
+ */
+
+#include "neural/serve/inference_server.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+static vector<float> Example(size_t a_index)
+{
+    vector<float> l_input(6);
+    for (size_t i = 0; i < l_input.size(); ++i)
+    {
+        l_input[i] = 0.1f * a_index - 0.2f * i;
+    }
+    return l_input;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(InferenceServerTest, TestPredictOverUnixSocket)
+{
+    Sequential l_model = MakeRandomModel({{6, 5}, {5, 2}});
+    InferenceServer l_server(l_model, {6}, 4, 0.001);
+    EXPECT_EQ(l_server.InputSize(), 6u);
+    EXPECT_EQ(l_server.OutputSize(), 2u);
+    string l_address = l_server.Listen("inference_server_test.sock");
+    EXPECT_EQ(l_address, "inference_server_test.sock");
+
+    InferenceClient l_client(l_address, 6, 2);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        vector<float> l_input = Example(i);
+        vector<float> l_output(2);
+        l_client.Predict(l_input.data(), l_output.data());
+
+        TTensorPtr l_expected = l_model.Forward(Tensor::New({1, 6}, l_input));
+        EXPECT_FLOAT_EQ(l_output[0], l_expected->At({0, 0}));
+        EXPECT_FLOAT_EQ(l_output[1], l_expected->At({0, 1}));
+    }
+    EXPECT_EQ(l_server.NumRequests(), 5u);
+}
+
+TEST(InferenceServerTest, TestConcurrentRequestsShareBatches)
+{
+    Sequential l_model = MakeRandomModel({{6, 5}, {5, 2}});
+    InferenceServer l_server(l_model, {6}, 8, 0.5);
+    string l_address = l_server.Listen("tcp:0");
+    ASSERT_EQ(l_address.compare(0, 4, "tcp:"), 0);
+
+    // Every client connects first so the requests go out together
+    vector<unique_ptr<InferenceClient>> l_clients;
+    for (size_t c = 0; c < 8; ++c)
+    {
+        l_clients.emplace_back(new InferenceClient(l_address, 6, 2));
+    }
+
+    vector<vector<float>> l_outputs(8, vector<float>(2));
+    vector<thread> l_threads;
+    for (size_t c = 0; c < 8; ++c)
+    {
+        l_threads.emplace_back([&l_clients, &l_outputs, c]() {
+            vector<float> l_input = Example(c);
+            l_clients[c]->Predict(l_input.data(), l_outputs[c].data());
+        });
+    }
+    for (thread& l_thread : l_threads)
+    {
+        l_thread.join();
+    }
+
+    // A full batch goes right away, long before the wait is up
+    EXPECT_EQ(l_server.NumRequests(), 8u);
+    EXPECT_LE(l_server.NumBatches(), 2u);
+    for (size_t c = 0; c < 8; ++c)
+    {
+        TTensorPtr l_expected = l_model.Forward(Tensor::New({1, 6}, Example(c)));
+        EXPECT_FLOAT_EQ(l_outputs[c][0], l_expected->At({0, 0}));
+        EXPECT_FLOAT_EQ(l_outputs[c][1], l_expected->At({0, 1}));
+    }
+}
+
+TEST(InferenceServerTest, TestErrors)
+{
+    EXPECT_THROW(InferenceServer(MakeRandomModel({{6, 5}, {5, 2}}), {6}, 0, 0.001), runtime_error);
+    EXPECT_THROW(InferenceClient("inference_server_test_missing.sock", 6, 2), runtime_error);
+
+    // The server is gone once it is destroyed, so is its socket
+    string l_address;
+    {
+        InferenceServer l_server(MakeRandomModel({{6, 5}, {5, 2}}), {6}, 4, 0.001);
+        l_address = l_server.Listen("inference_server_test.sock");
+        InferenceClient l_client(l_address, 6, 2);
+    }
+    EXPECT_THROW(InferenceClient(l_address, 6, 2), runtime_error);
+}
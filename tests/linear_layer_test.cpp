@@ -92,3 +92,48 @@ TEST(LinearLayerTest, TestForwardWithBias)
     EXPECT_EQ(6.0,  output->At({1, 0}));
     EXPECT_EQ(9.0,  output->At({1, 1}));
 }
+
+TEST(LinearLayerTest, TestSparseInput)
+{
+    TTensorPtr input = Tensor::New({2,3}, {
+        0.0, 3.0, 0.0,
+        2.0, 0.0, 0.0
+    });
+    TTensorPtr weights = Tensor::New({3,2}, {
+        1.0, 2.0,
+        3.0, 4.0,
+        5.0, 6.0
+    });
+    TTensorPtr gradInput = Tensor::New({2,2}, {
+        1.0, -1.0,
+        0.5, 2.0
+    });
+
+    LinearLayer dense(weights);
+    LinearLayer sparse(weights);
+    TSparseTensorPtr sparseInput = SparseTensor::FromDense(input);
+
+    TTensorPtr denseOut = dense.Forward(input);
+    TTensorPtr sparseOut = sparse.Forward(sparseInput);
+    ASSERT_EQ(denseOut->Shape(), sparseOut->Shape());
+    for (size_t i = 0; i < denseOut->Size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(denseOut->Data()[i], sparseOut->Data()[i]);
+    }
+
+    TTensorPtr denseGrad = dense.Backward(input, gradInput);
+    TTensorPtr sparseGrad = sparse.Backward(sparseInput, gradInput);
+    ASSERT_EQ(denseGrad->Shape(), sparseGrad->Shape());
+    for (size_t i = 0; i < denseGrad->Size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(denseGrad->Data()[i], sparseGrad->Data()[i]);
+    }
+
+    TTensorPtr denseWeightGrad = dense.CalcAvgWeightGrad();
+    TTensorPtr sparseWeightGrad = sparse.CalcAvgWeightGrad();
+    ASSERT_EQ(denseWeightGrad->Shape(), sparseWeightGrad->Shape());
+    for (size_t i = 0; i < denseWeightGrad->Size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(denseWeightGrad->Data()[i], sparseWeightGrad->Data()[i]);
+    }
+}
@@ -0,0 +1,158 @@
+/*
+ * Linear ReLU Layer Test
+ *
+ */
+
+#include "neural/layers/linear_layer.h"
+#include "neural/layers/linear_relu_layer.h"
+#include "neural/layers/relu_layer.h"
+#include "neural/parallel/threading.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+static void ExpectNear(const TTensorPtr& a_expected, const TTensorPtr& a_actual)
+{
+    ASSERT_EQ(a_expected->Shape(), a_actual->Shape());
+    for (size_t i = 0; i < a_expected->Size(); ++i)
+    {
+        EXPECT_NEAR(a_expected->Data()[i], a_actual->Data()[i], 1e-4);
+    }
+}
+
+// Runs the fused layer and Linear then ReLU side by side
+static void ExpectMatchesUnfused(const TTensorPtr& a_input, const TTensorPtr& a_weights, bool a_hasBias)
+{
+    LinearReLULayer fused(a_weights, a_hasBias);
+    LinearLayer linear(a_weights, a_hasBias);
+    ReLULayer relu;
+
+    TTensorPtr preActivation = linear.Forward(a_input);
+    TTensorPtr expected = relu.Forward(preActivation);
+    TTensorPtr output = fused.ForwardForBackward(a_input);
+    ExpectNear(expected, output);
+    ExpectNear(expected, fused.Forward(a_input));
+
+    TTensorPtr grad = Tensor::Random(output->Shape(), -1.0, 1.0);
+    TTensorPtr expectedGradWrtInput = linear.Backward(a_input, relu.Backward(preActivation, grad));
+    TTensorPtr gradWrtInput = fused.Backward(a_input, grad);
+    ExpectNear(expectedGradWrtInput, gradWrtInput);
+    ExpectNear(linear.CalcAvgWeightGrad(), fused.CalcAvgWeightGrad());
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(LinearReLULayerTest, TestForward)
+{
+    TTensorPtr input = Tensor::New({2,2}, {
+        4.0, 3.0,
+        2.0, -1.0
+    });
+
+    // The bias row starts at 1
+    TTensorPtr weights = Tensor::New({2,2}, {
+        1.0, -2.0,
+        -3.0, 4.0
+    });
+    LinearReLULayer layer(weights);
+
+    /*
+    (0,0) = 4*1 + 3*-3 + 1 = -4 -> 0
+    (0,1) = 4*-2 + 3*4 + 1 = 5
+    (1,0) = 2*1 + -1*-3 + 1 = 6
+    (1,1) = 2*-2 + -1*4 + 1 = -7 -> 0
+    */
+    TTensorPtr output = layer.Forward(input);
+    EXPECT_EQ(vector<size_t>({2, 2}), output->Shape());
+    EXPECT_EQ(0.0, output->At({0,0}));
+    EXPECT_EQ(5.0, output->At({0,1}));
+    EXPECT_EQ(6.0, output->At({1,0}));
+    EXPECT_EQ(0.0, output->At({1,1}));
+}
+
+TEST(LinearReLULayerTest, TestMatchesLinearThenReLU)
+{
+    // Not a multiple of the row block or of 64 columns
+    TTensorPtr input = Tensor::Random({101, 37}, -1.0, 1.0);
+    ExpectMatchesUnfused(input, Tensor::Random({37, 70}, -1.0, 1.0), true);
+    ExpectMatchesUnfused(input, Tensor::Random({37, 70}, -1.0, 1.0), false);
+}
+
+TEST(LinearReLULayerTest, TestMatchesLinearThenReLUInParallel)
+{
+    size_t l_threshold = Threading::Threshold(Threading::GEMM);
+    size_t l_threads = Threading::NumThreads();
+    Threading::SetThreshold(Threading::GEMM, 1);
+    Threading::SetNumThreads(3);
+
+    TTensorPtr input = Tensor::Random({130, 20}, -1.0, 1.0);
+    ExpectMatchesUnfused(input, Tensor::Random({20, 65}, -1.0, 1.0), true);
+
+    Threading::SetThreshold(Threading::GEMM, l_threshold);
+    Threading::SetNumThreads(l_threads);
+}
+
+TEST(LinearReLULayerTest, TestBackwardWithoutForward)
+{
+    TTensorPtr input = Tensor::Random({9, 5}, -1.0, 1.0);
+    TTensorPtr weights = Tensor::Random({5, 4}, -1.0, 1.0);
+    LinearReLULayer fused(weights);
+    LinearLayer linear(weights);
+    ReLULayer relu;
+
+    // No bits kept for this input, Backward has to run Forward itself
+    TTensorPtr grad = Tensor::Random({9, 4}, -1.0, 1.0);
+    TTensorPtr preActivation = linear.Forward(input);
+    ExpectNear(linear.Backward(input, relu.Backward(preActivation, grad)), fused.Backward(input, grad));
+    EXPECT_EQ(0, fused.NumPendingMasks());
+}
+
+TEST(LinearReLULayerTest, TestMasksAreReleased)
+{
+    TTensorPtr weights = Tensor::Random({5, 4}, -1.0, 1.0);
+    LinearReLULayer layer(weights);
+
+    TTensorPtr input = Tensor::Random({3, 5}, -1.0, 1.0);
+    TTensorPtr output = layer.ForwardForBackward(input);
+    EXPECT_EQ(1, layer.NumPendingMasks());
+    layer.Backward(input, output);
+    EXPECT_EQ(0, layer.NumPendingMasks());
+
+    // Inference keeps nothing, even for inputs that stay alive
+    layer.Forward(input);
+    EXPECT_EQ(0, layer.NumPendingMasks());
+
+    // Bits of inputs freed without a Backward go on the next ForwardForBackward
+    for (size_t i = 0; i < 5; ++i)
+    {
+        layer.ForwardForBackward(Tensor::Random({3, 5}, -1.0, 1.0));
+    }
+    EXPECT_EQ(1, layer.NumPendingMasks());
+
+    EXPECT_THROW(layer.Forward(Tensor::Random({3, 6}, -1.0, 1.0)), runtime_error);
+    EXPECT_THROW(layer.Backward(input, Tensor::Random({3, 3}, -1.0, 1.0)), runtime_error);
+}
+
+TEST(LinearReLULayerTest, TestUpdateWeightsAndClone)
+{
+    TTensorPtr input = Tensor::Random({8, 5}, -1.0, 1.0);
+    TTensorPtr weights = Tensor::Random({5, 4}, -1.0, 1.0);
+    LinearReLULayer fused(weights);
+    LinearLayer linear(weights);
+    ReLULayer relu;
+
+    TLayerPtr clone = fused.Clone();
+    TTensorPtr initialWeights = fused.Weights()->ToMutable();
+    TTensorPtr grad = Tensor::Random({8, 4}, -1.0, 1.0);
+    fused.ForwardForBackward(input);
+    fused.Backward(input, grad);
+    linear.Backward(input, relu.Backward(linear.Forward(input), grad));
+    fused.UpdateWeights(0.1);
+    linear.UpdateWeights(0.1);
+    ExpectNear(linear.Weights(), fused.Weights());
+
+    // The clone kept the old weights and none of the bits
+    ExpectNear(initialWeights, clone->Weights());
+    EXPECT_EQ(0, dynamic_pointer_cast<LinearReLULayer>(clone)->NumPendingMasks());
+}
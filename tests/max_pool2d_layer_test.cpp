@@ -0,0 +1,53 @@
+/*
+ * Max Pool 2D Layer Test
+ *
+ */
+
+#include "neural/layers/max_pool2d_layer.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(MaxPool2DLayerTest, TestForward)
+{
+    TTensorPtr input = Tensor::New({1, 2, 3, 4}, {
+        1.0, 2.0, 5.0, 0.0,
+        3.0, 4.0, 1.0, 6.0,
+        9.0, 9.0, 9.0, 9.0,
+
+        -1.0, -2.0, -3.0, -4.0,
+        -5.0, -6.0, -7.0, -8.0,
+        0.0, 0.0, 0.0, 0.0
+    });
+
+    // The last row doesn't fill a window and is dropped
+    MaxPool2DLayer layer(2);
+    TTensorPtr output = layer.Forward(input);
+    EXPECT_EQ(vector<size_t>({1, 2, 1, 2}), output->Shape());
+    EXPECT_EQ(vector<float>({4.0, 6.0, -1.0, -3.0}), output->Data());
+
+    // Overlapping windows with a stride of 1
+    MaxPool2DLayer overlapping(2, 1);
+    EXPECT_EQ(vector<size_t>({1, 2, 2, 3}), overlapping.Forward(input)->Shape());
+}
+
+TEST(MaxPool2DLayerTest, TestBackward)
+{
+    TTensorPtr input = Tensor::New({1, 1, 2, 4}, {
+        1.0, 2.0, 5.0, 5.0,
+        3.0, 4.0, 1.0, 0.0
+    });
+    TTensorPtr grad = Tensor::New({1, 1, 1, 2}, {10.0, 20.0});
+
+    // Gradients go to the winner of each window, the first one on ties
+    MaxPool2DLayer layer(2);
+    TTensorPtr inputGrad = layer.Backward(input, grad);
+    EXPECT_EQ(input->Shape(), inputGrad->Shape());
+    EXPECT_EQ(vector<float>({0.0, 0.0, 20.0, 0.0, 0.0, 10.0, 0.0, 0.0}), inputGrad->Data());
+
+    EXPECT_THROW(layer.Backward(input, Tensor::Zeros({1, 1, 2, 2})), runtime_error);
+    EXPECT_THROW(layer.Forward(Tensor::Zeros({1, 1, 1, 4})), runtime_error);
+}
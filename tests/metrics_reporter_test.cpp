@@ -0,0 +1,112 @@
+/*
+ * Metrics Reporter Test
+ *
+ */
+
+#include "neural/metrics/metrics_reporter.h"
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace neural;
+using namespace std;
+
+static Metrics& FillMetrics(Metrics& a_metrics)
+{
+    a_metrics.GetCounter("examples_total").Add(42);
+    Histogram& l_histogram = a_metrics.GetHistogram("step_seconds", "layer=\"0\"", {0.5, 1.0});
+    l_histogram.Record(0.25);
+    l_histogram.Record(0.75);
+    l_histogram.Record(2.0);
+    return a_metrics;
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(MetricsReporterTest, TestPrometheusText)
+{
+    Metrics l_metrics;
+    string l_text = MetricsReporter::PrometheusText(FillMetrics(l_metrics));
+
+    EXPECT_NE(l_text.find("# TYPE examples_total counter\nexamples_total 42\n"), string::npos);
+    EXPECT_NE(l_text.find("# TYPE step_seconds histogram\n"), string::npos);
+    EXPECT_NE(l_text.find("step_seconds_bucket{layer=\"0\",le=\"0.5\"} 1\n"), string::npos);
+    EXPECT_NE(l_text.find("step_seconds_bucket{layer=\"0\",le=\"1\"} 2\n"), string::npos);
+    EXPECT_NE(l_text.find("step_seconds_bucket{layer=\"0\",le=\"+Inf\"} 3\n"), string::npos);
+    EXPECT_NE(l_text.find("step_seconds_sum{layer=\"0\"} 3\n"), string::npos);
+    EXPECT_NE(l_text.find("step_seconds_count{layer=\"0\"} 3\n"), string::npos);
+
+    // Labels of one name stay together even if they were made apart
+    l_metrics.GetCounter("steps_total");
+    l_metrics.GetHistogram("step_seconds", "layer=\"1\"", {0.5, 1.0});
+    l_text = MetricsReporter::PrometheusText(l_metrics);
+    EXPECT_LT(l_text.find("step_seconds_count{layer=\"1\"}"), l_text.find("# TYPE steps_total"));
+    EXPECT_EQ(l_text.find("# TYPE step_seconds"), l_text.rfind("# TYPE step_seconds"));
+}
+
+TEST(MetricsReporterTest, TestCsv)
+{
+    string l_file("metrics_reporter_test.csv");
+    Metrics l_metrics;
+    FillMetrics(l_metrics);
+    {
+        MetricsReporter l_reporter(10.0, l_metrics);
+        l_reporter.ToCsv(l_file);
+        l_reporter.Report();
+
+        // Only what changed since the last report, the counter is always there
+        l_metrics.GetCounter("examples_total").Add(8);
+    }
+
+    ifstream l_infile(l_file);
+    vector<string> l_lines;
+    string l_line;
+    while (getline(l_infile, l_line))
+    {
+        l_lines.push_back(l_line);
+    }
+    ASSERT_EQ(l_lines.size(), 4u);
+    EXPECT_EQ(l_lines[0], "seconds,name,labels,count,rate,mean,p50,p99");
+    EXPECT_NE(l_lines[1].find(",examples_total,\"\",42,"), string::npos);
+    EXPECT_NE(l_lines[2].find(",step_seconds,\"layer=\"\"0\"\"\",3,"), string::npos);
+    EXPECT_NE(l_lines[3].find(",examples_total,\"\",50,"), string::npos);
+    remove(l_file.c_str());
+}
+
+TEST(MetricsReporterTest, TestServePrometheus)
+{
+    Metrics l_metrics;
+    MetricsReporter l_reporter(10.0, FillMetrics(l_metrics));
+    uint16_t l_port = l_reporter.ServePrometheus(0);
+    ASSERT_GT(l_port, 0);
+
+    int l_fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(l_fd, 0);
+    sockaddr_in l_addr;
+    memset(&l_addr, 0, sizeof(l_addr));
+    l_addr.sin_family = AF_INET;
+    l_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    l_addr.sin_port = htons(l_port);
+    ASSERT_EQ(connect(l_fd, (sockaddr*)&l_addr, sizeof(l_addr)), 0);
+
+    string l_request("GET /metrics HTTP/1.0\r\n\r\n");
+    ASSERT_EQ(write(l_fd, l_request.data(), l_request.size()), (ssize_t)l_request.size());
+    string l_response;
+    char l_buffer[1024];
+    ssize_t l_read = 0;
+    while ((l_read = read(l_fd, l_buffer, sizeof(l_buffer))) > 0)
+    {
+        l_response.append(l_buffer, l_read);
+    }
+    close(l_fd);
+
+    EXPECT_EQ(l_response.find("HTTP/1.0 200 OK\r\n"), 0u);
+    EXPECT_NE(l_response.find("\r\n\r\n" + MetricsReporter::PrometheusText(l_metrics)), string::npos);
+}
@@ -0,0 +1,125 @@
+/*
+ * Metrics Test
+ *
+ */
+
+#include "neural/metrics/metrics.h"
+#include "neural/layers/linear_layer.h"
+#include "neural/layers/relu_layer.h"
+#include "neural/models/sequential.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(MetricsTest, TestCounterFromManyThreads)
+{
+    Metrics l_metrics;
+    Counter& l_counter = l_metrics.GetCounter("examples_total");
+
+    vector<thread> l_threads;
+    for (size_t t = 0; t < 8; ++t)
+    {
+        l_threads.emplace_back([&l_counter]() {
+            for (size_t i = 0; i < 10000; ++i)
+            {
+                l_counter.Add();
+            }
+        });
+    }
+    for (thread& l_thread : l_threads)
+    {
+        l_thread.join();
+    }
+
+    EXPECT_EQ(l_counter.Value(), 80000u);
+    EXPECT_EQ(&l_metrics.GetCounter("examples_total"), &l_counter);
+}
+
+TEST(MetricsTest, TestHistogramQuantiles)
+{
+    Metrics l_metrics;
+    Histogram& l_histogram = l_metrics.GetHistogram("loss", "", {1.0, 2.0, 3.0, 4.0});
+
+    vector<thread> l_threads;
+    for (size_t t = 0; t < 4; ++t)
+    {
+        l_threads.emplace_back([&l_histogram, t]() {
+            for (size_t i = 0; i < 1000; ++i)
+            {
+                l_histogram.Record(t + 0.5);
+            }
+        });
+    }
+    for (thread& l_thread : l_threads)
+    {
+        l_thread.join();
+    }
+
+    Histogram::Snapshot l_snapshot = l_histogram.Read();
+    EXPECT_EQ(l_snapshot.count, 4000u);
+    EXPECT_DOUBLE_EQ(l_snapshot.Mean(), 2.0);
+    ASSERT_EQ(l_snapshot.buckets.size(), 5u);
+    EXPECT_EQ(l_snapshot.buckets[0], 1000u);
+    EXPECT_EQ(l_snapshot.buckets[3], 1000u);
+    EXPECT_EQ(l_snapshot.buckets[4], 0u);
+
+    // Half the values are in the first two buckets
+    EXPECT_DOUBLE_EQ(l_snapshot.Quantile(l_histogram.Bounds(), 0.5), 2.0);
+    EXPECT_NEAR(l_snapshot.Quantile(l_histogram.Bounds(), 0.99), 3.96, 1e-9);
+
+    l_histogram.Record(10.0);
+    Histogram::Snapshot l_window = l_histogram.Read() - l_snapshot;
+    EXPECT_EQ(l_window.count, 1u);
+    EXPECT_EQ(l_window.buckets[4], 1u);
+    EXPECT_DOUBLE_EQ(l_window.Quantile(l_histogram.Bounds(), 0.5), 4.0);
+}
+
+TEST(MetricsTest, TestRegistry)
+{
+    Metrics l_metrics;
+    Histogram& l_first = l_metrics.GetHistogram("layer_seconds", "layer=\"0\"");
+    Histogram& l_second = l_metrics.GetHistogram("layer_seconds", "layer=\"1\"");
+    l_metrics.GetCounter("steps_total");
+    EXPECT_NE(&l_first, &l_second);
+    EXPECT_EQ(&l_metrics.GetHistogram("layer_seconds", "layer=\"1\""), &l_second);
+    EXPECT_THROW(l_metrics.GetCounter("layer_seconds", "layer=\"0\""), runtime_error);
+    EXPECT_THROW(l_metrics.GetHistogram("steps_total"), runtime_error);
+
+    vector<Metrics::Entry> l_entries = l_metrics.Entries();
+    ASSERT_EQ(l_entries.size(), 3u);
+    EXPECT_EQ(l_entries[1].labels, "layer=\"1\"");
+    EXPECT_EQ(l_entries[2].name, "steps_total");
+    EXPECT_TRUE(l_entries[2].counter != nullptr);
+    EXPECT_TRUE(l_entries[2].histogram == nullptr);
+}
+
+TEST(MetricsTest, TestSequentialLayerTiming)
+{
+    Sequential l_model;
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::Random({3, 4}, -1.0f, 1.0f))));
+    l_model.Add(TLayerPtr(new ReLULayer()));
+    l_model.SetLayerTiming(true);
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::Random({4, 1}, -1.0f, 1.0f))));
+
+    Histogram& l_forward = Metrics::Instance().GetHistogram("layer_forward_seconds", "layer=\"2\"");
+    Histogram& l_backward = Metrics::Instance().GetHistogram("layer_backward_seconds", "layer=\"0\"");
+    uint64_t l_forwards = l_forward.Read().count;
+    uint64_t l_backwards = l_backward.Read().count;
+
+    vector<TTensorPtr> l_activations;
+    l_model.Forward(Tensor::New({1, 3}, {1.0f, 2.0f, 3.0f}), l_activations);
+    l_model.Backward(l_activations, Tensor::New({1, 1}, {1.0f}));
+    EXPECT_EQ(l_forward.Read().count, l_forwards + 1);
+    EXPECT_EQ(l_backward.Read().count, l_backwards + 1);
+
+    // Nothing is recorded with timing off
+    l_model.SetLayerTiming(false);
+    l_model.Forward(Tensor::New({1, 3}, {1.0f, 2.0f, 3.0f}), l_activations);
+    EXPECT_EQ(l_forward.Read().count, l_forwards + 1);
+}
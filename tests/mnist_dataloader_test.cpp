@@ -83,3 +83,63 @@ TEST(MNISTDataloaderTest, TestDataAt)
         EXPECT_EQ(4.0f, l_output->At({0, 0}));
     }
 }
+
+TEST(MNISTDataloaderTest, TestSparseBatchAt)
+{
+    MNISTDataloader l_dataloader("../data/mnist", true);
+    l_dataloader.SetZeroBackground(true);
+
+    TSparseTensorPtr l_inputs;
+    vector<float> l_targets;
+    ASSERT_TRUE(l_dataloader.SparseBatchAt(0, 3, l_inputs, l_targets));
+    ASSERT_TRUE(l_inputs);
+    EXPECT_EQ(vector<size_t>({3, 784}), l_inputs->Shape());
+    EXPECT_EQ(vector<float>({5.0, 0.0, 4.0}), l_targets);
+
+    // Same pixels as the dense zero background examples
+    TTensorPtr l_dense = l_inputs->ToDense();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        TMutableTensorPtr l_input, l_output;
+        ASSERT_TRUE(l_dataloader.DataAt(i, l_input, l_output));
+        for (size_t j = 0; j < 784; ++j)
+        {
+            ASSERT_FLOAT_EQ(l_input->At({0, j}), l_dense->At({i, j})) << i << "," << j;
+        }
+    }
+
+    EXPECT_FALSE(l_dataloader.SparseBatchAt(2, 2, l_inputs, l_targets));
+    EXPECT_FALSE(l_dataloader.SparseBatchAt(0, l_dataloader.DataLength() + 1, l_inputs, l_targets));
+}
+
+TEST(MNISTDataloaderTest, TestBatchAtNCHW)
+{
+    MNISTDataloader l_dataloader("../data/mnist", true);
+    EXPECT_EQ(MNISTDataloader::FLAT, l_dataloader.Layout());
+
+    TMutableTensorPtr l_flat;
+    vector<float> l_targets;
+    ASSERT_TRUE(l_dataloader.BatchAt(0, 3, l_flat, l_targets));
+    EXPECT_EQ(vector<size_t>({3, 784}), l_flat->Shape());
+    EXPECT_EQ(vector<float>({5.0, 0.0, 4.0}), l_targets);
+
+    l_dataloader.SetLayout(MNISTDataloader::NCHW);
+    TMutableTensorPtr l_images;
+    ASSERT_TRUE(l_dataloader.BatchAt(0, 3, l_images, l_targets));
+    EXPECT_EQ(vector<size_t>({3, 1, 28, 28}), l_images->Shape());
+
+    // Same pixels in both layouts and the same as DataAt
+    EXPECT_EQ(l_flat->Data(), l_images->Data());
+    TMutableTensorPtr l_input, l_output;
+    ASSERT_TRUE(l_dataloader.DataAt(2, l_input, l_output));
+    EXPECT_EQ(vector<size_t>({1, 1, 28, 28}), l_input->Shape());
+    for (size_t i = 0; i < 28; ++i)
+    {
+        for (size_t j = 0; j < 28; ++j)
+        {
+            ASSERT_EQ(l_images->At({2, 0, i, j}), l_input->At({0, 0, i, j}));
+        }
+    }
+
+    EXPECT_FALSE(l_dataloader.BatchAt(3, 3, l_images, l_targets));
+}
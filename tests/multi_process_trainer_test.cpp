@@ -0,0 +1,104 @@
+/*
+ * Multi Process Trainer Test
+ *
+ */
+
+#include "neural/train/multi_process_trainer.h"
+#include "neural/train/data_parallel_trainer.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// Weights of the two linear layers, every rank and the reference start from these
+static vector<TTensorPtr> Weights()
+{
+    return {
+        Tensor::New({3,2}, {
+            0.1, -0.2,
+            0.4, 0.5,
+            -0.7, 0.8
+        }),
+        Tensor::New({2,1}, {
+            0.5,
+            -0.5
+        })
+    };
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(MultiProcessTrainerTest, TestMatchesSingleProcess)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    for (size_t i = 0; i < 7; ++i)
+    {
+        float x = (float)i / 7.0f;
+        l_inputs.push_back(Tensor::New({1,3}, {x, 1.0f - x, 0.5f}));
+        l_targets.push_back(3.0f * x);
+    }
+
+    DataParallelTrainer l_reference(MakeModel(Weights()), 1);
+
+    // Ranks are threads here, each with its own model just like a process
+    size_t l_worldSize = 3;
+    string l_name = "/neural_mpt_" + to_string(getpid());
+    Sequential l_sizer = MakeModel(Weights());
+    ShmRingAllReduce::Create(l_name, l_worldSize, MultiProcessTrainer::NumFloats(l_sizer));
+
+    vector<Sequential> l_models;
+    for (size_t r = 0; r < l_worldSize; ++r)
+    {
+        l_models.push_back(MakeModel(Weights()));
+    }
+
+    size_t l_numSteps = 3;
+    vector<vector<float>> l_losses(l_worldSize);
+    vector<thread> l_ranks;
+    for (size_t r = 0; r < l_worldSize; ++r)
+    {
+        l_ranks.emplace_back([&, r]() {
+            ShmRingAllReduce l_comm(l_name, r);
+            MultiProcessTrainer l_trainer(l_models[r], l_comm);
+
+            // Uneven shards, 7 examples over 3 ranks
+            size_t l_begin = (l_inputs.size() * r) / l_worldSize;
+            size_t l_end = (l_inputs.size() * (r + 1)) / l_worldSize;
+            vector<TTensorPtr> l_shardInputs(l_inputs.begin() + l_begin, l_inputs.begin() + l_end);
+            vector<float> l_shardTargets(l_targets.begin() + l_begin, l_targets.begin() + l_end);
+            for (size_t s = 0; s < l_numSteps; ++s)
+            {
+                l_losses[r].push_back(l_trainer.Step(l_shardInputs, l_shardTargets, 0.1));
+            }
+        });
+    }
+    for (thread& l_rank : l_ranks)
+    {
+        l_rank.join();
+    }
+    ShmRingAllReduce::Unlink(l_name);
+
+    for (size_t s = 0; s < l_numSteps; ++s)
+    {
+        float l_expectedLoss = l_reference.Step(l_inputs, l_targets, 0.1);
+        for (size_t r = 0; r < l_worldSize; ++r)
+        {
+            EXPECT_NEAR(l_expectedLoss, l_losses[r][s], 1e-4);
+        }
+    }
+
+    for (size_t i = 0; i < l_inputs.size(); ++i)
+    {
+        float l_expected = l_reference.Replica(0).Forward(l_inputs[i])->At({0,0});
+        for (size_t r = 0; r < l_worldSize; ++r)
+        {
+            EXPECT_NEAR(l_expected, l_models[r].Forward(l_inputs[i])->At({0,0}), 1e-4);
+        }
+    }
+}
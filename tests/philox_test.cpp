@@ -0,0 +1,170 @@
+/*
+ * Philox Test
+ *
+ */
+
+#include "neural/math/philox.h"
+#include "neural/math/tensor.h"
+#include "neural/parallel/threading.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(PhiloxTest, TestKnownAnswers)
+{
+    // Philox4x32-10 test vectors from Random123
+    uint32_t l_out[4];
+    Philox::Block(0, 0, 0, l_out);
+    EXPECT_EQ(0x6627e8d5u, l_out[0]);
+    EXPECT_EQ(0xe169c58du, l_out[1]);
+    EXPECT_EQ(0xbc57ac4cu, l_out[2]);
+    EXPECT_EQ(0x9b00dbd8u, l_out[3]);
+
+    Philox::Block(0xffffffffffffffffull, 0xffffffffffffffffull, 0xffffffffffffffffull, l_out);
+    EXPECT_EQ(0x408f276du, l_out[0]);
+    EXPECT_EQ(0x41c83b0eu, l_out[1]);
+    EXPECT_EQ(0xa20bc7c6u, l_out[2]);
+    EXPECT_EQ(0x6d5451fdu, l_out[3]);
+}
+
+TEST(PhiloxTest, TestSameForAnyThreadCount)
+{
+    size_t l_size = 100003;
+    Philox l_rng(42, 7);
+    size_t l_threads = Threading::NumThreads();
+    size_t l_threshold = Threading::Threshold(Threading::ELEMENTWISE);
+
+    vector<vector<float>> l_uniform, l_normal;
+    for (size_t l_numThreads : {1, 3, 8})
+    {
+        Threading::SetNumThreads(l_numThreads);
+        Threading::SetThreshold(Threading::ELEMENTWISE, 1);
+        l_uniform.push_back(vector<float>(l_size));
+        l_normal.push_back(vector<float>(l_size));
+        l_rng.FillUniform(l_uniform.back().data(), l_size, -1.0, 1.0);
+        l_rng.FillNormal(l_normal.back().data(), l_size, 0.0, 1.0);
+    }
+    Threading::SetNumThreads(l_threads);
+    Threading::SetThreshold(Threading::ELEMENTWISE, l_threshold);
+
+    for (size_t i = 1; i < l_uniform.size(); ++i)
+    {
+        EXPECT_EQ(l_uniform[0], l_uniform[i]);
+        EXPECT_EQ(l_normal[0], l_normal[i]);
+    }
+
+    // Each value only depends on its index
+    EXPECT_EQ(-1.0f + 2.0f * l_rng.UniformAt(12345), l_uniform[0][12345]);
+}
+
+TEST(PhiloxTest, TestDistributions)
+{
+    size_t l_size = 200000;
+    vector<float> l_data(l_size);
+
+    Philox(1).FillUniform(l_data.data(), l_size, 2.0, 4.0);
+    double l_sum = 0.0;
+    for (float l_val : l_data)
+    {
+        ASSERT_GE(l_val, 2.0f);
+        ASSERT_LT(l_val, 4.0f);
+        l_sum += l_val;
+    }
+    EXPECT_NEAR(3.0, l_sum / l_size, 0.01);
+
+    Philox(2).FillNormal(l_data.data(), l_size, 1.0, 0.5);
+    double l_mean = 0.0, l_sq = 0.0;
+    for (float l_val : l_data)
+    {
+        l_mean += l_val;
+        l_sq += l_val * l_val;
+    }
+    l_mean /= l_size;
+    EXPECT_NEAR(1.0, l_mean, 0.01);
+    EXPECT_NEAR(0.5, sqrt(l_sq / l_size - l_mean * l_mean), 0.01);
+}
+
+TEST(PhiloxTest, TestDropoutMask)
+{
+    size_t l_size = 100000;
+    vector<float> l_mask(l_size);
+    Philox(3).FillDropoutMask(l_mask.data(), l_size, 0.8);
+
+    size_t l_kept = 0;
+    for (float l_val : l_mask)
+    {
+        ASSERT_TRUE(l_val == 0.0f || l_val == 1.25f);
+        l_kept += (l_val != 0.0f);
+    }
+    EXPECT_NEAR(0.8, (double)l_kept / l_size, 0.01);
+}
+
+TEST(PhiloxTest, TestShuffle)
+{
+    vector<size_t> l_values(1000);
+    for (size_t i = 0; i < l_values.size(); ++i)
+    {
+        l_values[i] = i;
+    }
+
+    vector<size_t> l_first = l_values;
+    vector<size_t> l_second = l_values;
+    vector<size_t> l_other = l_values;
+    Philox(4, 1).Shuffle(l_first);
+    Philox(4, 1).Shuffle(l_second);
+    Philox(4, 2).Shuffle(l_other);
+
+    EXPECT_EQ(l_first, l_second);
+    EXPECT_NE(l_first, l_other);
+    EXPECT_NE(l_values, l_first);
+
+    sort(l_first.begin(), l_first.end());
+    EXPECT_EQ(l_values, l_first);
+}
+
+TEST(PhiloxTest, TestGlobalSeedReproducible)
+{
+    Philox::SetGlobalSeed(1234);
+    TTensorPtr l_a = Tensor::Random({10, 10}, -0.5, 0.5);
+    TTensorPtr l_b = Tensor::Random({10, 10}, -0.5, 0.5);
+
+    Philox::SetGlobalSeed(1234);
+    TTensorPtr l_c = Tensor::Random({10, 10}, -0.5, 0.5);
+    TTensorPtr l_d = Tensor::Random({10, 10}, -0.5, 0.5);
+
+    EXPECT_EQ(l_a->Data(), l_c->Data());
+    EXPECT_EQ(l_b->Data(), l_d->Data());
+    EXPECT_NE(l_a->Data(), l_b->Data());
+
+    // The range of every call is respected
+    TTensorPtr l_e = Tensor::Random({100}, 10.0, 11.0);
+    for (float l_val : l_e->Data())
+    {
+        EXPECT_GE(l_val, 10.0f);
+        EXPECT_LT(l_val, 11.0f);
+    }
+}
+
+TEST(PhiloxTest, TestInitializers)
+{
+    TTensorPtr l_xavier = Tensor::XavierUniform({784, 300});
+    float l_limit = sqrt(6.0f / (784.0f + 300.0f));
+    for (float l_val : l_xavier->Data())
+    {
+        ASSERT_LE(fabs(l_val), l_limit);
+    }
+
+    TTensorPtr l_he = Tensor::HeNormal({784, 300});
+    double l_sq = 0.0;
+    for (float l_val : l_he->Data())
+    {
+        l_sq += l_val * l_val;
+    }
+    EXPECT_NEAR(sqrt(2.0 / 784.0), sqrt(l_sq / l_he->Size()), 0.001);
+}
@@ -0,0 +1,189 @@
+/*
+ * Pipeline Trainer Test
+ *
+ */
+
+#include "neural/train/pipeline_trainer.h"
+#include "neural/train/data_parallel_trainer.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// Weights of the two linear layers, the pipeline and the reference start from these
+static vector<TTensorPtr> Weights()
+{
+    return {
+        Tensor::New({3,4}, {
+            0.1, -0.2, 0.3, 0.05,
+            0.4, 0.5, -0.1, 0.2,
+            -0.7, 0.8, 0.2, -0.3
+        }),
+        Tensor::New({4,1}, {
+            0.5,
+            -0.5,
+            0.25,
+            0.1
+        })
+    };
+}
+
+static void MakeBatch(size_t a_size, vector<TTensorPtr>& a_outInputs, vector<float>& a_outTargets)
+{
+    for (size_t i = 0; i < a_size; ++i)
+    {
+        float x = (float)i / (float)a_size;
+        a_outInputs.push_back(Tensor::New({1,3}, {x, 1.0f - x, 0.5f}));
+        a_outTargets.push_back(2.0f * x);
+    }
+}
+
+// Passes everything through, Backward throws on call number m_failOn
+class FailingLayer : public Layer
+{
+public:
+    FailingLayer() : m_failOn(0), m_calls(0) {}
+
+    virtual TTensorPtr Forward(const TTensorPtr& a_input) const override { return a_input; }
+
+    virtual TTensorPtr Backward(const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput) override
+    {
+        if (++m_calls == m_failOn)
+        {
+            throw(runtime_error("FailingLayer::Backward"));
+        }
+        return a_gradInput;
+    }
+
+    virtual TTensorPtr CalcGradients(
+        const TTensorPtr& a_origInput, const TTensorPtr& a_gradInput,
+        TTensorPtr& a_outWeightGrad) const override
+    {
+        a_outWeightGrad = nullptr;
+        return a_gradInput;
+    }
+
+    virtual TLayerPtr Clone() const override { return TLayerPtr(new FailingLayer(*this)); }
+
+    size_t m_failOn;
+    size_t m_calls;
+};
+
+// Pipelined training does the same math as plain SGD on the whole batch
+static void ExpectMatchesReference(
+    size_t a_numStages, size_t a_numMicroBatches,
+    PipelineTrainer::ESchedule a_schedule, size_t a_queueCapacity = 0)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    MakeBatch(7, l_inputs, l_targets);
+
+    DataParallelTrainer l_reference(MakeModel(Weights()), 1);
+    Sequential l_model = MakeModel(Weights());
+    PipelineTrainer l_trainer(l_model, a_numStages, a_numMicroBatches, a_schedule, a_queueCapacity);
+    EXPECT_EQ(a_numStages, l_trainer.NumStages());
+
+    for (size_t s = 0; s < 3; ++s)
+    {
+        EXPECT_NEAR(l_reference.Step(l_inputs, l_targets, 0.1),
+                    l_trainer.Step(l_inputs, l_targets, 0.1), 1e-5);
+    }
+
+    for (size_t i = 0; i < l_inputs.size(); ++i)
+    {
+        EXPECT_NEAR(l_reference.Replica(0).Forward(l_inputs[i])->At({0,0}),
+                    l_model.Forward(l_inputs[i])->At({0,0}), 1e-5);
+    }
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(PipelineTrainerTest, TestSingleStage)
+{
+    ExpectMatchesReference(1, 3, PipelineTrainer::ONE_F_ONE_B);
+}
+
+TEST(PipelineTrainerTest, TestGPipe)
+{
+    ExpectMatchesReference(2, 3, PipelineTrainer::GPIPE);
+    ExpectMatchesReference(3, 4, PipelineTrainer::GPIPE);
+}
+
+TEST(PipelineTrainerTest, Test1F1B)
+{
+    ExpectMatchesReference(2, 3, PipelineTrainer::ONE_F_ONE_B);
+    ExpectMatchesReference(3, 4, PipelineTrainer::ONE_F_ONE_B);
+}
+
+TEST(PipelineTrainerTest, TestSmallQueuesAndManyMicroBatches)
+{
+    // More micro-batches than examples, each ends up with one example
+    ExpectMatchesReference(3, 10, PipelineTrainer::GPIPE, 1);
+    ExpectMatchesReference(3, 10, PipelineTrainer::ONE_F_ONE_B, 1);
+}
+
+TEST(PipelineTrainerTest, TestPartition)
+{
+    // The first linear layer has most of the weights, so it gets a stage to itself
+    Sequential l_model = MakeModel(Weights());
+    PipelineTrainer l_trainer(l_model, 2, 2);
+    EXPECT_EQ(0, l_trainer.StageBegin(0));
+    EXPECT_EQ(1, l_trainer.StageBegin(1));
+    EXPECT_EQ(3, l_trainer.StageBegin(2));
+
+    EXPECT_THROW(PipelineTrainer(l_model, 4, 2), runtime_error);
+}
+
+TEST(PipelineTrainerTest, TestFailedStepLeavesNoGradients)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    MakeBatch(8, l_inputs, l_targets);
+
+    // One layer per stage, micro-batch 0 gets back to the second linear
+    // layer before the last stage fails on micro-batch 1
+    shared_ptr<FailingLayer> l_failing(new FailingLayer());
+    l_failing->m_failOn = 2;
+    Sequential l_model = MakeModel(Weights());
+    l_model.Add(l_failing);
+    PipelineTrainer l_trainer(l_model, 4, 4);
+    EXPECT_THROW(l_trainer.Step(l_inputs, l_targets, 0.1), runtime_error);
+
+    // Afterwards it trains as if the failed step never happened
+    l_failing->m_failOn = 0;
+    DataParallelTrainer l_reference(MakeModel(Weights()), 1);
+    for (size_t s = 0; s < 2; ++s)
+    {
+        EXPECT_NEAR(l_reference.Step(l_inputs, l_targets, 0.1),
+                    l_trainer.Step(l_inputs, l_targets, 0.1), 1e-5);
+    }
+    for (size_t i = 0; i < l_inputs.size(); ++i)
+    {
+        EXPECT_NEAR(l_reference.Replica(0).Forward(l_inputs[i])->At({0,0}),
+                    l_model.Forward(l_inputs[i])->At({0,0}), 1e-5);
+    }
+}
+
+TEST(PipelineTrainerTest, TestStats)
+{
+    vector<TTensorPtr> l_inputs;
+    vector<float> l_targets;
+    MakeBatch(8, l_inputs, l_targets);
+
+    Sequential l_model = MakeModel(Weights());
+    PipelineTrainer l_trainer(l_model, 3, 4);
+    l_trainer.Step(l_inputs, l_targets, 0.1);
+    l_trainer.Step(l_inputs, l_targets, 0.1);
+
+    const PipelineStats& l_stats = l_trainer.Stats();
+    EXPECT_EQ(2, l_stats.steps);
+    EXPECT_GT(l_stats.seconds, 0.0);
+    ASSERT_EQ(3, l_stats.busySeconds.size());
+    EXPECT_GE(l_stats.BubbleFraction(), 0.0);
+    EXPECT_LE(l_stats.BubbleFraction(), 1.0);
+    EXPECT_DOUBLE_EQ(2.0 / 6.0, PipelineStats::IdealBubbleFraction(3, 4));
+
+    l_trainer.ResetStats();
+    EXPECT_EQ(0, l_trainer.Stats().steps);
+}
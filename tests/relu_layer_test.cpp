@@ -38,3 +38,17 @@ TEST(ReLULayerTest, TestForward)
     EXPECT_EQ(2.0, output->At({1,0}));
     EXPECT_EQ(0.0, output->At({1,1}));
 }
+
+TEST(ReLULayerTest, TestAnyRank)
+{
+    // NCHW activations straight out of a convolution
+    TTensorPtr input = Tensor::New({1, 2, 1, 2}, {-1.0, 2.0, 3.0, -4.0});
+    ReLULayer layer;
+
+    TTensorPtr output = layer.Forward(input);
+    EXPECT_EQ(input->Shape(), output->Shape());
+    EXPECT_EQ(vector<float>({0.0, 2.0, 3.0, 0.0}), output->Data());
+
+    TTensorPtr grad = layer.Backward(input, Tensor::New({1, 2, 1, 2}, {5.0, 6.0, 7.0, 8.0}));
+    EXPECT_EQ(vector<float>({0.0, 6.0, 7.0, 0.0}), grad->Data());
+}
@@ -0,0 +1,165 @@
+/*
+ * Sequential Model Test
+ *
+ */
+
+#include "neural/models/sequential.h"
+#include "neural/layers/linear_layer.h"
+#include "neural/layers/relu_layer.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// Weights of the two linear layers, used without a bias
+static vector<TTensorPtr> Weights()
+{
+    return {
+        Tensor::New({2,2}, {
+            1.0, -2.0,
+            3.0, 4.0
+        }),
+        Tensor::New({2,1}, {
+            1.0,
+            1.0
+        })
+    };
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(SequentialTest, TestForward)
+{
+    Sequential l_model = MakeModel(Weights(), false);
+    TTensorPtr l_input = Tensor::New({1,2}, {4.0, 3.0});
+
+    /*
+    [4 3] * W0 = [4*1 + 3*3, 4*-2 + 3*4] = [13, 4]
+    relu       = [13, 4]
+    * W1       = 17
+    */
+    vector<TTensorPtr> l_activations;
+    TTensorPtr l_output = l_model.Forward(l_input, l_activations);
+    EXPECT_EQ(17.0, l_output->At({0,0}));
+    EXPECT_EQ(3, l_activations.size());
+    EXPECT_EQ(l_input, l_activations.at(0));
+    EXPECT_EQ(13.0, l_activations.at(1)->At({0,0}));
+
+    EXPECT_EQ(17.0, l_model.Forward(l_input)->At({0,0}));
+}
+
+TEST(SequentialTest, TestBackwardAndUpdate)
+{
+    Sequential l_model = MakeModel(Weights(), false);
+    TTensorPtr l_input = Tensor::New({1,2}, {4.0, 3.0});
+
+    vector<TTensorPtr> l_activations;
+    l_model.Forward(l_input, l_activations);
+    TTensorPtr l_grad = l_model.Backward(l_activations, Tensor::New({1,1}, {1.0}));
+
+    // d/dx of x * W0 * W1 with both relus active is W0 * W1 = [1 - 2, 3 + 4]
+    EXPECT_EQ(-1.0, l_grad->At({0,0}));
+    EXPECT_EQ(7.0, l_grad->At({0,1}));
+
+    /*
+    W1 -= 0.1 * [13, 4]^T          = [-0.3, 0.6]^T
+    W0 -= 0.1 * [4, 3]^T * [1, 1]  = [0.6, -2.4; 2.7, 3.7]
+    [4 3] * W0 = [10.5, 1.5], * W1 = -3.15 + 0.9
+    */
+    l_model.UpdateWeights(0.1);
+    EXPECT_NEAR(-2.25, l_model.Forward(l_input)->At({0,0}), 1e-5);
+}
+
+TEST(SequentialTest, TestCloneIsDeep)
+{
+    Sequential l_model = MakeModel(Weights(), false);
+    Sequential l_clone = l_model.Clone();
+    TTensorPtr l_input = Tensor::New({1,2}, {4.0, 3.0});
+
+    // Train the clone, the original should not change
+    vector<TTensorPtr> l_activations;
+    l_clone.Forward(l_input, l_activations);
+    l_clone.Backward(l_activations, Tensor::New({1,1}, {1.0}));
+    l_clone.UpdateWeights(0.1);
+
+    EXPECT_EQ(17.0, l_model.Forward(l_input)->At({0,0}));
+    EXPECT_NE(17.0, l_clone.Forward(l_input)->At({0,0}));
+}
+
+TEST(SequentialTest, TestCheckpointingMatchesKeepingEverything)
+{
+    // 8 rows of 16 floats is 512 bytes per activation
+    Sequential l_model;
+    for (size_t i = 0; i < 6; ++i)
+    {
+        l_model.Add(TLayerPtr(new LinearLayer(Tensor::Random({16, 16}, -0.5, 0.5))));
+        l_model.Add(TLayerPtr(new ReLULayer()));
+    }
+    Sequential l_checkpointed = l_model.Clone();
+    l_checkpointed.SetCheckpointBudget(4 * 512);
+    EXPECT_EQ(4 * 512, l_checkpointed.Clone().CheckpointBudget());
+
+    TTensorPtr l_input = Tensor::Random({8, 16}, -1.0, 1.0);
+    TTensorPtr l_gradOutput = Tensor::Random({8, 16}, -1.0, 1.0);
+    vector<TTensorPtr> l_all, l_kept;
+    TTensorPtr l_output = l_model.Forward(l_input, l_all);
+    TTensorPtr l_checkpointedOutput = l_checkpointed.Forward(l_input, l_kept);
+    ASSERT_EQ(12, l_kept.size());
+    EXPECT_EQ(l_input, l_kept[0]);
+
+    // Half the budget is 2 activations, so every third one is kept
+    size_t l_numKept = 0;
+    for (const TTensorPtr& l_activation : l_kept)
+    {
+        l_numKept += l_activation ? 1 : 0;
+    }
+    EXPECT_EQ(4, l_numKept);
+
+    TTensorPtr l_grad = l_model.Backward(l_all, l_gradOutput);
+    TTensorPtr l_checkpointedGrad = l_checkpointed.Backward(l_kept, l_gradOutput);
+    for (size_t i = 0; i < l_grad->Size(); ++i)
+    {
+        EXPECT_NEAR(l_grad->Data()[i], l_checkpointedGrad->Data()[i], 1e-5);
+    }
+    for (size_t l = 0; l < l_model.Layers().size(); l += 2)
+    {
+        TTensorPtr l_weightGrad = l_model.Layers()[l]->CalcAvgWeightGrad();
+        TTensorPtr l_checkpointedWeightGrad = l_checkpointed.Layers()[l]->CalcAvgWeightGrad();
+        for (size_t i = 0; i < l_weightGrad->Size(); ++i)
+        {
+            EXPECT_NEAR(l_weightGrad->Data()[i], l_checkpointedWeightGrad->Data()[i], 1e-5);
+        }
+    }
+
+    const CheckpointStats& l_stats = l_checkpointed.LastCheckpointStats();
+    EXPECT_EQ(4 * 512, l_stats.keptBytes);
+    EXPECT_EQ(12 * 512, l_stats.allBytes);
+    EXPECT_EQ(6 * 512, l_stats.peakBytes);
+    EXPECT_EQ(8, l_stats.recomputedLayers);
+
+    // Without a budget nothing is recomputed
+    EXPECT_EQ(12 * 512, l_model.LastCheckpointStats().keptBytes);
+    EXPECT_EQ(12 * 512, l_model.LastCheckpointStats().peakBytes);
+    EXPECT_EQ(0, l_model.LastCheckpointStats().recomputedLayers);
+}
+
+TEST(SequentialTest, TestLayerHooks)
+{
+    Sequential l_model = MakeModel(Weights(), false);
+
+    // Recomputed layers are only reported once, when their backward is done
+    l_model.SetCheckpointBudget(4 * 8);
+    vector<size_t> l_before, l_after;
+    vector<TTensorPtr> l_activations;
+    l_model.Forward(Tensor::New({1,2}, {4.0, 3.0}), l_activations, [&](size_t a_layer) {
+        l_before.push_back(a_layer);
+    });
+    l_model.Backward(l_activations, Tensor::New({1,1}, {1.0}), [&](size_t a_layer) {
+        l_after.push_back(a_layer);
+    });
+
+    EXPECT_EQ(vector<size_t>({0, 1, 2}), l_before);
+    EXPECT_EQ(vector<size_t>({2, 1, 0}), l_after);
+    EXPECT_EQ(2, l_model.LastCheckpointStats().recomputedLayers);
+}
@@ -0,0 +1,126 @@
+/*
+ * Shared Memory Ring All Reduce Test
+ *
+ */
+
+#include "neural/parallel/shm_ring_all_reduce.h"
+
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+using namespace neural;
+using namespace std;
+
+static string SegmentName(const string& a_test)
+{
+    return "/neural_" + a_test + "_" + to_string(getpid());
+}
+
+// Every rank is a thread here, they only share the segment just like processes would
+static void RunRanks(const string& a_name, size_t a_worldSize, size_t a_size)
+{
+    vector<vector<float>> l_data(a_worldSize);
+    vector<thread> l_ranks;
+    for (size_t r = 0; r < a_worldSize; ++r)
+    {
+        l_data[r].resize(a_size);
+        for (size_t i = 0; i < a_size; ++i)
+        {
+            l_data[r][i] = (float)(r + 1) * (float)i;
+        }
+
+        l_ranks.emplace_back([&, r]() {
+            ShmRingAllReduce l_comm(a_name, r);
+            EXPECT_EQ(r, l_comm.Rank());
+            EXPECT_EQ(a_worldSize, l_comm.WorldSize());
+            // Twice to make sure the buffers can be reused
+            l_comm.SumInPlace(l_data[r].data(), a_size);
+            l_comm.SumInPlace(l_data[r].data(), a_size);
+        });
+    }
+
+    for (thread& l_rank : l_ranks)
+    {
+        l_rank.join();
+    }
+
+    // sum over r of (r + 1) * i, twice over
+    float l_factor = (float)(a_worldSize * (a_worldSize + 1) / 2) * (float)a_worldSize;
+    for (size_t r = 0; r < a_worldSize; ++r)
+    {
+        for (size_t i = 0; i < a_size; ++i)
+        {
+            ASSERT_FLOAT_EQ(l_factor * (float)i, l_data[r][i]) << "rank " << r << " @" << i;
+        }
+    }
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(ShmRingAllReduceTest, TestSum)
+{
+    string l_name = SegmentName("sum");
+    ShmRingAllReduce::Create(l_name, 4, 1000);
+    RunRanks(l_name, 4, 1000);
+    ShmRingAllReduce::Unlink(l_name);
+}
+
+TEST(ShmRingAllReduceTest, TestUnevenChunks)
+{
+    // Fewer elements than ranks leaves some chunks empty
+    string l_name = SegmentName("uneven");
+    ShmRingAllReduce::Create(l_name, 3, 100);
+    RunRanks(l_name, 3, 2);
+    RunRanks(l_name, 3, 97);
+    ShmRingAllReduce::Unlink(l_name);
+}
+
+TEST(ShmRingAllReduceTest, TestSingleRank)
+{
+    string l_name = SegmentName("single");
+    ShmRingAllReduce::Create(l_name, 1, 10);
+    RunRanks(l_name, 1, 10);
+    ShmRingAllReduce::Unlink(l_name);
+}
+
+TEST(ShmRingAllReduceTest, TestAcrossProcesses)
+{
+    string l_name = SegmentName("fork");
+    ShmRingAllReduce::Create(l_name, 2, 16);
+
+    pid_t l_child = fork();
+    ASSERT_GE(l_child, 0);
+    if (l_child == 0)
+    {
+        ShmRingAllReduce l_comm(l_name, 1);
+        vector<float> l_data(16, 2.0);
+        l_comm.SumInPlace(l_data.data(), l_data.size());
+        _exit(l_data[15] == 3.0 ? 0 : 1);
+    }
+
+    ShmRingAllReduce l_comm(l_name, 0);
+    vector<float> l_data(16, 1.0);
+    l_comm.SumInPlace(l_data.data(), l_data.size());
+    EXPECT_EQ(3.0, l_data[0]);
+    EXPECT_EQ(3.0, l_data[15]);
+
+    int l_status = 0;
+    waitpid(l_child, &l_status, 0);
+    EXPECT_TRUE(WIFEXITED(l_status));
+    EXPECT_EQ(0, WEXITSTATUS(l_status));
+    ShmRingAllReduce::Unlink(l_name);
+}
+
+TEST(ShmRingAllReduceTest, TestTooLongThrows)
+{
+    string l_name = SegmentName("long");
+    ShmRingAllReduce::Create(l_name, 1, 10);
+    ShmRingAllReduce l_comm(l_name, 0);
+    vector<float> l_data(11);
+    EXPECT_THROW(l_comm.SumInPlace(l_data.data(), l_data.size()), runtime_error);
+    ShmRingAllReduce::Unlink(l_name);
+}
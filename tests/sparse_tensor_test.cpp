@@ -0,0 +1,114 @@
+/*
+ * Sparse Tensor Test
+ *
+ */
+
+#include "neural/math/sparse_tensor.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+static TTensorPtr MakeDense()
+{
+    return Tensor::New({3,4}, {
+        0.0, 2.0, 0.0, 0.0,
+        0.0, 0.0, 0.0, 0.0,
+        1.0, 0.0, 0.0, 3.0
+    });
+}
+
+static void ExpectSameDense(const TTensorPtr& a_expected, const TTensorPtr& a_actual)
+{
+    ASSERT_EQ(a_expected->Shape(), a_actual->Shape());
+    for (size_t i = 0; i < a_expected->Size(); ++i)
+    {
+        EXPECT_EQ(a_expected->Data()[i], a_actual->Data()[i]) << "@" << i;
+    }
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(SparseTensorTest, TestFromDenseCSR)
+{
+    TSparseTensorPtr l_sparse = SparseTensor::FromDense(MakeDense());
+    EXPECT_EQ(SparseTensor::CSR, l_sparse->Format());
+    EXPECT_EQ(3, l_sparse->NumNonZeros());
+    EXPECT_FLOAT_EQ(3.0f / 12.0f, l_sparse->Density());
+
+    EXPECT_EQ(vector<size_t>({0, 1, 1, 3}), l_sparse->Offsets());
+    EXPECT_EQ(vector<uint32_t>({1, 0, 3}), l_sparse->Indices());
+    EXPECT_EQ(vector<float>({2.0, 1.0, 3.0}), l_sparse->Values());
+
+    ExpectSameDense(MakeDense(), l_sparse->ToDense());
+}
+
+TEST(SparseTensorTest, TestFromDenseCSC)
+{
+    TSparseTensorPtr l_sparse = SparseTensor::FromDense(MakeDense(), SparseTensor::CSC);
+    EXPECT_EQ(SparseTensor::CSC, l_sparse->Format());
+    EXPECT_EQ(4, l_sparse->NumOuter());
+    EXPECT_EQ(vector<size_t>({0, 1, 2, 2, 3}), l_sparse->Offsets());
+    EXPECT_EQ(vector<uint32_t>({2, 0, 2}), l_sparse->Indices());
+    EXPECT_EQ(vector<float>({1.0, 2.0, 3.0}), l_sparse->Values());
+
+    ExpectSameDense(MakeDense(), l_sparse->ToDense());
+    ExpectSameDense(MakeDense(), l_sparse->ToFormat(SparseTensor::CSR)->ToDense());
+}
+
+TEST(SparseTensorTest, TestTranspose)
+{
+    TSparseTensorPtr l_sparse = SparseTensor::FromDense(MakeDense());
+    TSparseTensorPtr l_transposed = l_sparse->Transpose();
+    EXPECT_EQ(SparseTensor::CSC, l_transposed->Format());
+    EXPECT_EQ(vector<size_t>({4, 3}), l_transposed->Shape());
+
+    // Shares the storage
+    EXPECT_EQ(&l_sparse->Values(), &l_transposed->Values());
+
+    TTensorPtr l_dense = l_transposed->ToDense();
+    EXPECT_EQ(2.0, l_dense->At({1, 0}));
+    EXPECT_EQ(1.0, l_dense->At({0, 2}));
+    EXPECT_EQ(3.0, l_dense->At({3, 2}));
+    EXPECT_EQ(0.0, l_dense->At({0, 0}));
+}
+
+TEST(SparseTensorTest, TestAddCol)
+{
+    TSparseTensorPtr l_withBias = SparseTensor::FromDense(MakeDense())->AddCol(1.0);
+    EXPECT_EQ(vector<size_t>({3, 5}), l_withBias->Shape());
+    EXPECT_EQ(6, l_withBias->NumNonZeros());
+
+    ExpectSameDense(Tensor::New({3,5}, {
+        0.0, 2.0, 0.0, 0.0, 1.0,
+        0.0, 0.0, 0.0, 0.0, 1.0,
+        1.0, 0.0, 0.0, 3.0, 1.0
+    }), l_withBias->ToDense());
+
+    // Works the same from CSC
+    TSparseTensorPtr l_csc = SparseTensor::FromDense(MakeDense(), SparseTensor::CSC)->AddCol(1.0);
+    EXPECT_EQ(SparseTensor::CSC, l_csc->Format());
+    ExpectSameDense(l_withBias->ToDense(), l_csc->ToDense());
+}
+
+TEST(SparseTensorTest, TestFromDenseIfSparse)
+{
+    // 3 of 12 are non zero
+    EXPECT_TRUE(SparseTensor::FromDenseIfSparse(MakeDense(), 0.25));
+    EXPECT_FALSE(SparseTensor::FromDenseIfSparse(MakeDense(), 0.2));
+}
+
+TEST(SparseTensorTest, TestAppendOuter)
+{
+    SparseTensor l_sparse(2, 3);
+    l_sparse.AppendOuter({2}, {5.0});
+    EXPECT_THROW(l_sparse.AppendOuter({3}, {1.0}), runtime_error);
+    EXPECT_THROW(l_sparse.AppendOuter({0, 1}, {1.0}), runtime_error);
+    l_sparse.AppendOuter({}, {});
+    EXPECT_THROW(l_sparse.AppendOuter({0}, {1.0}), runtime_error);
+
+    ExpectSameDense(Tensor::New({2,3}, {
+        0.0, 0.0, 5.0,
+        0.0, 0.0, 0.0
+    }), l_sparse.ToDense());
+}
@@ -0,0 +1,61 @@
+/*
+ * Step Executor Test
+ *
+ */
+
+#include "neural/train/step_executor.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// Runs a_numSteps steps on a_model with the executor and on a clone of it
+// the usual way, and expects the same weights
+static void ExpectSameAsSequential(Sequential& a_model, size_t a_numSteps)
+{
+    Sequential l_reference = a_model.Clone();
+    StepExecutor l_executor(a_model);
+    for (size_t s = 0; s < a_numSteps; ++s)
+    {
+        TTensorPtr l_input = Tensor::Random({8, 16}, -1.0, 1.0);
+        TTensorPtr l_gradOutput = Tensor::Random({8, 16}, -0.1, 0.1);
+
+        vector<TTensorPtr> l_activations;
+        l_executor.Forward(l_input, l_activations);
+        l_executor.Backward(l_activations, l_gradOutput, 0.01);
+
+        vector<TTensorPtr> l_referenceActivations;
+        l_reference.Forward(l_input, l_referenceActivations);
+        l_reference.Backward(l_referenceActivations, l_gradOutput);
+        l_reference.UpdateWeights(0.01);
+    }
+    l_executor.Wait();
+
+    for (size_t l = 0; l < a_model.Layers().size(); l += 2)
+    {
+        TTensorPtr l_weights = a_model.Layers()[l]->Weights();
+        TTensorPtr l_referenceWeights = l_reference.Layers()[l]->Weights();
+        for (size_t i = 0; i < l_weights->Size(); ++i)
+        {
+            EXPECT_NEAR(l_referenceWeights->Data()[i], l_weights->Data()[i], 1e-5);
+        }
+    }
+    EXPECT_GT(l_executor.UpdateSeconds(), 0.0);
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(StepExecutorTest, TestMatchesUpdatingAfterBackward)
+{
+    Sequential l_model = MakeRandomModel({{16, 16}, {16, 16}, {16, 16}, {16, 16}}, 0.5f);
+    ExpectSameAsSequential(l_model, 20);
+}
+
+TEST(StepExecutorTest, TestWithCheckpointing)
+{
+    // Recomputed forwards only run layers whose updates aren't queued yet
+    Sequential l_model = MakeRandomModel({{16, 16}, {16, 16}, {16, 16}, {16, 16}}, 0.5f);
+    l_model.SetCheckpointBudget(2 * 512);
+    ExpectSameAsSequential(l_model, 20);
+}
@@ -0,0 +1,97 @@
+/*
+ * Tensor Expressions Test
+ *
+ */
+
+#include "neural/math/tensor_expr.h"
+#include "neural/parallel/threading.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(TensorExprTest, TestArithmetic)
+{
+    TTensorPtr l_a = Tensor::New({2, 2}, {1.0, 2.0, 3.0, 4.0});
+    TTensorPtr l_b = Tensor::New({2, 2}, {4.0, 3.0, 2.0, 1.0});
+
+    TTensorPtr l_result = Evaluate((Lazy(l_a) + Lazy(l_b)) * 2.0f - Lazy(l_a) / Lazy(l_b));
+    ASSERT_EQ(l_a->Shape(), l_result->Shape());
+    for (size_t i = 0; i < 4; ++i)
+    {
+        float l_aVal = l_a->Data()[i];
+        float l_bVal = l_b->Data()[i];
+        EXPECT_FLOAT_EQ((l_aVal + l_bVal) * 2.0f - l_aVal / l_bVal, l_result->Data()[i]);
+    }
+
+    TTensorPtr l_neg = Evaluate(-Lazy(l_a));
+    EXPECT_EQ(-3.0, l_neg->At({1, 0}));
+}
+
+TEST(TensorExprTest, TestMaxMinWhere)
+{
+    TTensorPtr l_a = Tensor::New({4}, {-1.0, 2.0, -3.0, 4.0});
+    TTensorPtr l_b = Tensor::New({4}, {0.5, 0.5, 0.5, 0.5});
+
+    EXPECT_EQ(vector<float>({0.0, 2.0, 0.0, 4.0}), Evaluate(Max(Lazy(l_a), 0.0f))->Data());
+    EXPECT_EQ(vector<float>({-1.0, 0.5, -3.0, 0.5}), Evaluate(Min(Lazy(l_a), Lazy(l_b)))->Data());
+    EXPECT_EQ(vector<float>({0.0, 1.0, 0.0, 1.0}), Evaluate(Lazy(l_a) > 0.0f)->Data());
+    EXPECT_EQ(vector<float>({1.0, 0.0, 1.0, 0.0}), Evaluate(Lazy(l_a) < Lazy(l_b))->Data());
+
+    // ReLU backward, pass the gradient where the input was positive
+    EXPECT_EQ(vector<float>({0.0, 0.5, 0.0, 0.5}), Evaluate(Where(Lazy(l_a) > 0.0f, Lazy(l_b), 0.0f))->Data());
+    EXPECT_EQ(vector<float>({7.0, 2.0, 7.0, 4.0}), Evaluate(Where(Lazy(l_a) < 0.0f, 7.0f, Lazy(l_a)))->Data());
+}
+
+TEST(TensorExprTest, TestCompoundAssign)
+{
+    TMutableTensorPtr l_weights = Tensor::New({3}, {1.0, 2.0, 3.0});
+    TTensorPtr l_grad = Tensor::New({3}, {4.0, 8.0, 12.0});
+
+    Lazy(l_weights) -= 0.5f * (Lazy(l_grad) / 4.0f);
+    EXPECT_EQ(vector<float>({0.5, 1.0, 1.5}), l_weights->Data());
+
+    Lazy(l_weights) += 1.0f;
+    Lazy(l_weights) *= Lazy(l_grad);
+    EXPECT_EQ(vector<float>({6.0, 16.0, 30.0}), l_weights->Data());
+
+    Lazy(l_weights) /= 2.0f;
+    EXPECT_EQ(vector<float>({3.0, 8.0, 15.0}), l_weights->Data());
+
+    // Reading the destination at the index being written is fine
+    Lazy(l_weights) = Lazy(l_weights) * Lazy(l_weights);
+    EXPECT_EQ(vector<float>({9.0, 64.0, 225.0}), l_weights->Data());
+
+    TMutableTensorPtr l_copy = Tensor::Zeros({3});
+    Lazy(l_copy) = Lazy(l_weights);
+    EXPECT_EQ(l_weights->Data(), l_copy->Data());
+}
+
+TEST(TensorExprTest, TestShapeMismatchThrows)
+{
+    TMutableTensorPtr l_a = Tensor::Zeros({2, 3});
+    TTensorPtr l_b = Tensor::Zeros({3, 2});
+
+    EXPECT_THROW(Evaluate(Lazy(l_a) + Lazy(l_b)), runtime_error);
+    EXPECT_THROW(Lazy(l_a) -= Lazy(l_b), runtime_error);
+}
+
+TEST(TensorExprTest, TestParallelMatchesSerial)
+{
+    TTensorPtr l_a = Tensor::Random({300, 200}, -1.0, 1.0);
+    TTensorPtr l_b = Tensor::Random({300, 200}, -1.0, 1.0);
+
+    size_t l_threshold = Threading::Threshold(Threading::ELEMENTWISE);
+    Threading::SetThreshold(Threading::ELEMENTWISE, 1);
+    TTensorPtr l_parallel = Evaluate(Where(Lazy(l_a) > Lazy(l_b), Lazy(l_a) * 3.0f, Lazy(l_b) - 1.0f));
+    Threading::SetThreshold(Threading::ELEMENTWISE, l_threshold);
+
+    for (size_t i = 0; i < l_a->Size(); ++i)
+    {
+        float l_aVal = l_a->Data()[i];
+        float l_bVal = l_b->Data()[i];
+        EXPECT_EQ(l_aVal > l_bVal ? l_aVal * 3.0f : l_bVal - 1.0f, l_parallel->Data()[i]);
+    }
+}
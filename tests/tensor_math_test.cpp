@@ -4,6 +4,7 @@
  */
 
 #include "neural/math/tensor_math.h"
+#include "neural/parallel/threading.h"
 
 #include <gtest/gtest.h>
 
@@ -191,3 +192,184 @@ TEST(TensorMathTest, TestRemoveRow)
     EXPECT_EQ( 5.0, newMat->At({1,4}));
 }
 
+
+TEST(TensorMathTest, TestSparseMultiply)
+{
+    // Wide enough to span several column blocks of the kernel
+    size_t m = 5, k = 7, n = 130;
+    TMutableTensorPtr lhs = Tensor::Zeros({m, k});
+    for (size_t i = 0; i < m; ++i)
+    {
+        lhs->SetAt({i, (i * 3) % k}, (float)i + 1.0f);
+        lhs->SetAt({i, (i * 5 + 1) % k}, -0.5f);
+    }
+    TTensorPtr rhs = Tensor::Random({k, n}, -1.0, 1.0);
+
+    TensorMath::SetSparseThreshold(0.0);
+    TTensorPtr expected = TensorMath::Multiply(lhs, rhs);
+
+    for (SparseTensor::EFormat format : {SparseTensor::CSR, SparseTensor::CSC})
+    {
+        TTensorPtr actual = TensorMath::Multiply(SparseTensor::FromDense(lhs, format), rhs);
+        ASSERT_EQ(expected->Shape(), actual->Shape());
+        for (size_t i = 0; i < expected->Size(); ++i)
+        {
+            EXPECT_NEAR(expected->Data()[i], actual->Data()[i], 1e-5) << "@" << i;
+        }
+    }
+
+    // The dense entry point picks the sparse kernel by itself
+    TensorMath::SetSparseThreshold(0.5);
+    TTensorPtr automatic = TensorMath::Multiply(lhs, rhs);
+    for (size_t i = 0; i < expected->Size(); ++i)
+    {
+        EXPECT_NEAR(expected->Data()[i], automatic->Data()[i], 1e-5) << "@" << i;
+    }
+    TensorMath::SetSparseThreshold(0.0);
+}
+
+TEST(TensorMathTest, TestElementwise)
+{
+    TTensorPtr lhs = Tensor::New({2, 2}, {1.0, 2.0, 3.0, 4.0});
+    TTensorPtr rhs = Tensor::New({2, 2}, {5.0, 6.0, 7.0, 8.0});
+
+    EXPECT_EQ(vector<float>({6.0, 8.0, 10.0, 12.0}), TensorMath::Add(lhs, rhs)->Data());
+    EXPECT_EQ(vector<float>({-4.0, -4.0, -4.0, -4.0}), TensorMath::Subtract(lhs, rhs)->Data());
+    EXPECT_EQ(vector<float>({5.0, 12.0, 21.0, 32.0}), TensorMath::Hadamard(lhs, rhs)->Data());
+    EXPECT_EQ(vector<float>({0.5, 1.0, 1.5, 2.0}), TensorMath::Scale(lhs, 0.5)->Data());
+
+    TMutableTensorPtr y = rhs->ToMutable();
+    TensorMath::Axpy(2.0, lhs, y);
+    EXPECT_EQ(vector<float>({7.0, 10.0, 13.0, 16.0}), y->Data());
+
+    EXPECT_THROW(TensorMath::Add(lhs, Tensor::Zeros({4})), runtime_error);
+}
+
+TEST(TensorMathTest, TestReductions)
+{
+    TTensorPtr tensor = Tensor::New({2, 3}, {
+        1.0, 5.0, 3.0,
+        9.0, 2.0, 9.0
+    });
+
+    EXPECT_EQ(29.0, TensorMath::Sum(tensor));
+    EXPECT_FLOAT_EQ(29.0 / 6.0, TensorMath::Mean(tensor));
+    EXPECT_EQ(9.0, TensorMath::Max(tensor));
+    // First of the two nines
+    EXPECT_EQ(3, TensorMath::ArgMax(tensor));
+
+    TTensorPtr colSums = TensorMath::Sum(tensor, 0);
+    EXPECT_EQ(vector<size_t>({3}), colSums->Shape());
+    EXPECT_EQ(vector<float>({10.0, 7.0, 12.0}), colSums->Data());
+
+    TTensorPtr rowSums = TensorMath::Sum(tensor, 1);
+    EXPECT_EQ(vector<size_t>({2}), rowSums->Shape());
+    EXPECT_EQ(vector<float>({9.0, 20.0}), rowSums->Data());
+
+    EXPECT_EQ(vector<float>({5.0, 3.5, 6.0}), TensorMath::Mean(tensor, 0)->Data());
+    EXPECT_EQ(vector<float>({9.0, 5.0, 9.0}), TensorMath::Max(tensor, 0)->Data());
+    EXPECT_EQ(vector<float>({5.0, 9.0}), TensorMath::Max(tensor, 1)->Data());
+    EXPECT_EQ(vector<size_t>({1, 0, 1}), TensorMath::ArgMax(tensor, 0));
+    EXPECT_EQ(vector<size_t>({1, 0}), TensorMath::ArgMax(tensor, 1));
+
+    EXPECT_THROW(TensorMath::Sum(tensor, 2), runtime_error);
+    EXPECT_THROW(TensorMath::Max(Tensor::New({0})), runtime_error);
+}
+
+TEST(TensorMathTest, TestMiddleAxisReduction)
+{
+    TTensorPtr tensor = Tensor::Random({3, 40, 300}, -1.0, 1.0);
+    TTensorPtr sums = TensorMath::Sum(tensor, 1);
+    TTensorPtr maxes = TensorMath::Max(tensor, 1);
+    vector<size_t> argMaxes = TensorMath::ArgMax(tensor, 1);
+    ASSERT_EQ(vector<size_t>({3, 300}), sums->Shape());
+    ASSERT_EQ(3 * 300, argMaxes.size());
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 300; ++j)
+        {
+            double sum = 0.0;
+            float best = tensor->At({i, 0, j});
+            size_t bestIdx = 0;
+            for (size_t k = 0; k < 40; ++k)
+            {
+                float val = tensor->At({i, k, j});
+                sum += val;
+                if (val > best)
+                {
+                    best = val;
+                    bestIdx = k;
+                }
+            }
+            EXPECT_NEAR(sum, sums->At({i, j}), 1e-4);
+            EXPECT_EQ(best, maxes->At({i, j}));
+            EXPECT_EQ(bestIdx, argMaxes[i * 300 + j]);
+        }
+    }
+}
+
+TEST(TensorMathTest, TestLargeSumIsAccurateAndThreadInvariant)
+{
+    // Naive float summation of a million 0.1s is off by about 1%
+    size_t size = 1000003;
+    TTensorPtr tensor = Tensor::Constant({size}, 0.1);
+    float serial = 0.0;
+    {
+        Threading::SerialScope l_serial;
+        serial = TensorMath::Sum(tensor);
+    }
+    EXPECT_NEAR(size * 0.1, serial, size * 0.1 * 1e-5);
+
+    size_t threshold = Threading::Threshold(Threading::REDUCE);
+    Threading::SetThreshold(Threading::REDUCE, 1);
+    EXPECT_EQ(serial, TensorMath::Sum(tensor));
+    Threading::SetThreshold(Threading::REDUCE, threshold);
+
+    TMutableTensorPtr peaked = Tensor::Random({size}, -1.0, 1.0);
+    peaked->MutableData()[size - 2] = 2.0;
+    EXPECT_EQ(2.0, TensorMath::Max(peaked));
+    EXPECT_EQ(size - 2, TensorMath::ArgMax(peaked));
+}
+
+TEST(TensorMathTest, TestBatchedMultiply)
+{
+    TTensorPtr lhs = Tensor::Random({4, 3, 5}, -1.0, 1.0);
+    TTensorPtr rhs = Tensor::Random({4, 5, 2}, -1.0, 1.0);
+    TTensorPtr shared = Tensor::Random({5, 2}, -1.0, 1.0);
+    TTensorPtr sharedLhs = Tensor::Random({3, 5}, -1.0, 1.0);
+
+    TTensorPtr result = TensorMath::BatchedMultiply(lhs, rhs);
+    TTensorPtr resultShared = TensorMath::BatchedMultiply(lhs, shared);
+    TTensorPtr resultSharedLhs = TensorMath::BatchedMultiply(sharedLhs, rhs);
+    ASSERT_EQ(vector<size_t>({4, 3, 2}), result->Shape());
+    ASSERT_EQ(vector<size_t>({4, 3, 2}), resultShared->Shape());
+    ASSERT_EQ(vector<size_t>({4, 3, 2}), resultSharedLhs->Shape());
+
+    for (size_t b = 0; b < 4; ++b)
+    {
+        for (size_t i = 0; i < 3; ++i)
+        {
+            for (size_t j = 0; j < 2; ++j)
+            {
+                float expected = 0.0, expectedShared = 0.0, expectedSharedLhs = 0.0;
+                for (size_t k = 0; k < 5; ++k)
+                {
+                    expected += lhs->At({b, i, k}) * rhs->At({b, k, j});
+                    expectedShared += lhs->At({b, i, k}) * shared->At({k, j});
+                    expectedSharedLhs += sharedLhs->At({i, k}) * rhs->At({b, k, j});
+                }
+                EXPECT_NEAR(expected, result->At({b, i, j}), 1e-5);
+                EXPECT_NEAR(expectedShared, resultShared->At({b, i, j}), 1e-5);
+                EXPECT_NEAR(expectedSharedLhs, resultSharedLhs->At({b, i, j}), 1e-5);
+            }
+        }
+    }
+
+    // Plain matrices give a batch of one
+    EXPECT_EQ(vector<size_t>({1, 3, 2}), TensorMath::BatchedMultiply(sharedLhs, shared)->Shape());
+
+    EXPECT_THROW(TensorMath::BatchedMultiply(lhs, Tensor::Zeros({3, 5, 2})), runtime_error);
+    EXPECT_THROW(TensorMath::BatchedMultiply(lhs, Tensor::Zeros({4, 4, 2})), runtime_error);
+    EXPECT_THROW(TensorMath::BatchedMultiply(Tensor::Zeros({5}), shared), runtime_error);
+}
@@ -84,3 +84,44 @@ TEST(TensorTest, TestGetAtIdx)
     EXPECT_EQ(42.0, t.At({3, 1, 0, 0})); // image 3, row 1, col 0, channel, 0
 }
 
+
+TEST(TensorTest, TestCopyOnWrite)
+{
+    TMutableTensorPtr t = Tensor::New({2, 2}, {1.0, 2.0, 3.0, 4.0});
+    EXPECT_FALSE(t->IsShared());
+
+    // The copy shares our buffer until one of us writes
+    TMutableTensorPtr copy = t->ToMutable();
+    EXPECT_TRUE(t->IsShared());
+    EXPECT_EQ(t->Data().data(), copy->Data().data());
+
+    copy->SetAt({0, 1}, 7.0);
+    EXPECT_FALSE(t->IsShared());
+    EXPECT_NE(t->Data().data(), copy->Data().data());
+    EXPECT_EQ(2.0, t->At({0, 1}));
+    EXPECT_EQ(7.0, copy->At({0, 1}));
+
+    // Nobody else holds the buffer, so writing doesn't copy it
+    const float* l_before = copy->Data().data();
+    copy->MutableData()[0] = 5.0;
+    EXPECT_EQ(l_before, copy->Data().data());
+
+    // A copy that is dropped leaves the buffer to the original
+    t->ToMutable();
+    const float* l_original = t->Data().data();
+    t->SetAll(0.0);
+    EXPECT_EQ(l_original, t->Data().data());
+}
+
+TEST(TensorTest, TestReshape)
+{
+    TMutableTensorPtr t = Tensor::New({2, 3}, {1.0, 2.0, 3.0, 4.0, 5.0, 6.0});
+    TMutableTensorPtr r = t->Reshape({3, 2});
+    EXPECT_EQ(vector<size_t>({3, 2}), r->Shape());
+    EXPECT_EQ(t->Data().data(), r->Data().data());
+    EXPECT_EQ(4.0, r->At({1, 1}));
+
+    r->SetAll(0.0);
+    EXPECT_EQ(6.0, t->At({1, 2}));
+    EXPECT_THROW(t->Reshape({4, 2}), runtime_error);
+}
@@ -0,0 +1,64 @@
+/*
+ * Tensor View Test
+ *
+ */
+
+#include "neural/math/tensor.h"
+
+#include <gtest/gtest.h>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(TensorViewTest, TestMatchesAt)
+{
+    TTensorPtr l_tensor = Tensor::Random({3, 4, 5});
+    TensorView<3, const float> l_view = l_tensor->View<3>();
+    EXPECT_EQ(3, l_view.Dim(0));
+    EXPECT_EQ(4, l_view.Dim(1));
+    EXPECT_EQ(5, l_view.Dim(2));
+    EXPECT_EQ(20, l_view.Stride(0));
+    EXPECT_EQ(5, l_view.Stride(1));
+    EXPECT_EQ(1, l_view.Stride(2));
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 4; ++j)
+        {
+            for (size_t k = 0; k < 5; ++k)
+            {
+                EXPECT_EQ(l_tensor->At({i, j, k}), l_view(i, j, k));
+            }
+        }
+    }
+}
+
+TEST(TensorViewTest, TestMutableView)
+{
+    TMutableTensorPtr l_tensor = Tensor::Zeros({2, 3});
+    TensorView<2> l_view = l_tensor->MutableView<2>();
+    l_view(1, 2) = 5.0;
+    l_view(0, 1) += 2.0;
+
+    EXPECT_EQ(5.0, l_tensor->At({1, 2}));
+    EXPECT_EQ(2.0, l_tensor->At({0, 1}));
+    EXPECT_EQ(0.0, l_tensor->At({0, 0}));
+}
+
+TEST(TensorViewTest, TestWrongRankThrows)
+{
+    TTensorPtr l_tensor = Tensor::Zeros({2, 3});
+    EXPECT_THROW(l_tensor->View<3>(), runtime_error);
+    EXPECT_THROW(l_tensor->View<1>(), runtime_error);
+}
+
+#ifdef NEURAL_CHECK_BOUNDS
+TEST(TensorViewTest, TestBoundsChecked)
+{
+    TTensorPtr l_tensor = Tensor::Zeros({2, 3});
+    TensorView<2, const float> l_view = l_tensor->View<2>();
+    EXPECT_THROW(l_view(2, 0), out_of_range);
+    EXPECT_THROW(l_view(0, 3), out_of_range);
+}
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Test Models
+ *
+ * Small Sequential models the tests train, serve and checkpoint.
+ *
+ */
+
+#pragma once
+
+#include "neural/models/sequential.h"
+#include "neural/layers/linear_layer.h"
+#include "neural/layers/relu_layer.h"
+
+#include <vector>
+
+namespace neural
+{
+
+// A LinearLayer per weight tensor with a ReLULayer between each two
+inline Sequential MakeModel(const std::vector<TTensorPtr>& a_weights, bool a_hasBias = true)
+{
+    Sequential l_model;
+    for (size_t i = 0; i < a_weights.size(); ++i)
+    {
+        if (i > 0)
+        {
+            l_model.Add(TLayerPtr(new ReLULayer()));
+        }
+        l_model.Add(TLayerPtr(new LinearLayer(a_weights[i], a_hasBias)));
+    }
+    return l_model;
+}
+
+// Same with random weights in [-a_range, a_range], one shape per LinearLayer
+inline Sequential MakeRandomModel(const std::vector<std::vector<size_t>>& a_shapes, float a_range = 1.0f)
+{
+    std::vector<TTensorPtr> l_weights;
+    for (const std::vector<size_t>& l_shape : a_shapes)
+    {
+        l_weights.push_back(Tensor::Random(l_shape, -a_range, a_range));
+    }
+    return MakeModel(l_weights);
+}
+
+} // namespace neural
@@ -0,0 +1,168 @@
+/*
+ * Thread Pool Test
+ *
+ */
+
+#include "neural/parallel/thread_pool.h"
+#include "neural/parallel/threading.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(ThreadPoolTest, TestSubmit)
+{
+    ThreadPool l_pool(2);
+    EXPECT_EQ(2, l_pool.NumWorkers());
+
+    atomic<int> l_count(0);
+    vector<future<void>> l_futures;
+    for (int i = 0; i < 100; ++i)
+    {
+        l_futures.push_back(l_pool.Submit([&]() { ++l_count; }));
+    }
+    for (future<void>& l_future : l_futures)
+    {
+        l_future.get();
+    }
+    EXPECT_EQ(100, l_count);
+}
+
+TEST(ThreadPoolTest, TestSubmitRethrows)
+{
+    ThreadPool l_pool(1);
+    future<void> l_future = l_pool.Submit([]() { throw runtime_error("oops"); });
+    EXPECT_THROW(l_future.get(), runtime_error);
+}
+
+TEST(ThreadPoolTest, TestParallelForCoversRangeOnce)
+{
+    ThreadPool l_pool(3);
+    vector<int> l_hits(1001, 0);
+    l_pool.ParallelFor(0, l_hits.size(), 7, [&](size_t a_begin, size_t a_end) {
+        for (size_t i = a_begin; i < a_end; ++i)
+        {
+            ++l_hits[i];
+        }
+    });
+
+    for (size_t i = 0; i < l_hits.size(); ++i)
+    {
+        EXPECT_EQ(1, l_hits[i]) << "@" << i;
+    }
+}
+
+TEST(ThreadPoolTest, TestNestedParallelFor)
+{
+    // Chunks that start their own ParallelFor must not deadlock the pool
+    ThreadPool l_pool(2);
+    atomic<size_t> l_total(0);
+    l_pool.ParallelFor(0, 8, 8, [&](size_t a_begin, size_t a_end) {
+        for (size_t i = a_begin; i < a_end; ++i)
+        {
+            l_pool.ParallelFor(0, 100, 4, [&](size_t a_innerBegin, size_t a_innerEnd) {
+                l_total += a_innerEnd - a_innerBegin;
+            });
+        }
+    });
+    EXPECT_EQ(800, l_total);
+}
+
+TEST(ThreadPoolTest, TestParallelForRethrows)
+{
+    ThreadPool l_pool(2);
+    EXPECT_THROW(
+        l_pool.ParallelFor(0, 10, 10, [](size_t a_begin, size_t a_end) {
+            if (a_begin == 5) throw runtime_error("oops");
+        }),
+        runtime_error);
+}
+
+TEST(ThreadPoolTest, TestParallelForOnlyRunsItsOwnChunks)
+{
+    // Keep the only worker busy so everything else waits in the queue
+    ThreadPool l_pool(1);
+    atomic<bool> l_started(false), l_release(false);
+    future<void> l_busy = l_pool.Submit([&]() {
+        l_started = true;
+        while (!l_release)
+        {
+            this_thread::yield();
+        }
+    });
+    while (!l_started)
+    {
+        this_thread::yield();
+    }
+    atomic<bool> l_ranOther(false);
+    future<void> l_other = l_pool.Submit([&]() { l_ranOther = true; });
+
+    // The caller runs every chunk itself, but not the other task
+    atomic<size_t> l_total(0);
+    l_pool.ParallelFor(0, 100, 4, [&](size_t a_begin, size_t a_end) {
+        l_total += a_end - a_begin;
+    });
+    EXPECT_EQ(100, l_total);
+    EXPECT_FALSE(l_ranOther);
+
+    l_release = true;
+    l_busy.get();
+    l_other.get();
+    EXPECT_TRUE(l_ranOther);
+}
+
+TEST(ThreadPoolTest, TestResize)
+{
+    ThreadPool l_pool(2);
+    l_pool.Resize(4);
+    EXPECT_EQ(4, l_pool.NumWorkers());
+    l_pool.Resize(1);
+    EXPECT_EQ(1, l_pool.NumWorkers());
+
+    atomic<size_t> l_total(0);
+    l_pool.ParallelFor(0, 1000, 8, [&](size_t a_begin, size_t a_end) {
+        l_total += a_end - a_begin;
+    });
+    EXPECT_EQ(1000, l_total);
+    EXPECT_NO_THROW(l_pool.Submit([]() {}).get());
+
+    // The library's pool follows the thread count
+    size_t l_oldNumThreads = Threading::NumThreads();
+    Threading::SetNumThreads(3);
+    EXPECT_EQ(2, ThreadPool::Instance().NumWorkers());
+    Threading::SetNumThreads(5);
+    EXPECT_EQ(4, ThreadPool::Instance().NumWorkers());
+    Threading::SetNumThreads(l_oldNumThreads);
+}
+
+TEST(ThreadPoolTest, TestThreadingBackends)
+{
+    size_t l_oldNumThreads = Threading::NumThreads();
+    Threading::SetNumThreads(3);
+
+    Threading::EBackend l_backends[] = {Threading::OPENMP, Threading::THREAD_POOL};
+    for (Threading::EBackend l_backend : l_backends)
+    {
+        Threading::SetBackend(l_backend);
+        vector<int> l_hits(1 << 16, 0);
+        Threading::ParallelFor(Threading::ELEMENTWISE, l_hits.size(), [&](size_t a_begin, size_t a_end) {
+            for (size_t i = a_begin; i < a_end; ++i)
+            {
+                ++l_hits[i];
+            }
+        });
+
+        for (size_t i = 0; i < l_hits.size(); ++i)
+        {
+            ASSERT_EQ(1, l_hits[i]) << "backend " << l_backend << " @" << i;
+        }
+    }
+
+    Threading::SetBackend(Threading::OPENMP);
+    Threading::SetNumThreads(l_oldNumThreads);
+}
@@ -0,0 +1,81 @@
+/*
+ * Threading Test
+ *
+ */
+
+#include "neural/parallel/threading.h"
+#include "neural/parallel/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <sched.h>
+
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(ThreadingTest, TestThresholds)
+{
+    size_t l_oldNumThreads = Threading::NumThreads();
+    size_t l_oldThreshold = Threading::Threshold(Threading::ELEMENTWISE);
+
+    Threading::SetNumThreads(4);
+    Threading::SetThreshold(Threading::ELEMENTWISE, 1000);
+    EXPECT_EQ(4, Threading::NumThreads());
+    EXPECT_EQ(1000, Threading::Threshold(Threading::ELEMENTWISE));
+
+    // Tiny tensors run serially, big ones get every thread
+    EXPECT_EQ(1, Threading::ThreadsFor(Threading::ELEMENTWISE, 999));
+    EXPECT_EQ(4, Threading::ThreadsFor(Threading::ELEMENTWISE, 1000));
+
+    Threading::SetThreshold(Threading::ELEMENTWISE, l_oldThreshold);
+    Threading::SetNumThreads(l_oldNumThreads);
+}
+
+TEST(ThreadingTest, TestNoNestedParallelism)
+{
+    size_t l_oldNumThreads = Threading::NumThreads();
+    Threading::SetNumThreads(2);
+
+    int l_nestedThreads = 0;
+    #pragma omp parallel num_threads(2)
+    {
+        #pragma omp single
+        l_nestedThreads = Threading::ThreadsFor(Threading::ELEMENTWISE, 1 << 30);
+    }
+    EXPECT_EQ(1, l_nestedThreads);
+
+    Threading::SetNumThreads(l_oldNumThreads);
+}
+
+TEST(ThreadingTest, TestZeroMeansAllCores)
+{
+    size_t l_oldNumThreads = Threading::NumThreads();
+    Threading::SetNumThreads(0);
+    EXPECT_EQ(Threading::NumCores(), Threading::NumThreads());
+    Threading::SetNumThreads(l_oldNumThreads);
+}
+
+#ifdef __linux__
+TEST(ThreadingTest, TestPinThreadsLeavesNewThreadsAlone)
+{
+    cpu_set_t l_before;
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(l_before), &l_before));
+    Threading::PinThreads(0);
+
+    // The caller, and any thread it starts afterwards, keeps the cores it had
+    cpu_set_t l_caller, l_spawned;
+    sched_getaffinity(0, sizeof(l_caller), &l_caller);
+    thread([&]() { sched_getaffinity(0, sizeof(l_spawned), &l_spawned); }).join();
+    EXPECT_TRUE(CPU_EQUAL(&l_before, &l_caller));
+    EXPECT_TRUE(CPU_EQUAL(&l_before, &l_spawned));
+
+    // Workers of a pinned pool get a core each
+    ThreadPool l_pool(2, true);
+    cpu_set_t l_worker;
+    l_pool.Submit([&]() { sched_getaffinity(0, sizeof(l_worker), &l_worker); }).get();
+    EXPECT_EQ(1, CPU_COUNT(&l_worker));
+}
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Weight Snapshots Test
+ *
+ */
+
+#include "neural/models/weight_snapshots.h"
+#include "test_models.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// One training step on a single example
+static void Step(Sequential& a_model)
+{
+    vector<TTensorPtr> l_activations;
+    a_model.Forward(Tensor::New({1, 3}, {0.5f, -1.0f, 2.0f}), l_activations);
+    a_model.Backward(l_activations, Tensor::New({1, 1}, {1.0f}));
+    a_model.UpdateWeights(0.1f);
+}
+
+// TEST(TestCaseName, IndividualTestName)
+TEST(WeightSnapshotsTest, TestSnapshotDoesNotChange)
+{
+    Sequential l_model = MakeRandomModel({{3, 4}, {4, 1}});
+    Sequential l_reader = l_model.Clone();
+    TTensorPtr l_input = Tensor::New({1, 3}, {1.0f, 2.0f, 3.0f});
+    float l_before = l_model.Forward(l_input)->At({0, 0});
+
+    WeightSnapshots l_snapshots;
+    EXPECT_EQ(l_snapshots.Version(), 0u);
+    EXPECT_TRUE(l_snapshots.Acquire().Get() == nullptr);
+    l_snapshots.Publish(l_model);
+    EXPECT_EQ(l_snapshots.Version(), 1u);
+
+    // Training goes on, the snapshot still has the weights from before
+    Step(l_model);
+    Step(l_model);
+    EXPECT_NE(l_model.Forward(l_input)->At({0, 0}), l_before);
+    {
+        WeightSnapshots::Guard l_guard = l_snapshots.Acquire();
+        ASSERT_TRUE(l_guard.Get() != nullptr);
+        EXPECT_EQ(l_guard->version, 1u);
+        EXPECT_EQ(l_guard->weights.size(), 2u);
+        WeightSnapshots::Apply(*l_guard, l_reader);
+    }
+    EXPECT_FLOAT_EQ(l_reader.Forward(l_input)->At({0, 0}), l_before);
+
+    // Only pointers were handed over
+    l_snapshots.Publish(l_model);
+    WeightSnapshots::Guard l_guard = l_snapshots.Acquire();
+    EXPECT_EQ(l_guard->weights[0]->Data().data(), l_model.Layers()[0]->Weights()->Data().data());
+}
+
+TEST(WeightSnapshotsTest, TestReclaimWaitsForReaders)
+{
+    Sequential l_model = MakeRandomModel({{3, 4}, {4, 1}});
+    WeightSnapshots l_snapshots;
+    l_snapshots.Publish(l_model);
+    l_snapshots.Publish(l_model);
+    EXPECT_EQ(l_snapshots.NumRetired(), 0u);
+
+    {
+        WeightSnapshots::Guard l_guard = l_snapshots.Acquire();
+        l_snapshots.Publish(l_model);
+        l_snapshots.Publish(l_model);
+
+        // The reader may still be looking at version 2, or anything after
+        EXPECT_EQ(l_snapshots.NumRetired(), 2u);
+        EXPECT_EQ(l_guard->version, 2u);
+    }
+
+    l_snapshots.Publish(l_model);
+    EXPECT_EQ(l_snapshots.NumRetired(), 0u);
+    EXPECT_EQ(l_snapshots.Version(), 5u);
+
+    Sequential l_other;
+    l_other.Add(TLayerPtr(new LinearLayer(Tensor::Random({3, 4}, -1.0f, 1.0f))));
+    EXPECT_THROW(WeightSnapshots::Apply(*l_snapshots.Acquire(), l_other), runtime_error);
+}
+
+TEST(WeightSnapshotsTest, TestReadersWhileTraining)
+{
+    // Every step adds the same amount to every weight, so a snapshot that
+    // mixed two versions would have different values in it
+    TTensorPtr l_ones = Tensor::New({1, 2}, {1.0f, 1.0f});
+    TTensorPtr l_grad = Tensor::New({1, 2}, {-1.0f, -1.0f});
+    Sequential l_model;
+    l_model.Add(TLayerPtr(new LinearLayer(Tensor::Zeros({2, 2}))));
+
+    vector<float> l_initial = l_model.Layers()[0]->Weights()->Data();
+    WeightSnapshots l_snapshots(4);
+    l_snapshots.Publish(l_model);
+    atomic<bool> l_done(false);
+    atomic<size_t> l_torn(0);
+    atomic<size_t> l_reads(0);
+    vector<thread> l_readers;
+    for (size_t r = 0; r < 4; ++r)
+    {
+        l_readers.emplace_back([&]() {
+            while (!l_done.load())
+            {
+                WeightSnapshots::Guard l_guard = l_snapshots.Acquire();
+                const vector<float>& l_weights = l_guard->weights[0]->Data();
+                for (size_t i = 0; i < l_weights.size(); ++i)
+                {
+                    if (l_weights[i] - l_initial[i] != l_weights[0] - l_initial[0])
+                    {
+                        ++l_torn;
+                    }
+                }
+                ++l_reads;
+            }
+        });
+    }
+
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        l_model.Layers()[0]->Backward(l_ones, l_grad);
+        l_model.UpdateWeights(1.0f);
+        l_snapshots.Publish(l_model);
+    }
+    l_done.store(true);
+    for (thread& l_reader : l_readers)
+    {
+        l_reader.join();
+    }
+
+    EXPECT_EQ(l_torn.load(), 0u);
+    EXPECT_GT(l_reads.load(), 0u);
+    EXPECT_EQ(l_model.Layers()[0]->Weights()->At({1, 1}), 2000.0f);
+}
@@ -4,42 +4,641 @@
  */
 
 
+#include "neural/data/augment_pipeline.h"
 #include "neural/data/mnist_dataloader.h"
+#include "neural/layers/conv2d_layer.h"
+#include "neural/layers/flatten_layer.h"
 #include "neural/layers/linear_layer.h"
+#include "neural/layers/linear_relu_layer.h"
+#include "neural/layers/max_pool2d_layer.h"
 #include "neural/layers/relu_layer.h"
 #include "neural/loss/squared_error_loss.h"
+#include "neural/math/gemm_autotuner.h"
+#include "neural/math/philox.h"
+#include "neural/math/tensor_math.h"
+#include "neural/metrics/metrics_reporter.h"
+#include "neural/models/sequential.h"
+#include "neural/models/weight_snapshots.h"
+#include "neural/parallel/threading.h"
+#include "neural/train/checkpointer.h"
+#include "neural/train/data_parallel_trainer.h"
+#include "neural/train/hogwild_trainer.h"
+#include "neural/train/multi_process_trainer.h"
+#include "neural/train/pipeline_trainer.h"
+#include "neural/train/step_executor.h"
 
 #include <glog/logging.h>
 
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <thread>
+
 using namespace neural;
 using namespace std;
 
 float CalcAverage(const vector<float>& vals)
 {
-    float sum = 0.0;
-    for (size_t i = 0; i < vals.size(); ++i)
+    return TensorMath::Mean(vals.data(), vals.size());
+}
+
+// Returns the value passed after a_flag, ie. --gemm-cache gemm.cache
+string GetFlag(int argc, char const *argv[], const string& a_flag, const string& a_default)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (a_flag == argv[i])
+        {
+            return argv[i + 1];
+        }
+    }
+    return a_default;
+}
+
+// a_value of a_flag as a whole number, exits with a usage error unless it is one
+size_t ParseSize(const string& a_flag, const string& a_value)
+{
+    char* l_end = nullptr;
+    errno = 0;
+    unsigned long long l_value = isdigit((unsigned char)a_value.c_str()[0]) ? strtoull(a_value.c_str(), &l_end, 10) : 0;
+    if (!l_end || *l_end != '\0' || errno == ERANGE || l_value > numeric_limits<size_t>::max())
+    {
+        LOG(ERROR) << "Usage: " << a_flag << " takes a whole number, not '" << a_value << "'" << endl;
+        exit(1);
+    }
+    return l_value;
+}
+
+// a_value of a_flag as a number, exits with a usage error unless it is one
+double ParseDouble(const string& a_flag, const string& a_value)
+{
+    char* l_end = nullptr;
+    errno = 0;
+    double l_value = a_value.empty() ? 0.0 : strtod(a_value.c_str(), &l_end);
+    if (!l_end || *l_end != '\0' || errno == ERANGE || !isfinite(l_value))
+    {
+        LOG(ERROR) << "Usage: " << a_flag << " takes a number, not '" << a_value << "'" << endl;
+        exit(1);
+    }
+    return l_value;
+}
+
+size_t GetSizeFlag(int argc, char const *argv[], const string& a_flag, const string& a_default)
+{
+    return ParseSize(a_flag, GetFlag(argc, argv, a_flag, a_default));
+}
+
+double GetDoubleFlag(int argc, char const *argv[], const string& a_flag, const string& a_default)
+{
+    return ParseDouble(a_flag, GetFlag(argc, argv, a_flag, a_default));
+}
+
+// Loads examples [a_begin, a_end) in parallel on the ThreadPool
+void LoadBatch(
+    const MNISTDataloader& a_dataloader, size_t a_begin, size_t a_end,
+    vector<TTensorPtr>& a_outInputs, vector<float>& a_outTargets)
+{
+    size_t l_batchSize = a_end - a_begin;
+    vector<TMutableTensorPtr> l_inputs(l_batchSize), l_outputs(l_batchSize);
+    vector<future<bool>> l_loaded;
+    for (size_t i = 0; i < l_batchSize; ++i)
+    {
+        l_loaded.push_back(a_dataloader.DataAtAsync(a_begin + i, l_inputs[i], l_outputs[i]));
+    }
+
+    a_outInputs.clear();
+    a_outTargets.clear();
+    for (size_t i = 0; i < l_batchSize; ++i)
+    {
+        l_loaded[i].get();
+        a_outInputs.push_back(l_inputs[i]);
+        a_outTargets.push_back(l_outputs[i]->View<2>()(0, 0));
+    }
+}
+
+// Random a_shape weights from the initializer named a_init
+TTensorPtr InitWeights(const string& a_init, const vector<size_t>& a_shape)
+{
+    if (a_init == "xavier")
+    {
+        return Tensor::XavierUniform(a_shape);
+    }
+    if (a_init == "he")
+    {
+        return Tensor::HeNormal(a_shape);
+    }
+    return Tensor::Random(a_shape, -0.01f, 0.01f);
+}
+
+// Runs every snapshot published to a_snapshots over a_testData while
+// training goes on, until a_done is set and the last one is evaluated.
+// a_model only gives the layers, its weights are replaced.
+void EvaluateSnapshots(
+    const MNISTDataloader& a_testData, Sequential a_model,
+    WeightSnapshots& a_snapshots, const atomic<bool>& a_done)
+{
+    // Leave the cores to the training thread's ops
+    Threading::SerialScope l_serial;
+    SquaredErrorLoss l_loss;
+    const size_t l_batchSize = 100;
+    size_t l_numData = a_testData.DataLength();
+    uint64_t l_evaluated = 0;
+    while (true)
+    {
+        // Read before looking, so the last snapshot is always evaluated
+        bool l_done = a_done.load();
+        uint64_t l_version = 0;
+        {
+            WeightSnapshots::Guard l_guard = a_snapshots.Acquire();
+            if (l_guard.Get() && l_guard->version != l_evaluated)
+            {
+                WeightSnapshots::Apply(*l_guard, a_model);
+                l_version = l_guard->version;
+            }
+        }
+        if (l_version == 0)
+        {
+            if (l_done)
+            {
+                return;
+            }
+            this_thread::sleep_for(chrono::milliseconds(50));
+            continue;
+        }
+
+        chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+        double l_errorSum = 0.0;
+        size_t l_correct = 0;
+        for (size_t l_begin = 0; l_begin < l_numData; l_begin += l_batchSize)
+        {
+            TMutableTensorPtr l_inputs;
+            vector<float> l_targets;
+            if (!a_testData.BatchAt(l_begin, min(l_begin + l_batchSize, l_numData), l_inputs, l_targets))
+            {
+                LOG(ERROR) << "Could not read test examples from " << l_begin << endl;
+                return;
+            }
+
+            TTensorPtr l_output = a_model.Forward(l_inputs);
+            const vector<float>& l_preds = l_output->Data();
+            for (size_t i = 0; i < l_targets.size(); ++i)
+            {
+                l_errorSum += l_loss.Forward(l_preds[i], l_targets[i]);
+                l_correct += round(l_preds[i]) == l_targets[i] ? 1 : 0;
+            }
+        }
+        chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+        LOG(INFO) << "Snapshot " << l_version << " on " << l_numData << " test examples: avgError = "
+                  << l_errorSum / l_numData << ", accuracy " << 100.0 * l_correct / l_numData << "% in "
+                  << l_elapsed.count() * 1000.0 << " ms" << endl;
+        l_evaluated = l_version;
+    }
+}
+
+// Synchronous data parallel training, a_numReplicas copies of the model
+// each train on a slice of every batch
+void TrainDataParallel(
+    const MNISTDataloader& a_dataloader, const Sequential& a_model,
+    size_t a_numReplicas, size_t a_batchSize,
+    float a_learningRate, size_t a_numEpochs)
+{
+    DataParallelTrainer l_trainer(a_model, a_numReplicas);
+    size_t l_numData = a_dataloader.DataLength();
+    for (size_t i = 0; i < a_numEpochs; ++i)
+    {
+        LOG(INFO) << "--EPOCH (" << i << ")--" << endl;
+        chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+        vector<float> errorAcc;
+        for (size_t l_begin = 0; l_begin < l_numData; l_begin += a_batchSize)
+        {
+            size_t l_end = std::min(l_begin + a_batchSize, l_numData);
+            vector<TTensorPtr> l_inputs;
+            vector<float> l_targets;
+            LoadBatch(a_dataloader, l_begin, l_end, l_inputs, l_targets);
+
+            errorAcc.push_back(l_trainer.Step(l_inputs, l_targets, a_learningRate));
+
+            // Compute average error for last 100 batches
+            if (errorAcc.size() == 100)
+            {
+                LOG(INFO) << "avgError (" << i << "," << l_begin << ") = " << CalcAverage(errorAcc) << endl;
+                errorAcc.clear();
+            }
+        }
+
+        chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+        LOG(INFO) << "Data parallel examples/sec: " << l_numData / l_elapsed.count() << endl;
+    }
+}
+
+// Mini-batch SGD with every batch read straight into CSR by SparseBatchAt, so
+// no dense input is ever built. a_firstLayer (the model's first layer)
+// multiplies it sparse, the layers after it run dense.
+void TrainSparse(
+    const MNISTDataloader& a_dataloader, Sequential& a_model, LinearLayer& a_firstLayer,
+    size_t a_batchSize, float a_learningRate, size_t a_numEpochs)
+{
+    const vector<TLayerPtr>& l_layers = a_model.Layers();
+    SquaredErrorLoss l_loss;
+    size_t l_numData = a_dataloader.DataLength();
+    for (size_t i = 0; i < a_numEpochs; ++i)
+    {
+        LOG(INFO) << "--EPOCH (" << i << ")--" << endl;
+        chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+        vector<float> errorAcc;
+        for (size_t l_begin = 0; l_begin < l_numData; l_begin += a_batchSize)
+        {
+            size_t l_end = std::min(l_begin + a_batchSize, l_numData);
+            TSparseTensorPtr l_inputs;
+            vector<float> l_targets;
+            if (!a_dataloader.SparseBatchAt(l_begin, l_end, l_inputs, l_targets))
+            {
+                continue;
+            }
+
+            // Forward, keeping the input of every dense layer
+            vector<TTensorPtr> l_activations;
+            TTensorPtr l_output = a_firstLayer.Forward(l_inputs);
+            for (size_t l = 1; l < l_layers.size(); ++l)
+            {
+                l_activations.push_back(l_output);
+                l_output = l_layers[l]->ForwardForBackward(l_output);
+            }
+
+            // One Backward for the whole batch, so the gradient is the batch mean
+            size_t l_batchSize = l_end - l_begin;
+            TMutableTensorPtr l_errorGrad = Tensor::New({l_batchSize, 1});
+            TensorView<2, const float> l_outputView = l_output->View<2>();
+            TensorView<2> l_errorGradView = l_errorGrad->MutableView<2>();
+            float l_error = 0.0f;
+            for (size_t n = 0; n < l_batchSize; ++n)
+            {
+                float l_predVal = l_outputView(n, 0);
+                l_error += l_loss.Forward(l_predVal, l_targets[n]);
+                l_errorGradView(n, 0) = l_loss.Backward(l_predVal, l_targets[n]) / (float)l_batchSize;
+            }
+            l_loss.ZeroGrad();
+
+            TTensorPtr l_grad = l_errorGrad;
+            for (size_t l = l_layers.size(); l > 1; --l)
+            {
+                l_grad = l_layers[l - 1]->Backward(l_activations[l - 2], l_grad);
+            }
+            a_firstLayer.Backward(l_inputs, l_grad);
+            a_model.UpdateWeights(a_learningRate);
+
+            // Compute average error for last 100 batches
+            errorAcc.push_back(l_error / (float)l_batchSize);
+            if (errorAcc.size() == 100)
+            {
+                LOG(INFO) << "avgError (" << i << "," << l_begin << ") = " << CalcAverage(errorAcc) << endl;
+                errorAcc.clear();
+            }
+        }
+
+        chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+        LOG(INFO) << "Sparse input examples/sec: " << l_numData / l_elapsed.count() << endl;
+    }
+}
+
+// One rank of TrainMultiProcess, runs in the forked child
+void TrainRank(
+    const MNISTDataloader& a_dataloader, Sequential& a_model, const string& a_shmName,
+    size_t r, size_t a_numProcs, size_t a_coresPerProc,
+    size_t a_batchSize, float a_learningRate, size_t a_numEpochs)
+{
+    // Keep our OpenMP, BLAS and pool threads on our own cores
+    Threading::RestrictToCores((r * a_coresPerProc) % Threading::NumCores(), a_coresPerProc);
+    Threading::SetNumThreads(a_coresPerProc);
+
+    ShmRingAllReduce l_comm(a_shmName, r);
+    MultiProcessTrainer l_trainer(a_model, l_comm);
+    size_t l_numData = a_dataloader.DataLength();
+    for (size_t i = 0; i < a_numEpochs; ++i)
+    {
+        if (r == 0)
+        {
+            LOG(INFO) << "--EPOCH (" << i << ")--" << endl;
+        }
+        chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+        vector<float> errorAcc;
+        for (size_t l_begin = 0; l_begin < l_numData; l_begin += a_batchSize)
+        {
+            // Our slice of the batch
+            size_t l_batchSize = std::min(l_begin + a_batchSize, l_numData) - l_begin;
+            size_t l_shardBegin = l_begin + (l_batchSize * r) / a_numProcs;
+            size_t l_shardEnd = l_begin + (l_batchSize * (r + 1)) / a_numProcs;
+            vector<TTensorPtr> l_inputs;
+            vector<float> l_targets;
+            LoadBatch(a_dataloader, l_shardBegin, l_shardEnd, l_inputs, l_targets);
+
+            errorAcc.push_back(l_trainer.Step(l_inputs, l_targets, a_learningRate));
+
+            // Compute average error for last 100 batches
+            if (errorAcc.size() == 100)
+            {
+                if (r == 0)
+                {
+                    LOG(INFO) << "avgError (" << i << "," << l_begin << ") = " << CalcAverage(errorAcc) << endl;
+                }
+                errorAcc.clear();
+            }
+        }
+
+        chrono::duration<double> l_elapsed = chrono::steady_clock::now() - l_start;
+        if (r == 0)
+        {
+            LOG(INFO) << "Multi process examples/sec: " << l_numData / l_elapsed.count() << endl;
+        }
+    }
+
+    // Every rank tuned the same shapes on as many threads, and they leave with
+    // _exit so nothing is saved on the way out, rank 0 writes the cache for all
+    if (r == 0)
+    {
+        GemmAutotuner::Instance().Save();
+    }
+}
+
+// Synchronous data parallel training over a_numProcs forked processes, each
+// on its own group of cores, summing gradients through shared memory. False
+// if a rank couldn't be started or failed, the others are killed then since
+// they would wait for it at the next all-reduce forever.
+bool TrainMultiProcess(
+    const MNISTDataloader& a_dataloader, Sequential& a_model,
+    size_t a_numProcs, size_t a_batchSize,
+    float a_learningRate, size_t a_numEpochs)
+{
+    string l_shmName = "/feedforward_neural_net_" + to_string(getpid());
+    ShmRingAllReduce::Create(l_shmName, a_numProcs, MultiProcessTrainer::NumFloats(a_model));
+
+    // Fork before anything starts threads, children inherit the initial weights
+    size_t l_coresPerProc = std::max((size_t)1, Threading::NumCores() / a_numProcs);
+    vector<pid_t> l_children;
+    for (size_t r = 0; r < a_numProcs; ++r)
+    {
+        pid_t l_pid = fork();
+        if (l_pid < 0)
+        {
+            LOG(ERROR) << "TrainMultiProcess could not fork rank " << r << endl;
+            for (pid_t l_child : l_children)
+            {
+                kill(l_child, SIGKILL);
+                waitpid(l_child, nullptr, 0);
+            }
+            ShmRingAllReduce::Unlink(l_shmName);
+            return false;
+        }
+        if (l_pid > 0)
+        {
+            l_children.push_back(l_pid);
+            continue;
+        }
+
+        // Child, an exception must not unwind into the parent's code
+        try
+        {
+            TrainRank(a_dataloader, a_model, l_shmName, r, a_numProcs, l_coresPerProc,
+                a_batchSize, a_learningRate, a_numEpochs);
+        }
+        catch (const exception& l_e)
+        {
+            LOG(ERROR) << "TrainMultiProcess rank " << r << " failed: " << l_e.what() << endl;
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    // Reap in whatever order the ranks end, if one failed the rest are stuck
+    // waiting for it
+    bool l_ok = true;
+    while (!l_children.empty())
+    {
+        int l_status = 0;
+        pid_t l_child = waitpid(-1, &l_status, 0);
+        if (l_child < 0)
+        {
+            break;
+        }
+        l_children.erase(std::remove(l_children.begin(), l_children.end(), l_child), l_children.end());
+        if (l_ok && (!WIFEXITED(l_status) || WEXITSTATUS(l_status) != 0))
+        {
+            LOG(ERROR) << "TrainMultiProcess rank with pid " << l_child << " failed, stopping the others" << endl;
+            l_ok = false;
+            for (pid_t l_other : l_children)
+            {
+                kill(l_other, SIGKILL);
+            }
+        }
+    }
+    ShmRingAllReduce::Unlink(l_shmName);
+    return l_ok;
+}
+
+// Pipeline parallel training, the layers are split into a_numStages stages
+// that each batch streams through as a_numMicroBatches micro-batches
+void TrainPipeline(
+    const MNISTDataloader& a_dataloader, Sequential& a_model,
+    size_t a_numStages, size_t a_numMicroBatches, PipelineTrainer::ESchedule a_schedule,
+    size_t a_batchSize, float a_learningRate, size_t a_numEpochs)
+{
+    PipelineTrainer l_trainer(a_model, a_numStages, a_numMicroBatches, a_schedule);
+    size_t l_numData = a_dataloader.DataLength();
+    for (size_t i = 0; i < a_numEpochs; ++i)
+    {
+        LOG(INFO) << "--EPOCH (" << i << ")--" << endl;
+        l_trainer.ResetStats();
+        vector<float> errorAcc;
+        for (size_t l_begin = 0; l_begin < l_numData; l_begin += a_batchSize)
+        {
+            size_t l_end = std::min(l_begin + a_batchSize, l_numData);
+            vector<TTensorPtr> l_inputs;
+            vector<float> l_targets;
+            LoadBatch(a_dataloader, l_begin, l_end, l_inputs, l_targets);
+
+            errorAcc.push_back(l_trainer.Step(l_inputs, l_targets, a_learningRate));
+
+            // Compute average error for last 100 batches
+            if (errorAcc.size() == 100)
+            {
+                LOG(INFO) << "avgError (" << i << "," << l_begin << ") = " << CalcAverage(errorAcc) << endl;
+                errorAcc.clear();
+            }
+        }
+
+        // Compare the bubble against the ideal one, and examples/sec against --replicas
+        const PipelineStats& l_stats = l_trainer.Stats();
+        LOG(INFO) << "Pipeline examples/sec: " << l_numData / l_stats.seconds
+                  << " bubble: " << l_stats.BubbleFraction()
+                  << " (ideal " << PipelineStats::IdealBubbleFraction(a_numStages, a_numMicroBatches) << ")" << endl;
+        for (size_t s = 0; s < a_numStages; ++s)
+        {
+            LOG(INFO) << "Stage " << s << " busy " << l_stats.busySeconds[s] << "s of " << l_stats.seconds << "s" << endl;
+        }
+    }
+}
+
+// Lock free asynchronous SGD with a_numWorkers threads sharing a_model
+void TrainHogwild(
+    const MNISTDataloader& a_dataloader, Sequential& a_model,
+    size_t a_numWorkers, float a_learningRate, size_t a_numEpochs,
+    const string& a_curveFile)
+{
+    HogwildTrainer l_trainer(a_model, a_numWorkers);
+    for (size_t i = 0; i < a_numEpochs; ++i)
+    {
+        LOG(INFO) << "--EPOCH (" << i << ")--" << endl;
+        l_trainer.Train(a_dataloader, a_learningRate);
+        LOG(INFO) << "Hogwild examples/sec: " << l_trainer.ExamplesPerSecond() << endl;
+    }
+
+    // Convergence curve to compare against the synchronous path
+    if (!a_curveFile.empty())
     {
-        sum += vals.at(i);
+        ofstream l_outfile(a_curveFile);
+        l_outfile << "examples,seconds,avg_error" << endl;
+        for (const TrainingCurvePoint& l_point : l_trainer.Curve())
+        {
+            l_outfile << l_point.examples << "," << l_point.seconds << "," << l_point.avgLoss << endl;
+        }
     }
-    return sum / ((float)vals.size());
 }
 
 int main(int argc, char const *argv[])
 {
-    // Define data loader
-    MNISTDataloader l_dataloader("../data/mnist/");
+    // One thread count for OpenMP and BLAS, 0 is one per core
+    string l_numThreads = GetFlag(argc, argv, "--threads", "");
+    if (!l_numThreads.empty())
+    {
+        Threading::SetNumThreads(ParseSize("--threads", l_numThreads));
+    }
 
-    // Define model
-    // first linear layer is 784x300
-    // 784 inputs, 300 hidden size
-    LinearLayer firstLinearLayer(Tensor::Random({784, 300}, -0.01f, 0.01f));
+    // libgomp doesn't survive a fork once it has started its threads, so with
+    // --procs nothing runs in parallel until the children are forked
+    size_t numProcs = GetSizeFlag(argc, argv, "--procs", "1");
+    unique_ptr<Threading::SerialScope> beforeFork;
+    if (numProcs > 1)
+    {
+        beforeFork.reset(new Threading::SerialScope());
+    }
 
-    // Non-linear activation
-    ReLULayer activationLayer;
-    
-    // second linear layer is 300x1
-    // 300 hidden units, 1 output
-    LinearLayer secondLinearLayer(Tensor::Random({300, 1}, -0.01f, 0.01f));
+    // Pin our threads to cores starting at this one, with --procs every
+    // child keeps to its own cores instead
+    string l_firstCore = GetFlag(argc, argv, "--pin-threads", "");
+    if (!l_firstCore.empty() && numProcs > 1)
+    {
+        LOG(WARNING) << "--pin-threads is ignored with --procs" << endl;
+    }
+    else if (!l_firstCore.empty())
+    {
+        Threading::PinThreads(ParseSize("--pin-threads", l_firstCore));
+    }
+
+    // Run our parallel loops on OpenMP or on the work stealing pool
+    if (GetFlag(argc, argv, "--backend", "openmp") == "pool")
+    {
+        Threading::SetBackend(Threading::THREAD_POOL);
+    }
+
+    // Time GEMM kernels per shape and remember the winners between runs
+    string l_gemmCache = GetFlag(argc, argv, "--gemm-cache", "");
+    if (!l_gemmCache.empty())
+    {
+        GemmAutotuner::Instance().Enable(l_gemmCache);
+    }
+
+    // Define data loader, the files are mapped unless --io pread
+    IdxFile::EAccess l_access = GetFlag(argc, argv, "--io", "mmap") == "pread" ? IdxFile::PREAD : IdxFile::MMAP;
+    MNISTDataloader l_dataloader("../data/mnist/", true, l_access);
+    string l_readAhead = GetFlag(argc, argv, "--read-ahead", "");
+    if (!l_readAhead.empty())
+    {
+        l_dataloader.SetReadAhead(ParseSize("--read-ahead", l_readAhead) << 20);
+    }
+
+    // Index the *.gz files up front if that is what we found
+    if (GetFlag(argc, argv, "--gzip-index", "off") == "on")
+    {
+        l_dataloader.BuildIndex();
+    }
+
+    // Zero background pixels so the first layer can run sparse
+    bool sparse = GetFlag(argc, argv, "--sparse", "off") == "on";
+    if (sparse)
+    {
+        l_dataloader.SetZeroBackground(true);
+    }
+
+    // Densest input that takes the sparse GEMM path, off unless asked for
+    // since every multiply then checks its left side first
+    string l_sparseThreshold = GetFlag(argc, argv, "--sparse-threshold", sparse ? "0.25" : "");
+    if (!l_sparseThreshold.empty())
+    {
+        TensorMath::SetSparseThreshold(ParseDouble("--sparse-threshold", l_sparseThreshold));
+    }
+
+    // Same seed, same initial weights, whatever the number of threads
+    string l_seed = GetFlag(argc, argv, "--seed", "");
+    if (!l_seed.empty())
+    {
+        Philox::SetGlobalSeed(ParseSize("--seed", l_seed));
+    }
+    LOG(INFO) << "Random seed: " << Philox::GlobalSeed() << endl;
+    string l_init = GetFlag(argc, argv, "--init", "uniform");
+
+    // Define model, the two alternatives to the default model don't mix
+    bool conv = GetFlag(argc, argv, "--conv", "off") == "on";
+    bool fuseRelu = GetFlag(argc, argv, "--fuse-relu", "off") == "on";
+    if (conv && fuseRelu)
+    {
+        LOG(ERROR) << "Usage: --conv on and --fuse-relu on can't be combined, the conv model has no linear layer followed by a ReLU" << endl;
+        return 1;
+    }
+    Sequential model;
+    if (conv)
+    {
+        // 8 5x5 filters over 1x28x28 images give 8x24x24, pooled down to 8x12x12
+        l_dataloader.SetLayout(MNISTDataloader::NCHW);
+        shared_ptr<Conv2DLayer> convLayer(new Conv2DLayer(InitWeights(l_init, {25, 8}), 1, 5));
+        model.Add(convLayer);
+        model.Add(TLayerPtr(new ReLULayer()));
+        model.Add(TLayerPtr(new MaxPool2DLayer(2)));
+        model.Add(TLayerPtr(new FlattenLayer()));
+        model.Add(TLayerPtr(new LinearLayer(InitWeights(l_init, {8 * 12 * 12, 1}))));
+    }
+    else if (fuseRelu)
+    {
+        // Same 784x300x1 network with the first linear layer and the ReLU in one layer
+        model.Add(TLayerPtr(new LinearReLULayer(InitWeights(l_init, {784, 300}))));
+        model.Add(TLayerPtr(new LinearLayer(InitWeights(l_init, {300, 1}))));
+    }
+    else
+    {
+        // first linear layer is 784x300
+        // 784 inputs, 300 hidden size
+        shared_ptr<LinearLayer> firstLinearLayer(new LinearLayer(InitWeights(l_init, {784, 300})));
+
+        // Non-linear activation
+        shared_ptr<ReLULayer> activationLayer(new ReLULayer());
+
+        // second linear layer is 300x1
+        // 300 hidden units, 1 output
+        shared_ptr<LinearLayer> secondLinearLayer(new LinearLayer(InitWeights(l_init, {300, 1})));
+
+        model.Add(firstLinearLayer);
+        model.Add(activationLayer);
+        model.Add(secondLinearLayer);
+    }
 
     // Error function
     SquaredErrorLoss loss;
@@ -47,49 +646,270 @@ int main(int argc, char const *argv[])
     // Training loop
     float learningRate = 0.5;
     size_t numEpochs = 10;
+
+    // Hogwild training with this many threads updating the model without locks
+    size_t numHogwildWorkers = GetSizeFlag(argc, argv, "--hogwild", "0");
+    if (numHogwildWorkers > 0)
+    {
+        beforeFork.reset();
+        TrainHogwild(l_dataloader, model, numHogwildWorkers, learningRate, numEpochs,
+                     GetFlag(argc, argv, "--curve-csv", ""));
+        return 0;
+    }
+
+    // Keep at most this many KB of activations between forward and backward,
+    // recomputing the rest, hogwild workers need them all so it's set after
+    string l_checkpointBudget = GetFlag(argc, argv, "--checkpoint-budget", "");
+    if (!l_checkpointBudget.empty())
+    {
+        model.SetCheckpointBudget(ParseSize("--checkpoint-budget", l_checkpointBudget) * 1024);
+    }
+
+    // Pipeline parallel training with the layers split into this many stages
+    size_t numStages = GetSizeFlag(argc, argv, "--pipeline", "0");
+    if (numStages > 0)
+    {
+        beforeFork.reset();
+        size_t batchSize = GetSizeFlag(argc, argv, "--batch-size", "32");
+        size_t numMicroBatches = GetSizeFlag(argc, argv, "--micro-batches", "4");
+        PipelineTrainer::ESchedule schedule = PipelineTrainer::ONE_F_ONE_B;
+        if (GetFlag(argc, argv, "--schedule", "1f1b") == "gpipe")
+        {
+            schedule = PipelineTrainer::GPIPE;
+        }
+        TrainPipeline(l_dataloader, model, numStages, numMicroBatches, schedule,
+                      batchSize, learningRate, numEpochs);
+        return 0;
+    }
+
+    // Data parallel training with this many processes, each with its own cores
+    if (numProcs > 1)
+    {
+        size_t batchSize = GetSizeFlag(argc, argv, "--batch-size", "32");
+        beforeFork.reset();
+        return TrainMultiProcess(l_dataloader, model, numProcs, batchSize, learningRate, numEpochs) ? 0 : 1;
+    }
+
+    // Data parallel training with this many replicas of the model
+    size_t numReplicas = GetSizeFlag(argc, argv, "--replicas", "1");
+    if (numReplicas > 1)
+    {
+        size_t batchSize = GetSizeFlag(argc, argv, "--batch-size", "32");
+        TrainDataParallel(l_dataloader, model, numReplicas, batchSize, learningRate, numEpochs);
+        return 0;
+    }
+
+    // With --sparse on and a batch size, batches go from the files to CSR and
+    // the first layer multiplies them sparse, which needs a plain LinearLayer
+    string sparseBatchSize = GetFlag(argc, argv, "--batch-size", "");
+    if (sparse && !sparseBatchSize.empty())
+    {
+        shared_ptr<LinearLayer> firstLayer = dynamic_pointer_cast<LinearLayer>(model.Layers()[0]);
+        if (!firstLayer)
+        {
+            LOG(ERROR) << "--sparse on with --batch-size needs the default model, not --conv or --fuse-relu" << endl;
+            return 1;
+        }
+        TrainSparse(l_dataloader, model, *firstLayer, std::max((size_t)1, ParseSize("--batch-size", sparseBatchSize)),
+                    learningRate, numEpochs);
+        return 0;
+    }
+
+    // Checkpoint every N steps to --checkpoint FILE on a background thread,
+    // --resume on carries on from the step it holds
+    string checkpointFile = GetFlag(argc, argv, "--checkpoint", "");
+    size_t checkpointEvery = GetSizeFlag(argc, argv, "--checkpoint-every", "10000");
+    unique_ptr<Checkpointer> checkpointer;
+    TrainState state = {0, 0, 0, Philox::GlobalSeed(), learningRate};
+    if (!checkpointFile.empty())
+    {
+        if (GetFlag(argc, argv, "--resume", "off") == "on" && Checkpointer::Load(checkpointFile, model, state))
+        {
+            Philox::SetGlobalSeed(state.seed);
+            learningRate = state.learningRate;
+            LOG(INFO) << "Resuming from " << checkpointFile << " at epoch " << state.epoch
+                      << " example " << state.iteration << ", step " << state.step << endl;
+        }
+        checkpointer.reset(new Checkpointer(checkpointFile));
+    }
+
+    // Shift, rotate, distort and add noise to every example on this many threads
+    size_t numAugmentWorkers = GetSizeFlag(argc, argv, "--augment", "0");
+    unique_ptr<AugmentPipeline> augment;
+    if (numAugmentWorkers > 0)
+    {
+        Augmenter augmenter(Augmenter::DefaultParams(), Philox::GlobalSeed());
+        augment.reset(new AugmentPipeline(l_dataloader, augmenter, 1, numAugmentWorkers));
+    }
+
+    // Publish the weights every N steps for a thread evaluating them on
+    // t10k, training never waits for it
+    size_t evalEvery = GetSizeFlag(argc, argv, "--eval-every", "0");
+    WeightSnapshots snapshots;
+    atomic<bool> evalDone(false);
+    unique_ptr<MNISTDataloader> testData;
+    thread evalThread;
+    if (evalEvery > 0)
+    {
+        testData.reset(new MNISTDataloader("../data/mnist/", false, l_access));
+        testData->SetLayout(l_dataloader.Layout());
+        testData->SetZeroBackground(l_dataloader.ZeroBackground());
+        evalThread = thread(EvaluateSnapshots, cref(*testData), model.Clone(), ref(snapshots), cref(evalDone));
+    }
+
+    // Each layer's update runs on the pool as soon as its gradient is ready,
+    // alongside backward through the layers before it
+    unique_ptr<StepExecutor> executor;
+    if (GetFlag(argc, argv, "--overlap-updates", "off") == "on")
+    {
+        executor.reset(new StepExecutor(model));
+    }
+
+    // Loss, throughput, step and per layer times go to a reporter thread
+    // every --metrics-interval seconds instead of a log line per example
+    MetricsReporter reporter(GetDoubleFlag(argc, argv, "--metrics-interval", "10"));
+    if (GetFlag(argc, argv, "--metrics", "stdout") == "stdout")
+    {
+        reporter.ToStdout();
+    }
+    string metricsCsv = GetFlag(argc, argv, "--metrics-csv", "");
+    if (!metricsCsv.empty())
+    {
+        reporter.ToCsv(metricsCsv);
+    }
+    string metricsPort = GetFlag(argc, argv, "--metrics-port", "");
+    if (!metricsPort.empty())
+    {
+        LOG(INFO) << "Serving metrics on 127.0.0.1:" << reporter.ServePrometheus(ParseSize("--metrics-port", metricsPort)) << endl;
+    }
+    reporter.Start();
+    model.SetLayerTiming(true);
+    Counter& examplesMetric = Metrics::Instance().GetCounter("train_examples_total");
+    Histogram& lossMetric = Metrics::Instance().GetHistogram("train_loss");
+    Histogram& stepMetric = Metrics::Instance().GetHistogram("train_step_seconds");
+
     size_t numIters = l_dataloader.DataLength();
-    for (size_t i = 0; i < numEpochs; ++i)
+    for (size_t i = state.epoch; i < numEpochs; ++i)
     {
         LOG(INFO) << "--EPOCH (" << i << ")--" << endl;
-        vector<float> errorAcc;
-        for (size_t j = 0; j < numIters; ++j)
+
+        // Load the first example, after that each one is loaded while we train on the last
+        size_t firstIter = i == state.epoch ? state.iteration : 0;
+        TMutableTensorPtr nextInput, nextOutput;
+        future<bool> nextLoaded;
+        if (augment)
+        {
+            augment->StartEpoch(i, firstIter);
+        }
+        else if (firstIter < numIters)
+        {
+            nextLoaded = l_dataloader.DataAtAsync(firstIter, nextInput, nextOutput);
+        }
+        for (size_t j = firstIter; j < numIters; ++j)
         {
-            LOG(INFO) << "--ITER (" << i << "," << j << ")--" << endl;
+            ScopedTimer stepTimer(stepMetric);
+
             // Get training example
-            TMutableTensorPtr input, output;
-            l_dataloader.DataAt(j, input, output);
-            float targetOutput = output->At({0,0});
+            TTensorPtr input;
+            float targetOutput = 0.0f;
+            if (augment)
+            {
+                vector<float> targets;
+                augment->Next(input, targets);
+                targetOutput = targets[0];
+            }
+            else
+            {
+                nextLoaded.get();
+                input = nextInput;
+                targetOutput = nextOutput->View<2>()(0, 0);
+                if (j + 1 < numIters)
+                {
+                    nextLoaded = l_dataloader.DataAtAsync(j + 1, nextInput, nextOutput);
+                }
+            }
 
             // Forward pass
-            TTensorPtr output0 = firstLinearLayer.Forward(input);
-            TTensorPtr output1 = activationLayer.Forward(output0);
-            TTensorPtr y_pred = secondLinearLayer.Forward(output1);
-            float yPredVal = y_pred->At({0,0});
-            LOG(INFO) << "Got prediction: " << yPredVal << " for target " << targetOutput << endl;
+            vector<TTensorPtr> activations;
+            TTensorPtr y_pred = executor ? executor->Forward(input, activations) : model.Forward(input, activations);
+            float yPredVal = y_pred->View<2>()(0, 0);
 
             // Calc Error
             float error = loss.Forward(yPredVal, targetOutput);
-            errorAcc.push_back(error);
-            LOG(INFO) << "Calculated error for example [" << i << "]: " << error << endl;
-
-            // Compute average error for last 100 examples
-            if (j % 100 == 0)
-            {
-                float avgError = CalcAverage(errorAcc);
-                LOG(INFO) << "avgError = " << avgError << endl;
-                errorAcc.clear();
-            }
+            lossMetric.Record(error);
+            examplesMetric.Add();
 
             // Backward pass
             float errorGrad = loss.Backward(yPredVal, targetOutput);
-            TTensorPtr y_predGrad = secondLinearLayer.Backward(output1, Tensor::New({1,1}, {errorGrad}));
-            TTensorPtr grad1 = activationLayer.Backward(output0, y_predGrad);
-            TTensorPtr grad0 = firstLinearLayer.Backward(input, grad1);
+            if (executor)
+            {
+                // Queues the gradient descent step too
+                executor->Backward(activations, Tensor::New({1,1}, {errorGrad}), learningRate);
+            }
+            else
+            {
+                model.Backward(activations, Tensor::New({1,1}, {errorGrad}));
+            }
+            if (j % 100 == 0 && model.CheckpointBudget() > 0)
+            {
+                const CheckpointStats& stats = model.LastCheckpointStats();
+                LOG(INFO) << "Activations peak " << stats.peakBytes << " of " << stats.allBytes
+                          << " bytes, recomputed " << stats.recomputedLayers << " layers in "
+                          << stats.recomputeSeconds * 1000.0 << " of " << stats.backwardSeconds * 1000.0
+                          << " backward ms" << endl;
+            }
 
             // Gradient Descent
-            secondLinearLayer.UpdateWeights(learningRate);
-            firstLinearLayer.UpdateWeights(learningRate);
+            if (!executor)
+            {
+                model.UpdateWeights(learningRate);
+            }
+            ++state.step;
+
+            if (evalEvery > 0 && state.step % evalEvery == 0)
+            {
+                if (executor)
+                {
+                    executor->Wait();
+                }
+                snapshots.Publish(model);
+            }
+
+            // Only the copy of the weights happens here, the writing doesn't
+            if (checkpointer && state.step % checkpointEvery == 0)
+            {
+                if (executor)
+                {
+                    executor->Wait();
+                }
+                state.epoch = j + 1 < numIters ? i : i + 1;
+                state.iteration = j + 1 < numIters ? j + 1 : 0;
+                checkpointer->Save(model, state);
+                LOG(INFO) << "Checkpoint at step " << state.step << ", " << checkpointer->NumWritten()
+                          << " written, " << checkpointer->SnapshotSeconds() * 1000.0
+                          << " ms spent copying so far" << endl;
+            }
         }
+
+        if (executor)
+        {
+            executor->Wait();
+            LOG(INFO) << "Weight updates took " << executor->UpdateSeconds() * 1000.0 << " ms so far, "
+                      << executor->WaitSeconds() * 1000.0 << " ms of it not hidden behind backward" << endl;
+        }
+    }
+
+    if (checkpointer)
+    {
+        checkpointer->Flush();
+    }
+
+    // And the final weights
+    if (evalThread.joinable())
+    {
+        snapshots.Publish(model);
+        evalDone.store(true);
+        evalThread.join();
     }
 
     return 0;
@@ -0,0 +1,259 @@
+/*
+ * Tool serving a trained network to local processes, with a load
+ * generator to measure it
+ *
+ */
+
+
+#include "neural/layers/conv2d_layer.h"
+#include "neural/layers/flatten_layer.h"
+#include "neural/layers/linear_layer.h"
+#include "neural/layers/linear_relu_layer.h"
+#include "neural/layers/max_pool2d_layer.h"
+#include "neural/layers/relu_layer.h"
+#include "neural/models/sequential.h"
+#include "neural/parallel/threading.h"
+#include "neural/serve/inference_server.h"
+#include "neural/train/checkpointer.h"
+
+#include <glog/logging.h>
+
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+using namespace neural;
+using namespace std;
+
+// Returns the value passed after a_flag, ie. --listen nn.sock
+string GetFlag(int argc, char const *argv[], const string& a_flag, const string& a_default)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (a_flag == argv[i])
+        {
+            return argv[i + 1];
+        }
+    }
+    return a_default;
+}
+
+// a_value of a_flag as a whole number, exits with a usage error unless it is one
+size_t ParseSize(const string& a_flag, const string& a_value)
+{
+    char* l_end = nullptr;
+    errno = 0;
+    unsigned long long l_value = isdigit((unsigned char)a_value.c_str()[0]) ? strtoull(a_value.c_str(), &l_end, 10) : 0;
+    if (!l_end || *l_end != '\0' || errno == ERANGE || l_value > numeric_limits<size_t>::max())
+    {
+        LOG(ERROR) << "Usage: " << a_flag << " takes a whole number, not '" << a_value << "'" << endl;
+        exit(1);
+    }
+    return l_value;
+}
+
+// a_value of a_flag as a number, exits with a usage error unless it is one
+double ParseDouble(const string& a_flag, const string& a_value)
+{
+    char* l_end = nullptr;
+    errno = 0;
+    double l_value = a_value.empty() ? 0.0 : strtod(a_value.c_str(), &l_end);
+    if (!l_end || *l_end != '\0' || errno == ERANGE || !isfinite(l_value))
+    {
+        LOG(ERROR) << "Usage: " << a_flag << " takes a number, not '" << a_value << "'" << endl;
+        exit(1);
+    }
+    return l_value;
+}
+
+size_t GetSizeFlag(int argc, char const *argv[], const string& a_flag, const string& a_default)
+{
+    return ParseSize(a_flag, GetFlag(argc, argv, a_flag, a_default));
+}
+
+double GetDoubleFlag(int argc, char const *argv[], const string& a_flag, const string& a_default)
+{
+    return ParseDouble(a_flag, GetFlag(argc, argv, a_flag, a_default));
+}
+
+// What a load run measured, latencies are as the clients saw them
+struct LoadResult
+{
+    size_t requests;
+    double seconds;
+    double p50;
+    double p99;
+};
+
+// a_numClients connections each sending one request after the other for a_seconds
+LoadResult RunLoad(
+    const string& a_address, size_t a_inputSize, size_t a_outputSize,
+    size_t a_numClients, double a_seconds)
+{
+    vector<vector<double>> l_latencies(a_numClients);
+    atomic<bool> l_stop(false);
+    vector<thread> l_threads;
+    chrono::steady_clock::time_point l_start = chrono::steady_clock::now();
+    for (size_t c = 0; c < a_numClients; ++c)
+    {
+        l_threads.emplace_back([&, c]() {
+            InferenceClient l_client(a_address, a_inputSize, a_outputSize);
+            TMutableTensorPtr l_input = Tensor::Random({a_inputSize}, 0.0f, 1.0f);
+            vector<float> l_output(a_outputSize);
+            while (!l_stop.load())
+            {
+                chrono::steady_clock::time_point l_sent = chrono::steady_clock::now();
+                l_client.Predict(l_input->Data().data(), l_output.data());
+                l_latencies[c].push_back(chrono::duration<double>(chrono::steady_clock::now() - l_sent).count());
+            }
+        });
+    }
+
+    this_thread::sleep_for(chrono::duration<double>(a_seconds));
+    l_stop.store(true);
+    for (thread& l_thread : l_threads)
+    {
+        l_thread.join();
+    }
+
+    vector<double> l_all;
+    for (const vector<double>& l_client : l_latencies)
+    {
+        l_all.insert(l_all.end(), l_client.begin(), l_client.end());
+    }
+    sort(l_all.begin(), l_all.end());
+
+    LoadResult l_result;
+    l_result.requests = l_all.size();
+    l_result.seconds = chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+    l_result.p50 = l_all.empty() ? 0.0 : l_all[l_all.size() / 2];
+    l_result.p99 = l_all.empty() ? 0.0 : l_all[min(l_all.size() - 1, l_all.size() * 99 / 100)];
+    return l_result;
+}
+
+// Comma separated whole numbers in a_value of a_flag, ie. "1,4,16"
+vector<size_t> ParseSizes(const string& a_flag, const string& a_value)
+{
+    vector<size_t> l_sizes;
+    stringstream l_values(a_value);
+    string l_value;
+    while (getline(l_values, l_value, ','))
+    {
+        l_sizes.push_back(ParseSize(a_flag, l_value));
+    }
+    return l_sizes;
+}
+
+// Runs the load at every client count in a_clients
+void RunLoads(
+    const string& a_address, size_t a_inputSize, size_t a_outputSize,
+    const vector<size_t>& a_clients, double a_seconds, const InferenceServer* a_server)
+{
+    for (size_t l_count : a_clients)
+    {
+        size_t l_requests = a_server ? a_server->NumRequests() : 0;
+        size_t l_batches = a_server ? a_server->NumBatches() : 0;
+        LoadResult l_result = RunLoad(a_address, a_inputSize, a_outputSize, l_count, a_seconds);
+
+        stringstream l_ss;
+        l_ss << l_count << " clients: " << l_result.requests / l_result.seconds << " requests/sec, p50 "
+             << l_result.p50 * 1000.0 << " ms, p99 " << l_result.p99 * 1000.0 << " ms";
+        if (a_server && a_server->NumBatches() > l_batches)
+        {
+            l_ss << ", " << double(a_server->NumRequests() - l_requests) / (a_server->NumBatches() - l_batches)
+                 << " requests per batch";
+        }
+        LOG(INFO) << l_ss.str() << endl;
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    // SIGINT and SIGTERM are waited for below, block them before any thread starts
+    sigset_t l_signals;
+    sigemptyset(&l_signals);
+    sigaddset(&l_signals, SIGINT);
+    sigaddset(&l_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &l_signals, nullptr);
+
+    string l_numThreads = GetFlag(argc, argv, "--threads", "");
+    if (!l_numThreads.empty())
+    {
+        Threading::SetNumThreads(ParseSize("--threads", l_numThreads));
+    }
+
+    // Same layers as feedforward_neural_net, the first linear layer and its
+    // ReLU fused since we only ever run forward
+    Sequential model;
+    vector<size_t> inputShape;
+    if (GetFlag(argc, argv, "--conv", "off") == "on")
+    {
+        inputShape = {1, 28, 28};
+        model.Add(TLayerPtr(new Conv2DLayer(Tensor::XavierUniform({25, 8}), 1, 5)));
+        model.Add(TLayerPtr(new ReLULayer()));
+        model.Add(TLayerPtr(new MaxPool2DLayer(2)));
+        model.Add(TLayerPtr(new FlattenLayer()));
+        model.Add(TLayerPtr(new LinearLayer(Tensor::XavierUniform({8 * 12 * 12, 1}))));
+    }
+    else
+    {
+        inputShape = {784};
+        model.Add(TLayerPtr(new LinearReLULayer(Tensor::XavierUniform({784, 300}))));
+        model.Add(TLayerPtr(new LinearLayer(Tensor::XavierUniform({300, 1}))));
+    }
+
+    // Weights from a training checkpoint, random ones are fine for measuring
+    string checkpointFile = GetFlag(argc, argv, "--checkpoint", "");
+    TrainState state;
+    if (!checkpointFile.empty())
+    {
+        if (!Checkpointer::Load(checkpointFile, model, state))
+        {
+            LOG(ERROR) << "Could not read " << checkpointFile << endl;
+            return 1;
+        }
+        LOG(INFO) << "Serving " << checkpointFile << " from step " << state.step << endl;
+    }
+
+    size_t maxBatch = GetSizeFlag(argc, argv, "--max-batch", "32");
+    double maxWait = GetDoubleFlag(argc, argv, "--max-wait-us", "1000") / 1e6;
+    vector<size_t> clients = ParseSizes("--clients", GetFlag(argc, argv, "--clients", "1,4,16,64"));
+    double seconds = GetDoubleFlag(argc, argv, "--seconds", "3");
+    InferenceServer server(model, inputShape, maxBatch, maxWait);
+
+    // Load generator against a server that is already running, ours never listens
+    string connect = GetFlag(argc, argv, "--connect", "");
+    if (!connect.empty())
+    {
+        RunLoads(connect, server.InputSize(), server.OutputSize(), clients, seconds, nullptr);
+        return 0;
+    }
+
+    // Serve on loopback TCP in this process and put the load generator on it
+    if (GetFlag(argc, argv, "--bench", "off") == "on")
+    {
+        string address = server.Listen("tcp:0");
+        LOG(INFO) << "Benchmarking batches of up to " << maxBatch << " waiting up to "
+                  << maxWait * 1e6 << " us on " << address << endl;
+        RunLoads(address, server.InputSize(), server.OutputSize(), clients, seconds, &server);
+        return 0;
+    }
+
+    string address = server.Listen(GetFlag(argc, argv, "--listen", "nn.sock"));
+    LOG(INFO) << "Serving " << server.InputSize() << " floats in, " << server.OutputSize()
+              << " out on " << address << endl;
+
+    int signal = 0;
+    sigwait(&l_signals, &signal);
+    LOG(INFO) << "Served " << server.NumRequests() << " requests in " << server.NumBatches() << " batches" << endl;
+    return 0;
+}